@@ -2,10 +2,28 @@
 #include "opencv2/imgcodecs.hpp"   // for cv::imread
 #include "opencv2/core/utility.hpp"    // for cv::CommandLineParser
 
-#include "UtilityFunctions/utility_functions.h"
+#include "UtilityFunctions/utility_functions.h" // for pixelValue_C1() to pixelValue_C4() and CPP_CV::ImageCache
 
 #include <iostream>
 #include <array>
+#include <string>
+#include <fstream>    // for std::ifstream
+#include <sstream>    // for std::istringstream
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Print the pixel value(s) at a location in an image
+ * 
+ * @param image image with 1 to 4 channels
+ * @param row row of pixel
+ * @param column column of pixel
+ * @return true if the location is inside the image
+ * @return false otherwise
+ */
+bool printPixelValue(const cv::Mat& image, int row, int column);
+
+//-------------------------- End of Function Declarations ---------------------//
 
 int main(int argc, char* argv[])
 {
@@ -18,12 +36,19 @@ int main(int argc, char* argv[])
      *      2. Row on which to find pixel
      *      3. Column on which to find pixel
      * 
+     * To find many pixels, in one or more images, provide instead:
+     *      4. Text file with one pixel to find per line: row, column and full path to image file
+     *      5. Memory budget of the decoded image cache in MB. Each image is decoded once, 
+     *         however many of its pixels we find, unless its file changes
+     * 
     */
    const cv::String keys = 
    "{help h usage ? | | Access pixel intensity values of an image }"
-   "{image | <none> | Full path to image file }"
+   "{image | | Full path to image file. Not needed with a queries file }"
    "{row | 0 | Row to find pixel }"
-   "{column | 0 | Column to find pixel }";
+   "{column | 0 | Column to find pixel }"
+   "{queries | | text file with one pixel to find per line: row, column and full path to image file }"
+   "{cacheMB | 512 | memory budget of the decoded image cache in MB }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -36,6 +61,8 @@ int main(int argc, char* argv[])
     cv::String imagePath = parser.get<cv::String>("image");
     int row = parser.get<int>("row");
     int column = parser.get<int>("column");
+    cv::String queriesPath = parser.get<cv::String>("queries");
+    int cacheMB = parser.get<int>("cacheMB");
 
     // check for any errors encountered 
     if(!parser.check())
@@ -45,9 +72,76 @@ int main(int argc, char* argv[])
         return -1;
     }
           
-    //----------------------- 2. Read image file ----------------------------//
+    if (cacheMB < 0)
+    {
+        std::cout << "\nThe memory budget of the cache should not be negative.\n";
+
+        return -1;
+    }
+
+    CPP_CV::ImageCache::DecodedImageCache::instance().setCapacity(static_cast<std::size_t>(cacheMB) * 1024 * 1024);
+
+    //----------------------- 2. Find pixels from a queries file ---------------------//
+
+    // Images are read through the cache, so an image with many queries is decoded once
+    if (!queriesPath.empty())
+    {
+        std::ifstream queries(queriesPath);
+        if (!queries)
+        {
+            std::cout << "\nCould not open queries file " << queriesPath << '\n';
+
+            return -1;
+        }
+
+        std::string line;
+        while (std::getline(queries, line))
+        {
+            // Skip empty lines and comments
+            if (line.empty() || (line[0] == '#'))
+            {
+                continue;
+            }
+
+            // The rest of the line is the path, which may contain spaces
+            std::istringstream query {line};
+            int queryRow {0};
+            int queryColumn {0};
+            std::string queryPath;
+            if (!(query >> queryRow >> queryColumn) || !std::getline(query >> std::ws, queryPath))
+            {
+                std::cout << "\nERROR: Expected row, column and image path: " << line << '\n';
+                continue;
+            }
+
+            cv::Mat queryImage {CPP_CV::ImageCache::imread(queryPath, cv::IMREAD_ANYCOLOR)};
+            if (queryImage.empty())
+            {
+                std::cout << "\nCould not read image data from " << queryPath << '\n';
+                continue;
+            }
+
+            std::cout << "\n" << queryPath;
+            printPixelValue(queryImage, queryRow, queryColumn);
+        }
+
+        const CPP_CV::ImageCache::Statistics statistics { CPP_CV::ImageCache::DecodedImageCache::instance().statistics() };
+        std::cout << "\nDecoded image cache: " << statistics.hits << " reads from cache, " 
+                  << statistics.misses << " decoded, " << statistics.evictions << " removed to stay within budget\n\n";
+
+        return 0;
+    }
+
+    if (imagePath.empty())
+    {
+        std::cout << "\nPlease provide an image file (image) or a queries file (queries).\n";
+
+        return -1;
+    }
+          
+    //----------------------- 3. Read image file ----------------------------//
 
-    cv::Mat image {cv::imread(imagePath, cv::IMREAD_ANYCOLOR)};
+    cv::Mat image {CPP_CV::ImageCache::imread(imagePath, cv::IMREAD_ANYCOLOR)};
 
     // Check if we have successfully read the image data
     if (image.empty())
@@ -67,14 +161,37 @@ int main(int argc, char* argv[])
               << '\n';
 
         
-    //----------------------- 3. Access pixel values -------------------------// 
+    //----------------------- 4. Access pixel values -------------------------// 
     
+    if (!printPixelValue(image, row, column))
+    {
+        return -1; // early exit
+    }
+   
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Print the pixel value(s) at a location in an image
+ * 
+ * @param image image with 1 to 4 channels
+ * @param row row of pixel
+ * @param column column of pixel
+ * @return true if the location is inside the image
+ * @return false otherwise
+ */
+bool printPixelValue(const cv::Mat& image, int row, int column)
+{
     // Check if (row, column) supplied by user are valid
-    if ((row < 0) || (row > image.rows) || (column < 0) || (column > image.cols))
+    if ((row < 0) || (row >= image.rows) || (column < 0) || (column >= image.cols))
     {
         std::cout << "\nERROR: Row/Column of pixel is outside image boundary\n";
 
-        return -1; // early exit
+        return false;
     }
 
     // Get OpenCV image data type of pixel values
@@ -109,8 +226,8 @@ int main(int argc, char* argv[])
                   << "(" << pixelValue[0] << ", " << pixelValue[1] << ", " 
                   << pixelValue[2] << ", " << pixelValue[3] << ")\n";
     }    
-   
-    std::cout << '\n';
 
-    return 0;
-}
\ No newline at end of file
+    return true;
+}
+
+//-------------------------- End of Function Definitions ---------------------//
@@ -0,0 +1,330 @@
+// Program: mask_codec.cpp
+
+/*
+ * Program compares our mask codec, CPP_CV::MaskCodec::encodeMask() and
+ * CPP_CV::MaskCodec::decodeMask(), against PNG for storing binary masks.
+ *
+ * The masks are either made the same way as in the tutorial on masking - a rectangle, a
+ * circle, and the masks we get by combining them with cv::bitwise_or(), cv::bitwise_and()
+ * and cv::bitwise_xor() - or by thresholding an image we provide.
+ *
+ * Every codec compresses to and de-compresses from a memory buffer, so only the codecs are
+ * timed and not the disk. For each mask, and for PNG and every encoding of our codec, we report:
+ *      1. Median time to compress the mask in milliseconds
+ *      2. Median time to de-compress the mask in milliseconds
+ *      3. Size of the compressed mask in bytes
+ *      4. Whether the mask de-compresses to exactly the same pixels
+ *
+ * The last mask can also be saved to a file with our codec.
+ *
+ * Inputs are provided through the command line
+ *
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core types, bitwise operators and cv::countNonZero()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgproc.hpp"         // for cv::rectangle(), cv::circle() and cv::threshold()
+#include "opencv2/imgcodecs.hpp"       // for cv::imread(), cv::imencode() and cv::imdecode()
+
+#include "UtilityFunctions/utility_functions.h" // for encodeMask() and decodeMask()
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <fstream>     // for std::ofstream
+#include <vector>
+#include <string>
+#include <utility>     // for std::pair
+#include <algorithm>   // for std::sort
+#include <functional>  // for std::function
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values);
+
+
+/**
+ * @brief Compress and de-compress a mask several times with one codec, and print a row
+ *        of the results table
+ *
+ * @param name name of codec shown in the table
+ * @param mask mask of 0 and 255 pixels to compress
+ * @param repeat no. of times to compress and de-compress the mask
+ * @param encode function that compresses a mask into a buffer
+ * @param decode function that de-compresses a buffer into a mask
+ * @return true if the codec compressed and de-compressed the mask
+ * @return false otherwise
+ */
+bool benchmarkCodec(const std::string& name, const cv::Mat& mask, int repeat,
+                    const std::function<bool(const cv::Mat&, std::vector<uchar>&)>& encode,
+                    const std::function<bool(const std::vector<uchar>&, cv::Mat&)>& decode);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to an image to threshold into a mask (optional)
+     *      2. Threshold value, and size of the masks we draw when no image is given
+     *      3. No. of times to compress and de-compress each mask with each codec
+     *      4. Full path to a file to save the last mask in (optional)
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Benchmark our mask codec against PNG }"
+        "{image | | full path to image to threshold into a mask. If empty, we draw masks instead }"
+        "{threshold | 127 | pixels brighter than this are set to 255 in the mask of the image }"
+        "{size | 1024 | width and height of the masks we draw }"
+        "{repeat | 5 | no. of times to compress and de-compress each mask with each codec }"
+        "{output | | full path to file to save the last mask in with our codec (e.g. mask.msk) }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nCompare our bit-packed and run-length mask codec against PNG.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("image");
+    double thresholdValue = parser.get<double>("threshold");
+    int size = parser.get<int>("size");
+    int repeat = parser.get<int>("repeat");
+    cv::String outputPath = parser.get<cv::String>("output");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if ((repeat <= 0) || (size <= 0))
+    {
+        std::cerr << "\nRepeat and size should be greater than 0.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Create Masks ///////////////////////////////
+
+    std::vector<std::pair<std::string, cv::Mat>> masks;
+
+    if (!imagePath.empty())
+    {
+        cv::Mat image { cv::imread(imagePath, cv::IMREAD_GRAYSCALE) };
+        if (image.empty())
+        {
+            std::cerr << "\nCould not read data from image file: " << imagePath << '\n';
+
+            return -1;
+        }
+
+        cv::Mat mask;
+        cv::threshold(image, mask, thresholdValue, 255, cv::THRESH_BINARY);
+        masks.emplace_back("threshold", mask);
+    }
+    else
+    {
+        // A rectangle and a circle, as in the tutorial on masking
+        cv::Mat rectangle { cv::Mat::zeros(size, size, CV_8UC1) };
+        cv::rectangle(rectangle, cv::Point(size / 8, size / 8), cv::Point(size * 5 / 8, size * 5 / 8),
+                      cv::Scalar(255), cv::FILLED);
+
+        cv::Mat circle { cv::Mat::zeros(size, size, CV_8UC1) };
+        cv::circle(circle, cv::Point(size * 5 / 8, size * 5 / 8), size / 4, cv::Scalar(255), cv::FILLED);
+
+        cv::Mat orMask, andMask, xorMask;
+        cv::bitwise_or(rectangle, circle, orMask);
+        cv::bitwise_and(rectangle, circle, andMask);
+        cv::bitwise_xor(rectangle, circle, xorMask);
+
+        // Random noise has very short runs, and is the worst case for any mask codec
+        cv::Mat noise(size, size, CV_8UC1);
+        cv::randu(noise, cv::Scalar(0), cv::Scalar(256));
+        cv::threshold(noise, noise, 127, 255, cv::THRESH_BINARY);
+
+        masks.emplace_back("rectangle", rectangle);
+        masks.emplace_back("circle", circle);
+        masks.emplace_back("or", orMask);
+        masks.emplace_back("and", andMask);
+        masks.emplace_back("xor", xorMask);
+        masks.emplace_back("noise", noise);
+    }
+
+    //---------------------- End of Create Masks -------------------//
+
+    ///////////////////////// 3. Benchmark each codec //////////////////////
+
+    using CPP_CV::MaskCodec::MaskEncoding;
+
+    // Our codec with each encoding, on its own and deflated
+    const std::vector<std::pair<std::string, std::pair<MaskEncoding, int>>> settings {
+        { "packed", { MaskEncoding::bitPacked, 0 } },
+        { "packed+z", { MaskEncoding::bitPacked, 6 } },
+        { "rle", { MaskEncoding::runLength, 0 } },
+        { "rle+z", { MaskEncoding::runLength, 6 } },
+        { "auto", { MaskEncoding::automatic, 0 } },
+        { "auto+z", { MaskEncoding::automatic, 6 } }
+    };
+
+    for (const auto& [maskName, mask] : masks)
+    {
+        std::cout << "\nMask: " << maskName << " (" << mask.cols << " x " << mask.rows << ", "
+                  << cv::countNonZero(mask) << " non-zero pixels)\n";
+
+        std::cout << std::left << std::setw(10) << "Codec" << std::right
+                  << std::setw(16) << "encode (ms)" << std::setw(16) << "decode (ms)"
+                  << std::setw(14) << "bytes" << std::setw(10) << "Lossless" << '\n';
+
+        // a. PNG with cv::imencode() and cv::imdecode(), as our masks were stored before
+        bool result { benchmarkCodec("png", mask, repeat,
+            [](const cv::Mat& input, std::vector<uchar>& buffer) {
+                return cv::imencode(".png", input, buffer);
+            },
+            [](const std::vector<uchar>& buffer, cv::Mat& output) {
+                output = cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+                return !output.empty();
+            }) };
+
+        // b. Our mask codec
+        for (const auto& [name, setting] : settings)
+        {
+            const auto [encoding, deflateLevel] = setting;
+
+            result = result && benchmarkCodec(name, mask, repeat,
+                [encoding = encoding, deflateLevel = deflateLevel](const cv::Mat& input, std::vector<uchar>& buffer) {
+                    return CPP_CV::MaskCodec::encodeMask(input, buffer, encoding, deflateLevel);
+                },
+                CPP_CV::MaskCodec::decodeMask);
+        }
+
+        if (!result)
+        {
+            std::cerr << "\nError: could not compress mask " << maskName << '\n';
+
+            return -1;
+        }
+    }
+
+    //---------------------- End of Benchmark each codec -------------------//
+
+    ///////////////////////// 4. Save Mask to File //////////////////////
+
+    if (!outputPath.empty())
+    {
+        std::vector<uchar> buffer;
+        if (!CPP_CV::MaskCodec::encodeMask(masks.back().second, buffer))
+        {
+            std::cerr << "\nError: could not compress mask " << masks.back().first << '\n';
+
+            return -1;
+        }
+
+        std::ofstream file(outputPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (!file)
+        {
+            std::cerr << "\nError: could not save mask to file: " << outputPath << '\n';
+
+            return -1;
+        }
+
+        std::cout << "\nSaved mask " << masks.back().first << " to file: " << outputPath
+                  << " (" << buffer.size() << " bytes)\n";
+    }
+
+    //---------------------- End of Save Mask to File -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    const std::size_t middle { values.size() / 2 };
+
+    return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+
+/**
+ * @brief Compress and de-compress a mask several times with one codec, and print a row
+ *        of the results table
+ *
+ * @param name name of codec shown in the table
+ * @param mask mask of 0 and 255 pixels to compress
+ * @param repeat no. of times to compress and de-compress the mask
+ * @param encode function that compresses a mask into a buffer
+ * @param decode function that de-compresses a buffer into a mask
+ * @return true if the codec compressed and de-compressed the mask
+ * @return false otherwise
+ */
+bool benchmarkCodec(const std::string& name, const cv::Mat& mask, int repeat,
+                    const std::function<bool(const cv::Mat&, std::vector<uchar>&)>& encode,
+                    const std::function<bool(const std::vector<uchar>&, cv::Mat&)>& decode)
+{
+    std::vector<double> encodeTimes;
+    std::vector<double> decodeTimes;
+    std::vector<uchar> buffer;
+    cv::Mat decoded;
+
+    for (int i {0}; i < repeat; ++i)
+    {
+        cv::TickMeter timer;
+        timer.start();
+        bool result { encode(mask, buffer) };
+        timer.stop();
+
+        if (!result)
+        {
+            return false;
+        }
+        encodeTimes.push_back(timer.getTimeMilli());
+
+        timer.reset();
+        timer.start();
+        result = decode(buffer, decoded);
+        timer.stop();
+
+        if (!result)
+        {
+            return false;
+        }
+        decodeTimes.push_back(timer.getTimeMilli());
+    }
+
+    // Every codec is lossless for masks of 0 and 255 pixels
+    const bool lossless { (decoded.size() == mask.size()) && (decoded.type() == mask.type()) &&
+                          (cv::norm(decoded, mask, cv::NORM_INF) == 0) };
+
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(16) << median(encodeTimes) << std::setw(16) << median(decodeTimes)
+              << std::setw(14) << buffer.size() << std::setw(10) << (lossless ? "yes" : "NO") << '\n';
+
+    return true;
+}
+
+//-------------------------- End of Function Definitions ---------------------//
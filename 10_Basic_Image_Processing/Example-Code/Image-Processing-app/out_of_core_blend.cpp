@@ -0,0 +1,162 @@
+// Program: out_of_core_blend.cpp
+
+/*
+ * Program blends two images that are too large to load into memory with cv::imread(),
+ * e.g. two 60,000 x 60,000 16-bit 4 channel survey mosaics, using
+ *
+ *      output = alpha * image1 + beta * image2 + gamma
+ *
+ * which is what cv::addWeighted() calculates. Both images are read from TIFF files a block
+ * of tiles at a time, blended, and written to a tiled TIFF file a block at a time. Three
+ * blocks (one from each input and the output) are held in memory at once, and their size
+ * is chosen to keep memory use below the limit we set.
+ *
+ * Program inputs are provided through the command line
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core types and cv::addWeighted()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+
+#include "UtilityFunctions/utility_functions.h" // for TiledTiffSource, TiledTiffSink and processBlocks()
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to the two input TIFF files
+     *      2. Full path to output TIFF file
+     *      3. Weights of each image and the value added to the sum
+     *      4. Memory limit, tile size and compression of output file
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Blend two images that do not fit in memory }"
+        "{image1 | <none> | full path to first input TIFF file }"
+        "{image2 | <none> | full path to second input TIFF file. Must be the same size and type as image1 }"
+        "{output | <none> | full path to output tiled TIFF file }"
+        "{alpha | 0.5 | weight of first image }"
+        "{beta | 0.5 | weight of second image }"
+        "{gamma | 0.0 | value added to each weighted sum }"
+        "{memoryLimit | 256 | limit on image data held in memory, in MB }"
+        "{tileSize | 256 | width and height of output tiles (multiple of 16) }"
+        "{compression | 8 | output compression: 1 = none, 5 = LZW, 8 = Deflate }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nBlend two TIFF images of any size, a block of tiles at a time.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath1 = parser.get<cv::String>("image1");
+    cv::String imagePath2 = parser.get<cv::String>("image2");
+    cv::String outputPath = parser.get<cv::String>("output");
+    double alpha = parser.get<double>("alpha");
+    double beta = parser.get<double>("beta");
+    double gamma = parser.get<double>("gamma");
+    int memoryLimit = parser.get<int>("memoryLimit");
+    int tileSize = parser.get<int>("tileSize");
+    int compression = parser.get<int>("compression");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if ((memoryLimit <= 0) || (tileSize <= 0) || ((compression != 1) && (compression != 5) && (compression != 8)))
+    {
+        std::cerr << "\nMemory limit and tile size should be greater than 0, and compression should be 1, 5 or 8.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Open Input and Output Files ///////////////////////////////
+
+    // Only the TIFF headers are read here, not the image data
+    CPP_CV::TiledImages::TiledTiffSource source1(imagePath1);
+    CPP_CV::TiledImages::TiledTiffSource source2(imagePath2);
+    if (!source1.isOpen() || !source2.isOpen())
+    {
+        return -1;
+    }
+
+    // cv::addWeighted() needs both images to be the same size and type
+    if ((source1.size() != source2.size()) || (source1.type() != source2.type()))
+    {
+        std::cerr << "\nBoth images must be the same size and type.\n";
+
+        return -1;
+    }
+
+    CPP_CV::TiledImages::TiledTiffSink sink(outputPath, source1.size(), source1.type(), tileSize,
+                                            static_cast<CPP_CV::TiledImages::TiffCompression>(compression));
+    if (!sink.isOpen())
+    {
+        return -1;
+    }
+
+    std::cout << "\nImage size (width x height): " << source1.size().width << " x " << source1.size().height
+              << "\nMemory limit: " << memoryLimit << " MB\n";
+
+    //---------------------- End of Open Input and Output Files -------------------//
+
+    ///////////////////////////// 3. Blend Images a Block at a Time ///////////////////////////////
+
+    cv::TickMeter timer;
+    timer.start();
+
+    bool result {false};
+
+    try
+    {
+        // One block from each input is kept between blocks, so they are only allocated once
+        cv::Mat block1;
+        cv::Mat block2;
+
+        result = CPP_CV::TiledImages::processBlocks(sink,
+                                                    [&](const cv::Rect& region, cv::Mat& block) {
+                                                        if (!source1.read(region, block1) || !source2.read(region, block2))
+                                                        {
+                                                            return false;
+                                                        }
+
+                                                        cv::addWeighted(block1, alpha, block2, beta, gamma, block);
+
+                                                        return true;
+                                                    },
+                                                    static_cast<std::size_t>(memoryLimit) << 20, 3.0);
+
+        result = sink.close() && result;
+    }
+    catch (const cv::Exception& ex)
+    {
+        std::cerr << "\nERROR: " << ex.what();
+    }
+
+    timer.stop();
+
+    if (!result)
+    {
+        std::cerr << "\nERROR: Could not create " << outputPath << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nSaved " << outputPath << " in " << timer.getTimeSec() << " s\n";
+
+    //---------------------- End of Blend Images a Block at a Time -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Program: read_color_space.cpp
+
+/*
+ * Program compares two ways of reading an image into the grayscale and YCrCb color spaces:
+ *
+ *      1. cv::imread() followed by cv::cvtColor(), as in the tutorial on color spaces
+ *      2. CPP_CV::ColorSpaces::imreadColorSpace(), which decodes JPEG files straight to
+ *         grayscale or YCrCb. A JPEG file already stores its pixels as Y, Cb and Cr planes,
+ *         so there is no conversion to BGR and back, and no BGR image in between
+ *
+ * For each color space we report the median time of each method in milliseconds, whether
+ * the JPEG planes were used directly, and the largest and mean difference between the two
+ * images (they differ only by the rounding of the BGR image the first method makes).
+ *
+ * Inputs are provided through the command line
+ *
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core types and cv::norm()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgproc.hpp"         // for cv::cvtColor()
+#include "opencv2/imgcodecs.hpp"       // for cv::imread()
+
+#include "UtilityFunctions/utility_functions.h" // for imreadColorSpace() and readJpegColorSpace()
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <vector>
+#include <string>
+#include <utility>     // for std::pair
+#include <algorithm>   // for std::sort
+#include <functional>  // for std::function
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values);
+
+
+/**
+ * @brief Read an image several times and return the median time taken
+ *
+ * @param repeat no. of times to read the image
+ * @param read function that reads the image
+ * @param image receives the image from the last read
+ * @return double median time in milliseconds
+ */
+double timeRead(int repeat, const std::function<cv::Mat()>& read, cv::Mat& image);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to image to read (a JPEG file shows the difference)
+     *      2. No. of times to read the image with each method
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Read an image straight into the grayscale and YCrCb color spaces }"
+        "{image | <none> | full path to image file, e.g. a JPEG file }"
+        "{repeat | 5 | no. of times to read the image with each method }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nCompare cv::imread() + cv::cvtColor() with decoding straight to grayscale or YCrCb.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("image");
+    int repeat = parser.get<int>("repeat");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if (repeat <= 0)
+    {
+        std::cerr << "\nRepeat should be greater than 0.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////// 2. Read Image into each Color Space //////////////////////
+
+    const std::vector<std::pair<std::string, int>> colorSpaces {
+        { "Grayscale", cv::COLOR_BGR2GRAY },
+        { "YCrCb", cv::COLOR_BGR2YCrCb }
+    };
+
+    std::cout << '\n' << std::left << std::setw(12) << "Color space" << std::right
+              << std::setw(24) << "imread+cvtColor (ms)" << std::setw(24) << "imreadColorSpace (ms)"
+              << std::setw(10) << "Direct" << std::setw(10) << "Max diff" << std::setw(12) << "Mean diff" << '\n';
+
+    for (const auto& [name, code] : colorSpaces)
+    {
+        cv::Mat converted;
+        cv::Mat direct;
+
+        try
+        {
+            // a. Decode to BGR, then convert
+            const double convertTime { timeRead(repeat, [&imagePath, code = code]() {
+                cv::Mat image { cv::imread(imagePath, cv::IMREAD_COLOR) };
+                if (!image.empty())
+                {
+                    cv::cvtColor(image, image, code);
+                }
+
+                return image;
+            }, converted) };
+
+            // b. Decode straight to the color space
+            const double directTime { timeRead(repeat, [&imagePath, code = code]() {
+                return CPP_CV::ColorSpaces::imreadColorSpace(imagePath, code);
+            }, direct) };
+
+            if (converted.empty() || direct.empty())
+            {
+                std::cerr << "\nCould not read data from image file: " << imagePath << '\n';
+
+                return -1;
+            }
+
+            // Was the JPEG file decoded straight to the color space?
+            cv::Mat jpegImage;
+            const bool usedPlanes { CPP_CV::ColorSpaces::readJpegColorSpace(imagePath, code, jpegImage) };
+
+            const bool sameShape { (converted.size() == direct.size()) && (converted.type() == direct.type()) };
+            const double maxDifference { sameShape ? cv::norm(converted, direct, cv::NORM_INF) : -1.0 };
+            const double meanDifference { sameShape ? cv::norm(converted, direct, cv::NORM_L1) / static_cast<double>(converted.total() * converted.channels()) : -1.0 };
+
+            std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(24) << convertTime << std::setw(24) << directTime
+                      << std::setw(10) << (usedPlanes ? "yes" : "no") << std::setw(10) << maxDifference
+                      << std::setw(12) << meanDifference << '\n';
+        }
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nERROR: " << ex.what();
+
+            return -1;
+        }
+    }
+
+    //---------------------- End of Read Image into each Color Space -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    const std::size_t middle { values.size() / 2 };
+
+    return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+
+/**
+ * @brief Read an image several times and return the median time taken
+ *
+ * @param repeat no. of times to read the image
+ * @param read function that reads the image
+ * @param image receives the image from the last read
+ * @return double median time in milliseconds
+ */
+double timeRead(int repeat, const std::function<cv::Mat()>& read, cv::Mat& image)
+{
+    std::vector<double> times;
+
+    for (int i {0}; i < repeat; ++i)
+    {
+        cv::TickMeter timer;
+        timer.start();
+        image = read();
+        timer.stop();
+
+        times.push_back(timer.getTimeMilli());
+    }
+
+    return median(times);
+}
+
+//-------------------------- End of Function Definitions ---------------------//
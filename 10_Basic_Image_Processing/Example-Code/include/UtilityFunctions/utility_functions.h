@@ -3,6 +3,7 @@
 
 #include "opencv2/core.hpp" 
 #include "opencv2/core/persistence.hpp" // for cv::FileStorage
+#include "opencv2/imgcodecs.hpp"        // for cv::IMREAD_COLOR
 
 #include <string_view> // Good for passing around const string's. No unnecessary copying
 #include <string>
@@ -12,6 +13,16 @@
 #include <fstream>    // for std::ifstream
 #include <iterator>   // for std::istream_iterator
 #include <algorithm>  // for std::copy
+#include <memory>     // for std::unique_ptr
+#include <functional> // for std::function
+#include <cstdint>    // for std::uint64_t
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+// libtiff file handle (TIFF). Declared here so users of this header do not need tiffio.h
+struct tiff;
 
 namespace CPP_CV {
 
@@ -559,6 +570,434 @@ namespace CPP_CV {
     }
 
     namespace Img {}
+
+    namespace TiledImages {
+
+        /*
+         * Out-of-core processing of images that are too large to load with cv::imread().
+         *
+         * A TiledTiffSource decodes only the TIFF tiles (or strips) that cover the region
+         * we ask for, and a TiledTiffSink writes the result one block of tiles at a time.
+         * processBlocks() and processTiles() walk over the output in blocks sized so the
+         * data held in memory stays below a memory limit, and run our own kernel on each block.
+        */
+
+        /**
+         * @brief Default limit, in bytes, on the image data processBlocks() and processTiles()
+         *        hold in memory at any one time
+         */
+        constexpr std::size_t defaultMemoryLimit {std::size_t{256} << 20};
+
+        /**
+         * @brief TIFF compression schemes supported by TiledTiffSink. Values are the TIFF tag values
+         */
+        enum class TiffCompression
+        {
+            none = 1,       // no compression
+            lzw = 5,        // lossless
+            jpeg = 7,       // lossy, 8-bit images with 1 or 3 channels only
+            deflate = 8     // lossless, same algorithm as PNG/zlib
+        };
+
+        /**
+         * @brief Closes a libtiff file handle. Lets us keep the handle in a std::unique_ptr
+         *        without including tiffio.h in this header
+         */
+        struct TiffCloser
+        {
+            void operator()(tiff* handle) const;
+        };
+
+
+        /**
+         * @brief Reads any region of a TIFF file without loading the whole image. Tiled TIFF
+         *        files are read most efficiently, but striped files also work.
+         */
+        class TiledTiffSource
+        {
+        public:
+
+            /**
+             * @brief Open the first page of a TIFF file. Use isOpen() to check if it succeeded
+             *
+             * @param filePath full path to TIFF file
+             */
+            explicit TiledTiffSource(const std::string& filePath);
+
+            /**
+             * @brief Check if the file was opened and has a pixel layout we can read
+             *        (1 to 4 interleaved channels of a type OpenCV supports)
+             */
+            bool isOpen() const { return static_cast<bool>(m_tiff); }
+
+            cv::Size size() const { return m_size; }          // image width and height
+            int type() const { return m_type; }               // OpenCV type e.g. CV_16UC4
+            cv::Size tileSize() const { return m_tileSize; }  // size of a tile, or of a strip (full image width)
+            std::uint64_t tilesDecoded() const { return m_tilesDecoded; } // no. of tiles or strips decoded so far
+
+            /**
+             * @brief Read a region of the image. Colour images are returned in BGR(A) order.
+             *
+             * @param region region to read. Parts of the region outside the image are filled
+             *               the same way as cv::copyMakeBorder()
+             * @param block output image, the size of region
+             * @param borderType cv::BORDER_CONSTANT, cv::BORDER_REPLICATE, cv::BORDER_REFLECT,
+             *                   cv::BORDER_WRAP or cv::BORDER_REFLECT_101
+             * @param value value of pixels outside the image when borderType is cv::BORDER_CONSTANT
+             * @return true if the region was read
+             * @return false if the region is empty, the border type is not supported or a tile could not be decoded
+             */
+            bool read(const cv::Rect& region, cv::Mat& block,
+                      int borderType = cv::BORDER_CONSTANT, const cv::Scalar& value = cv::Scalar());
+
+        private:
+
+            /**
+             * @brief Decode a tile (or strip) into m_tileBuffer, unless it is already there
+             *
+             * @param tileColumn column of tile in the tile grid. Always 0 for striped files
+             * @param tileRow row of tile in the tile grid
+             * @return true if the tile was decoded
+             * @return false otherwise
+             */
+            bool decodeTile(int tileColumn, int tileRow);
+
+            std::unique_ptr<tiff, TiffCloser> m_tiff;   // open file. Empty if the file could not be opened
+            cv::Size m_size;                            // image width and height
+            int m_type {-1};                            // OpenCV type of the image
+            cv::Size m_tileSize;                        // size of a tile or strip
+            bool m_tiled {false};                       // true for tiled files, false for striped files
+            bool m_rgb {false};                         // true if the file stores colour as RGB(A)
+            std::vector<uchar> m_tileBuffer;            // last tile decoded
+            cv::Point m_bufferedTile {-1, -1};          // column and row of the tile in m_tileBuffer
+            std::uint64_t m_tilesDecoded {0};
+        };
+
+
+        /**
+         * @brief Writes an image to a tiled TIFF file one block of tiles at a time.
+         *        Big TIFF is used for images of 3 GB or more.
+         */
+        class TiledTiffSink
+        {
+        public:
+
+            /**
+             * @brief Create a tiled TIFF file. Use isOpen() to check if it succeeded
+             *
+             * @param filePath full path to TIFF file
+             * @param size image width and height
+             * @param type OpenCV type of image, with 1 to 4 channels. CV_16F is not supported
+             * @param tileSize width and height of tiles. Rounded up to a multiple of 16
+             * @param compression compression scheme. LZW and Deflate also use a predictor
+             */
+            TiledTiffSink(const std::string& filePath, cv::Size size, int type,
+                          int tileSize = 256, TiffCompression compression = TiffCompression::deflate);
+
+            /**
+             * @brief Write the directory of any image that close() was not called for
+             */
+            ~TiledTiffSink();
+
+            bool isOpen() const { return static_cast<bool>(m_tiff); }
+            cv::Size size() const { return m_size; }          // image width and height
+            int type() const { return m_type; }               // OpenCV type e.g. CV_16UC4
+            cv::Size tileSize() const { return m_tileSize; }  // width and height of tiles
+
+            /**
+             * @brief Write a block of whole tiles to the file
+             *
+             * @param origin top left corner of the block in the image. Must be on a tile boundary
+             * @param block image data in BGR(A) order with the sink's type. The block must end
+             *              on a tile boundary or at the right/bottom edge of the image
+             * @return true if the block was written
+             * @return false otherwise
+             */
+            bool write(const cv::Point& origin, const cv::Mat& block);
+
+            /**
+             * @brief Finish writing the file
+             *
+             * @return true if every tile was written and the file was closed without errors
+             * @return false otherwise
+             */
+            bool close();
+
+        private:
+
+            std::unique_ptr<tiff, TiffCloser> m_tiff;   // open file. Empty once the file is closed
+            std::string m_filePath;
+            cv::Size m_size;
+            int m_type {-1};
+            cv::Size m_tileSize;
+            std::vector<uchar> m_tileBuffer;            // one tile in TIFF (RGB) channel order
+            std::uint64_t m_tilesWritten {0};
+            bool m_failed {false};                      // true once any write has failed
+        };
+
+
+        /**
+         * @brief Kernel run by processBlocks() on each block of the output image.
+         *        It must fill block, which already has the sink's size and type.
+         *        Return false to stop processing
+         */
+        using BlockKernel = std::function<bool(const cv::Rect& region, cv::Mat& block)>;
+
+        /**
+         * @brief Kernel run by processTiles() on each overlapping tile of the input image.
+         *        output must be the same size as input (the overlap is then cropped), or
+         *        the size of input minus the overlap on every side
+         */
+        using TileKernel = std::function<void(const cv::Mat& input, cv::Mat& output)>;
+
+
+        /**
+         * @brief Produce an image block by block and write it to a sink. Blocks are whole
+         *        tiles of the sink, as large as the memory limit allows.
+         *
+         * @param sink file to write to
+         * @param kernel fills each block of the output image
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param buffersPerBlock no. of block sized images the kernel holds at one time, including
+         *                        the output block e.g. 3 for blending two images
+         * @return true if every block was produced and written
+         * @return false otherwise
+         */
+        bool processBlocks(TiledTiffSink& sink, const BlockKernel& kernel,
+                           std::size_t memoryLimit = defaultMemoryLimit, double buffersPerBlock = 2.0);
+
+        /**
+         * @brief Run a kernel (e.g. a filter) over an image that does not fit in memory.
+         *        Each block is read with 'overlap' extra pixels on every side so results
+         *        along block edges are the same as processing the whole image at once.
+         *
+         * @param source image to read. Must be the same size as sink
+         * @param sink file to write result to
+         * @param overlap no. of extra pixels read on each side of a block e.g. the kernel radius of a filter
+         * @param kernel operation run on each block
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param borderType how pixels beyond the image edges are filled (see TiledTiffSource::read())
+         * @return true if the whole image was processed
+         * @return false otherwise
+         */
+        bool processTiles(TiledTiffSource& source, TiledTiffSink& sink, int overlap, const TileKernel& kernel,
+                          std::size_t memoryLimit = defaultMemoryLimit, int borderType = cv::BORDER_REFLECT_101);
+    }
+
+    namespace MaskCodec {
+
+        /*
+         * Compact storage for binary masks - CV_8UC1 images whose pixels are either 0 or 
+         * not 0 (usually 255), such as the masks made with cv::bitwise_and(), cv::bitwise_or(), 
+         * cv::rectangle(), cv::circle() or cv::threshold().
+         *
+         * A mask needs 1 bit per pixel, not 8. Each row is stored either bit-packed (8 pixels 
+         * per byte), or as the lengths of its runs of 0 and non-0 pixels, which is far smaller 
+         * for masks made of a few large shapes. The result can also be deflated (LZ77 + Huffman 
+         * coding, as in PNG) to remove repeated patterns between rows. Packing, unpacking and 
+         * finding runs use OpenCV's universal intrinsics, so they run on SIMD registers 16 
+         * pixels at a time on any CPU OpenCV supports.
+        */
+
+        /**
+         * @brief How the rows of a mask are stored
+         */
+        enum class MaskEncoding
+        {
+            bitPacked = 0,      // 1 bit per pixel. Best for noisy masks with many short runs
+            runLength = 1,      // lengths of alternating runs of 0 and non-0 pixels. Best for shapes
+            automatic = 2       // whichever of the two is smaller for this mask
+        };
+
+        /**
+         * @brief Compress a binary mask
+         *
+         * @param mask CV_8UC1 image. Pixels that are not 0 are stored as 255
+         * @param buffer output buffer. Resized to fit the compressed mask, keeping its memory for the next mask
+         * @param encoding how the rows are stored
+         * @param deflateLevel zlib compression level (1 to 9) applied after the encoding. 0 = not deflated
+         * @return true if the mask was compressed
+         * @return false if the mask is not CV_8UC1 or zlib reported an error
+         */
+        bool encodeMask(const cv::Mat& mask, std::vector<uchar>& buffer, 
+                        MaskEncoding encoding = MaskEncoding::automatic, int deflateLevel = 0);
+
+        /**
+         * @brief De-compress a mask made by encodeMask()
+         *
+         * @param buffer compressed mask
+         * @param mask receives the CV_8UC1 mask of 0 and 255 pixels. Its memory is re-used if it 
+         *             already has the right size
+         * @return true if the mask was de-compressed
+         * @return false if the buffer is not a valid compressed mask
+         */
+        bool decodeMask(const std::vector<uchar>& buffer, cv::Mat& mask);
+
+        /**
+         * @brief Return the encoding a compressed mask was stored with (bitPacked or runLength), 
+         *        and whether it was deflated
+         *
+         * @param buffer compressed mask
+         * @param encoding receives the encoding of the rows
+         * @param deflated set to true if the rows were deflated
+         * @return true if the buffer starts with a valid header
+         * @return false otherwise
+         */
+        bool maskEncoding(const std::vector<uchar>& buffer, MaskEncoding& encoding, bool& deflated);
+    }
+
+    namespace ColorSpaces {
+
+        /*
+         * cv::imread() decodes a colour JPEG file to BGR, and cv::cvtColor() then converts 
+         * it back to grayscale or YCrCb. But a JPEG file already stores its pixels as Y 
+         * (luminance), Cb and Cr planes, so both conversions and the BGR image in between 
+         * can be skipped by asking libjpeg for the planes directly. libjpeg uses the same 
+         * equations as cv::COLOR_BGR2GRAY and cv::COLOR_BGR2YCrCb, so the results only differ 
+         * by the rounding of the BGR image we no longer make.
+        */
+
+        /**
+         * @brief Decode a JPEG file straight to grayscale or YCrCb, without making a BGR image
+         *
+         * @param filePath full path to image file
+         * @param code cv::COLOR_BGR2GRAY, or cv::COLOR_BGR2YCrCb (channels in OpenCV's Y, Cr, Cb order)
+         * @param image receives the decoded 8-bit image
+         * @return true if the file was decoded
+         * @return false if the file is not a JPEG file whose planes can be used for this code 
+         *         (e.g. grayscale or CMYK JPEG files for cv::COLOR_BGR2YCrCb), or could not be decoded
+         */
+        bool readJpegColorSpace(const std::string& filePath, int code, cv::Mat& image);
+
+        /**
+         * @brief Read an image file and convert it to another color space. The same as cv::imread() 
+         *        followed by cv::cvtColor(), but JPEG files are decoded straight to grayscale or YCrCb 
+         *        with readJpegColorSpace()
+         *
+         * @param filePath full path to image file
+         * @param code color space conversion code used with cv::cvtColor() on the BGR image, e.g. 
+         *             cv::COLOR_BGR2GRAY, cv::COLOR_BGR2YCrCb or cv::COLOR_BGR2HSV
+         * @return cv::Mat converted image. Empty if the file could not be read
+         */
+        cv::Mat imreadColorSpace(const std::string& filePath, int code);
+    }
+
+    namespace ImageCache {
+
+        /**
+         * @brief No. of reads served from the cache (hits) or decoded (misses), no. of images 
+         *        removed to stay within the memory budget (evictions), and no. of images decoded 
+         *        again because their file had changed (invalidations)
+         */
+        struct Statistics 
+        {
+            std::uint64_t hits {0};
+            std::uint64_t misses {0};
+            std::uint64_t evictions {0};
+            std::uint64_t invalidations {0};
+            std::size_t images {0};     // no. of images held
+            std::size_t bytes {0};      // total size of the images held
+        };
+
+
+        /**
+         * @brief Keeps decoded images in memory, so reading the same image file again does not 
+         *        decode it again. Images are keyed by file path, last write time and cv::imread() 
+         *        flags, so an image whose file has changed since it was decoded is decoded again.
+         * 
+         *        When the images held exceed the memory budget, the least recently used images are 
+         *        removed (LRU). Images are spread over several shards, each with its own lock, so 
+         *        threads reading different images rarely wait for each other. Images are decoded 
+         *        without holding a lock.
+         * 
+         *        imread() returns a cv::Mat that shares its pixels with the cache (nothing is copied). 
+         *        Do not change the pixels - clone() the image first.
+         */
+        class DecodedImageCache 
+        {
+        public:
+
+            /**
+             * @brief Create an empty cache
+             * 
+             * @param capacity memory budget: limit on the total size of the images held, in bytes
+             * @param shards no. of independently locked parts of the cache
+             */
+            explicit DecodedImageCache(std::size_t capacity, int shards = 16);
+
+            DecodedImageCache(const DecodedImageCache&) = delete;
+            DecodedImageCache& operator=(const DecodedImageCache&) = delete;
+
+            /**
+             * @brief The cache shared by the whole program. Its memory budget starts at 512 MB
+             */
+            static DecodedImageCache& instance();
+
+            /**
+             * @brief Read an image as cv::imread() does. The image is taken from the cache if it was 
+             *        decoded with the same flags and its file has not changed since
+             * 
+             * @param filePath full path to image file
+             * @param flags cv::ImreadModes flags for cv::imread()
+             * @return cv::Mat image sharing its pixels with the cache. Empty if the image could not be read
+             */
+            cv::Mat imread(const std::string& filePath, int flags = cv::IMREAD_COLOR);
+
+            /**
+             * @brief Change the memory budget, removing the least recently used images until they fit
+             * 
+             * @param capacity limit on the total size of the images held, in bytes
+             */
+            void setCapacity(std::size_t capacity);
+
+            std::size_t capacity() const { return m_capacity.load(); }
+
+            void clear();                       // remove every image. The statistics are kept
+            Statistics statistics() const;
+
+        private:
+
+            struct Entry 
+            {
+                std::string key;                // flags and file path
+                std::int64_t writeTime {0};     // last write time of the file when it was decoded
+                std::uintmax_t fileSize {0};    // size of the file when it was decoded
+                cv::Mat image;
+                std::size_t bytes {0};          // size of the image pixels
+                std::uint64_t lastUsed {0};     // value of m_clock when the image was last read
+            };
+
+            struct Shard 
+            {
+                std::mutex mutex;
+                std::list<Entry> entries;       // most recently used first
+                std::unordered_map<std::string, std::list<Entry>::iterator> index;
+            };
+
+            Shard& shardOf(const std::string& key);
+            void evict();
+
+            std::vector<std::unique_ptr<Shard>> m_shards;
+            std::atomic<std::size_t> m_capacity;
+            std::atomic<std::size_t> m_bytes {0};
+            std::atomic<std::size_t> m_images {0};
+            std::atomic<std::uint64_t> m_clock {0};     // counts reads, to find the least recently used image
+            std::atomic<std::uint64_t> m_hits {0};
+            std::atomic<std::uint64_t> m_misses {0};
+            std::atomic<std::uint64_t> m_evictions {0};
+            std::atomic<std::uint64_t> m_invalidations {0};
+        };
+
+
+        /**
+         * @brief Read an image through the cache shared by the whole program, DecodedImageCache::instance()
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes flags for cv::imread()
+         * @return cv::Mat image sharing its pixels with the cache. Do not change the pixels
+         */
+        cv::Mat imread(const std::string& filePath, int flags = cv::IMREAD_COLOR);
+    }
 }
 
 
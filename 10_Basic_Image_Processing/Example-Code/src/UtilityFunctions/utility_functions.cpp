@@ -1,6 +1,23 @@
 #include "UtilityFunctions/utility_functions.h"
 
 #include <filesystem> // handles files
+#include <iostream>   // for std::cerr
+#include <algorithm>  // for std::copy_n, std::swap_ranges, std::max
+#include <cmath>      // for std::sqrt
+#include <cstring>    // for std::memset
+#include <climits>    // for INT_MAX
+#include <cstdint>    // for SIZE_MAX, UINT64_MAX
+#include <cstdio>     // for std::FILE, std::fopen()
+#include <csetjmp>    // for std::jmp_buf, setjmp(), std::longjmp()
+#include <utility>    // for std::swap
+
+#include "opencv2/core/hal/intrin.hpp" // for OpenCV's universal intrinsics (SIMD)
+#include "opencv2/imgproc.hpp"         // for cv::cvtColor()
+#include "opencv2/imgcodecs.hpp"       // for cv::imread()
+
+#include <tiffio.h>   // for libtiff tiled reads and writes
+#include <zlib.h>     // for compress2(), uncompress()
+#include <jpeglib.h>  // for decoding JPEG files straight to grayscale or YCbCr
 
 namespace CPP_CV {
 
@@ -293,4 +310,1490 @@ namespace CPP_CV {
         }
 
     }
-}
\ No newline at end of file
+
+
+    namespace TiledImages {
+
+        /**
+         * @brief Swap the first and third channel of every pixel e.g. RGB <-> BGR
+         *
+         * @param data pixels
+         * @param pixels no. of pixels
+         * @param channels no. of channels in each pixel. Must be 3 or 4
+         * @param bytesPerChannel size of one channel in bytes
+         */
+        static void swapRedBlue(uchar* data, std::size_t pixels, int channels, std::size_t bytesPerChannel)
+        {
+            const std::size_t pixelBytes { channels * bytesPerChannel };
+            for (std::size_t i {0}; i < pixels; ++i, data += pixelBytes)
+            {
+                std::swap_ranges(data, data + bytesPerChannel, data + 2 * bytesPerChannel);
+            }
+        }
+
+
+        /**
+         * @brief Closes a libtiff file handle. Lets us keep the handle in a std::unique_ptr
+         *        without including tiffio.h in this header
+         */
+        void TiffCloser::operator()(tiff* handle) const
+        {
+            TIFFClose(handle);
+        }
+
+
+        /**
+         * @brief Open the first page of a TIFF file. Use isOpen() to check if it succeeded
+         *
+         * @param filePath full path to TIFF file
+         */
+        TiledTiffSource::TiledTiffSource(const std::string& filePath)
+            : m_tiff { TIFFOpen(filePath.c_str(), "r") }
+        {
+            if (!m_tiff)
+            {
+                std::cerr << "\nCould not open TIFF file " << filePath << '\n';
+                return;
+            }
+
+            TIFF* file { m_tiff.get() };
+
+            uint32_t width {0}, height {0};
+            uint16_t bitsPerSample {0}, samplesPerPixel {0}, sampleFormat {0}, planarConfig {0}, photometric {0}, compression {0};
+            TIFFGetField(file, TIFFTAG_IMAGEWIDTH, &width);
+            TIFFGetField(file, TIFFTAG_IMAGELENGTH, &height);
+            TIFFGetFieldDefaulted(file, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+            TIFFGetFieldDefaulted(file, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+            TIFFGetFieldDefaulted(file, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+            TIFFGetFieldDefaulted(file, TIFFTAG_PLANARCONFIG, &planarConfig);
+            TIFFGetFieldDefaulted(file, TIFFTAG_COMPRESSION, &compression);
+            TIFFGetField(file, TIFFTAG_PHOTOMETRIC, &photometric);
+
+            // Match the TIFF sample format and size to an OpenCV depth
+            int depth {-1};
+            switch (sampleFormat * 100 + bitsPerSample)
+            {
+                case SAMPLEFORMAT_UINT * 100 + 8:    depth = CV_8U;  break;
+                case SAMPLEFORMAT_INT * 100 + 8:     depth = CV_8S;  break;
+                case SAMPLEFORMAT_UINT * 100 + 16:   depth = CV_16U; break;
+                case SAMPLEFORMAT_INT * 100 + 16:    depth = CV_16S; break;
+                case SAMPLEFORMAT_INT * 100 + 32:    depth = CV_32S; break;
+                case SAMPLEFORMAT_IEEEFP * 100 + 32: depth = CV_32F; break;
+                case SAMPLEFORMAT_IEEEFP * 100 + 64: depth = CV_64F; break;
+                default: break;
+            }
+
+            // JPEG compressed files usually store YCbCr. libtiff converts it back to RGB for us
+            if ((photometric == PHOTOMETRIC_YCBCR) && (compression == COMPRESSION_JPEG))
+            {
+                TIFFSetField(file, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+                photometric = PHOTOMETRIC_RGB;
+            }
+
+            if ((width == 0) || (height == 0) || (depth < 0) || (samplesPerPixel < 1) || (samplesPerPixel > 4) ||
+                (planarConfig != PLANARCONFIG_CONTIG) ||
+                ((photometric != PHOTOMETRIC_MINISBLACK) && (photometric != PHOTOMETRIC_RGB)))
+            {
+                std::cerr << "\nUnsupported TIFF pixel layout in " << filePath
+                          << ". Only 1 to 4 interleaved grey or RGB channels can be read.\n";
+                m_tiff.reset();
+                return;
+            }
+
+            m_size = cv::Size(static_cast<int>(width), static_cast<int>(height));
+            m_type = CV_MAKETYPE(depth, samplesPerPixel);
+            m_rgb = (photometric == PHOTOMETRIC_RGB) && (samplesPerPixel >= 3);
+            m_tiled = TIFFIsTiled(file) != 0;
+
+            if (m_tiled)
+            {
+                uint32_t tileWidth {0}, tileHeight {0};
+                TIFFGetField(file, TIFFTAG_TILEWIDTH, &tileWidth);
+                TIFFGetField(file, TIFFTAG_TILELENGTH, &tileHeight);
+                m_tileSize = cv::Size(static_cast<int>(tileWidth), static_cast<int>(tileHeight));
+            }
+            else
+            {
+                uint32_t rowsPerStrip {0};
+                TIFFGetFieldDefaulted(file, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+                m_tileSize = cv::Size(m_size.width, static_cast<int>(std::min(rowsPerStrip, height)));
+            }
+
+            m_tileBuffer.resize(static_cast<std::size_t>(m_tileSize.area()) * CV_ELEM_SIZE(m_type));
+        }
+
+
+        /**
+         * @brief Decode a tile (or strip) into m_tileBuffer, unless it is already there
+         *
+         * @param tileColumn column of tile in the tile grid. Always 0 for striped files
+         * @param tileRow row of tile in the tile grid
+         * @return true if the tile was decoded
+         * @return false otherwise
+         */
+        bool TiledTiffSource::decodeTile(int tileColumn, int tileRow)
+        {
+            if (m_bufferedTile == cv::Point(tileColumn, tileRow))
+            {
+                return true;
+            }
+
+            TIFF* file { m_tiff.get() };
+            const tmsize_t bufferSize { static_cast<tmsize_t>(m_tileBuffer.size()) };
+
+            tmsize_t decoded {-1};
+            if (m_tiled)
+            {
+                const ttile_t tile { TIFFComputeTile(file, static_cast<uint32_t>(tileColumn * m_tileSize.width),
+                                                     static_cast<uint32_t>(tileRow * m_tileSize.height), 0, 0) };
+                decoded = TIFFReadEncodedTile(file, tile, m_tileBuffer.data(), bufferSize);
+            }
+            else
+            {
+                decoded = TIFFReadEncodedStrip(file, static_cast<uint32_t>(tileRow), m_tileBuffer.data(), bufferSize);
+            }
+
+            if (decoded < 0)
+            {
+                m_bufferedTile = cv::Point(-1, -1);
+                return false;
+            }
+
+            if (m_rgb)
+            {
+                swapRedBlue(m_tileBuffer.data(), static_cast<std::size_t>(m_tileSize.area()),
+                            CV_MAT_CN(m_type), CV_ELEM_SIZE1(m_type));
+            }
+
+            m_bufferedTile = cv::Point(tileColumn, tileRow);
+            ++m_tilesDecoded;
+
+            return true;
+        }
+
+
+        /**
+         * @brief Read a region of the image. Colour images are returned in BGR(A) order.
+         *
+         * @param region region to read. Parts of the region outside the image are filled
+         *               the same way as cv::copyMakeBorder()
+         * @param block output image, the size of region
+         * @param borderType cv::BORDER_CONSTANT, cv::BORDER_REPLICATE, cv::BORDER_REFLECT,
+         *                   cv::BORDER_WRAP or cv::BORDER_REFLECT_101
+         * @param value value of pixels outside the image when borderType is cv::BORDER_CONSTANT
+         * @return true if the region was read
+         * @return false if the region is empty, the border type is not supported or a tile could not be decoded
+         */
+        bool TiledTiffSource::read(const cv::Rect& region, cv::Mat& block, int borderType, const cv::Scalar& value)
+        {
+            borderType &= ~cv::BORDER_ISOLATED;
+            if (!m_tiff || region.empty() || (borderType < cv::BORDER_CONSTANT) || (borderType > cv::BORDER_REFLECT_101))
+            {
+                return false;
+            }
+
+            block.create(region.size(), m_type);
+
+            /*
+             * a. Find the image column and row each pixel of the block is copied from.
+             *    Pixels outside the image are mapped back inside with cv::borderInterpolate(),
+             *    which returns -1 for cv::BORDER_CONSTANT
+            */
+            auto sourceCoordinate = [borderType](int p, int length) {
+                return ((p >= 0) && (p < length)) ? p : cv::borderInterpolate(p, length, borderType);
+            };
+
+            const cv::Rect imageArea { cv::Point(0, 0), m_size };
+            if ((region & imageArea) != region)
+            {
+                block.setTo(value);
+            }
+
+            /*
+             * b. Group the columns by the tile they come from into spans of neighbouring pixels,
+             *    so each span is a single copy. Rows are grouped by tile row the same way.
+            */
+            struct Span
+            {
+                int blockX;     // first column in block
+                int imageX;     // first column in image
+                int length;     // no. of pixels
+            };
+
+            const int tileColumns { (m_size.width + m_tileSize.width - 1) / m_tileSize.width };
+            const int tileRows { (m_size.height + m_tileSize.height - 1) / m_tileSize.height };
+
+            std::vector<std::vector<Span>> spansInTileColumn(static_cast<std::size_t>(tileColumns));
+            for (int x {0}; x < region.width; ++x)
+            {
+                const int imageX { sourceCoordinate(region.x + x, m_size.width) };
+                if (imageX < 0)
+                {
+                    continue;
+                }
+
+                auto& spans { spansInTileColumn[static_cast<std::size_t>(imageX / m_tileSize.width)] };
+                if (!spans.empty() && (spans.back().blockX + spans.back().length == x) &&
+                    (spans.back().imageX + spans.back().length == imageX))
+                {
+                    ++spans.back().length;
+                }
+                else
+                {
+                    spans.push_back(Span {x, imageX, 1});
+                }
+            }
+
+            std::vector<std::vector<cv::Point>> rowsInTileRow(static_cast<std::size_t>(tileRows)); // (block row, image row)
+            for (int y {0}; y < region.height; ++y)
+            {
+                const int imageY { sourceCoordinate(region.y + y, m_size.height) };
+                if (imageY >= 0)
+                {
+                    rowsInTileRow[static_cast<std::size_t>(imageY / m_tileSize.height)].emplace_back(y, imageY);
+                }
+            }
+
+            // c. Decode each tile we need once, and copy its spans into the block
+            const std::size_t pixelBytes { block.elemSize() };
+            const std::size_t tileRowBytes { m_tileSize.width * pixelBytes };
+
+            for (int tileRow {0}; tileRow < tileRows; ++tileRow)
+            {
+                const auto& rows { rowsInTileRow[static_cast<std::size_t>(tileRow)] };
+                if (rows.empty())
+                {
+                    continue;
+                }
+
+                for (int tileColumn {0}; tileColumn < tileColumns; ++tileColumn)
+                {
+                    const auto& spans { spansInTileColumn[static_cast<std::size_t>(tileColumn)] };
+                    if (spans.empty())
+                    {
+                        continue;
+                    }
+
+                    if (!decodeTile(tileColumn, tileRow))
+                    {
+                        std::cerr << "\nCould not decode TIFF tile (" << tileColumn << ", " << tileRow << ")\n";
+                        return false;
+                    }
+
+                    const int tileX { tileColumn * m_tileSize.width };
+                    const int tileY { tileRow * m_tileSize.height };
+
+                    for (const cv::Point& row : rows)
+                    {
+                        const uchar* source { m_tileBuffer.data() + (row.y - tileY) * tileRowBytes };
+                        uchar* destination { block.ptr<uchar>(row.x) };
+
+                        for (const Span& span : spans)
+                        {
+                            std::copy_n(source + (span.imageX - tileX) * pixelBytes, span.length * pixelBytes,
+                                        destination + span.blockX * pixelBytes);
+                        }
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Create a tiled TIFF file. Use isOpen() to check if it succeeded
+         *
+         * @param filePath full path to TIFF file
+         * @param size image width and height
+         * @param type OpenCV type of image, with 1 to 4 channels. CV_16F is not supported
+         * @param tileSize width and height of tiles. Rounded up to a multiple of 16
+         * @param compression compression scheme. LZW and Deflate also use a predictor
+         */
+        TiledTiffSink::TiledTiffSink(const std::string& filePath, cv::Size size, int type,
+                                     int tileSize, TiffCompression compression)
+            : m_filePath {filePath}, m_size {size}, m_type {type}
+        {
+            const int depth { CV_MAT_DEPTH(type) };
+            const int channels { CV_MAT_CN(type) };
+
+            if ((size.width <= 0) || (size.height <= 0) || (tileSize <= 0) || (channels > 4) || (depth == CV_16F) ||
+                ((compression == TiffCompression::jpeg) && ((depth != CV_8U) || (channels == 2) || (channels == 4))))
+            {
+                std::cerr << "\nCannot save a " << General::openCVDescriptiveDataType(type)
+                          << " image with the chosen tiled TIFF options.\n";
+                return;
+            }
+
+            // Big TIFF ("w8") is needed once a file grows beyond 4 GB
+            const std::size_t totalBytes { static_cast<std::size_t>(size.width) * size.height * CV_ELEM_SIZE(type) };
+            m_tiff.reset(TIFFOpen(filePath.c_str(), totalBytes > (std::size_t{3} << 30) ? "w8" : "w"));
+            if (!m_tiff)
+            {
+                std::cerr << "\nCould not open " << filePath << " for writing.\n";
+                return;
+            }
+
+            TIFF* file { m_tiff.get() };
+
+            const int sampleFormat { (depth == CV_32F || depth == CV_64F) ? SAMPLEFORMAT_IEEEFP :
+                                     ((depth == CV_8S || depth == CV_16S || depth == CV_32S) ? SAMPLEFORMAT_INT : SAMPLEFORMAT_UINT) };
+
+            // Tiles must be a multiple of 16 pixels wide and high
+            const int tileSide { (tileSize + 15) / 16 * 16 };
+            m_tileSize = cv::Size(tileSide, tileSide);
+
+            TIFFSetField(file, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(size.width));
+            TIFFSetField(file, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(size.height));
+            TIFFSetField(file, TIFFTAG_BITSPERSAMPLE, static_cast<int>(CV_ELEM_SIZE1(type) * 8));
+            TIFFSetField(file, TIFFTAG_SAMPLESPERPIXEL, channels);
+            TIFFSetField(file, TIFFTAG_SAMPLEFORMAT, sampleFormat);
+            TIFFSetField(file, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            TIFFSetField(file, TIFFTAG_PHOTOMETRIC, channels >= 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(file, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+            TIFFSetField(file, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tileSide));
+            TIFFSetField(file, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tileSide));
+
+            if ((channels == 2) || (channels == 4))
+            {
+                const uint16_t extraSample[] { EXTRASAMPLE_UNASSALPHA };
+                TIFFSetField(file, TIFFTAG_EXTRASAMPLES, 1, extraSample);
+            }
+
+            TIFFSetField(file, TIFFTAG_COMPRESSION, static_cast<int>(compression));
+            if ((compression == TiffCompression::lzw) || (compression == TiffCompression::deflate))
+            {
+                // Store differences between neighbouring pixels, which compress far better
+                TIFFSetField(file, TIFFTAG_PREDICTOR, sampleFormat == SAMPLEFORMAT_IEEEFP ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL);
+            }
+
+            m_tileBuffer.resize(static_cast<std::size_t>(m_tileSize.area()) * CV_ELEM_SIZE(type));
+        }
+
+
+        /**
+         * @brief Write the directory of any image that close() was not called for
+         */
+        TiledTiffSink::~TiledTiffSink()
+        {
+            close();
+        }
+
+
+        /**
+         * @brief Write a block of whole tiles to the file
+         *
+         * @param origin top left corner of the block in the image. Must be on a tile boundary
+         * @param block image data in BGR(A) order with the sink's type. The block must end
+         *              on a tile boundary or at the right/bottom edge of the image
+         * @return true if the block was written
+         * @return false otherwise
+         */
+        bool TiledTiffSink::write(const cv::Point& origin, const cv::Mat& block)
+        {
+            const int right { origin.x + block.cols };
+            const int bottom { origin.y + block.rows };
+
+            if (!m_tiff || block.empty() || (block.type() != m_type) || (origin.x < 0) || (origin.y < 0) ||
+                (origin.x % m_tileSize.width != 0) || (origin.y % m_tileSize.height != 0) ||
+                (right > m_size.width) || (bottom > m_size.height) ||
+                ((right % m_tileSize.width != 0) && (right != m_size.width)) ||
+                ((bottom % m_tileSize.height != 0) && (bottom != m_size.height)))
+            {
+                std::cerr << "\nBlock at (" << origin.x << ", " << origin.y << ") does not line up with the tiles of "
+                          << m_filePath << '\n';
+                m_failed = true;
+                return false;
+            }
+
+            TIFF* file { m_tiff.get() };
+            const int channels { block.channels() };
+            const std::size_t pixelBytes { block.elemSize() };
+            const std::size_t tileRowBytes { m_tileSize.width * pixelBytes };
+
+            for (int y {0}; y < block.rows; y += m_tileSize.height)
+            {
+                for (int x {0}; x < block.cols; x += m_tileSize.width)
+                {
+                    const int width { std::min(m_tileSize.width, block.cols - x) };
+                    const int height { std::min(m_tileSize.height, block.rows - y) };
+
+                    // Tiles at the right and bottom edges of the image are padded with zeros
+                    if ((width < m_tileSize.width) || (height < m_tileSize.height))
+                    {
+                        std::fill(m_tileBuffer.begin(), m_tileBuffer.end(), uchar {0});
+                    }
+
+                    for (int row {0}; row < height; ++row)
+                    {
+                        const uchar* source { block.ptr<uchar>(y + row) + x * pixelBytes };
+                        std::copy_n(source, width * pixelBytes, m_tileBuffer.data() + row * tileRowBytes);
+                    }
+
+                    // TIFF stores colour images as RGB(A)
+                    if (channels >= 3)
+                    {
+                        swapRedBlue(m_tileBuffer.data(), static_cast<std::size_t>(m_tileSize.area()), channels, block.elemSize1());
+                    }
+
+                    const ttile_t tile { TIFFComputeTile(file, static_cast<uint32_t>(origin.x + x),
+                                                         static_cast<uint32_t>(origin.y + y), 0, 0) };
+                    if (TIFFWriteEncodedTile(file, tile, m_tileBuffer.data(), static_cast<tmsize_t>(m_tileBuffer.size())) < 0)
+                    {
+                        std::cerr << "\nCould not write tile at (" << origin.x + x << ", " << origin.y + y << ") to " << m_filePath << '\n';
+                        m_failed = true;
+                        return false;
+                    }
+
+                    ++m_tilesWritten;
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Finish writing the file
+         *
+         * @return true if every tile was written and the file was closed without errors
+         * @return false otherwise
+         */
+        bool TiledTiffSink::close()
+        {
+            if (!m_tiff)
+            {
+                return false;
+            }
+
+            const std::uint64_t tiles { static_cast<std::uint64_t>((m_size.width + m_tileSize.width - 1) / m_tileSize.width) *
+                                        static_cast<std::uint64_t>((m_size.height + m_tileSize.height - 1) / m_tileSize.height) };
+            if (m_tilesWritten != tiles)
+            {
+                std::cerr << "\nOnly " << m_tilesWritten << " of " << tiles << " tiles were written to " << m_filePath << '\n';
+                m_failed = true;
+            }
+
+            const bool directoryWritten { TIFFWriteDirectory(m_tiff.get()) != 0 };
+            m_tiff.reset();
+
+            return directoryWritten && !m_failed;
+        }
+
+
+        /**
+         * @brief Produce an image block by block and write it to a sink. Blocks are whole
+         *        tiles of the sink, as large as the memory limit allows.
+         *
+         * @param sink file to write to
+         * @param kernel fills each block of the output image
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param buffersPerBlock no. of block sized images the kernel holds at one time, including
+         *                        the output block e.g. 3 for blending two images
+         * @return true if every block was produced and written
+         * @return false otherwise
+         */
+        bool processBlocks(TiledTiffSink& sink, const BlockKernel& kernel, std::size_t memoryLimit, double buffersPerBlock)
+        {
+            if (!sink.isOpen())
+            {
+                return false;
+            }
+
+            /*
+             * Use square blocks of whole tiles, as large as the memory limit allows. Square
+             * blocks keep the overlap read by processTiles() small compared to the block.
+             * A block is never smaller than one tile, even if that exceeds the limit.
+            */
+            const cv::Size tile { sink.tileSize() };
+            const double bytesPerPixel { std::max(buffersPerBlock, 1.0) * CV_ELEM_SIZE(sink.type()) };
+            const int side { static_cast<int>(std::sqrt(static_cast<double>(memoryLimit) / bytesPerPixel)) };
+
+            const cv::Size blockSize { std::min(std::max(side / tile.width, 1) * tile.width, sink.size().width),
+                                       std::min(std::max(side / tile.height, 1) * tile.height, sink.size().height) };
+
+            cv::Mat buffer(blockSize, sink.type());
+
+            for (int y {0}; y < sink.size().height; y += blockSize.height)
+            {
+                for (int x {0}; x < sink.size().width; x += blockSize.width)
+                {
+                    const cv::Rect region { x, y, std::min(blockSize.width, sink.size().width - x),
+                                            std::min(blockSize.height, sink.size().height - y) };
+
+                    cv::Mat block { buffer(cv::Rect(cv::Point(0, 0), region.size())) };
+                    if (!kernel(region, block))
+                    {
+                        return false;
+                    }
+
+                    if ((block.size() != region.size()) || (block.type() != sink.type()))
+                    {
+                        std::cerr << "\nKernel returned a " << block.cols << " x " << block.rows << " block of type "
+                                  << block.type() << ". Expected " << region.width << " x " << region.height
+                                  << " of type " << sink.type() << '\n';
+                        return false;
+                    }
+
+                    if (!sink.write(region.tl(), block))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Run a kernel (e.g. a filter) over an image that does not fit in memory.
+         *        Each block is read with 'overlap' extra pixels on every side so results
+         *        along block edges are the same as processing the whole image at once.
+         *
+         * @param source image to read. Must be the same size as sink
+         * @param sink file to write result to
+         * @param overlap no. of extra pixels read on each side of a block e.g. the kernel radius of a filter
+         * @param kernel operation run on each block
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param borderType how pixels beyond the image edges are filled (see TiledTiffSource::read())
+         * @return true if the whole image was processed
+         * @return false otherwise
+         */
+        bool processTiles(TiledTiffSource& source, TiledTiffSink& sink, int overlap, const TileKernel& kernel,
+                          std::size_t memoryLimit, int borderType)
+        {
+            if (!source.isOpen() || !sink.isOpen() || (source.size() != sink.size()) || (overlap < 0))
+            {
+                std::cerr << "\nSource and sink must be open and the same size, and the overlap must not be negative.\n";
+                return false;
+            }
+
+            // Memory held per block: the output block, plus the input and the kernel's output
+            // (both with the overlap), which may have a different type to the sink
+            const double inputBuffers { static_cast<double>(CV_ELEM_SIZE(source.type())) / CV_ELEM_SIZE(sink.type()) };
+
+            cv::Mat input;
+            cv::Mat output;
+
+            auto blockKernel = [&](const cv::Rect& region, cv::Mat& block) {
+                const cv::Rect inputRegion { region.x - overlap, region.y - overlap,
+                                             region.width + 2 * overlap, region.height + 2 * overlap };
+                if (!source.read(inputRegion, input, borderType))
+                {
+                    return false;
+                }
+
+                kernel(input, output);
+
+                // Crop the overlap from the kernel output
+                cv::Mat result { output };
+                if ((output.size() == input.size()) && (overlap > 0))
+                {
+                    result = output(cv::Rect(overlap, overlap, region.width, region.height));
+                }
+
+                if ((result.size() != region.size()) || (result.type() != sink.type()))
+                {
+                    std::cerr << "\nKernel output must be the size of its input, or the input minus the overlap, "
+                              << "and have the type of the sink.\n";
+                    return false;
+                }
+
+                result.copyTo(block);
+
+                return true;
+            };
+
+            return processBlocks(sink, blockKernel, memoryLimit, 1.0 + 2.0 * inputBuffers);
+        }
+    }
+
+    namespace MaskCodec {
+
+        /*
+         * A compressed mask is a 22 byte header followed by the rows, all little-endian:
+         *      "MASK", width (4 bytes), height (4 bytes), encoding (1 byte), 
+         *      deflated (1 byte), size of the rows before deflating (8 bytes)
+         *
+         * Bit-packed rows hold 8 pixels per byte, the first pixel in the lowest bit. 
+         * Run-length rows hold the lengths of alternating runs of 0 and 255 pixels, starting 
+         * with a run of 0 pixels (which may be empty), each as a variable length integer 
+         * (7 bits per byte, the highest bit set on every byte but the last).
+        */
+        constexpr std::size_t maskHeaderSize {22};
+        constexpr std::uint64_t maxMaskPixels { std::uint64_t{1} << 30 };
+        constexpr std::uint64_t maxDeflateRatio {1032}; // deflate never shrinks data by more than this
+
+        static std::size_t packedRowBytes(int width)
+        {
+            return (static_cast<std::size_t>(width) + 7) / 8;
+        }
+
+
+        /**
+         * @brief Pack a row of a mask into 1 bit per pixel
+         *
+         * @param row pixels of the row
+         * @param width no. of pixels
+         * @param packed receives packedRowBytes(width) bytes
+         */
+        static void packRow(const uchar* row, int width, uchar* packed)
+        {
+            int x {0};
+
+#if CV_SIMD128
+            // 16 pixels at a time: compare with 0, then collect the top bit of every lane
+            const cv::v_uint8x16 zero { cv::v_setzero_u8() };
+            for (; x + 16 <= width; x += 16)
+            {
+                const int bits { cv::v_signmask(cv::v_load(row + x) != zero) };
+                packed[x / 8] = static_cast<uchar>(bits & 0xFF);
+                packed[x / 8 + 1] = static_cast<uchar>(bits >> 8);
+            }
+#endif
+
+            for (; x < width; x += 8)
+            {
+                uchar byte {0};
+                for (int bit {0}; (bit < 8) && (x + bit < width); ++bit)
+                {
+                    byte |= static_cast<uchar>((row[x + bit] != 0) << bit);
+                }
+                packed[x / 8] = byte;
+            }
+        }
+
+
+        /**
+         * @brief Unpack a bit-packed row of a mask into pixels of 0 or 255
+         *
+         * @param packed packedRowBytes(width) bytes of the row
+         * @param width no. of pixels
+         * @param row receives the pixels
+         */
+        static void unpackRow(const uchar* packed, int width, uchar* row)
+        {
+            int x {0};
+
+#if CV_SIMD128
+            // Copy each of 2 bytes to 8 lanes, keep a different bit in each lane, and 
+            // turn the lanes whose bit is set into 255
+            const cv::v_uint8x16 bitOfLane { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+            const cv::v_uint8x16 zero { cv::v_setzero_u8() };
+            for (; x + 16 <= width; x += 16)
+            {
+                const uchar low { packed[x / 8] };
+                const uchar high { packed[x / 8 + 1] };
+                const cv::v_uint8x16 bytes { low, low, low, low, low, low, low, low, 
+                                             high, high, high, high, high, high, high, high };
+                cv::v_store(row + x, (bytes & bitOfLane) != zero);
+            }
+#endif
+
+            for (; x < width; ++x)
+            {
+                row[x] = ((packed[x / 8] >> (x % 8)) & 1) ? 255 : 0;
+            }
+        }
+
+
+        /**
+         * @brief Find where a run of 0 (or of non-0) pixels ends
+         *
+         * @param row pixels of the row
+         * @param start first pixel of the run
+         * @param width no. of pixels in the row
+         * @param set true for a run of non-0 pixels, false for a run of 0 pixels
+         * @return int first pixel after the run
+         */
+        static int findRunEnd(const uchar* row, int start, int width, bool set)
+        {
+            int x {start};
+
+#if CV_SIMD128
+            const cv::v_uint8x16 zero { cv::v_setzero_u8() };
+            for (; x + 16 <= width; x += 16)
+            {
+                const cv::v_uint8x16 pixels { cv::v_load(row + x) };
+                const cv::v_uint8x16 ended { set ? (pixels == zero) : (pixels != zero) };
+                if (cv::v_check_any(ended))
+                {
+                    return x + cv::v_scan_forward(ended);
+                }
+            }
+#endif
+
+            while ((x < width) && ((row[x] != 0) == set))
+            {
+                ++x;
+            }
+
+            return x;
+        }
+
+
+        static void appendVarint(std::vector<uchar>& buffer, std::uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                buffer.push_back(static_cast<uchar>(value | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back(static_cast<uchar>(value));
+        }
+
+
+        static bool readVarint(const uchar*& in, const uchar* end, std::uint64_t& value)
+        {
+            value = 0;
+            for (int shift {0}; (in < end) && (shift < 64); shift += 7)
+            {
+                const uchar byte { *in++ };
+                value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+
+        /**
+         * @brief Append the rows of a mask to a buffer
+         *
+         * @param mask CV_8UC1 image
+         * @param encoding bitPacked or runLength
+         * @param buffer rows are appended to it
+         * @param sizeLimit run-length encoding stops once the rows take more than this no. 
+         *                  of bytes (used to pick the smaller encoding)
+         * @return true if the rows were appended
+         * @return false if run-length encoding went over sizeLimit
+         */
+        static bool appendRows(const cv::Mat& mask, MaskEncoding encoding, std::vector<uchar>& buffer, 
+                               std::size_t sizeLimit = SIZE_MAX)
+        {
+            const std::size_t start { buffer.size() };
+
+            if (encoding == MaskEncoding::bitPacked)
+            {
+                const std::size_t rowBytes { packedRowBytes(mask.cols) };
+                buffer.resize(start + rowBytes * mask.rows);
+                for (int y {0}; y < mask.rows; ++y)
+                {
+                    packRow(mask.ptr<uchar>(y), mask.cols, buffer.data() + start + rowBytes * y);
+                }
+
+                return true;
+            }
+
+            for (int y {0}; y < mask.rows; ++y)
+            {
+                const uchar* row { mask.ptr<uchar>(y) };
+
+                bool set {false}; // every row starts with a run of 0 pixels, which may be empty
+                for (int x {0}; x < mask.cols; set = !set)
+                {
+                    const int end { findRunEnd(row, x, mask.cols, set) };
+                    appendVarint(buffer, static_cast<std::uint64_t>(end - x));
+                    x = end;
+                }
+
+                if (buffer.size() - start > sizeLimit)
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Compress a binary mask
+         *
+         * @param mask CV_8UC1 image. Pixels that are not 0 are stored as 255
+         * @param buffer output buffer. Resized to fit the compressed mask, keeping its memory for the next mask
+         * @param encoding how the rows are stored
+         * @param deflateLevel zlib compression level (1 to 9) applied after the encoding. 0 = not deflated
+         * @return true if the mask was compressed
+         * @return false if the mask is not CV_8UC1 or zlib reported an error
+         */
+        bool encodeMask(const cv::Mat& mask, std::vector<uchar>& buffer, MaskEncoding encoding, int deflateLevel)
+        {
+            if (mask.empty() || (mask.type() != CV_8UC1))
+            {
+                return false;
+            }
+
+            // Rows are deflated from a separate buffer, otherwise they go straight after the header
+            std::vector<uchar> deflateInput;
+            std::vector<uchar>& rows { (deflateLevel > 0) ? deflateInput : buffer };
+            rows.resize((deflateLevel > 0) ? 0 : maskHeaderSize);
+
+            // Run-length encoding is tried first, and given up as soon as it is larger than bit-packing
+            const std::size_t headerBytes { rows.size() };
+            const std::size_t packedBytes { packedRowBytes(mask.cols) * mask.rows };
+            if (encoding == MaskEncoding::automatic)
+            {
+                encoding = appendRows(mask, MaskEncoding::runLength, rows, packedBytes) ? MaskEncoding::runLength 
+                                                                                        : MaskEncoding::bitPacked;
+                if (encoding == MaskEncoding::bitPacked)
+                {
+                    rows.resize(headerBytes);
+                    appendRows(mask, encoding, rows);
+                }
+            }
+            else 
+            {
+                appendRows(mask, encoding, rows);
+            }
+
+            const std::uint64_t rowBytes { rows.size() - headerBytes };
+
+            if (deflateLevel > 0)
+            {
+                uLongf deflatedBytes { compressBound(static_cast<uLong>(rowBytes)) };
+                buffer.resize(maskHeaderSize + deflatedBytes);
+                if (compress2(buffer.data() + maskHeaderSize, &deflatedBytes, deflateInput.data(), 
+                              static_cast<uLong>(rowBytes), std::min(deflateLevel, 9)) != Z_OK)
+                {
+                    buffer.clear();
+                    return false;
+                }
+                buffer.resize(maskHeaderSize + deflatedBytes);
+            }
+
+            // Header
+            uchar* header { buffer.data() };
+            auto writeLittleEndian = [&header](std::uint64_t value, int bytes) {
+                for (int i {0}; i < bytes; ++i)
+                {
+                    *header++ = static_cast<uchar>(value >> (8 * i));
+                }
+            };
+            const char magic[4] { 'M', 'A', 'S', 'K' };
+            header = std::copy(std::begin(magic), std::end(magic), header);
+            writeLittleEndian(static_cast<std::uint64_t>(mask.cols), 4);
+            writeLittleEndian(static_cast<std::uint64_t>(mask.rows), 4);
+            writeLittleEndian(static_cast<std::uint64_t>(encoding), 1);
+            writeLittleEndian((deflateLevel > 0) ? 1 : 0, 1);
+            writeLittleEndian(rowBytes, 8);
+
+            return true;
+        }
+
+
+        /**
+         * @brief Read the header of a compressed mask
+         *
+         * @param buffer compressed mask
+         * @param size receives the width and height of the mask
+         * @param encoding receives the encoding of the rows
+         * @param deflated set to true if the rows were deflated
+         * @param rowBytes receives the size of the rows before deflating
+         * @return true if the header is valid
+         * @return false otherwise
+         */
+        static bool readMaskHeader(const std::vector<uchar>& buffer, cv::Size& size, MaskEncoding& encoding, 
+                                   bool& deflated, std::uint64_t& rowBytes)
+        {
+            if ((buffer.size() < maskHeaderSize) || (buffer[0] != 'M') || (buffer[1] != 'A') || 
+                (buffer[2] != 'S') || (buffer[3] != 'K'))
+            {
+                return false;
+            }
+
+            auto readLittleEndian = [&buffer](std::size_t offset, int bytes) {
+                std::uint64_t value {0};
+                for (int i {0}; i < bytes; ++i)
+                {
+                    value |= static_cast<std::uint64_t>(buffer[offset + i]) << (8 * i);
+                }
+                return value;
+            };
+
+            const std::uint64_t width { readLittleEndian(4, 4) };
+            const std::uint64_t height { readLittleEndian(8, 4) };
+            const std::uint64_t encodingValue { readLittleEndian(12, 1) };
+            const std::uint64_t deflatedValue { readLittleEndian(13, 1) };
+            rowBytes = readLittleEndian(14, 8);
+
+            // Like cv::imread(), refuse masks of more than 2^30 pixels so a damaged header cannot 
+            // make us allocate an enormous mask
+            if ((width == 0) || (height == 0) || (width > INT_MAX) || (height > INT_MAX) || 
+                (width * height > maxMaskPixels) || (encodingValue > 1) || (deflatedValue > 1))
+            {
+                return false;
+            }
+
+            size = cv::Size(static_cast<int>(width), static_cast<int>(height));
+            encoding = static_cast<MaskEncoding>(encodingValue);
+            deflated = (deflatedValue == 1);
+
+            // Bit-packed rows have a known size. A run-length row holds at most width + 1 runs of up to 5 bytes
+            return (encoding == MaskEncoding::bitPacked) ? (rowBytes == packedRowBytes(size.width) * height) 
+                                                         : (rowBytes >= height) && (rowBytes <= (width + 1) * 5 * height);
+        }
+
+
+        /**
+         * @brief Return the encoding a compressed mask was stored with (bitPacked or runLength), 
+         *        and whether it was deflated
+         *
+         * @param buffer compressed mask
+         * @param encoding receives the encoding of the rows
+         * @param deflated set to true if the rows were deflated
+         * @return true if the buffer starts with a valid header
+         * @return false otherwise
+         */
+        bool maskEncoding(const std::vector<uchar>& buffer, MaskEncoding& encoding, bool& deflated)
+        {
+            cv::Size size;
+            std::uint64_t rowBytes {0};
+
+            return readMaskHeader(buffer, size, encoding, deflated, rowBytes);
+        }
+
+
+        /**
+         * @brief De-compress a mask made by encodeMask()
+         *
+         * @param buffer compressed mask
+         * @param mask receives the CV_8UC1 mask of 0 and 255 pixels. Its memory is re-used if it 
+         *             already has the right size
+         * @return true if the mask was de-compressed
+         * @return false if the buffer is not a valid compressed mask
+         */
+        bool decodeMask(const std::vector<uchar>& buffer, cv::Mat& mask)
+        {
+            cv::Size size;
+            MaskEncoding encoding { MaskEncoding::bitPacked };
+            bool deflated {false};
+            std::uint64_t rowBytes {0};
+            if (!readMaskHeader(buffer, size, encoding, deflated, rowBytes))
+            {
+                return false;
+            }
+
+            // Inflate the rows, or use them where they are
+            std::vector<uchar> inflated;
+            const uchar* in { buffer.data() + maskHeaderSize };
+            if (deflated)
+            {
+                if (rowBytes > (buffer.size() - maskHeaderSize) * maxDeflateRatio)
+                {
+                    return false;
+                }
+                inflated.resize(static_cast<std::size_t>(rowBytes));
+                uLongf inflatedBytes { static_cast<uLongf>(rowBytes) };
+                if ((uncompress(inflated.data(), &inflatedBytes, in, static_cast<uLong>(buffer.size() - maskHeaderSize)) != Z_OK) ||
+                    (inflatedBytes != rowBytes))
+                {
+                    return false;
+                }
+                in = inflated.data();
+            }
+            else if (buffer.size() - maskHeaderSize != rowBytes)
+            {
+                return false;
+            }
+            const uchar* end { in + rowBytes };
+
+            mask.create(size, CV_8UC1);
+
+            if (encoding == MaskEncoding::bitPacked)
+            {
+                const std::size_t packedBytes { packedRowBytes(size.width) };
+                for (int y {0}; y < mask.rows; ++y)
+                {
+                    unpackRow(in + packedBytes * y, mask.cols, mask.ptr<uchar>(y));
+                }
+
+                return true;
+            }
+
+            for (int y {0}; y < mask.rows; ++y)
+            {
+                uchar* row { mask.ptr<uchar>(y) };
+
+                uchar value {0};
+                for (int x {0}; x < mask.cols; value = ~value)
+                {
+                    std::uint64_t length {0};
+                    if (!readVarint(in, end, length) || (length > static_cast<std::uint64_t>(mask.cols - x)))
+                    {
+                        return false;
+                    }
+                    std::memset(row + x, value, static_cast<std::size_t>(length));
+                    x += static_cast<int>(length);
+                }
+            }
+
+            return in == end;
+        }
+    }
+
+    namespace ColorSpaces {
+
+        /**
+         * @brief Error manager for libjpeg. Errors jump back to the decoder instead of 
+         *        ending the program, and messages are not printed
+         */
+        struct JpegErrorManager
+        {
+            jpeg_error_mgr base;
+            std::jmp_buf jump;
+        };
+
+        static void jpegErrorExit(j_common_ptr info)
+        {
+            std::longjmp(reinterpret_cast<JpegErrorManager*>(info->err)->jump, 1);
+        }
+
+        static void jpegOutputMessage(j_common_ptr) {}
+
+
+        /**
+         * @brief Find the orientation tag in the EXIF data (APP1 marker) of a JPEG file
+         *
+         * @param markers markers saved by libjpeg while reading the header
+         * @return int EXIF orientation (1 to 8). 1 (stored upright) if there is no orientation tag
+         */
+        static int exifOrientation(jpeg_saved_marker_ptr markers)
+        {
+            for (jpeg_saved_marker_ptr marker { markers }; marker != nullptr; marker = marker->next)
+            {
+                // "Exif\0\0" followed by a TIFF header and the first directory of tags
+                const uchar* exif { marker->data };
+                const std::size_t length { marker->data_length };
+                if ((marker->marker != JPEG_APP0 + 1) || (length < 14) || (std::memcmp(exif, "Exif\0\0", 6) != 0))
+                {
+                    continue;
+                }
+
+                const uchar* tiff { exif + 6 };
+                const std::size_t tiffLength { length - 6 };
+                const bool littleEndian { (tiff[0] == 'I') && (tiff[1] == 'I') };
+                auto read = [tiff, littleEndian](std::size_t offset, int bytes) {
+                    std::uint32_t value {0};
+                    for (int i {0}; i < bytes; ++i)
+                    {
+                        const int shift { littleEndian ? 8 * i : 8 * (bytes - 1 - i) };
+                        value |= static_cast<std::uint32_t>(tiff[offset + i]) << shift;
+                    }
+                    return value;
+                };
+
+                const std::size_t directory { read(4, 4) };
+                if ((directory > tiffLength - 2) || (tiffLength < 8))
+                {
+                    return 1;
+                }
+
+                const std::size_t tags { read(directory, 2) };
+                for (std::size_t tag {0}; (tag < tags) && (directory + 2 + 12 * (tag + 1) <= tiffLength); ++tag)
+                {
+                    const std::size_t entry { directory + 2 + 12 * tag };
+                    if ((read(entry, 2) == 0x0112) && (read(entry + 2, 2) == 3)) // orientation, a SHORT
+                    {
+                        const int orientation { static_cast<int>(read(entry + 8, 2)) };
+
+                        return ((orientation >= 1) && (orientation <= 8)) ? orientation : 1;
+                    }
+                }
+
+                return 1;
+            }
+
+            return 1;
+        }
+
+
+        /**
+         * @brief Turn an image upright according to its EXIF orientation, as cv::imread() does
+         *
+         * @param image image as stored in the file
+         * @param orientation EXIF orientation (1 to 8)
+         */
+        static void applyExifOrientation(cv::Mat& image, int orientation)
+        {
+            switch (orientation)
+            {
+                case 2: cv::flip(image, image, 1); break;
+                case 3: cv::flip(image, image, -1); break;
+                case 4: cv::flip(image, image, 0); break;
+                case 5: cv::transpose(image, image); break;
+                case 6: cv::transpose(image, image); cv::flip(image, image, 1); break;
+                case 7: cv::transpose(image, image); cv::flip(image, image, -1); break;
+                case 8: cv::transpose(image, image); cv::flip(image, image, 0); break;
+                default: break;
+            }
+        }
+
+
+        /**
+         * @brief Decode a JPEG file straight to grayscale or YCrCb, without making a BGR image
+         *
+         * @param filePath full path to image file
+         * @param code cv::COLOR_BGR2GRAY, or cv::COLOR_BGR2YCrCb (channels in OpenCV's Y, Cr, Cb order)
+         * @param image receives the decoded 8-bit image
+         * @return true if the file was decoded
+         * @return false if the file is not a JPEG file whose planes can be used for this code 
+         *         (e.g. grayscale or CMYK JPEG files for cv::COLOR_BGR2YCrCb), or could not be decoded
+         */
+        bool readJpegColorSpace(const std::string& filePath, int code, cv::Mat& image)
+        {
+            if ((code != cv::COLOR_BGR2GRAY) && (code != cv::COLOR_BGR2YCrCb))
+            {
+                return false;
+            }
+
+            std::FILE* file { std::fopen(filePath.c_str(), "rb") };
+            if (file == nullptr)
+            {
+                return false;
+            }
+
+            // Every JPEG file starts with an SOI marker followed by another marker
+            uchar signature[3] {};
+            if ((std::fread(signature, 1, 3, file) != 3) || (signature[0] != 0xFF) || (signature[1] != 0xD8) || (signature[2] != 0xFF))
+            {
+                std::fclose(file);
+
+                return false;
+            }
+            std::rewind(file);
+
+            // Only plain C data lives in this function, as longjmp() does not call destructors
+            jpeg_decompress_struct info {};
+            JpegErrorManager errorManager {};
+            info.err = jpeg_std_error(&errorManager.base);
+            errorManager.base.error_exit = jpegErrorExit;
+            errorManager.base.output_message = jpegOutputMessage;
+
+            if (setjmp(errorManager.jump))
+            {
+                jpeg_destroy_decompress(&info);
+                std::fclose(file);
+
+                return false;
+            }
+
+            jpeg_create_decompress(&info);
+            jpeg_stdio_src(&info, file);
+            jpeg_save_markers(&info, JPEG_APP0 + 1, 0xFFFF); // EXIF data, for the orientation
+            jpeg_read_header(&info, TRUE);
+
+            // Grayscale output only keeps the Y plane, and libjpeg does not even decode Cb and Cr. 
+            // YCbCr output skips the colour conversion, but still upsamples Cb and Cr to full size
+            const bool gray { code == cv::COLOR_BGR2GRAY };
+            if (!((info.jpeg_color_space == JCS_YCbCr) || (gray && (info.jpeg_color_space == JCS_GRAYSCALE))))
+            {
+                jpeg_destroy_decompress(&info);
+                std::fclose(file);
+
+                return false;
+            }
+            info.out_color_space = gray ? JCS_GRAYSCALE : JCS_YCbCr;
+
+            jpeg_start_decompress(&info);
+
+            const int orientation { exifOrientation(info.marker_list) };
+
+            try
+            {
+                image.create(static_cast<int>(info.output_height), static_cast<int>(info.output_width), CV_8UC(info.output_components));
+            }
+            catch (...)
+            {
+                jpeg_destroy_decompress(&info);
+                std::fclose(file);
+
+                throw;
+            }
+
+            // Rows are decoded straight into the image
+            while (info.output_scanline < info.output_height)
+            {
+                JSAMPROW row { image.ptr<uchar>(static_cast<int>(info.output_scanline)) };
+                jpeg_read_scanlines(&info, &row, 1);
+
+                // JPEG stores Y, Cb, Cr but OpenCV's YCrCb is Y, Cr, Cb
+                if (!gray)
+                {
+                    for (int x {0}; x < image.cols; ++x)
+                    {
+                        std::swap(row[3 * x + 1], row[3 * x + 2]);
+                    }
+                }
+            }
+
+            jpeg_finish_decompress(&info);
+            jpeg_destroy_decompress(&info);
+            std::fclose(file);
+
+            applyExifOrientation(image, orientation);
+
+            return true;
+        }
+
+
+        /**
+         * @brief Read an image file and convert it to another color space. The same as cv::imread() 
+         *        followed by cv::cvtColor(), but JPEG files are decoded straight to grayscale or YCrCb 
+         *        with readJpegColorSpace()
+         *
+         * @param filePath full path to image file
+         * @param code color space conversion code used with cv::cvtColor() on the BGR image, e.g. 
+         *             cv::COLOR_BGR2GRAY, cv::COLOR_BGR2YCrCb or cv::COLOR_BGR2HSV
+         * @return cv::Mat converted image. Empty if the file could not be read
+         */
+        cv::Mat imreadColorSpace(const std::string& filePath, int code)
+        {
+            cv::Mat image;
+            if (readJpegColorSpace(filePath, code, image))
+            {
+                return image;
+            }
+
+            // Other files are decoded by OpenCV. Decoders can make grayscale images themselves
+            if (code == cv::COLOR_BGR2GRAY)
+            {
+                return cv::imread(filePath, cv::IMREAD_GRAYSCALE);
+            }
+
+            image = cv::imread(filePath, cv::IMREAD_COLOR);
+            if (!image.empty())
+            {
+                cv::cvtColor(image, image, code);
+            }
+
+            return image;
+        }
+    }
+
+    namespace ImageCache {
+
+        /**
+         * @brief Create an empty cache
+         * 
+         * @param capacity memory budget: limit on the total size of the images held, in bytes
+         * @param shards no. of independently locked parts of the cache
+         */
+        DecodedImageCache::DecodedImageCache(std::size_t capacity, int shards) 
+            : m_capacity {capacity}
+        {
+            for (int i {0}; i < std::max(shards, 1); ++i)
+            {
+                m_shards.push_back(std::make_unique<Shard>());
+            }
+        }
+
+
+        /**
+         * @brief The cache shared by the whole program. Its memory budget starts at 512 MB
+         */
+        DecodedImageCache& DecodedImageCache::instance()
+        {
+            static DecodedImageCache cache(static_cast<std::size_t>(512) * 1024 * 1024);
+
+            return cache;
+        }
+
+
+        DecodedImageCache::Shard& DecodedImageCache::shardOf(const std::string& key)
+        {
+            return *m_shards[std::hash<std::string>{}(key) % m_shards.size()];
+        }
+
+
+        /**
+         * @brief Read an image as cv::imread() does. The image is taken from the cache if it was 
+         *        decoded with the same flags and its file has not changed since
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes flags for cv::imread()
+         * @return cv::Mat image sharing its pixels with the cache. Empty if the image could not be read
+         */
+        cv::Mat DecodedImageCache::imread(const std::string& filePath, int flags)
+        {
+            // The file is checked on every read, so a changed file is never served from the cache
+            std::error_code error;
+            const auto writeTime { std::filesystem::last_write_time(filePath, error) };
+            const std::uintmax_t fileSize { error ? 0 : std::filesystem::file_size(filePath, error) };
+            if (error)
+            {
+                ++m_misses;
+
+                return cv::imread(filePath, flags);
+            }
+
+            const std::int64_t writeTicks { static_cast<std::int64_t>(writeTime.time_since_epoch().count()) };
+            const std::string key { std::to_string(flags) + '|' + filePath };
+            Shard& shard { shardOf(key) };
+
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+
+                const auto found { shard.index.find(key) };
+                if (found != shard.index.end())
+                {
+                    Entry& entry { *found->second };
+                    if ((entry.writeTime == writeTicks) && (entry.fileSize == fileSize))
+                    {
+                        entry.lastUsed = ++m_clock;
+                        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+                        ++m_hits;
+
+                        return entry.image;
+                    }
+
+                    // The file has changed since it was decoded
+                    m_bytes -= entry.bytes;
+                    --m_images;
+                    ++m_invalidations;
+                    shard.entries.erase(found->second);
+                    shard.index.erase(found);
+                }
+            }
+
+            // Decode without holding the lock. Two threads missing the same image both decode it
+            ++m_misses;
+            cv::Mat image { cv::imread(filePath, flags) };
+            const std::size_t bytes { image.total() * image.elemSize() };
+            if (image.empty() || (bytes > m_capacity.load()))
+            {
+                return image;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+
+                const auto found { shard.index.find(key) };
+                if (found != shard.index.end())
+                {
+                    m_bytes -= found->second->bytes;
+                    --m_images;
+                    shard.entries.erase(found->second);
+                    shard.index.erase(found);
+                }
+
+                shard.entries.push_front(Entry{ key, writeTicks, fileSize, image, bytes, ++m_clock });
+                shard.index[key] = shard.entries.begin();
+                m_bytes += bytes;
+                ++m_images;
+            }
+
+            evict();
+
+            return image;
+        }
+
+
+        /**
+         * @brief Remove the least recently used images until the images held fit in the memory budget. 
+         *        The least recently used image is at the back of one of the shards. Only one shard 
+         *        is locked at a time
+         */
+        void DecodedImageCache::evict()
+        {
+            while (m_bytes.load() > m_capacity.load())
+            {
+                Shard* oldest {nullptr};
+                std::uint64_t oldestUse {UINT64_MAX};
+                for (auto& shard : m_shards)
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    if (!shard->entries.empty() && (shard->entries.back().lastUsed < oldestUse))
+                    {
+                        oldestUse = shard->entries.back().lastUsed;
+                        oldest = shard.get();
+                    }
+                }
+
+                if (oldest == nullptr)
+                {
+                    return; // the cache is empty
+                }
+
+                // Another thread may have read or removed the image since, so the back of 
+                // the shard is removed whatever it now holds
+                std::lock_guard<std::mutex> lock(oldest->mutex);
+                if (m_bytes.load() <= m_capacity.load())
+                {
+                    return; // another thread made room first
+                }
+                if (oldest->entries.empty())
+                {
+                    continue;
+                }
+
+                const Entry& entry { oldest->entries.back() };
+                m_bytes -= entry.bytes;
+                --m_images;
+                ++m_evictions;
+                oldest->index.erase(entry.key);
+                oldest->entries.pop_back();
+            }
+        }
+
+
+        /**
+         * @brief Change the memory budget, removing the least recently used images until they fit
+         * 
+         * @param capacity limit on the total size of the images held, in bytes
+         */
+        void DecodedImageCache::setCapacity(std::size_t capacity)
+        {
+            m_capacity = capacity;
+
+            evict();
+        }
+
+
+        void DecodedImageCache::clear()
+        {
+            for (auto& shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                for (const auto& entry : shard->entries)
+                {
+                    m_bytes -= entry.bytes;
+                    --m_images;
+                }
+                shard->entries.clear();
+                shard->index.clear();
+            }
+        }
+
+
+        Statistics DecodedImageCache::statistics() const
+        {
+            Statistics statistics;
+            statistics.hits = m_hits.load();
+            statistics.misses = m_misses.load();
+            statistics.evictions = m_evictions.load();
+            statistics.invalidations = m_invalidations.load();
+            statistics.images = m_images.load();
+            statistics.bytes = m_bytes.load();
+
+            return statistics;
+        }
+
+
+        /**
+         * @brief Read an image through the cache shared by the whole program, DecodedImageCache::instance()
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes flags for cv::imread()
+         * @return cv::Mat image sharing its pixels with the cache. Do not change the pixels
+         */
+        cv::Mat imread(const std::string& filePath, int flags)
+        {
+            return DecodedImageCache::instance().imread(filePath, flags);
+        }
+    }
+}
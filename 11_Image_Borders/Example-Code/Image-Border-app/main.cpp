@@ -3,6 +3,7 @@
 #include <opencv2/core/utility.hpp> // for command line or terminal inputs
 #include "opencv2/core/persistence.hpp" // for cv::FileStorage
 #include "opencv2/imgproc.hpp" // for cv::rectangle()
+#include "opencv2/imgcodecs.hpp" // for cv::imread()
 
 #include "UtilityFunctions/utility_functions.h" // functions from our own library
 
@@ -11,6 +12,7 @@
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <filesystem>
 
 /**
  * @brief Returns a string describing how an image border type is created
@@ -26,7 +28,9 @@ int main(int argc, char* argv[])
 
     const cv::String keys = 
         "{help h usage ? | | Create a border around a region of interest }"
-        "{path | <none> | Full path to file with input data (must have extension e.g. .xml, .yaml, .yml or .json) }";
+        "{path | <none> | Full path to file with input data (must have extension e.g. .xml, .yaml, .yml or .json) }"
+        "{list | | Headless mode: text file with the full path to an image on each line. The ROI and border from the input data file are applied to every image }"
+        "{outDir | | Directory to save images with borders to instead of displaying them }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -38,6 +42,8 @@ int main(int argc, char* argv[])
     //----------------------------- Extract command line arguments into program
 
     cv::String pathToInputFile = parser.get<cv::String>("path");
+    cv::String listPath = parser.get<cv::String>("list");
+    cv::String outputDirectory = parser.get<cv::String>("outDir");
 
     // Check for any errors encountered during arguments extraction
     if (!parser.check())
@@ -46,6 +52,12 @@ int main(int argc, char* argv[])
         return -1; // early exit from function
     }
 
+    if (!listPath.empty() && outputDirectory.empty())
+    {
+        std::cout << "\nERROR: Please provide a directory to save the images to (outDir).\n";
+        return -1;
+    }
+
     // Since we can only read from 5 file types we need to check if file
     // path provided by user is valid. We first call the function to 
     // extract the file extension
@@ -177,6 +189,73 @@ int main(int argc, char* argv[])
     std::cout << "\n\nFinished reading data from file " 
             << pathToInputFile << '\n';
 
+    // If using a constant value for the border convert to cv::Scalar
+    const cv::Scalar constantBorderValue {constantValue, constantValue, constantValue};
+
+    cv::Rect area {topLeftCornerCoordinates, bottomRightCornerCoordinates};
+
+    //------------------------ Headless Mode ----------------------------------//
+
+    // Create the border for every image in the list and save it to disk, 
+    // timing each stage of the work. No display windows are created.
+    if (!listPath.empty())
+    {
+        const auto inputs { CPP_CV::Headless::readInputList(listPath) };
+        if (!inputs || !CPP_CV::Headless::createOutputDirectory(outputDirectory))
+        {
+            return -1;
+        }
+
+        CPP_CV::Headless::StageTimer timer;
+        cv::TickMeter wallTime;
+        wallTime.start();
+
+        int processed {0};
+
+        for (const auto& path : *inputs)
+        {
+            timer.start("decode");
+            cv::Mat image = cv::imread(path, cv::IMREAD_ANYCOLOR);
+            timer.stop();
+
+            if (image.empty())
+            {
+                std::cout << "\nERROR: Could not read image data from " << path << '\n';
+                continue;
+            }
+
+            // The ROI must fit inside each image in the list
+            if ((area & cv::Rect(0, 0, image.cols, image.rows)) != area)
+            {
+                std::cout << "\nERROR: ROI lies outside image " << path << '\n';
+                continue;
+            }
+
+            timer.start("process");
+            cv::Mat imageWithBorder;
+            cv::copyMakeBorder(image(area), imageWithBorder, 
+                               topBorderSize, bottomBorderSize, leftBorderSize, rightBorderSize,
+                               borderType | cv::BORDER_ISOLATED, constantBorderValue);
+            timer.stop();
+
+            const std::string fileName { std::filesystem::path(path).stem().string() + "_border.png" };
+            if (CPP_CV::Headless::writeResult(outputDirectory, fileName, imageWithBorder, timer))
+            {
+                ++processed;
+            }
+        }
+
+        wallTime.stop();
+
+        std::cout << "\nCreated borders for " << processed << " images in " << wallTime.getTimeSec() << " s ("
+                  << processed / wallTime.getTimeSec() << " images/s)\n";
+        timer.print();
+
+        std::cout << '\n';
+
+        return 0;
+    }
+
     //--------------------- 3. Read source image data -------------------------//
 
     cv::Mat inputImage = cv::imread(imagePath, cv::IMREAD_ANYCOLOR);
@@ -209,11 +288,12 @@ int main(int argc, char* argv[])
         );
 
     // Display original source image with ROI
-    cv::imshow("Input image with ROI (BGR format)", copyOfSourceImage);
+    if (outputDirectory.empty())
+    {
+        cv::imshow("Input image with ROI (BGR format)", copyOfSourceImage);
+    }
 
     //--------------- 4. Create our ROI as a view of the parent image ---------//
-    
-    cv::Rect area {topLeftCornerCoordinates, bottomRightCornerCoordinates};
 
     cv::Mat regionOfInterest = inputImage(area); 
 
@@ -223,15 +303,15 @@ int main(int argc, char* argv[])
             << CPP_CV::General::openCVDescriptiveDataType(regionOfInterest.type())
             << '\n';
 
-    cv::imshow("ROI", regionOfInterest);
+    if (outputDirectory.empty())
+    {
+        cv::imshow("ROI", regionOfInterest);
+    }
 
     // ------------------------ Create border around ROI ---------------- //
 
     cv::Mat dst; // Output image with border added to it
 
-    // If using a constant value for the border convert to cv::Scalar
-    const cv::Scalar constantBorderValue {constantValue, constantValue, constantValue};
-
     cv::copyMakeBorder(
         regionOfInterest,                   // Image defining ROI
         dst,                                // Output image with border added to it
@@ -249,6 +329,24 @@ int main(int argc, char* argv[])
             << CPP_CV::General::openCVDescriptiveDataType(dst.type())
             << '\n';
 
+    // Save ROI image with border instead of displaying it if the user provided a directory
+    if (!outputDirectory.empty())
+    {
+        CPP_CV::Headless::StageTimer timer;
+        const std::string fileName { std::filesystem::path(imagePath).stem().string() + "_border.png" };
+        if (!CPP_CV::Headless::createOutputDirectory(outputDirectory) || 
+            !CPP_CV::Headless::writeResult(outputDirectory, fileName, dst, timer))
+        {
+            std::cout << "\nERROR: Could not save image with border.\n";
+            return -1;
+        }
+
+        timer.print();
+        std::cout << '\n';
+
+        return 0;
+    }
+
     // Display ROI image with border       
     auto borderDescription = std::string(imageBorderDescription(borderType));
     cv::imshow(borderDescription, dst);
@@ -0,0 +1,186 @@
+// Program: out_of_core_border.cpp
+
+/*
+ * Program adds a border around an image that is too large to load into memory with
+ * cv::imread(), e.g. a 60,000 x 60,000 16-bit 4 channel survey mosaic (~29 GB).
+ *
+ * The image is read from a TIFF file a block of tiles at a time and the result is written
+ * to a tiled TIFF file a block at a time, so memory use stays below the limit we set no
+ * matter how large the image is. Each output block is read from the input with the same
+ * border types cv::copyMakeBorder() uses, which fills in the pixels beyond the image edges.
+ *
+ * Instead of adding a border the program can also blur the image with a box filter. Each
+ * block is then read with extra pixels (the filter radius) on every side, so the result
+ * is the same as blurring the whole image at once. Here the border type decides how pixels
+ * beyond the image edges are filled, as it does for cv::blur().
+ *
+ * Program inputs are provided through the command line
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core types
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgproc.hpp"         // for cv::blur()
+
+#include "UtilityFunctions/utility_functions.h" // for TiledTiffSource, TiledTiffSink and processBlocks()
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to input TIFF file
+     *      2. Full path to output TIFF file
+     *      3. Size of top, bottom, left and right borders
+     *      4. Border type and the value of constant borders
+     *      5. Size of box filter. If > 0 the image is blurred instead of given a border
+     *      6. Memory limit, tile size and compression of output file
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Add a border to an image that does not fit in memory }"
+        "{@input | <none> | full path to input TIFF file }"
+        "{@output | <none> | full path to output tiled TIFF file }"
+        "{top | 0 | size of top border in pixels }"
+        "{bottom | 0 | size of bottom border in pixels }"
+        "{left | 0 | size of left border in pixels }"
+        "{right | 0 | size of right border in pixels }"
+        "{borderType | 0 | 0 = constant, 1 = replicate, 2 = reflect, 3 = wrap, 4 = reflect 101 }"
+        "{value | 0 | value of every channel of a constant border }"
+        "{blurSize | 0 | if > 0, blur the image with a blurSize x blurSize box filter instead of adding a border }"
+        "{memoryLimit | 256 | limit on image data held in memory, in MB }"
+        "{tileSize | 256 | width and height of output tiles (multiple of 16) }"
+        "{compression | 8 | output compression: 1 = none, 5 = LZW, 8 = Deflate }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nAdd a border to (or blur) a TIFF image of any size, a block of tiles at a time.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String inputPath = parser.get<cv::String>("@input");
+    cv::String outputPath = parser.get<cv::String>("@output");
+    int top = parser.get<int>("top");
+    int bottom = parser.get<int>("bottom");
+    int left = parser.get<int>("left");
+    int right = parser.get<int>("right");
+    int borderType = parser.get<int>("borderType");
+    double value = parser.get<double>("value");
+    int blurSize = parser.get<int>("blurSize");
+    int memoryLimit = parser.get<int>("memoryLimit");
+    int tileSize = parser.get<int>("tileSize");
+    int compression = parser.get<int>("compression");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if ((top < 0) || (bottom < 0) || (left < 0) || (right < 0) || (borderType < cv::BORDER_CONSTANT) ||
+        (borderType > cv::BORDER_REFLECT_101) || (blurSize < 0) || (memoryLimit <= 0) || (tileSize <= 0) ||
+        ((compression != 1) && (compression != 5) && (compression != 8)))
+    {
+        std::cerr << "\nBorder sizes and blur size should not be negative, border type should be 0 to 4, "
+                  << "memory limit and tile size should be greater than 0, and compression should be 1, 5 or 8.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Open Input and Output Files ///////////////////////////////
+
+    // Only the TIFF header is read here, not the image data
+    CPP_CV::TiledImages::TiledTiffSource source(inputPath);
+    if (!source.isOpen())
+    {
+        return -1;
+    }
+
+    // A border makes the output image larger than the input image
+    const cv::Size outputSize { blurSize > 0 ? source.size()
+                                             : cv::Size(source.size().width + left + right, source.size().height + top + bottom) };
+
+    CPP_CV::TiledImages::TiledTiffSink sink(outputPath, outputSize, source.type(), tileSize,
+                                            static_cast<CPP_CV::TiledImages::TiffCompression>(compression));
+    if (!sink.isOpen())
+    {
+        return -1;
+    }
+
+    std::cout << "\nInput image (width x height): " << source.size().width << " x " << source.size().height
+              << "\nInput tile size: " << source.tileSize().width << " x " << source.tileSize().height
+              << "\nOutput image (width x height): " << outputSize.width << " x " << outputSize.height
+              << "\nMemory limit: " << memoryLimit << " MB\n";
+
+    //---------------------- End of Open Input and Output Files -------------------//
+
+    ///////////////////////////// 3. Process Image a Block at a Time ///////////////////////////////
+
+    const std::size_t memoryLimitBytes { static_cast<std::size_t>(memoryLimit) << 20 };
+    const cv::Scalar borderValue { value, value, value, value };
+
+    cv::TickMeter timer;
+    timer.start();
+
+    bool result {false};
+
+    try
+    {
+        if (blurSize > 0)
+        {
+            // The filter needs blurSize / 2 pixels on each side of a block
+            result = CPP_CV::TiledImages::processTiles(source, sink, blurSize / 2,
+                                                       [blurSize, borderType](const cv::Mat& input, cv::Mat& output) {
+                                                           cv::blur(input, output, cv::Size(blurSize, blurSize),
+                                                                    cv::Point(-1, -1), borderType);
+                                                       },
+                                                       memoryLimitBytes, borderType);
+        }
+        else
+        {
+            /*
+             * Output pixel (x, y) is input pixel (x - left, y - top). Reading that region
+             * from the source fills anything beyond the input image with the border
+            */
+            result = CPP_CV::TiledImages::processBlocks(sink,
+                                                        [&](const cv::Rect& region, cv::Mat& block) {
+                                                            const cv::Rect inputRegion { region.x - left, region.y - top,
+                                                                                         region.width, region.height };
+                                                            return source.read(inputRegion, block, borderType, borderValue);
+                                                        },
+                                                        memoryLimitBytes, 1.0);
+        }
+
+        result = sink.close() && result;
+    }
+    catch (const cv::Exception& ex)
+    {
+        std::cerr << "\nERROR: " << ex.what();
+    }
+
+    timer.stop();
+
+    if (!result)
+    {
+        std::cerr << "\nERROR: Could not create " << outputPath << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nSaved " << outputPath << " in " << timer.getTimeSec() << " s"
+              << "\nInput tiles decoded: " << source.tilesDecoded() << '\n';
+
+    //---------------------- End of Process Image a Block at a Time -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
@@ -12,6 +12,13 @@
 #include <fstream>    // for std::ifstream
 #include <iterator>   // for std::istream_iterator
 #include <algorithm>  // for std::copy
+#include <memory>     // for std::unique_ptr
+#include <functional> // for std::function
+#include <cstdint>    // for std::uint64_t
+#include <optional>   // for std::optional
+
+// libtiff file handle (TIFF). Declared here so users of this header do not need tiffio.h
+struct tiff;
 
 namespace CPP_CV {
 
@@ -556,6 +563,304 @@ namespace CPP_CV {
          */
         cv::Scalar pixelValue_C4(const cv::Mat& image, int type, int y, int x);
     }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Measures the wall time spent in each stage of a batch job (e.g. decode, 
+         *        process, encode, write) over many images. Stages are printed in the 
+         *        order they were first timed.
+         */
+        class StageTimer 
+        {
+        public:
+
+            /**
+             * @brief Start timing a stage. A stage that is still being timed is stopped first.
+             * 
+             * @param stage name of stage e.g. "decode"
+             */
+            void start(const std::string& stage);
+
+
+            /**
+             * @brief Stop timing the current stage and add its time to the stage total
+             */
+            void stop();
+
+
+            /**
+             * @brief Print the no. of runs, total time, mean time and share of the 
+             *        total time of each stage
+             * 
+             * @param out stream to print to e.g. std::cout
+             */
+            void print(std::ostream& out = std::cout) const;
+
+        private:
+
+            struct Stage 
+            {
+                std::string name;
+                int count {0};                  // no. of times the stage was timed
+                double totalMilliseconds {0.0}; // total time spent in the stage
+            };
+
+            std::vector<Stage> m_stages;    // stages in the order they were first timed
+            std::string m_currentStage;     // stage being timed. Empty if no stage is being timed
+            int64 m_startTicks {0};         // value of cv::getTickCount() when the current stage started
+        };
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened (a message is printed to std::cerr)
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath);
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise (a message is printed to std::cerr)
+         */
+        bool createOutputDirectory(const std::string& outputDirectory);
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer);
+    }
+
+    namespace TiledImages {
+
+        /*
+         * Out-of-core processing of images that are too large to load with cv::imread().
+         *
+         * A TiledTiffSource decodes only the TIFF tiles (or strips) that cover the region
+         * we ask for, and a TiledTiffSink writes the result one block of tiles at a time.
+         * processBlocks() and processTiles() walk over the output in blocks sized so the
+         * data held in memory stays below a memory limit, and run our own kernel on each block.
+        */
+
+        /**
+         * @brief Default limit, in bytes, on the image data processBlocks() and processTiles()
+         *        hold in memory at any one time
+         */
+        constexpr std::size_t defaultMemoryLimit {std::size_t{256} << 20};
+
+        /**
+         * @brief TIFF compression schemes supported by TiledTiffSink. Values are the TIFF tag values
+         */
+        enum class TiffCompression
+        {
+            none = 1,       // no compression
+            lzw = 5,        // lossless
+            jpeg = 7,       // lossy, 8-bit images with 1 or 3 channels only
+            deflate = 8     // lossless, same algorithm as PNG/zlib
+        };
+
+        /**
+         * @brief Closes a libtiff file handle. Lets us keep the handle in a std::unique_ptr
+         *        without including tiffio.h in this header
+         */
+        struct TiffCloser
+        {
+            void operator()(tiff* handle) const;
+        };
+
+
+        /**
+         * @brief Reads any region of a TIFF file without loading the whole image. Tiled TIFF
+         *        files are read most efficiently, but striped files also work.
+         */
+        class TiledTiffSource
+        {
+        public:
+
+            /**
+             * @brief Open the first page of a TIFF file. Use isOpen() to check if it succeeded
+             *
+             * @param filePath full path to TIFF file
+             */
+            explicit TiledTiffSource(const std::string& filePath);
+
+            /**
+             * @brief Check if the file was opened and has a pixel layout we can read
+             *        (1 to 4 interleaved channels of a type OpenCV supports)
+             */
+            bool isOpen() const { return static_cast<bool>(m_tiff); }
+
+            cv::Size size() const { return m_size; }          // image width and height
+            int type() const { return m_type; }               // OpenCV type e.g. CV_16UC4
+            cv::Size tileSize() const { return m_tileSize; }  // size of a tile, or of a strip (full image width)
+            std::uint64_t tilesDecoded() const { return m_tilesDecoded; } // no. of tiles or strips decoded so far
+
+            /**
+             * @brief Read a region of the image. Colour images are returned in BGR(A) order.
+             *
+             * @param region region to read. Parts of the region outside the image are filled
+             *               the same way as cv::copyMakeBorder()
+             * @param block output image, the size of region
+             * @param borderType cv::BORDER_CONSTANT, cv::BORDER_REPLICATE, cv::BORDER_REFLECT,
+             *                   cv::BORDER_WRAP or cv::BORDER_REFLECT_101
+             * @param value value of pixels outside the image when borderType is cv::BORDER_CONSTANT
+             * @return true if the region was read
+             * @return false if the region is empty, the border type is not supported or a tile could not be decoded
+             */
+            bool read(const cv::Rect& region, cv::Mat& block,
+                      int borderType = cv::BORDER_CONSTANT, const cv::Scalar& value = cv::Scalar());
+
+        private:
+
+            /**
+             * @brief Decode a tile (or strip) into m_tileBuffer, unless it is already there
+             *
+             * @param tileColumn column of tile in the tile grid. Always 0 for striped files
+             * @param tileRow row of tile in the tile grid
+             * @return true if the tile was decoded
+             * @return false otherwise
+             */
+            bool decodeTile(int tileColumn, int tileRow);
+
+            std::unique_ptr<tiff, TiffCloser> m_tiff;   // open file. Empty if the file could not be opened
+            cv::Size m_size;                            // image width and height
+            int m_type {-1};                            // OpenCV type of the image
+            cv::Size m_tileSize;                        // size of a tile or strip
+            bool m_tiled {false};                       // true for tiled files, false for striped files
+            bool m_rgb {false};                         // true if the file stores colour as RGB(A)
+            std::vector<uchar> m_tileBuffer;            // last tile decoded
+            cv::Point m_bufferedTile {-1, -1};          // column and row of the tile in m_tileBuffer
+            std::uint64_t m_tilesDecoded {0};
+        };
+
+
+        /**
+         * @brief Writes an image to a tiled TIFF file one block of tiles at a time.
+         *        Big TIFF is used for images of 3 GB or more.
+         */
+        class TiledTiffSink
+        {
+        public:
+
+            /**
+             * @brief Create a tiled TIFF file. Use isOpen() to check if it succeeded
+             *
+             * @param filePath full path to TIFF file
+             * @param size image width and height
+             * @param type OpenCV type of image, with 1 to 4 channels. CV_16F is not supported
+             * @param tileSize width and height of tiles. Rounded up to a multiple of 16
+             * @param compression compression scheme. LZW and Deflate also use a predictor
+             */
+            TiledTiffSink(const std::string& filePath, cv::Size size, int type,
+                          int tileSize = 256, TiffCompression compression = TiffCompression::deflate);
+
+            /**
+             * @brief Write the directory of any image that close() was not called for
+             */
+            ~TiledTiffSink();
+
+            bool isOpen() const { return static_cast<bool>(m_tiff); }
+            cv::Size size() const { return m_size; }          // image width and height
+            int type() const { return m_type; }               // OpenCV type e.g. CV_16UC4
+            cv::Size tileSize() const { return m_tileSize; }  // width and height of tiles
+
+            /**
+             * @brief Write a block of whole tiles to the file
+             *
+             * @param origin top left corner of the block in the image. Must be on a tile boundary
+             * @param block image data in BGR(A) order with the sink's type. The block must end
+             *              on a tile boundary or at the right/bottom edge of the image
+             * @return true if the block was written
+             * @return false otherwise
+             */
+            bool write(const cv::Point& origin, const cv::Mat& block);
+
+            /**
+             * @brief Finish writing the file
+             *
+             * @return true if every tile was written and the file was closed without errors
+             * @return false otherwise
+             */
+            bool close();
+
+        private:
+
+            std::unique_ptr<tiff, TiffCloser> m_tiff;   // open file. Empty once the file is closed
+            std::string m_filePath;
+            cv::Size m_size;
+            int m_type {-1};
+            cv::Size m_tileSize;
+            std::vector<uchar> m_tileBuffer;            // one tile in TIFF (RGB) channel order
+            std::uint64_t m_tilesWritten {0};
+            bool m_failed {false};                      // true once any write has failed
+        };
+
+
+        /**
+         * @brief Kernel run by processBlocks() on each block of the output image.
+         *        It must fill block, which already has the sink's size and type.
+         *        Return false to stop processing
+         */
+        using BlockKernel = std::function<bool(const cv::Rect& region, cv::Mat& block)>;
+
+        /**
+         * @brief Kernel run by processTiles() on each overlapping tile of the input image.
+         *        output must be the same size as input (the overlap is then cropped), or
+         *        the size of input minus the overlap on every side
+         */
+        using TileKernel = std::function<void(const cv::Mat& input, cv::Mat& output)>;
+
+
+        /**
+         * @brief Produce an image block by block and write it to a sink. Blocks are whole
+         *        tiles of the sink, as large as the memory limit allows.
+         *
+         * @param sink file to write to
+         * @param kernel fills each block of the output image
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param buffersPerBlock no. of block sized images the kernel holds at one time, including
+         *                        the output block e.g. 3 for blending two images
+         * @return true if every block was produced and written
+         * @return false otherwise
+         */
+        bool processBlocks(TiledTiffSink& sink, const BlockKernel& kernel,
+                           std::size_t memoryLimit = defaultMemoryLimit, double buffersPerBlock = 2.0);
+
+        /**
+         * @brief Run a kernel (e.g. a filter) over an image that does not fit in memory.
+         *        Each block is read with 'overlap' extra pixels on every side so results
+         *        along block edges are the same as processing the whole image at once.
+         *
+         * @param source image to read. Must be the same size as sink
+         * @param sink file to write result to
+         * @param overlap no. of extra pixels read on each side of a block e.g. the kernel radius of a filter
+         * @param kernel operation run on each block
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param borderType how pixels beyond the image edges are filled (see TiledTiffSource::read())
+         * @return true if the whole image was processed
+         * @return false otherwise
+         */
+        bool processTiles(TiledTiffSource& source, TiledTiffSink& sink, int overlap, const TileKernel& kernel,
+                          std::size_t memoryLimit = defaultMemoryLimit, int borderType = cv::BORDER_REFLECT_101);
+    }
 }
 
 
@@ -1,7 +1,15 @@
 #include "UtilityFunctions/utility_functions.h"
 
 
+#include "opencv2/imgcodecs.hpp" // for cv::imencode()
+
 #include <filesystem> // handles files
+#include <fstream>    // for std::ifstream, std::ofstream
+#include <iomanip>    // for std::setw
+#include <algorithm>  // for std::find_if, std::copy_n, std::swap_ranges
+#include <cmath>      // for std::sqrt
+
+#include <tiffio.h>   // for libtiff tiled reads and writes
 
 namespace CPP_CV {
 
@@ -294,4 +302,788 @@ namespace CPP_CV {
         }
 
     }
-}
\ No newline at end of file
+
+
+    namespace Headless {
+
+        /**
+         * @brief Start timing a stage. A stage that is still being timed is stopped first.
+         * 
+         * @param stage name of stage e.g. "decode"
+         */
+        void StageTimer::start(const std::string& stage)
+        {
+            stop();
+
+            m_currentStage = stage;
+            m_startTicks = cv::getTickCount();
+        }
+
+
+        /**
+         * @brief Stop timing the current stage and add its time to the stage total
+         */
+        void StageTimer::stop()
+        {
+            if (m_currentStage.empty())
+            {
+                return; // no stage is being timed
+            }
+
+            const double milliseconds { (cv::getTickCount() - m_startTicks) * 1000.0 / cv::getTickFrequency() };
+
+            auto found { std::find_if(m_stages.begin(), m_stages.end(), 
+                                      [this](const Stage& s) { return s.name == m_currentStage; }) };
+            if (found == m_stages.end())
+            {
+                m_stages.push_back(Stage { m_currentStage, 0, 0.0 });
+                found = m_stages.end() - 1;
+            }
+
+            ++found->count;
+            found->totalMilliseconds += milliseconds;
+
+            m_currentStage.clear();
+        }
+
+
+        /**
+         * @brief Print the no. of runs, total time, mean time and share of the 
+         *        total time of each stage
+         * 
+         * @param out stream to print to e.g. std::cout
+         */
+        void StageTimer::print(std::ostream& out) const
+        {
+            double totalMilliseconds {0.0};
+            for (const auto& stage : m_stages)
+            {
+                totalMilliseconds += stage.totalMilliseconds;
+            }
+
+            out << "\nStage       Runs    Total (ms)    Mean (ms)    Share\n";
+
+            for (const auto& stage : m_stages)
+            {
+                out << std::left << std::setw(10) << stage.name << std::right 
+                    << std::setw(6) << stage.count 
+                    << std::fixed << std::setprecision(2)
+                    << std::setw(14) << stage.totalMilliseconds 
+                    << std::setw(13) << stage.totalMilliseconds / stage.count 
+                    << std::setw(8) << std::setprecision(1) 
+                    << ((totalMilliseconds > 0) ? 100.0 * stage.totalMilliseconds / totalMilliseconds : 0.0) << " %\n";
+            }
+
+            out << std::left << std::setw(10) << "total" << std::right << std::setw(20) 
+                << std::setprecision(2) << totalMilliseconds << '\n';
+        }
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath)
+        {
+            std::vector<std::string> inputs;
+
+            std::ifstream file(listPath);
+            if (!file)
+            {
+                std::cerr << "\nCould not open list of inputs: " << listPath << '\n';
+
+                return std::nullopt;
+            }
+
+            std::string line;
+            while (std::getline(file, line))
+            {
+                // Remove trailing white space, including '\r' from files saved on Windows
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+
+                if (!line.empty() && (line[0] != '#'))
+                {
+                    inputs.push_back(line);
+                }
+            }
+
+            return inputs;
+        }
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise
+         */
+        bool createOutputDirectory(const std::string& outputDirectory)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(outputDirectory, error);
+
+            if (error || !std::filesystem::is_directory(outputDirectory, error))
+            {
+                std::cerr << "\nCould not create output directory " << outputDirectory 
+                          << (error ? ": " + error.message() : std::string()) << '\n';
+
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer)
+        {
+            std::filesystem::path savePath { outputDirectory };
+            savePath /= fileName;
+
+            // a. Compress the image with the codec that matches the file extension
+            timer.start("encode");
+
+            std::vector<uchar> buffer;
+            bool result {false};
+            try 
+            {
+                result = cv::imencode(savePath.extension().string(), image, buffer);
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nError compressing " << fileName << ": " << ex.what();
+            }
+
+            timer.stop();
+
+            if (!result)
+            {
+                return false;
+            }
+
+            // b. Save the compressed image
+            timer.start("write");
+
+            std::ofstream file(savePath, std::ios::out | std::ios::binary);
+            file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            result = static_cast<bool>(file);
+            timer.stop();
+
+            return result;
+        }
+    }
+
+
+    namespace TiledImages {
+
+        /**
+         * @brief Swap the first and third channel of every pixel e.g. RGB <-> BGR
+         *
+         * @param data pixels
+         * @param pixels no. of pixels
+         * @param channels no. of channels in each pixel. Must be 3 or 4
+         * @param bytesPerChannel size of one channel in bytes
+         */
+        static void swapRedBlue(uchar* data, std::size_t pixels, int channels, std::size_t bytesPerChannel)
+        {
+            const std::size_t pixelBytes { channels * bytesPerChannel };
+            for (std::size_t i {0}; i < pixels; ++i, data += pixelBytes)
+            {
+                std::swap_ranges(data, data + bytesPerChannel, data + 2 * bytesPerChannel);
+            }
+        }
+
+
+        /**
+         * @brief Closes a libtiff file handle. Lets us keep the handle in a std::unique_ptr
+         *        without including tiffio.h in this header
+         */
+        void TiffCloser::operator()(tiff* handle) const
+        {
+            TIFFClose(handle);
+        }
+
+
+        /**
+         * @brief Open the first page of a TIFF file. Use isOpen() to check if it succeeded
+         *
+         * @param filePath full path to TIFF file
+         */
+        TiledTiffSource::TiledTiffSource(const std::string& filePath)
+            : m_tiff { TIFFOpen(filePath.c_str(), "r") }
+        {
+            if (!m_tiff)
+            {
+                std::cerr << "\nCould not open TIFF file " << filePath << '\n';
+                return;
+            }
+
+            TIFF* file { m_tiff.get() };
+
+            uint32_t width {0}, height {0};
+            uint16_t bitsPerSample {0}, samplesPerPixel {0}, sampleFormat {0}, planarConfig {0}, photometric {0}, compression {0};
+            TIFFGetField(file, TIFFTAG_IMAGEWIDTH, &width);
+            TIFFGetField(file, TIFFTAG_IMAGELENGTH, &height);
+            TIFFGetFieldDefaulted(file, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+            TIFFGetFieldDefaulted(file, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+            TIFFGetFieldDefaulted(file, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+            TIFFGetFieldDefaulted(file, TIFFTAG_PLANARCONFIG, &planarConfig);
+            TIFFGetFieldDefaulted(file, TIFFTAG_COMPRESSION, &compression);
+            TIFFGetField(file, TIFFTAG_PHOTOMETRIC, &photometric);
+
+            // Match the TIFF sample format and size to an OpenCV depth
+            int depth {-1};
+            switch (sampleFormat * 100 + bitsPerSample)
+            {
+                case SAMPLEFORMAT_UINT * 100 + 8:    depth = CV_8U;  break;
+                case SAMPLEFORMAT_INT * 100 + 8:     depth = CV_8S;  break;
+                case SAMPLEFORMAT_UINT * 100 + 16:   depth = CV_16U; break;
+                case SAMPLEFORMAT_INT * 100 + 16:    depth = CV_16S; break;
+                case SAMPLEFORMAT_INT * 100 + 32:    depth = CV_32S; break;
+                case SAMPLEFORMAT_IEEEFP * 100 + 32: depth = CV_32F; break;
+                case SAMPLEFORMAT_IEEEFP * 100 + 64: depth = CV_64F; break;
+                default: break;
+            }
+
+            // JPEG compressed files usually store YCbCr. libtiff converts it back to RGB for us
+            if ((photometric == PHOTOMETRIC_YCBCR) && (compression == COMPRESSION_JPEG))
+            {
+                TIFFSetField(file, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+                photometric = PHOTOMETRIC_RGB;
+            }
+
+            if ((width == 0) || (height == 0) || (depth < 0) || (samplesPerPixel < 1) || (samplesPerPixel > 4) ||
+                (planarConfig != PLANARCONFIG_CONTIG) ||
+                ((photometric != PHOTOMETRIC_MINISBLACK) && (photometric != PHOTOMETRIC_RGB)))
+            {
+                std::cerr << "\nUnsupported TIFF pixel layout in " << filePath
+                          << ". Only 1 to 4 interleaved grey or RGB channels can be read.\n";
+                m_tiff.reset();
+                return;
+            }
+
+            m_size = cv::Size(static_cast<int>(width), static_cast<int>(height));
+            m_type = CV_MAKETYPE(depth, samplesPerPixel);
+            m_rgb = (photometric == PHOTOMETRIC_RGB) && (samplesPerPixel >= 3);
+            m_tiled = TIFFIsTiled(file) != 0;
+
+            if (m_tiled)
+            {
+                uint32_t tileWidth {0}, tileHeight {0};
+                TIFFGetField(file, TIFFTAG_TILEWIDTH, &tileWidth);
+                TIFFGetField(file, TIFFTAG_TILELENGTH, &tileHeight);
+                m_tileSize = cv::Size(static_cast<int>(tileWidth), static_cast<int>(tileHeight));
+            }
+            else
+            {
+                uint32_t rowsPerStrip {0};
+                TIFFGetFieldDefaulted(file, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+                m_tileSize = cv::Size(m_size.width, static_cast<int>(std::min(rowsPerStrip, height)));
+            }
+
+            m_tileBuffer.resize(static_cast<std::size_t>(m_tileSize.area()) * CV_ELEM_SIZE(m_type));
+        }
+
+
+        /**
+         * @brief Decode a tile (or strip) into m_tileBuffer, unless it is already there
+         *
+         * @param tileColumn column of tile in the tile grid. Always 0 for striped files
+         * @param tileRow row of tile in the tile grid
+         * @return true if the tile was decoded
+         * @return false otherwise
+         */
+        bool TiledTiffSource::decodeTile(int tileColumn, int tileRow)
+        {
+            if (m_bufferedTile == cv::Point(tileColumn, tileRow))
+            {
+                return true;
+            }
+
+            TIFF* file { m_tiff.get() };
+            const tmsize_t bufferSize { static_cast<tmsize_t>(m_tileBuffer.size()) };
+
+            tmsize_t decoded {-1};
+            if (m_tiled)
+            {
+                const ttile_t tile { TIFFComputeTile(file, static_cast<uint32_t>(tileColumn * m_tileSize.width),
+                                                     static_cast<uint32_t>(tileRow * m_tileSize.height), 0, 0) };
+                decoded = TIFFReadEncodedTile(file, tile, m_tileBuffer.data(), bufferSize);
+            }
+            else
+            {
+                decoded = TIFFReadEncodedStrip(file, static_cast<uint32_t>(tileRow), m_tileBuffer.data(), bufferSize);
+            }
+
+            if (decoded < 0)
+            {
+                m_bufferedTile = cv::Point(-1, -1);
+                return false;
+            }
+
+            if (m_rgb)
+            {
+                swapRedBlue(m_tileBuffer.data(), static_cast<std::size_t>(m_tileSize.area()),
+                            CV_MAT_CN(m_type), CV_ELEM_SIZE1(m_type));
+            }
+
+            m_bufferedTile = cv::Point(tileColumn, tileRow);
+            ++m_tilesDecoded;
+
+            return true;
+        }
+
+
+        /**
+         * @brief Read a region of the image. Colour images are returned in BGR(A) order.
+         *
+         * @param region region to read. Parts of the region outside the image are filled
+         *               the same way as cv::copyMakeBorder()
+         * @param block output image, the size of region
+         * @param borderType cv::BORDER_CONSTANT, cv::BORDER_REPLICATE, cv::BORDER_REFLECT,
+         *                   cv::BORDER_WRAP or cv::BORDER_REFLECT_101
+         * @param value value of pixels outside the image when borderType is cv::BORDER_CONSTANT
+         * @return true if the region was read
+         * @return false if the region is empty, the border type is not supported or a tile could not be decoded
+         */
+        bool TiledTiffSource::read(const cv::Rect& region, cv::Mat& block, int borderType, const cv::Scalar& value)
+        {
+            borderType &= ~cv::BORDER_ISOLATED;
+            if (!m_tiff || region.empty() || (borderType < cv::BORDER_CONSTANT) || (borderType > cv::BORDER_REFLECT_101))
+            {
+                return false;
+            }
+
+            block.create(region.size(), m_type);
+
+            /*
+             * a. Find the image column and row each pixel of the block is copied from.
+             *    Pixels outside the image are mapped back inside with cv::borderInterpolate(),
+             *    which returns -1 for cv::BORDER_CONSTANT
+            */
+            auto sourceCoordinate = [borderType](int p, int length) {
+                return ((p >= 0) && (p < length)) ? p : cv::borderInterpolate(p, length, borderType);
+            };
+
+            const cv::Rect imageArea { cv::Point(0, 0), m_size };
+            if ((region & imageArea) != region)
+            {
+                block.setTo(value);
+            }
+
+            /*
+             * b. Group the columns by the tile they come from into spans of neighbouring pixels,
+             *    so each span is a single copy. Rows are grouped by tile row the same way.
+            */
+            struct Span
+            {
+                int blockX;     // first column in block
+                int imageX;     // first column in image
+                int length;     // no. of pixels
+            };
+
+            const int tileColumns { (m_size.width + m_tileSize.width - 1) / m_tileSize.width };
+            const int tileRows { (m_size.height + m_tileSize.height - 1) / m_tileSize.height };
+
+            std::vector<std::vector<Span>> spansInTileColumn(static_cast<std::size_t>(tileColumns));
+            for (int x {0}; x < region.width; ++x)
+            {
+                const int imageX { sourceCoordinate(region.x + x, m_size.width) };
+                if (imageX < 0)
+                {
+                    continue;
+                }
+
+                auto& spans { spansInTileColumn[static_cast<std::size_t>(imageX / m_tileSize.width)] };
+                if (!spans.empty() && (spans.back().blockX + spans.back().length == x) &&
+                    (spans.back().imageX + spans.back().length == imageX))
+                {
+                    ++spans.back().length;
+                }
+                else
+                {
+                    spans.push_back(Span {x, imageX, 1});
+                }
+            }
+
+            std::vector<std::vector<cv::Point>> rowsInTileRow(static_cast<std::size_t>(tileRows)); // (block row, image row)
+            for (int y {0}; y < region.height; ++y)
+            {
+                const int imageY { sourceCoordinate(region.y + y, m_size.height) };
+                if (imageY >= 0)
+                {
+                    rowsInTileRow[static_cast<std::size_t>(imageY / m_tileSize.height)].emplace_back(y, imageY);
+                }
+            }
+
+            // c. Decode each tile we need once, and copy its spans into the block
+            const std::size_t pixelBytes { block.elemSize() };
+            const std::size_t tileRowBytes { m_tileSize.width * pixelBytes };
+
+            for (int tileRow {0}; tileRow < tileRows; ++tileRow)
+            {
+                const auto& rows { rowsInTileRow[static_cast<std::size_t>(tileRow)] };
+                if (rows.empty())
+                {
+                    continue;
+                }
+
+                for (int tileColumn {0}; tileColumn < tileColumns; ++tileColumn)
+                {
+                    const auto& spans { spansInTileColumn[static_cast<std::size_t>(tileColumn)] };
+                    if (spans.empty())
+                    {
+                        continue;
+                    }
+
+                    if (!decodeTile(tileColumn, tileRow))
+                    {
+                        std::cerr << "\nCould not decode TIFF tile (" << tileColumn << ", " << tileRow << ")\n";
+                        return false;
+                    }
+
+                    const int tileX { tileColumn * m_tileSize.width };
+                    const int tileY { tileRow * m_tileSize.height };
+
+                    for (const cv::Point& row : rows)
+                    {
+                        const uchar* source { m_tileBuffer.data() + (row.y - tileY) * tileRowBytes };
+                        uchar* destination { block.ptr<uchar>(row.x) };
+
+                        for (const Span& span : spans)
+                        {
+                            std::copy_n(source + (span.imageX - tileX) * pixelBytes, span.length * pixelBytes,
+                                        destination + span.blockX * pixelBytes);
+                        }
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Create a tiled TIFF file. Use isOpen() to check if it succeeded
+         *
+         * @param filePath full path to TIFF file
+         * @param size image width and height
+         * @param type OpenCV type of image, with 1 to 4 channels. CV_16F is not supported
+         * @param tileSize width and height of tiles. Rounded up to a multiple of 16
+         * @param compression compression scheme. LZW and Deflate also use a predictor
+         */
+        TiledTiffSink::TiledTiffSink(const std::string& filePath, cv::Size size, int type,
+                                     int tileSize, TiffCompression compression)
+            : m_filePath {filePath}, m_size {size}, m_type {type}
+        {
+            const int depth { CV_MAT_DEPTH(type) };
+            const int channels { CV_MAT_CN(type) };
+
+            if ((size.width <= 0) || (size.height <= 0) || (tileSize <= 0) || (channels > 4) || (depth == CV_16F) ||
+                ((compression == TiffCompression::jpeg) && ((depth != CV_8U) || (channels == 2) || (channels == 4))))
+            {
+                std::cerr << "\nCannot save a " << General::openCVDescriptiveDataType(type)
+                          << " image with the chosen tiled TIFF options.\n";
+                return;
+            }
+
+            // Big TIFF ("w8") is needed once a file grows beyond 4 GB
+            const std::size_t totalBytes { static_cast<std::size_t>(size.width) * size.height * CV_ELEM_SIZE(type) };
+            m_tiff.reset(TIFFOpen(filePath.c_str(), totalBytes > (std::size_t{3} << 30) ? "w8" : "w"));
+            if (!m_tiff)
+            {
+                std::cerr << "\nCould not open " << filePath << " for writing.\n";
+                return;
+            }
+
+            TIFF* file { m_tiff.get() };
+
+            const int sampleFormat { (depth == CV_32F || depth == CV_64F) ? SAMPLEFORMAT_IEEEFP :
+                                     ((depth == CV_8S || depth == CV_16S || depth == CV_32S) ? SAMPLEFORMAT_INT : SAMPLEFORMAT_UINT) };
+
+            // Tiles must be a multiple of 16 pixels wide and high
+            const int tileSide { (tileSize + 15) / 16 * 16 };
+            m_tileSize = cv::Size(tileSide, tileSide);
+
+            TIFFSetField(file, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(size.width));
+            TIFFSetField(file, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(size.height));
+            TIFFSetField(file, TIFFTAG_BITSPERSAMPLE, static_cast<int>(CV_ELEM_SIZE1(type) * 8));
+            TIFFSetField(file, TIFFTAG_SAMPLESPERPIXEL, channels);
+            TIFFSetField(file, TIFFTAG_SAMPLEFORMAT, sampleFormat);
+            TIFFSetField(file, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            TIFFSetField(file, TIFFTAG_PHOTOMETRIC, channels >= 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(file, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+            TIFFSetField(file, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tileSide));
+            TIFFSetField(file, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tileSide));
+
+            if ((channels == 2) || (channels == 4))
+            {
+                const uint16_t extraSample[] { EXTRASAMPLE_UNASSALPHA };
+                TIFFSetField(file, TIFFTAG_EXTRASAMPLES, 1, extraSample);
+            }
+
+            TIFFSetField(file, TIFFTAG_COMPRESSION, static_cast<int>(compression));
+            if ((compression == TiffCompression::lzw) || (compression == TiffCompression::deflate))
+            {
+                // Store differences between neighbouring pixels, which compress far better
+                TIFFSetField(file, TIFFTAG_PREDICTOR, sampleFormat == SAMPLEFORMAT_IEEEFP ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL);
+            }
+
+            m_tileBuffer.resize(static_cast<std::size_t>(m_tileSize.area()) * CV_ELEM_SIZE(type));
+        }
+
+
+        /**
+         * @brief Write the directory of any image that close() was not called for
+         */
+        TiledTiffSink::~TiledTiffSink()
+        {
+            close();
+        }
+
+
+        /**
+         * @brief Write a block of whole tiles to the file
+         *
+         * @param origin top left corner of the block in the image. Must be on a tile boundary
+         * @param block image data in BGR(A) order with the sink's type. The block must end
+         *              on a tile boundary or at the right/bottom edge of the image
+         * @return true if the block was written
+         * @return false otherwise
+         */
+        bool TiledTiffSink::write(const cv::Point& origin, const cv::Mat& block)
+        {
+            const int right { origin.x + block.cols };
+            const int bottom { origin.y + block.rows };
+
+            if (!m_tiff || block.empty() || (block.type() != m_type) || (origin.x < 0) || (origin.y < 0) ||
+                (origin.x % m_tileSize.width != 0) || (origin.y % m_tileSize.height != 0) ||
+                (right > m_size.width) || (bottom > m_size.height) ||
+                ((right % m_tileSize.width != 0) && (right != m_size.width)) ||
+                ((bottom % m_tileSize.height != 0) && (bottom != m_size.height)))
+            {
+                std::cerr << "\nBlock at (" << origin.x << ", " << origin.y << ") does not line up with the tiles of "
+                          << m_filePath << '\n';
+                m_failed = true;
+                return false;
+            }
+
+            TIFF* file { m_tiff.get() };
+            const int channels { block.channels() };
+            const std::size_t pixelBytes { block.elemSize() };
+            const std::size_t tileRowBytes { m_tileSize.width * pixelBytes };
+
+            for (int y {0}; y < block.rows; y += m_tileSize.height)
+            {
+                for (int x {0}; x < block.cols; x += m_tileSize.width)
+                {
+                    const int width { std::min(m_tileSize.width, block.cols - x) };
+                    const int height { std::min(m_tileSize.height, block.rows - y) };
+
+                    // Tiles at the right and bottom edges of the image are padded with zeros
+                    if ((width < m_tileSize.width) || (height < m_tileSize.height))
+                    {
+                        std::fill(m_tileBuffer.begin(), m_tileBuffer.end(), uchar {0});
+                    }
+
+                    for (int row {0}; row < height; ++row)
+                    {
+                        const uchar* source { block.ptr<uchar>(y + row) + x * pixelBytes };
+                        std::copy_n(source, width * pixelBytes, m_tileBuffer.data() + row * tileRowBytes);
+                    }
+
+                    // TIFF stores colour images as RGB(A)
+                    if (channels >= 3)
+                    {
+                        swapRedBlue(m_tileBuffer.data(), static_cast<std::size_t>(m_tileSize.area()), channels, block.elemSize1());
+                    }
+
+                    const ttile_t tile { TIFFComputeTile(file, static_cast<uint32_t>(origin.x + x),
+                                                         static_cast<uint32_t>(origin.y + y), 0, 0) };
+                    if (TIFFWriteEncodedTile(file, tile, m_tileBuffer.data(), static_cast<tmsize_t>(m_tileBuffer.size())) < 0)
+                    {
+                        std::cerr << "\nCould not write tile at (" << origin.x + x << ", " << origin.y + y << ") to " << m_filePath << '\n';
+                        m_failed = true;
+                        return false;
+                    }
+
+                    ++m_tilesWritten;
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Finish writing the file
+         *
+         * @return true if every tile was written and the file was closed without errors
+         * @return false otherwise
+         */
+        bool TiledTiffSink::close()
+        {
+            if (!m_tiff)
+            {
+                return false;
+            }
+
+            const std::uint64_t tiles { static_cast<std::uint64_t>((m_size.width + m_tileSize.width - 1) / m_tileSize.width) *
+                                        static_cast<std::uint64_t>((m_size.height + m_tileSize.height - 1) / m_tileSize.height) };
+            if (m_tilesWritten != tiles)
+            {
+                std::cerr << "\nOnly " << m_tilesWritten << " of " << tiles << " tiles were written to " << m_filePath << '\n';
+                m_failed = true;
+            }
+
+            const bool directoryWritten { TIFFWriteDirectory(m_tiff.get()) != 0 };
+            m_tiff.reset();
+
+            return directoryWritten && !m_failed;
+        }
+
+
+        /**
+         * @brief Produce an image block by block and write it to a sink. Blocks are whole
+         *        tiles of the sink, as large as the memory limit allows.
+         *
+         * @param sink file to write to
+         * @param kernel fills each block of the output image
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param buffersPerBlock no. of block sized images the kernel holds at one time, including
+         *                        the output block e.g. 3 for blending two images
+         * @return true if every block was produced and written
+         * @return false otherwise
+         */
+        bool processBlocks(TiledTiffSink& sink, const BlockKernel& kernel, std::size_t memoryLimit, double buffersPerBlock)
+        {
+            if (!sink.isOpen())
+            {
+                return false;
+            }
+
+            /*
+             * Use square blocks of whole tiles, as large as the memory limit allows. Square
+             * blocks keep the overlap read by processTiles() small compared to the block.
+             * A block is never smaller than one tile, even if that exceeds the limit.
+            */
+            const cv::Size tile { sink.tileSize() };
+            const double bytesPerPixel { std::max(buffersPerBlock, 1.0) * CV_ELEM_SIZE(sink.type()) };
+            const int side { static_cast<int>(std::sqrt(static_cast<double>(memoryLimit) / bytesPerPixel)) };
+
+            const cv::Size blockSize { std::min(std::max(side / tile.width, 1) * tile.width, sink.size().width),
+                                       std::min(std::max(side / tile.height, 1) * tile.height, sink.size().height) };
+
+            cv::Mat buffer(blockSize, sink.type());
+
+            for (int y {0}; y < sink.size().height; y += blockSize.height)
+            {
+                for (int x {0}; x < sink.size().width; x += blockSize.width)
+                {
+                    const cv::Rect region { x, y, std::min(blockSize.width, sink.size().width - x),
+                                            std::min(blockSize.height, sink.size().height - y) };
+
+                    cv::Mat block { buffer(cv::Rect(cv::Point(0, 0), region.size())) };
+                    if (!kernel(region, block))
+                    {
+                        return false;
+                    }
+
+                    if ((block.size() != region.size()) || (block.type() != sink.type()))
+                    {
+                        std::cerr << "\nKernel returned a " << block.cols << " x " << block.rows << " block of type "
+                                  << block.type() << ". Expected " << region.width << " x " << region.height
+                                  << " of type " << sink.type() << '\n';
+                        return false;
+                    }
+
+                    if (!sink.write(region.tl(), block))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Run a kernel (e.g. a filter) over an image that does not fit in memory.
+         *        Each block is read with 'overlap' extra pixels on every side so results
+         *        along block edges are the same as processing the whole image at once.
+         *
+         * @param source image to read. Must be the same size as sink
+         * @param sink file to write result to
+         * @param overlap no. of extra pixels read on each side of a block e.g. the kernel radius of a filter
+         * @param kernel operation run on each block
+         * @param memoryLimit limit, in bytes, on the image data held in memory at one time
+         * @param borderType how pixels beyond the image edges are filled (see TiledTiffSource::read())
+         * @return true if the whole image was processed
+         * @return false otherwise
+         */
+        bool processTiles(TiledTiffSource& source, TiledTiffSink& sink, int overlap, const TileKernel& kernel,
+                          std::size_t memoryLimit, int borderType)
+        {
+            if (!source.isOpen() || !sink.isOpen() || (source.size() != sink.size()) || (overlap < 0))
+            {
+                std::cerr << "\nSource and sink must be open and the same size, and the overlap must not be negative.\n";
+                return false;
+            }
+
+            // Memory held per block: the output block, plus the input and the kernel's output
+            // (both with the overlap), which may have a different type to the sink
+            const double inputBuffers { static_cast<double>(CV_ELEM_SIZE(source.type())) / CV_ELEM_SIZE(sink.type()) };
+
+            cv::Mat input;
+            cv::Mat output;
+
+            auto blockKernel = [&](const cv::Rect& region, cv::Mat& block) {
+                const cv::Rect inputRegion { region.x - overlap, region.y - overlap,
+                                             region.width + 2 * overlap, region.height + 2 * overlap };
+                if (!source.read(inputRegion, input, borderType))
+                {
+                    return false;
+                }
+
+                kernel(input, output);
+
+                // Crop the overlap from the kernel output
+                cv::Mat result { output };
+                if ((output.size() == input.size()) && (overlap > 0))
+                {
+                    result = output(cv::Rect(overlap, overlap, region.width, region.height));
+                }
+
+                if ((result.size() != region.size()) || (result.type() != sink.type()))
+                {
+                    std::cerr << "\nKernel output must be the size of its input, or the input minus the overlap, "
+                              << "and have the type of the sink.\n";
+                    return false;
+                }
+
+                result.copyTo(block);
+
+                return true;
+            };
+
+            return processBlocks(sink, blockKernel, memoryLimit, 1.0 + 2.0 * inputBuffers);
+        }
+    }
+}
@@ -0,0 +1,706 @@
+// Program: lossless_jpeg_transform.cpp
+
+/*
+ * This program rotates, flips and crops a JPEG file WITHOUT decoding it to
+ * pixels and re-encoding it.
+ *
+ * A JPEG file stores each 8 x 8 block of pixels as 64 quantized DCT
+ * (Discrete Cosine Transform) coefficients. A 90 degree rotation, a flip or a
+ * crop along block boundaries can be carried out directly on these coefficients:
+ *      1. Blocks are moved to their new position in the output image
+ *      2. A transpose of the image transposes the 8 x 8 coefficients of each block
+ *      3. A mirror image of a block negates its odd (horizontal or vertical) frequencies
+ *
+ * No coefficient is re-quantized, so the output has exactly the quality of the
+ * input. Skipping the inverse DCT, colour conversion and forward DCT also makes
+ * the transform much faster than cv::imread() -> cv::rotate() -> cv::imwrite().
+ *
+ * The transforms work on whole MCUs (Minimum Coded Units - usually 8 x 8 or 16 x 16
+ * pixels), therefore:
+ *      1. The top-left corner of a crop is moved up/left to the nearest MCU boundary
+ *      2. A partial MCU at an image edge that would move to the top or left of the
+ *         output (e.g. the right edge of a horizontal flip) is trimmed off
+ *
+ * The program uses libjpeg (libjpeg-turbo) directly, as OpenCV does not give access
+ * to the DCT coefficients of an image. Inputs are provided through the command line
+ * in the same way as Save_Image_As.cpp.
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core data types
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgcodecs.hpp"       // for cv::imread() and cv::imwrite()
+
+#include <UtilityFunctions/utility_functions.h> // for getFileExtension() from our own library
+
+#include <cstdio>       // for std::FILE - libjpeg reads and writes through C file streams
+#include <csetjmp>      // for std::setjmp() and std::longjmp() - libjpeg error handling
+#include <jpeglib.h>    // for the libjpeg compressor and decompressor
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <algorithm>    // for std::fill
+#include <utility>      // for std::swap
+#include <filesystem>   // for std::filesystem::rename() and std::filesystem::equivalent()
+#include <random>       // for std::random_device - unique name for the temporary output file
+
+///////////////////////////// Function Declarations //////////////////////////////
+
+/**
+ * @brief Lossless transforms that can be carried out on the DCT coefficients of a JPEG file
+ */
+enum class JpegTransform
+{
+    none,           // no rotation or flip (crop only)
+    flipHorizontal, // mirror image left to right
+    flipVertical,   // mirror image top to bottom
+    rotate90,       // rotate 90 degrees clockwise
+    rotate180,      // rotate 180 degrees
+    rotate270,      // rotate 270 degrees clockwise (90 degrees anti-clockwise)
+    transpose,      // mirror image about the top-left to bottom-right diagonal
+    transverse      // mirror image about the top-right to bottom-left diagonal
+};
+
+
+/**
+ * @brief Convert a transform name given on the command line to a JpegTransform
+ *
+ * @param name one of: none, flipH, flipV, rotate90, rotate180, rotate270, transpose, transverse
+ * @param transform transform that matches the name
+ * @return true if the name is valid
+ * @return false if the name is not valid
+ */
+bool parseJpegTransform(std::string_view name, JpegTransform& transform);
+
+
+/**
+ * @brief Check if file extension of image file supplied by user is a JPEG file extension
+ *
+ * @param fileExtension image file extension
+ * @return true
+ * @return false
+ */
+bool isValidFileExtension(std::string_view fileExtension);
+
+
+/**
+ * @brief Rotate, flip and/or crop a JPEG file without decoding and re-encoding it.
+ *        The crop is applied to the input image, before it is rotated or flipped.
+ *        The output is written to a temporary file that replaces 'outputPath' only once it
+ *        is complete, so 'outputPath' may be the input file.
+ *
+ * @param inputPath full path to JPEG file to transform
+ * @param outputPath full path to save transformed JPEG file to
+ * @param transform rotation or flip to carry out
+ * @param crop region of input image to keep. An empty rectangle keeps the whole image.
+ *             The top-left corner is moved to the nearest MCU boundary
+ * @param optimize compute optimal Huffman tables for the output (smaller file, slightly slower)
+ * @param outputSize size of the output image
+ * @param errorMessage description of the error if the transform fails
+ * @return true if the transformed image was saved
+ * @return false if the transform failed. Any existing file at 'outputPath' is left unchanged
+ */
+bool losslessJpegTransform(const std::string& inputPath, const std::string& outputPath,
+                           JpegTransform transform, cv::Rect crop, bool optimize,
+                           cv::Size& outputSize, std::string& errorMessage);
+
+
+/**
+ * @brief Carry out the same transform by decoding the image, transforming the pixels
+ *        and encoding the result with cv::imwrite()
+ *
+ * @param inputPath full path to JPEG file to transform
+ * @param outputPath full path to save transformed JPEG file to
+ * @param transform rotation or flip to carry out
+ * @param crop region of input image to keep. An empty rectangle keeps the whole image
+ * @param quality JPEG quality used to encode the output
+ * @return true if the transformed image was saved
+ * @return false if the image could not be read or saved
+ */
+bool decodeTransformEncode(const std::string& inputPath, const std::string& outputPath,
+                           JpegTransform transform, cv::Rect crop, int quality);
+
+////////////////////////// End of Function Declarations //////////////////////////
+
+
+int main(int argc, char* argv[])
+{
+    /*
+     * Define the command line arguments
+     *      1. image to read/open
+     *      2. path to save image
+     *      3. rotation or flip to carry out
+     *      4. region of image to keep
+     *      5. optimize Huffman tables of output
+     *      6. compare the speed against decode -> transform -> cv::imwrite()
+    */
+    const cv::String keys =
+        "{help h usage ? | | Losslessly rotate, flip or crop a JPEG file }"
+        "{@image | <none> | Full path to JPEG file }"
+        "{@path | <none> | Full path to save JPEG to. Should include file name and extension.  }"
+        "{transform | none | One of: none, flipH, flipV, rotate90, rotate180, rotate270, transpose, transverse }"
+        "{crop | | Region of input image to keep as x,y,width,height e.g. 64,32,640,480 }"
+        "{optimize | false | Compute optimal Huffman tables for the output file }"
+        "{benchmark | false | Compare the speed against decoding, transforming and re-encoding with cv::imwrite() }"
+        "{repeat | 10 | No. of times each method is timed in benchmark mode }"
+        "{quality | 95 | JPEG quality used by cv::imwrite() in benchmark mode }";
+
+    // define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nRotate, flip or crop a JPEG file without re-encoding it (no loss of quality)."
+        "\n\tRotations and flips trim partial MCUs from the edges that would move to the top or left."
+        "\n\tThe top-left corner of a crop is moved to the nearest MCU (8 or 16 pixels) boundary.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("@image");
+    cv::String savePath = parser.get<cv::String>("@path");
+    cv::String transformName = parser.get<cv::String>("transform");
+    cv::String cropText = parser.get<cv::String>("crop");
+    bool optimize = parser.get<bool>("optimize");
+    bool benchmark = parser.get<bool>("benchmark");
+    int repeat = parser.get<int>("repeat");
+    int quality = parser.get<int>("quality");
+
+    // Check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors(); // Print errors
+
+        return -1; // Early program exit
+    }
+
+    // We can only transform JPEG files, and the output is always a JPEG file
+    if(!isValidFileExtension(CPP_CV::ReadWriteFiles::getFileExtension(imagePath)) ||
+       !isValidFileExtension(CPP_CV::ReadWriteFiles::getFileExtension(savePath)))
+    {
+        std::cerr << "\nInput and output files should have the extension jpeg or jpg.\n";
+
+        return -1;
+    }
+
+    JpegTransform transform;
+    if (!parseJpegTransform(transformName, transform))
+    {
+        std::cerr << "\nInvalid transform: " << transformName << '\n';
+
+        return -1;
+    }
+
+    cv::Rect crop;
+    if (!cropText.empty())
+    {
+        if ((std::sscanf(cropText.c_str(), "%d,%d,%d,%d", &crop.x, &crop.y, &crop.width, &crop.height) != 4) ||
+            (crop.x < 0) || (crop.y < 0) || (crop.width <= 0) || (crop.height <= 0))
+        {
+            std::cerr << "\nCrop should be given as x,y,width,height e.g. 64,32,640,480\n";
+
+            return -1;
+        }
+    }
+
+    // Every benchmark run must start from the original input, so it cannot be overwritten in place
+    std::error_code pathError;
+    if (benchmark && std::filesystem::equivalent(imagePath, savePath, pathError))
+    {
+        std::cerr << "\nError: Benchmark mode needs an output path different from the input path.\n";
+
+        return -1;
+    }
+
+    // Carry out the lossless transform
+    cv::Size outputSize;
+    std::string errorMessage;
+
+    cv::TickMeter timer;
+    timer.start();
+    bool result = losslessJpegTransform(imagePath, savePath, transform, crop, optimize, outputSize, errorMessage);
+    timer.stop();
+
+    if(!result)
+    {
+        std::cerr << "\nError: Could not transform " << imagePath << ": " << errorMessage << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nSuccessfully saved " << outputSize.width << " x " << outputSize.height
+              << " image file to " << savePath << " (" << timer.getTimeMilli() << " ms)\n";
+
+    if (benchmark)
+    {
+        if (repeat <= 0)
+        {
+            std::cerr << "\nRepeat should be greater than 0.\n";
+
+            return -1;
+        }
+
+        // The decode -> transform -> encode output is saved next to the lossless output
+        const std::string reencodedPath { savePath.substr(0, savePath.find_last_of('.')) + "_reencoded.jpg" };
+
+        cv::TickMeter losslessTimer;
+        cv::TickMeter reencodeTimer;
+
+        for (int i {0}; i < repeat; ++i)
+        {
+            losslessTimer.start();
+            result = losslessJpegTransform(imagePath, savePath, transform, crop, optimize, outputSize, errorMessage);
+            losslessTimer.stop();
+
+            if (!result)
+            {
+                std::cerr << "\nError: Could not transform " << imagePath << ": " << errorMessage << '\n';
+
+                return -1;
+            }
+
+            reencodeTimer.start();
+            result = decodeTransformEncode(imagePath, reencodedPath, transform, crop, quality);
+            reencodeTimer.stop();
+
+            if (!result)
+            {
+                std::cerr << "\nError: Could not decode, transform and encode " << imagePath << '\n';
+
+                return -1;
+            }
+        }
+
+        const double losslessMilliseconds { losslessTimer.getTimeMilli() / repeat };
+        const double reencodeMilliseconds { reencodeTimer.getTimeMilli() / repeat };
+
+        std::cout << "\nMean time over " << repeat << " runs:"
+                  << "\n\tLossless DCT-domain transform: " << losslessMilliseconds << " ms"
+                  << "\n\tDecode -> transform -> cv::imwrite() (quality " << quality << "): " << reencodeMilliseconds << " ms"
+                  << "\n\tSpeed up: " << reencodeMilliseconds / losslessMilliseconds << "x\n";
+
+        // Re-encoding changes the pixels, the lossless transform does not
+        cv::Mat lossless { cv::imread(savePath, cv::IMREAD_COLOR) };
+        cv::Mat reencoded { cv::imread(reencodedPath, cv::IMREAD_COLOR) };
+        if (!lossless.empty() && (lossless.size() == reencoded.size()))
+        {
+            std::cout << "\tPSNR of re-encoded image against lossless image: "
+                      << cv::PSNR(lossless, reencoded) << " dB\n";
+        }
+    }
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+//////////////////// Function Definitions ///////////////////////////////////////
+
+/**
+ * @brief Convert a transform name given on the command line to a JpegTransform
+ *
+ * @param name one of: none, flipH, flipV, rotate90, rotate180, rotate270, transpose, transverse
+ * @param transform transform that matches the name
+ * @return true if the name is valid
+ * @return false if the name is not valid
+ */
+bool parseJpegTransform(std::string_view name, JpegTransform& transform)
+{
+    if (name == "none") transform = JpegTransform::none;
+    else if (name == "flipH") transform = JpegTransform::flipHorizontal;
+    else if (name == "flipV") transform = JpegTransform::flipVertical;
+    else if (name == "rotate90") transform = JpegTransform::rotate90;
+    else if (name == "rotate180") transform = JpegTransform::rotate180;
+    else if (name == "rotate270") transform = JpegTransform::rotate270;
+    else if (name == "transpose") transform = JpegTransform::transpose;
+    else if (name == "transverse") transform = JpegTransform::transverse;
+    else return false;
+
+    return true;
+}
+
+
+/**
+ * @brief Check if file extension of image file supplied by user is a JPEG file extension
+ *
+ * @param fileExtension image file extension
+ * @return true
+ * @return false
+ */
+bool isValidFileExtension(std::string_view fileExtension)
+{
+    return (fileExtension == "jpeg") || (fileExtension == "jpg");
+}
+
+
+/*
+ * libjpeg calls error_exit() when it cannot continue. The default handler
+ * terminates the program, so we replace it with one that jumps back to
+ * losslessJpegTransform(), which cleans up and reports the error.
+ */
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;                     // "public" fields used by libjpeg
+    std::jmp_buf setjmpBuffer;              // where to return to on an error
+    char message[JMSG_LENGTH_MAX] {};       // error message
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    auto* errorManager = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, errorManager->message);
+    std::longjmp(errorManager->setjmpBuffer, 1);
+}
+
+
+/**
+ * @brief Rotate, flip and/or crop a JPEG file without decoding and re-encoding it.
+ *        The crop is applied to the input image, before it is rotated or flipped.
+ *        The output is written to a temporary file that replaces 'outputPath' only once it
+ *        is complete, so 'outputPath' may be the input file.
+ *
+ * @param inputPath full path to JPEG file to transform
+ * @param outputPath full path to save transformed JPEG file to
+ * @param transform rotation or flip to carry out
+ * @param crop region of input image to keep. An empty rectangle keeps the whole image.
+ *             The top-left corner is moved to the nearest MCU boundary
+ * @param optimize compute optimal Huffman tables for the output (smaller file, slightly slower)
+ * @param outputSize size of the output image
+ * @param errorMessage description of the error if the transform fails
+ * @return true if the transformed image was saved
+ * @return false if the transform failed. Any existing file at 'outputPath' is left unchanged
+ */
+bool losslessJpegTransform(const std::string& inputPath, const std::string& outputPath,
+                           JpegTransform transform, cv::Rect crop, bool optimize,
+                           cv::Size& outputSize, std::string& errorMessage)
+{
+    /*
+     * Every transform is described as an optional transpose (swap rows and columns)
+     * followed by an optional mirror of the columns (flipX) and/or rows (flipY):
+     *      rotate90 = transpose + flipX,   rotate270 = transpose + flipY
+     *      rotate180 = flipX + flipY,      transverse = transpose + flipX + flipY
+    */
+    const bool transposed { (transform == JpegTransform::transpose) || (transform == JpegTransform::transverse) ||
+                            (transform == JpegTransform::rotate90) || (transform == JpegTransform::rotate270) };
+    const bool flipX { (transform == JpegTransform::flipHorizontal) || (transform == JpegTransform::rotate180) ||
+                       (transform == JpegTransform::rotate90) || (transform == JpegTransform::transverse) };
+    const bool flipY { (transform == JpegTransform::flipVertical) || (transform == JpegTransform::rotate180) ||
+                       (transform == JpegTransform::rotate270) || (transform == JpegTransform::transverse) };
+
+    std::FILE* inputFile { std::fopen(inputPath.c_str(), "rb") };
+    if (inputFile == nullptr)
+    {
+        errorMessage = "could not open file for reading";
+        return false;
+    }
+
+    // Opening 'outputPath' with "wb" would truncate the input before it is read when both are
+    // the same file, so write next to it and rename over it once the output is complete
+    const std::string temporaryPath { outputPath + ".tmp" + std::to_string(std::random_device{}()) };
+
+    std::FILE* outputFile { std::fopen(temporaryPath.c_str(), "wb") };
+    if (outputFile == nullptr)
+    {
+        std::fclose(inputFile);
+        errorMessage = "could not open " + temporaryPath + " for writing";
+        return false;
+    }
+
+    // Both libjpeg objects share one error manager, so any error jumps back to the same place
+    jpeg_decompress_struct src;
+    jpeg_compress_struct dst;
+    JpegErrorManager error;
+
+    src.err = jpeg_std_error(&error.pub);
+    error.pub.error_exit = jpegErrorExit;
+    dst.err = &error.pub;
+
+    jpeg_create_decompress(&src);
+    jpeg_create_compress(&dst);
+
+    if (setjmp(error.setjmpBuffer))
+    {
+        errorMessage = error.message;
+
+        jpeg_destroy_compress(&dst);
+        jpeg_destroy_decompress(&src);
+        std::fclose(outputFile);
+        std::fclose(inputFile);
+        std::remove(temporaryPath.c_str());
+
+        return false;
+    }
+
+    //--------------------- 1. Read the JPEG header -------------------------//
+
+    jpeg_stdio_src(&src, inputFile);
+
+    // Keep comments and APPn markers (e.g. EXIF, ICC colour profile) so they can be copied
+    jpeg_save_markers(&src, JPEG_COM, 0xFFFF);
+    for (int marker {0}; marker < 16; ++marker)
+    {
+        jpeg_save_markers(&src, JPEG_APP0 + marker, 0xFFFF);
+    }
+
+    jpeg_read_header(&src, TRUE);
+
+    //---------------- 2. Work out the region to keep, in MCUs --------------//
+
+    // Size of an MCU in pixels
+    const int mcuWidth { src.max_h_samp_factor * DCTSIZE };
+    const int mcuHeight { src.max_v_samp_factor * DCTSIZE };
+
+    const cv::Rect wholeImage(0, 0, static_cast<int>(src.image_width), static_cast<int>(src.image_height));
+    cv::Rect region { crop.empty() ? wholeImage : (crop & wholeImage) };
+    if (region.empty())
+    {
+        std::snprintf(error.message, JMSG_LENGTH_MAX, "crop lies outside the image");
+        std::longjmp(error.setjmpBuffer, 1);
+    }
+
+    // Move the top-left corner to the nearest MCU boundary, keeping the bottom-right corner
+    region.width += region.x % mcuWidth;
+    region.height += region.y % mcuHeight;
+    region.x -= region.x % mcuWidth;
+    region.y -= region.y % mcuHeight;
+
+    // A partial MCU at the right (bottom) edge cannot be moved to the left (top) edge
+    // of the output - trim it off. After the transpose, output columns are input rows
+    const bool mirrorColumns { transposed ? flipY : flipX };
+    const bool mirrorRows { transposed ? flipX : flipY };
+    if (mirrorColumns) region.width -= region.width % mcuWidth;
+    if (mirrorRows) region.height -= region.height % mcuHeight;
+
+    if (region.empty())
+    {
+        std::snprintf(error.message, JMSG_LENGTH_MAX, "image is smaller than one MCU (%d x %d pixels)", mcuWidth, mcuHeight);
+        std::longjmp(error.setjmpBuffer, 1);
+    }
+
+    outputSize = transposed ? cv::Size(region.height, region.width) : region.size();
+
+    //------------- 3. Request arrays for the output coefficients -----------//
+
+    // Each component is stored as an array of blocks. Output arrays cover whole MCUs
+    const int outputMcuWidth { transposed ? mcuHeight : mcuWidth };
+    const int outputMcuHeight { transposed ? mcuWidth : mcuHeight };
+    const int outputMcuColumns { (outputSize.width + outputMcuWidth - 1) / outputMcuWidth };
+    const int outputMcuRows { (outputSize.height + outputMcuHeight - 1) / outputMcuHeight };
+
+    jvirt_barray_ptr dstCoefficients[MAX_COMPONENTS] {};
+    for (int c {0}; c < src.num_components; ++c)
+    {
+        const jpeg_component_info& component { src.comp_info[c] };
+        const int hSampling { transposed ? component.v_samp_factor : component.h_samp_factor };
+        const int vSampling { transposed ? component.h_samp_factor : component.v_samp_factor };
+
+        dstCoefficients[c] = (*src.mem->request_virt_barray)(reinterpret_cast<j_common_ptr>(&src), JPOOL_IMAGE, TRUE,
+                                                             static_cast<JDIMENSION>(outputMcuColumns * hSampling),
+                                                             static_cast<JDIMENSION>(outputMcuRows * vSampling),
+                                                             static_cast<JDIMENSION>(vSampling));
+    }
+
+    //------------- 4. Read the DCT coefficients (no inverse DCT) -----------//
+
+    jvirt_barray_ptr* srcCoefficients { jpeg_read_coefficients(&src) };
+
+    //------------------- 5. Set up the output JPEG file --------------------//
+
+    jpeg_copy_critical_parameters(&src, &dst);
+    dst.image_width = static_cast<JDIMENSION>(outputSize.width);
+    dst.image_height = static_cast<JDIMENSION>(outputSize.height);
+    dst.optimize_coding = optimize ? TRUE : FALSE;
+
+    if (transposed)
+    {
+        // Sampling factors swap between columns and rows
+        for (int c {0}; c < dst.num_components; ++c)
+        {
+            std::swap(dst.comp_info[c].h_samp_factor, dst.comp_info[c].v_samp_factor);
+        }
+
+        // Quantization tables are stored in natural (row by row) order - transpose them too
+        for (int t {0}; t < NUM_QUANT_TBLS; ++t)
+        {
+            JQUANT_TBL* table { dst.quant_tbl_ptrs[t] };
+            if (table == nullptr) continue;
+
+            for (int v {0}; v < DCTSIZE; ++v)
+            {
+                for (int u { v + 1 }; u < DCTSIZE; ++u)
+                {
+                    std::swap(table->quantval[v * DCTSIZE + u], table->quantval[u * DCTSIZE + v]);
+                }
+            }
+        }
+    }
+
+    jpeg_stdio_dest(&dst, outputFile);
+    jpeg_write_coefficients(&dst, dstCoefficients);
+
+    // Copy the saved markers. libjpeg writes its own JFIF (APP0) and Adobe (APP14) markers
+    for (jpeg_saved_marker_ptr marker { src.marker_list }; marker != nullptr; marker = marker->next)
+    {
+        if ((dst.write_JFIF_header && (marker->marker == JPEG_APP0)) ||
+            (dst.write_Adobe_marker && (marker->marker == JPEG_APP0 + 14)))
+        {
+            continue;
+        }
+
+        jpeg_write_marker(&dst, marker->marker, marker->data, marker->data_length);
+    }
+
+    //------------------ 6. Move and transform each block -------------------//
+
+    // The transform of the coefficients is the same for every block, so work out once 
+    // where each output coefficient comes from and whether its sign changes.
+    // v = vertical frequency (row of block), u = horizontal frequency (column of block).
+    // Mirroring a cosine of odd frequency about the block centre changes its sign
+    int coefficientIndex[DCTSIZE2];
+    JCOEF coefficientSign[DCTSIZE2];
+    for (int v {0}; v < DCTSIZE; ++v)
+    {
+        for (int u {0}; u < DCTSIZE; ++u)
+        {
+            coefficientIndex[v * DCTSIZE + u] = transposed ? u * DCTSIZE + v : v * DCTSIZE + u;
+            coefficientSign[v * DCTSIZE + u] = ((flipX && (u & 1)) != (flipY && (v & 1))) ? -1 : 1;
+        }
+    }
+
+    for (int c {0}; c < src.num_components; ++c)
+    {
+        const jpeg_component_info& component { src.comp_info[c] };
+
+        // Size of the source array in blocks (including the blocks that pad the last MCU)
+        const int srcBlockColumns { static_cast<int>((component.width_in_blocks + component.h_samp_factor - 1) /
+                                                      component.h_samp_factor * component.h_samp_factor) };
+        const int srcBlockRows { static_cast<int>((component.height_in_blocks + component.v_samp_factor - 1) /
+                                                   component.v_samp_factor * component.v_samp_factor) };
+
+        // Region to keep, in blocks of this component. The region starts on an MCU boundary
+        const int regionBlockX { region.x / mcuWidth * component.h_samp_factor };
+        const int regionBlockY { region.y / mcuHeight * component.v_samp_factor };
+
+        // Size of the (transposed) region in blocks. Only used when mirroring, which
+        // happens when the mirrored size is a whole no. of MCUs
+        const int hSampling { transposed ? component.v_samp_factor : component.h_samp_factor };
+        const int vSampling { transposed ? component.h_samp_factor : component.v_samp_factor };
+        const int regionBlockColumns { outputSize.width / outputMcuWidth * hSampling };
+        const int regionBlockRows { outputSize.height / outputMcuHeight * vSampling };
+
+        const int dstBlockRows { outputMcuRows * vSampling };
+        const int dstBlockColumns { outputMcuColumns * hSampling };
+
+        for (int dstRow {0}; dstRow < dstBlockRows; ++dstRow)
+        {
+            JBLOCKROW dstBlocks { (*src.mem->access_virt_barray)(reinterpret_cast<j_common_ptr>(&src), dstCoefficients[c],
+                                                                 static_cast<JDIMENSION>(dstRow), 1, TRUE)[0] };
+
+            for (int dstColumn {0}; dstColumn < dstBlockColumns; ++dstColumn)
+            {
+                // Position of the block in the transposed region, then in the source array
+                const int column { flipX ? regionBlockColumns - 1 - dstColumn : dstColumn };
+                const int row { flipY ? regionBlockRows - 1 - dstRow : dstRow };
+                const int srcColumn { regionBlockX + (transposed ? row : column) };
+                const int srcRow { regionBlockY + (transposed ? column : row) };
+
+                JCOEF* out { dstBlocks[dstColumn] };
+
+                // Blocks that pad the last output MCU may lie outside the source image
+                if ((srcColumn >= srcBlockColumns) || (srcRow >= srcBlockRows))
+                {
+                    std::fill(out, out + DCTSIZE2, JCOEF {0});
+                    continue;
+                }
+
+                const JCOEF* in { (*src.mem->access_virt_barray)(reinterpret_cast<j_common_ptr>(&src), srcCoefficients[c],
+                                                                 static_cast<JDIMENSION>(srcRow), 1, FALSE)[0][srcColumn] };
+
+                for (int k {0}; k < DCTSIZE2; ++k)
+                {
+                    out[k] = static_cast<JCOEF>(in[coefficientIndex[k]] * coefficientSign[k]);
+                }
+            }
+        }
+    }
+
+    //----------------------------- 7. Finish --------------------------------//
+
+    jpeg_finish_compress(&dst);
+    jpeg_destroy_compress(&dst);
+
+    jpeg_finish_decompress(&src);
+    jpeg_destroy_decompress(&src);
+
+    const bool writeError { std::ferror(outputFile) != 0 };
+    const bool written { (std::fclose(outputFile) == 0) && !writeError };
+    std::fclose(inputFile);
+
+    std::error_code renameError;
+    if (written)
+    {
+        std::filesystem::rename(temporaryPath, outputPath, renameError);
+    }
+
+    if (!written || renameError)
+    {
+        errorMessage = written ? "could not replace " + outputPath + ": " + renameError.message() 
+                               : "could not write " + temporaryPath;
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Carry out the same transform by decoding the image, transforming the pixels
+ *        and encoding the result with cv::imwrite()
+ *
+ * @param inputPath full path to JPEG file to transform
+ * @param outputPath full path to save transformed JPEG file to
+ * @param transform rotation or flip to carry out
+ * @param crop region of input image to keep. An empty rectangle keeps the whole image
+ * @param quality JPEG quality used to encode the output
+ * @return true if the transformed image was saved
+ * @return false if the image could not be read or saved
+ */
+bool decodeTransformEncode(const std::string& inputPath, const std::string& outputPath,
+                           JpegTransform transform, cv::Rect crop, int quality)
+{
+    cv::Mat image { cv::imread(inputPath, cv::IMREAD_UNCHANGED) };
+    if (image.empty())
+    {
+        return false;
+    }
+
+    if (!crop.empty())
+    {
+        image = image(crop & cv::Rect(0, 0, image.cols, image.rows));
+    }
+
+    cv::Mat output;
+    switch (transform)
+    {
+        case JpegTransform::none:           output = image; break;
+        case JpegTransform::flipHorizontal: cv::flip(image, output, 1); break;
+        case JpegTransform::flipVertical:   cv::flip(image, output, 0); break;
+        case JpegTransform::rotate90:       cv::rotate(image, output, cv::ROTATE_90_CLOCKWISE); break;
+        case JpegTransform::rotate180:      cv::rotate(image, output, cv::ROTATE_180); break;
+        case JpegTransform::rotate270:      cv::rotate(image, output, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+        case JpegTransform::transpose:      cv::transpose(image, output); break;
+        case JpegTransform::transverse:     cv::transpose(image, output); cv::flip(output, output, -1); break;
+    }
+
+    try
+    {
+        return cv::imwrite(outputPath, output, { cv::IMWRITE_JPEG_QUALITY, quality });
+    }
+    catch (const cv::Exception& ex)
+    {
+        std::cerr << "\nError saving image to " << outputPath << ": " << ex.what();
+    }
+
+    return false;
+}
+
+//////////////////// End of Function Definitions //////////////////////////////////
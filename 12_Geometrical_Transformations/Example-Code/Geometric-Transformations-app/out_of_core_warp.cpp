@@ -0,0 +1,230 @@
+// Program: out_of_core_warp.cpp
+
+/*
+ * Program rotates and scales an image that is too large to load into memory with
+ * cv::imread(), e.g. a 60,000 x 60,000 16-bit 4 channel survey mosaic.
+ *
+ * The output image is made large enough to hold the whole rotated image, and is written
+ * to a tiled TIFF file a block at a time. For each output block we:
+ *      1. Map the corners of the block back into the input image with the inverse transform
+ *      2. Read the input region covering those corners (plus a few pixels for interpolation)
+ *         from the input TIFF file
+ *      3. Run cv::warpAffine() on just that region, with the transform shifted to the
+ *         corners of the region and the block
+ *
+ * The result is the same as running cv::warpAffine() on the whole image, but memory use
+ * stays below the limit we set no matter how large the image is.
+ *
+ * Program inputs are provided through the command line
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core types
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgproc.hpp"         // for cv::getRotationMatrix2D(), cv::invertAffineTransform() and cv::warpAffine()
+
+#include "UtilityFunctions/utility_functions.h" // for TiledTiffSource, TiledTiffSink and processBlocks()
+
+#include <iostream>
+#include <string>
+#include <cmath>       // for std::abs, std::ceil, std::floor
+#include <algorithm>   // for std::min, std::max
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to input TIFF file
+     *      2. Full path to output TIFF file
+     *      3. Rotation angle and scale
+     *      4. Interpolation method, and value of pixels outside the input image
+     *      5. Memory limit, tile size and compression of output file
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Rotate and scale an image that does not fit in memory }"
+        "{@input | <none> | full path to input TIFF file }"
+        "{@output | <none> | full path to output tiled TIFF file }"
+        "{angle | 0.0 | rotation angle in degrees. Positive values rotate anti-clockwise }"
+        "{scale | 1.0 | scale factor }"
+        "{interpolation | 1 | 0 = nearest neighbour, 1 = bilinear, 2 = bicubic }"
+        "{value | 0 | value of every channel of pixels outside the input image }"
+        "{memoryLimit | 256 | limit on image data held in memory, in MB }"
+        "{tileSize | 256 | width and height of output tiles (multiple of 16) }"
+        "{compression | 8 | output compression: 1 = none, 5 = LZW, 8 = Deflate }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nRotate and scale a TIFF image of any size, a block of tiles at a time.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String inputPath = parser.get<cv::String>("@input");
+    cv::String outputPath = parser.get<cv::String>("@output");
+    double angle = parser.get<double>("angle");
+    double scale = parser.get<double>("scale");
+    int interpolation = parser.get<int>("interpolation");
+    double value = parser.get<double>("value");
+    int memoryLimit = parser.get<int>("memoryLimit");
+    int tileSize = parser.get<int>("tileSize");
+    int compression = parser.get<int>("compression");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if ((scale <= 0.0) || (interpolation < cv::INTER_NEAREST) || (interpolation > cv::INTER_CUBIC) ||
+        (memoryLimit <= 0) || (tileSize <= 0) || ((compression != 1) && (compression != 5) && (compression != 8)))
+    {
+        std::cerr << "\nScale, memory limit and tile size should be greater than 0, interpolation should be 0, 1 or 2, "
+                  << "and compression should be 1, 5 or 8.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Open Input File and Create Transform ///////////////////////////////
+
+    // Only the TIFF header is read here, not the image data
+    CPP_CV::TiledImages::TiledTiffSource source(inputPath);
+    if (!source.isOpen())
+    {
+        return -1;
+    }
+
+    const cv::Size inputSize { source.size() };
+    const cv::Point2f center { inputSize.width / 2.0f, inputSize.height / 2.0f };
+
+    // Rotate and scale about the center of the input image
+    cv::Mat transform { cv::getRotationMatrix2D(center, angle, scale) };
+
+    // Make the output large enough to hold the whole rotated image, and move the
+    // center of the input image to the center of the output image
+    const double cosine { std::abs(transform.at<double>(0, 0)) };
+    const double sine { std::abs(transform.at<double>(0, 1)) };
+    const cv::Size outputSize { static_cast<int>(std::ceil(inputSize.width * cosine + inputSize.height * sine)),
+                                static_cast<int>(std::ceil(inputSize.width * sine + inputSize.height * cosine)) };
+
+    transform.at<double>(0, 2) += outputSize.width / 2.0 - center.x;
+    transform.at<double>(1, 2) += outputSize.height / 2.0 - center.y;
+
+    // The inverse transform maps output pixels back to input pixels
+    cv::Mat inverse;
+    cv::invertAffineTransform(transform, inverse);
+
+    CPP_CV::TiledImages::TiledTiffSink sink(outputPath, outputSize, source.type(), tileSize,
+                                            static_cast<CPP_CV::TiledImages::TiffCompression>(compression));
+    if (!sink.isOpen())
+    {
+        return -1;
+    }
+
+    std::cout << "\nInput image (width x height): " << inputSize.width << " x " << inputSize.height
+              << "\nInput tile size: " << source.tileSize().width << " x " << source.tileSize().height
+              << "\nOutput image (width x height): " << outputSize.width << " x " << outputSize.height
+              << "\nMemory limit: " << memoryLimit << " MB\n";
+
+    //---------------------- End of Open Input File and Create Transform -------------------//
+
+    ///////////////////////////// 3. Warp Image a Block at a Time ///////////////////////////////
+
+    // No. of extra input pixels each interpolation method needs around a point
+    const int margin { interpolation == cv::INTER_CUBIC ? 3 : 2 };
+
+    // Pixels outside the input image never affect the output, so regions are clipped to the
+    // input image (plus the margin). This also stops scaled down images reading huge regions
+    const cv::Rect inputArea { -margin, -margin, inputSize.width + 2 * margin, inputSize.height + 2 * margin };
+    const cv::Scalar borderValue { value, value, value, value };
+
+    cv::Mat region; // input region of the current block. Kept between blocks so it is only allocated once
+
+    auto warpBlock = [&](const cv::Rect& outputRegion, cv::Mat& block) {
+        // a. Map the corners of the block back into the input image
+        double minX {1e300}, minY {1e300}, maxX {-1e300}, maxY {-1e300};
+        for (const cv::Point2d& corner : { cv::Point2d(outputRegion.x, outputRegion.y),
+                                           cv::Point2d(outputRegion.x + outputRegion.width, outputRegion.y),
+                                           cv::Point2d(outputRegion.x, outputRegion.y + outputRegion.height),
+                                           cv::Point2d(outputRegion.x + outputRegion.width, outputRegion.y + outputRegion.height) })
+        {
+            const double x { inverse.at<double>(0, 0) * corner.x + inverse.at<double>(0, 1) * corner.y + inverse.at<double>(0, 2) };
+            const double y { inverse.at<double>(1, 0) * corner.x + inverse.at<double>(1, 1) * corner.y + inverse.at<double>(1, 2) };
+            minX = std::min(minX, x);
+            minY = std::min(minY, y);
+            maxX = std::max(maxX, x);
+            maxY = std::max(maxY, y);
+        }
+
+        const cv::Rect inputRegion { cv::Rect(static_cast<int>(std::floor(minX)) - margin, static_cast<int>(std::floor(minY)) - margin,
+                                              static_cast<int>(std::ceil(maxX - minX)) + 2 * margin + 1,
+                                              static_cast<int>(std::ceil(maxY - minY)) + 2 * margin + 1) & inputArea };
+
+        // The whole block is outside the rotated image
+        if (inputRegion.empty())
+        {
+            block.setTo(borderValue);
+            return true;
+        }
+
+        // b. Read the input region. Pixels beyond the image edges get the border value
+        if (!source.read(inputRegion, region, cv::BORDER_CONSTANT, borderValue))
+        {
+            return false;
+        }
+
+        /*
+         * c. Shift the transform so it maps the input region onto the block. If the transform
+         *    maps input point p to A * p + b, then region point q (= p - s) maps to block point
+         *    A * (q + s) + b - o, where s and o are the top left corners of the region and block
+        */
+        cv::Mat blockTransform { transform.clone() };
+        blockTransform.at<double>(0, 2) += transform.at<double>(0, 0) * inputRegion.x + transform.at<double>(0, 1) * inputRegion.y - outputRegion.x;
+        blockTransform.at<double>(1, 2) += transform.at<double>(1, 0) * inputRegion.x + transform.at<double>(1, 1) * inputRegion.y - outputRegion.y;
+
+        cv::warpAffine(region, block, blockTransform, block.size(), interpolation, cv::BORDER_CONSTANT, borderValue);
+
+        return true;
+    };
+
+    cv::TickMeter timer;
+    timer.start();
+
+    bool result {false};
+
+    try
+    {
+        // Each block holds the output block and an input region of up to 2 / scale^2 times its size
+        result = CPP_CV::TiledImages::processBlocks(sink, warpBlock, static_cast<std::size_t>(memoryLimit) << 20,
+                                                    1.0 + 2.0 / (scale * scale));
+
+        result = sink.close() && result;
+    }
+    catch (const cv::Exception& ex)
+    {
+        std::cerr << "\nERROR: " << ex.what();
+    }
+
+    timer.stop();
+
+    if (!result)
+    {
+        std::cerr << "\nERROR: Could not create " << outputPath << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nSaved " << outputPath << " in " << timer.getTimeSec() << " s"
+              << "\nInput tiles decoded: " << source.tilesDecoded() << '\n';
+
+    //---------------------- End of Warp Image a Block at a Time -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
@@ -2,7 +2,24 @@
 #include "opencv2/highgui.hpp"    // for cv::imshow() and cv::waitKey() 
 #include "opencv2/imgcodecs.hpp"  // for cv::imread()
 #include "opencv2/imgproc.hpp"    // for cv::resize()
+
+#include "UtilityFunctions/utility_functions.h" // for CPP_CV::Headless and CPP_CV::ImageCache functions
+
 #include <iostream>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <algorithm>  // for std::min, std::max
+#include <map>
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Print how many images were read from the decoded image cache, and how many were decoded
+ */
+void printCacheStatistics();
+
+//-------------------------- End of Function Declarations ---------------------//
 
 
 int main(int argc, char* argv[])
@@ -15,12 +32,25 @@ int main(int argc, char* argv[])
      * 2. second image to blend with first image
      * 3. blending value between 0 and 1
      * 
+     * To blend many images without display windows (headless mode) provide:
+     * 
+     * 4. text file listing the first images, one per line. Each is blended with the second image
+     * 5. directory to save the blended images to
+     * 
+     * Images are read through a cache of decoded images, so an image is only decoded again 
+     * if its file has changed:
+     * 
+     * 6. memory budget of the cache in MB
+     * 
     */
     const cv::String keys = 
         "{help h usage ? | | Blend two images and display resulting image in a window }"
-        "{image1 | <none> | Full path to first image }"
+        "{image1 | | Full path to first image. Not needed in headless mode }"
         "{image2 | <none> | Full path to second image. Image should have same data type as image1. }"
-        "{alpha | 0.5 | Blending value between 0 and 1 }";
+        "{alpha | 0.5 | Blending value between 0 and 1 }"
+        "{list | | Headless mode: text file with the full path to a first image on each line }"
+        "{outDir | | Headless mode: directory to save the blended images to }"
+        "{cacheMB | 512 | memory budget of the decoded image cache in MB. Images listed more than once are decoded once }";
     
     // Create a cv::CommandLineParser object
     auto parser = cv::CommandLineParser(argc, argv, keys);
@@ -33,6 +63,9 @@ int main(int argc, char* argv[])
     cv::String image1 = parser.get<cv::String>("image1");
     cv::String image2 = parser.get<cv::String>("image2");
     double alpha = parser.get<double>("alpha");
+    cv::String listPath = parser.get<cv::String>("list");
+    cv::String outputDirectory = parser.get<cv::String>("outDir");
+    int cacheMB = parser.get<int>("cacheMB");
 
     // Check for any errors encountered while extracting user input
     if(!parser.check())
@@ -41,6 +74,19 @@ int main(int argc, char* argv[])
         return -1; // Exit application early
     }
 
+    // We need either a single first image, or a list of images and a directory to save results to
+    const bool headless { !listPath.empty() };
+    if (headless && outputDirectory.empty())
+    {
+        std::cerr << "\nPlease provide a directory to save the blended images to (outDir).\n";
+        return -1;
+    }
+    if (!headless && image1.empty())
+    {
+        std::cerr << "\nPlease provide the first image (image1) or a list of images (list).\n";
+        return -1;
+    }
+
     // Check the value of 'alpha' if it is between 0 and 1, 
     // if not use 0.5
     if(alpha >= 0 && alpha <= 1)
@@ -52,45 +98,191 @@ int main(int argc, char* argv[])
         alpha = 0.5;
     }
 
-    // If there are no errors, we can now read our image data
-    cv::Mat sourceImage1 { cv::imread(image1, cv::IMREAD_UNCHANGED) };
-    cv::Mat sourceImage2 { cv::imread(image2, cv::IMREAD_UNCHANGED) };
-
-    // Check if we have successfully read the image data
-    if(sourceImage1.empty())
+    if (cacheMB < 0)
     {
-        std::cerr << "\nCould not read input image file: " 
-                  << image1<< '\n';
-        return -1; // Early exit from application
+        std::cerr << "\nThe memory budget of the cache should not be negative.\n";
+        return -1;
     }
 
-    if(sourceImage2.empty())
+    CPP_CV::ImageCache::DecodedImageCache::instance().setCapacity(static_cast<std::size_t>(cacheMB) * 1024 * 1024);
+
+    // Headless mode: blend every image in the list with the second image and 
+    // save the results to disk, timing each stage of the work
+    if (headless)
     {
-        std::cerr << "\nCould not read input image file: " 
-                  << image2<< '\n';
-        return -1; // Early exit from application
+        const auto inputs { CPP_CV::Headless::readInputList(listPath) };
+        if (!inputs || !CPP_CV::Headless::createOutputDirectory(outputDirectory))
+        {
+            return -1;
+        }
+
+        // Each result is named after its input, so two inputs with the same name in 
+        // different directories would overwrite each other's result
+        std::map<std::string, std::string> inputOfResult; // result file name -> input
+        for (const auto& path : *inputs)
+        {
+            const std::string fileName { std::filesystem::path(path).stem().string() + "_blended.png" };
+            const auto [existing, added] = inputOfResult.emplace(fileName, path);
+            if (!added && (existing->second != path))
+            {
+                std::cerr << "\nBoth " << existing->second << " and " << path << " would be saved as " 
+                          << fileName << ". Rename one of them or use separate lists.\n";
+                return -1;
+            }
+        }
+
+        CPP_CV::Headless::StageTimer timer;
+        cv::TickMeter wallTime;
+        wallTime.start();
+
+        timer.start("decode");
+        cv::Mat sourceImage2 { CPP_CV::ImageCache::imread(image2, cv::IMREAD_UNCHANGED) };
+        timer.stop();
+
+        if (sourceImage2.empty())
+        {
+            std::cerr << "\nCould not read input image file: " << image2 << '\n';
+            return -1;
+        }
+
+        int processed {0};
+        cv::Mat dst; // image2 resized to the size of the current image. Re-used while image sizes stay the same
+
+        for (const auto& path : *inputs)
+        {
+            // An image listed more than once is only decoded the first time
+            timer.start("decode");
+            cv::Mat sourceImage1 { CPP_CV::ImageCache::imread(path, cv::IMREAD_UNCHANGED) };
+            timer.stop();
+
+            if (sourceImage1.empty())
+            {
+                std::cerr << "\nCould not read input image file: " << path << '\n';
+                continue;
+            }
+
+            // An image with a different no. of channels or data type to image2 cannot be blended 
+            // with it. Skip it instead of ending the whole batch
+            timer.start("process");
+            cv::Mat blendedImage;
+            try 
+            {
+                if (dst.size() != sourceImage1.size())
+                {
+                    cv::resize(sourceImage2, dst, sourceImage1.size(), 0.0, 0.0);
+                }
+                cv::addWeighted(sourceImage1, alpha, dst, (1.0 - alpha), 0.0, blendedImage);
+            }
+            catch (const cv::Exception& ex)
+            {
+                timer.stop();
+                std::cerr << "\nCould not blend " << path << " with " << image2 << ": " << ex.what();
+                continue;
+            }
+            timer.stop();
+
+            const std::string fileName { std::filesystem::path(path).stem().string() + "_blended.png" };
+            if (CPP_CV::Headless::writeResult(outputDirectory, fileName, blendedImage, timer))
+            {
+                ++processed;
+            }
+            else 
+            {
+                std::cerr << "\nCould not save blended image: " << fileName << '\n';
+            }
+        }
+
+        wallTime.stop();
+
+        std::cout << "\nBlended " << processed << " images in " << wallTime.getTimeSec() << " s ("
+                  << processed / wallTime.getTimeSec() << " images/s)\n";
+        timer.print();
+        printCacheStatistics();
+
+        std::cout << '\n';
+
+        return 0;
     }
 
-    // Blend/Combine our two images
-    // ===========================
+    std::cout << "\nPress '+' or '-' to change alpha, 'r' to read the images again "
+              << "(only changed files are decoded), any other key to quit.\n";
+
+    while (true)
+    {
+        // If there are no errors, we can now read our image data. Images are 
+        // taken from the cache unless their file has changed since they were decoded
+        cv::Mat sourceImage1 { CPP_CV::ImageCache::imread(image1, cv::IMREAD_UNCHANGED) };
+        cv::Mat sourceImage2 { CPP_CV::ImageCache::imread(image2, cv::IMREAD_UNCHANGED) };
+
+        // Check if we have successfully read the image data
+        if(sourceImage1.empty())
+        {
+            std::cerr << "\nCould not read input image file: " 
+                      << image1<< '\n';
+            return -1; // Early exit from application
+        }
 
-    // First make sure size of second image is the same as that
-    // of the first image
-    cv::Mat dst; // image2 converted to same size as image1
-    cv::resize(sourceImage2, dst, cv::Size(sourceImage1.cols, sourceImage1.rows), 0.0, 0.0);
+        if(sourceImage2.empty())
+        {
+            std::cerr << "\nCould not read input image file: " 
+                      << image2<< '\n';
+            return -1; // Early exit from application
+        }
 
-    // Blend images
-    cv::Mat blendedImage; // array to save the blended image    
+        // Blend/Combine our two images
+        // ===========================
 
-    // We will use the function cv::addWeighted() to blend the two images
-    cv::addWeighted(sourceImage1, alpha, dst, (1.0 - alpha), 0.0, blendedImage);
+        // First make sure size of second image is the same as that
+        // of the first image
+        cv::Mat dst; // image2 converted to same size as image1
+        cv::resize(sourceImage2, dst, cv::Size(sourceImage1.cols, sourceImage1.rows), 0.0, 0.0);
 
-    // Display the blended image in window
-    cv::imshow("Blended Image", blendedImage);
+        // Blend images
+        cv::Mat blendedImage; // array to save the blended image    
 
-    cv::waitKey(0);
+        // We will use the function cv::addWeighted() to blend the two images
+        cv::addWeighted(sourceImage1, alpha, dst, (1.0 - alpha), 0.0, blendedImage);
+
+        // Display the blended image in window
+        cv::imshow("Blended Image", blendedImage);
+
+        const int key { cv::waitKey(0) };
+        if (key == '+')
+        {
+            alpha = std::min(alpha + 0.1, 1.0);
+        }
+        else if (key == '-')
+        {
+            alpha = std::max(alpha - 0.1, 0.0);
+        }
+        else if (key != 'r')
+        {
+            break;
+        }
+
+        std::cout << "alpha = " << alpha << '\n';
+    }
+
+    printCacheStatistics();
         
     std::cout << '\n';
 
     return 0;
-}
\ No newline at end of file
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Print how many images were read from the decoded image cache, and how many were decoded
+ */
+void printCacheStatistics()
+{
+    const CPP_CV::ImageCache::Statistics statistics { CPP_CV::ImageCache::DecodedImageCache::instance().statistics() };
+
+    std::cout << "\nDecoded image cache: " << statistics.hits << " reads from cache, " << statistics.misses 
+              << " decoded (" << statistics.invalidations << " because the file changed), " 
+              << statistics.evictions << " removed to stay within budget, " 
+              << statistics.bytes / (1024 * 1024) << " MB held\n";
+}
+
+//-------------------------- End of Function Definitions ---------------------//
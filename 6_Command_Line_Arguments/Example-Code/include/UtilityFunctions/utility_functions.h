@@ -2,9 +2,19 @@
 #define UTILITY_FUNCTIONS_H
 
 #include "opencv2/core.hpp" 
+#include "opencv2/imgcodecs.hpp" // for cv::IMREAD_COLOR
 
 #include <string_view>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>   // for std::unique_ptr
+#include <cstdint>  // for std::uint64_t, std::int64_t
+#include <optional> // for std::optional
 
 namespace CPP_CV {
 
@@ -283,6 +293,209 @@ namespace CPP_CV {
         }
 
     }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Measures the wall time spent in each stage of a batch job (e.g. decode, 
+         *        process, encode, write) over many images. Stages are printed in the 
+         *        order they were first timed.
+         */
+        class StageTimer 
+        {
+        public:
+
+            /**
+             * @brief Start timing a stage. A stage that is still being timed is stopped first.
+             * 
+             * @param stage name of stage e.g. "decode"
+             */
+            void start(const std::string& stage);
+
+
+            /**
+             * @brief Stop timing the current stage and add its time to the stage total
+             */
+            void stop();
+
+
+            /**
+             * @brief Print the no. of runs, total time, mean time and share of the 
+             *        total time of each stage
+             * 
+             * @param out stream to print to e.g. std::cout
+             */
+            void print(std::ostream& out = std::cout) const;
+
+        private:
+
+            struct Stage 
+            {
+                std::string name;
+                int count {0};                  // no. of times the stage was timed
+                double totalMilliseconds {0.0}; // total time spent in the stage
+            };
+
+            std::vector<Stage> m_stages;    // stages in the order they were first timed
+            std::string m_currentStage;     // stage being timed. Empty if no stage is being timed
+            int64 m_startTicks {0};         // value of cv::getTickCount() when the current stage started
+        };
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened (a message is printed to std::cerr)
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath);
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise (a message is printed to std::cerr)
+         */
+        bool createOutputDirectory(const std::string& outputDirectory);
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer);
+    }
+
+
+    namespace ImageCache {
+
+        /**
+         * @brief No. of reads served from the cache (hits) or decoded (misses), no. of images 
+         *        removed to stay within the memory budget (evictions), and no. of images decoded 
+         *        again because their file had changed (invalidations)
+         */
+        struct Statistics 
+        {
+            std::uint64_t hits {0};
+            std::uint64_t misses {0};
+            std::uint64_t evictions {0};
+            std::uint64_t invalidations {0};
+            std::size_t images {0};     // no. of images held
+            std::size_t bytes {0};      // total size of the images held
+        };
+
+
+        /**
+         * @brief Keeps decoded images in memory, so reading the same image file again does not 
+         *        decode it again. Images are keyed by file path, last write time and cv::imread() 
+         *        flags, so an image whose file has changed since it was decoded is decoded again.
+         * 
+         *        When the images held exceed the memory budget, the least recently used images are 
+         *        removed (LRU). Images are spread over several shards, each with its own lock, so 
+         *        threads reading different images rarely wait for each other. Images are decoded 
+         *        without holding a lock.
+         * 
+         *        imread() returns a cv::Mat that shares its pixels with the cache (nothing is copied). 
+         *        Do not change the pixels - clone() the image first.
+         */
+        class DecodedImageCache 
+        {
+        public:
+
+            /**
+             * @brief Create an empty cache
+             * 
+             * @param capacity memory budget: limit on the total size of the images held, in bytes
+             * @param shards no. of independently locked parts of the cache
+             */
+            explicit DecodedImageCache(std::size_t capacity, int shards = 16);
+
+            DecodedImageCache(const DecodedImageCache&) = delete;
+            DecodedImageCache& operator=(const DecodedImageCache&) = delete;
+
+            /**
+             * @brief The cache shared by the whole program. Its memory budget starts at 512 MB
+             */
+            static DecodedImageCache& instance();
+
+            /**
+             * @brief Read an image as cv::imread() does. The image is taken from the cache if it was 
+             *        decoded with the same flags and its file has not changed since
+             * 
+             * @param filePath full path to image file
+             * @param flags cv::ImreadModes flags for cv::imread()
+             * @return cv::Mat image sharing its pixels with the cache. Empty if the image could not be read
+             */
+            cv::Mat imread(const std::string& filePath, int flags = cv::IMREAD_COLOR);
+
+            /**
+             * @brief Change the memory budget, removing the least recently used images until they fit
+             * 
+             * @param capacity limit on the total size of the images held, in bytes
+             */
+            void setCapacity(std::size_t capacity);
+
+            std::size_t capacity() const { return m_capacity.load(); }
+
+            void clear();                       // remove every image. The statistics are kept
+            Statistics statistics() const;
+
+        private:
+
+            struct Entry 
+            {
+                std::string key;                // flags and file path
+                std::int64_t writeTime {0};     // last write time of the file when it was decoded
+                std::uintmax_t fileSize {0};    // size of the file when it was decoded
+                cv::Mat image;
+                std::size_t bytes {0};          // size of the image pixels
+                std::uint64_t lastUsed {0};     // value of m_clock when the image was last read
+            };
+
+            struct Shard 
+            {
+                std::mutex mutex;
+                std::list<Entry> entries;       // most recently used first
+                std::unordered_map<std::string, std::list<Entry>::iterator> index;
+            };
+
+            Shard& shardOf(const std::string& key);
+            void evict();
+
+            std::vector<std::unique_ptr<Shard>> m_shards;
+            std::atomic<std::size_t> m_capacity;
+            std::atomic<std::size_t> m_bytes {0};
+            std::atomic<std::size_t> m_images {0};
+            std::atomic<std::uint64_t> m_clock {0};     // counts reads, to find the least recently used image
+            std::atomic<std::uint64_t> m_hits {0};
+            std::atomic<std::uint64_t> m_misses {0};
+            std::atomic<std::uint64_t> m_evictions {0};
+            std::atomic<std::uint64_t> m_invalidations {0};
+        };
+
+
+        /**
+         * @brief Read an image through the cache shared by the whole program, DecodedImageCache::instance()
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes flags for cv::imread()
+         * @return cv::Mat image sharing its pixels with the cache. Do not change the pixels
+         */
+        cv::Mat imread(const std::string& filePath, int flags = cv::IMREAD_COLOR);
+    }
 }
 
 
@@ -1,5 +1,12 @@
 #include "UtilityFunctions/utility_functions.h"
 
+#include "opencv2/imgcodecs.hpp" // for cv::imencode()
+
+#include <filesystem> // handles files
+#include <fstream>    // for std::ifstream, std::ofstream
+#include <iomanip>    // for std::setw
+#include <algorithm>  // for std::find_if, std::max
+
 namespace CPP_CV {
 
     namespace General {
@@ -70,4 +77,413 @@ namespace CPP_CV {
 	}
     
     }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Start timing a stage. A stage that is still being timed is stopped first.
+         * 
+         * @param stage name of stage e.g. "decode"
+         */
+        void StageTimer::start(const std::string& stage)
+        {
+            stop();
+
+            m_currentStage = stage;
+            m_startTicks = cv::getTickCount();
+        }
+
+
+        /**
+         * @brief Stop timing the current stage and add its time to the stage total
+         */
+        void StageTimer::stop()
+        {
+            if (m_currentStage.empty())
+            {
+                return; // no stage is being timed
+            }
+
+            const double milliseconds { (cv::getTickCount() - m_startTicks) * 1000.0 / cv::getTickFrequency() };
+
+            auto found { std::find_if(m_stages.begin(), m_stages.end(), 
+                                      [this](const Stage& s) { return s.name == m_currentStage; }) };
+            if (found == m_stages.end())
+            {
+                m_stages.push_back(Stage { m_currentStage, 0, 0.0 });
+                found = m_stages.end() - 1;
+            }
+
+            ++found->count;
+            found->totalMilliseconds += milliseconds;
+
+            m_currentStage.clear();
+        }
+
+
+        /**
+         * @brief Print the no. of runs, total time, mean time and share of the 
+         *        total time of each stage
+         * 
+         * @param out stream to print to e.g. std::cout
+         */
+        void StageTimer::print(std::ostream& out) const
+        {
+            double totalMilliseconds {0.0};
+            for (const auto& stage : m_stages)
+            {
+                totalMilliseconds += stage.totalMilliseconds;
+            }
+
+            out << "\nStage       Runs    Total (ms)    Mean (ms)    Share\n";
+
+            for (const auto& stage : m_stages)
+            {
+                out << std::left << std::setw(10) << stage.name << std::right 
+                    << std::setw(6) << stage.count 
+                    << std::fixed << std::setprecision(2)
+                    << std::setw(14) << stage.totalMilliseconds 
+                    << std::setw(13) << stage.totalMilliseconds / stage.count 
+                    << std::setw(8) << std::setprecision(1) 
+                    << ((totalMilliseconds > 0) ? 100.0 * stage.totalMilliseconds / totalMilliseconds : 0.0) << " %\n";
+            }
+
+            out << std::left << std::setw(10) << "total" << std::right << std::setw(20) 
+                << std::setprecision(2) << totalMilliseconds << '\n';
+        }
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath)
+        {
+            std::vector<std::string> inputs;
+
+            std::ifstream file(listPath);
+            if (!file)
+            {
+                std::cerr << "\nCould not open list of inputs: " << listPath << '\n';
+
+                return std::nullopt;
+            }
+
+            std::string line;
+            while (std::getline(file, line))
+            {
+                // Remove trailing white space, including '\r' from files saved on Windows
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+
+                if (!line.empty() && (line[0] != '#'))
+                {
+                    inputs.push_back(line);
+                }
+            }
+
+            return inputs;
+        }
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise
+         */
+        bool createOutputDirectory(const std::string& outputDirectory)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(outputDirectory, error);
+
+            if (error || !std::filesystem::is_directory(outputDirectory, error))
+            {
+                std::cerr << "\nCould not create output directory " << outputDirectory 
+                          << (error ? ": " + error.message() : std::string()) << '\n';
+
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer)
+        {
+            std::filesystem::path savePath { outputDirectory };
+            savePath /= fileName;
+
+            // a. Compress the image with the codec that matches the file extension
+            timer.start("encode");
+
+            std::vector<uchar> buffer;
+            bool result {false};
+            try 
+            {
+                result = cv::imencode(savePath.extension().string(), image, buffer);
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nError compressing " << fileName << ": " << ex.what();
+            }
+
+            timer.stop();
+
+            if (!result)
+            {
+                return false;
+            }
+
+            // b. Save the compressed image
+            timer.start("write");
+
+            std::ofstream file(savePath, std::ios::out | std::ios::binary);
+            file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            result = static_cast<bool>(file);
+            timer.stop();
+
+            return result;
+        }
+    }
+
+
+    namespace ImageCache {
+
+        /**
+         * @brief Create an empty cache
+         * 
+         * @param capacity memory budget: limit on the total size of the images held, in bytes
+         * @param shards no. of independently locked parts of the cache
+         */
+        DecodedImageCache::DecodedImageCache(std::size_t capacity, int shards) 
+            : m_capacity {capacity}
+        {
+            for (int i {0}; i < std::max(shards, 1); ++i)
+            {
+                m_shards.push_back(std::make_unique<Shard>());
+            }
+        }
+
+
+        /**
+         * @brief The cache shared by the whole program. Its memory budget starts at 512 MB
+         */
+        DecodedImageCache& DecodedImageCache::instance()
+        {
+            static DecodedImageCache cache(static_cast<std::size_t>(512) * 1024 * 1024);
+
+            return cache;
+        }
+
+
+        DecodedImageCache::Shard& DecodedImageCache::shardOf(const std::string& key)
+        {
+            return *m_shards[std::hash<std::string>{}(key) % m_shards.size()];
+        }
+
+
+        /**
+         * @brief Read an image as cv::imread() does. The image is taken from the cache if it was 
+         *        decoded with the same flags and its file has not changed since
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes flags for cv::imread()
+         * @return cv::Mat image sharing its pixels with the cache. Empty if the image could not be read
+         */
+        cv::Mat DecodedImageCache::imread(const std::string& filePath, int flags)
+        {
+            // The file is checked on every read, so a changed file is never served from the cache
+            std::error_code error;
+            const auto writeTime { std::filesystem::last_write_time(filePath, error) };
+            const std::uintmax_t fileSize { error ? 0 : std::filesystem::file_size(filePath, error) };
+            if (error)
+            {
+                ++m_misses;
+
+                return cv::imread(filePath, flags);
+            }
+
+            const std::int64_t writeTicks { static_cast<std::int64_t>(writeTime.time_since_epoch().count()) };
+            const std::string key { std::to_string(flags) + '|' + filePath };
+            Shard& shard { shardOf(key) };
+
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+
+                const auto found { shard.index.find(key) };
+                if (found != shard.index.end())
+                {
+                    Entry& entry { *found->second };
+                    if ((entry.writeTime == writeTicks) && (entry.fileSize == fileSize))
+                    {
+                        entry.lastUsed = ++m_clock;
+                        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+                        ++m_hits;
+
+                        return entry.image;
+                    }
+
+                    // The file has changed since it was decoded
+                    m_bytes -= entry.bytes;
+                    --m_images;
+                    ++m_invalidations;
+                    shard.entries.erase(found->second);
+                    shard.index.erase(found);
+                }
+            }
+
+            // Decode without holding the lock. Two threads missing the same image both decode it
+            ++m_misses;
+            cv::Mat image { cv::imread(filePath, flags) };
+            const std::size_t bytes { image.total() * image.elemSize() };
+            if (image.empty() || (bytes > m_capacity.load()))
+            {
+                return image;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+
+                const auto found { shard.index.find(key) };
+                if (found != shard.index.end())
+                {
+                    m_bytes -= found->second->bytes;
+                    --m_images;
+                    shard.entries.erase(found->second);
+                    shard.index.erase(found);
+                }
+
+                shard.entries.push_front(Entry{ key, writeTicks, fileSize, image, bytes, ++m_clock });
+                shard.index[key] = shard.entries.begin();
+                m_bytes += bytes;
+                ++m_images;
+            }
+
+            evict();
+
+            return image;
+        }
+
+
+        /**
+         * @brief Remove the least recently used images until the images held fit in the memory budget. 
+         *        The least recently used image is at the back of one of the shards. Only one shard 
+         *        is locked at a time
+         */
+        void DecodedImageCache::evict()
+        {
+            while (m_bytes.load() > m_capacity.load())
+            {
+                Shard* oldest {nullptr};
+                std::uint64_t oldestUse {UINT64_MAX};
+                for (auto& shard : m_shards)
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    if (!shard->entries.empty() && (shard->entries.back().lastUsed < oldestUse))
+                    {
+                        oldestUse = shard->entries.back().lastUsed;
+                        oldest = shard.get();
+                    }
+                }
+
+                if (oldest == nullptr)
+                {
+                    return; // the cache is empty
+                }
+
+                // Another thread may have read or removed the image since, so the back of 
+                // the shard is removed whatever it now holds
+                std::lock_guard<std::mutex> lock(oldest->mutex);
+                if (m_bytes.load() <= m_capacity.load())
+                {
+                    return; // another thread made room first
+                }
+                if (oldest->entries.empty())
+                {
+                    continue;
+                }
+
+                const Entry& entry { oldest->entries.back() };
+                m_bytes -= entry.bytes;
+                --m_images;
+                ++m_evictions;
+                oldest->index.erase(entry.key);
+                oldest->entries.pop_back();
+            }
+        }
+
+
+        /**
+         * @brief Change the memory budget, removing the least recently used images until they fit
+         * 
+         * @param capacity limit on the total size of the images held, in bytes
+         */
+        void DecodedImageCache::setCapacity(std::size_t capacity)
+        {
+            m_capacity = capacity;
+
+            evict();
+        }
+
+
+        void DecodedImageCache::clear()
+        {
+            for (auto& shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                for (const auto& entry : shard->entries)
+                {
+                    m_bytes -= entry.bytes;
+                    --m_images;
+                }
+                shard->entries.clear();
+                shard->index.clear();
+            }
+        }
+
+
+        Statistics DecodedImageCache::statistics() const
+        {
+            Statistics statistics;
+            statistics.hits = m_hits.load();
+            statistics.misses = m_misses.load();
+            statistics.evictions = m_evictions.load();
+            statistics.invalidations = m_invalidations.load();
+            statistics.images = m_images.load();
+            statistics.bytes = m_bytes.load();
+
+            return statistics;
+        }
+
+
+        /**
+         * @brief Read an image through the cache shared by the whole program, DecodedImageCache::instance()
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes flags for cv::imread()
+         * @return cv::Mat image sharing its pixels with the cache. Do not change the pixels
+         */
+        cv::Mat imread(const std::string& filePath, int flags)
+        {
+            return DecodedImageCache::instance().imread(filePath, flags);
+        }
+    }
 }
\ No newline at end of file
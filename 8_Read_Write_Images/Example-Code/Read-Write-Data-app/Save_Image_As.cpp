@@ -48,12 +48,14 @@ int main(int argc, char* argv[])
      *      1. image to read/open 
      *      2. path to save image
      *      3. quality of compression 
+     *      4. (optional) use our multi-threaded PNG encoder
     */
     const cv::String keys = 
         "{help h usage ? | | Save an image file }"
         "{@image | <none> | Full path to image file }"
         "{@path | <none> | Full path to save image to. Should include file name and extension.  }"
-        "{@quality | 1 | quality of compression }";
+        "{@quality | 1 | quality of compression }"
+        "{parallelPNG | false | compress png files on all threads with our parallel deflate encoder instead of cv::imwrite() }";
 
     // define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -69,6 +71,7 @@ int main(int argc, char* argv[])
     cv::String imagePath = parser.get<cv::String>("@image"); 
     cv::String savePath = parser.get<cv::String>("@path"); 
     int qualityOfCompression = parser.get<int>("@quality"); 
+    bool parallelPNG = parser.get<bool>("parallelPNG");
 
     // Check for any errors encountered 
     if(!parser.check())
@@ -134,7 +137,18 @@ int main(int argc, char* argv[])
     bool result = false;
 
     try {
-        result = cv::imwrite(savePath, image, compression_params);
+        if (parallelPNG && (CPP_CV::ReadWriteFiles::getFileExtension(savePath) == "png"))
+        {
+            // Rows are filtered and deflated on all the threads available to OpenCV, 
+            // then the PNG file is written in a few large writes
+            std::vector<uchar> buffer;
+            result = CPP_CV::ReadWriteFiles::encodePNGParallel(image, buffer, qualityOfCompression) && 
+                     CPP_CV::ReadWriteFiles::writeBufferToFile(savePath, buffer);
+        }
+        else 
+        {
+            result = cv::imwrite(savePath, image, compression_params);
+        }
     } 
     catch (const cv::Exception& ex)
     {
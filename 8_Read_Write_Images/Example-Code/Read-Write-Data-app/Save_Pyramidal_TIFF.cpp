@@ -0,0 +1,237 @@
+// Program: Save_Pyramidal_TIFF.cpp
+
+/*
+ * Program saves an image as a tiled pyramidal TIFF file, the format slide scanners, map
+ * servers and image viewers use to show very large images quickly at any zoom.
+ *
+ * The first page of the file holds the full resolution image. Every following page is
+ * marked as a reduced resolution image, and is half the width and height of the page
+ * before it (each pixel is the average of 2 x 2 pixels), down to a page that fits in one
+ * tile. Every page is stored as tiles, so a viewer can show any part of the image at any
+ * zoom by picking the page closest to the zoom and reading only the few tiles on screen.
+ *
+ * All the pages are made in a single pass over the image, one row of tiles at a time,
+ * so the pyramid costs little more time than saving the full resolution image alone.
+ * cv::imread() reads the full resolution page of the file, and cv::imreadmulti() reads
+ * every page.
+ *
+ * Program inputs are provided through the command line
+*/
+
+#include "opencv2/core.hpp"            // for core data types
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgcodecs.hpp"       // for cv::imread()
+
+#include <UtilityFunctions/utility_functions.h> // for user-defined functions
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <vector>
+#include <string>
+#include <filesystem>  // handles files
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Convert a compression name to a lossless TIFF compression scheme
+ *
+ * @param name one of none, lzw or deflate
+ * @param compression TIFF compression scheme matching name
+ * @return true if name is a supported compression scheme
+ * @return false otherwise
+ */
+bool parseTiffCompression(const std::string& name, CPP_CV::ReadWriteFiles::TiffCompression& compression);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+int main(int argc, char* argv[])
+{
+
+    ////////////////////////////// 1. Extract Command Line Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     * We need 3 arguments:
+     *      1. full path to image file
+     *      2. path to directory to save pyramidal image file
+     *      3. name of file to save image
+     *
+     * and the following are optional:
+     *      4. compression scheme
+     *      5. predictor applied before compression
+     *      6. size of square tiles
+     *      7. Deflate level (1 - 9)
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Save an image as a tiled pyramidal TIFF file }"
+        "{@image | <none> | full path to image file }"
+        "{@path | <none> | full path to directory to save pyramidal image file }"
+        "{@fileName| <none> | name of pyramidal image file with extension .tiff }"
+        "{compression | deflate | compression scheme: none, lzw or deflate }"
+        "{predictor | 2 | 1 = none, 2 = horizontal differencing, 3 = floating point. Used with lzw and deflate }"
+        "{tileSize | 256 | width and height of tiles (multiple of 16). Every page is reduced until it fits in one tile }"
+        "{quality | -1 | Deflate level (1 - 9). -1 uses the default }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nSave an image as a tiled, multi-resolution (pyramidal) Tag Image File Format (TIFF) file.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("@image"); // full path to image file
+    cv::String saveDirectoryPath = parser.get<cv::String>("@path"); // full path to directory to save image
+    cv::String fileName = parser.get<cv::String>("@fileName"); // name of pyramidal image file
+    cv::String compressionName = parser.get<cv::String>("compression"); // compression scheme
+    int predictor = parser.get<int>("predictor"); // predictor used with LZW and Deflate
+    int tileSize = parser.get<int>("tileSize"); // width and height of tiles
+    int quality = parser.get<int>("quality"); // Deflate level
+
+    // Check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors(); // Print any errors
+
+        return -1;
+    }
+
+    // Check if user has provided a suitable file name with the extension '.tiff'
+    using namespace std::string_literals; // converts 'tiff' from 'const char' to 'std::string' by simply adding an 's'
+    if(CPP_CV::ReadWriteFiles::getFileExtension(fileName) != "tiff"s)
+    {
+        std::cout << "\nERROR: Your filename should have '.tiff' extension.\n";
+
+        return -1;
+    }
+
+    // Collect the TIFF options into a single structure
+    CPP_CV::ReadWriteFiles::TiffWriteOptions options;
+    if (!parseTiffCompression(compressionName, options.compression))
+    {
+        std::cerr << "\nERROR: Unknown compression '" << compressionName << "'. Use none, lzw or deflate.\n";
+
+        return -1;
+    }
+
+    if ((predictor < 1) || (predictor > 3) || (tileSize <= 0))
+    {
+        std::cerr << "\nERROR: Predictor should be 1, 2 or 3, and tile size should be greater than 0.\n";
+
+        return -1;
+    }
+
+    if ((quality != -1) && ((quality < 1) || (quality > 9)))
+    {
+        std::cerr << "\nERROR: Deflate level should be 1 to 9, or -1 for the default.\n";
+
+        return -1;
+    }
+
+    options.predictor = predictor;
+    options.tileWidth = tileSize;
+    options.tileHeight = tileSize;
+    if (quality != -1)
+    {
+        options.deflateLevel = quality;
+    }
+
+    //------------------------- End of Extracting Command Line Arguments ---------------------//
+
+    ///////////////////////// 2. Read Image File //////////////////////////////////
+
+    // Use cv::imread() to read the image file as is
+    cv::Mat image { cv::imread(imagePath, cv::IMREAD_UNCHANGED) };
+
+    // check if we have successfully opened the image
+    if (image.empty())
+    {
+        std::cerr << "\nCould not read data from image file: " << imagePath << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nImage (width x height): " << image.cols << " x " << image.rows
+              << "\nImage data type: " << CPP_CV::General::openCVDescriptiveDataType(image.type()) << '\n';
+
+    //----------------------- End of Read Image File --------------------------//
+
+
+    //////////////////////// 3. Save To Pyramidal TIFF Image File ////////////////////////////////
+
+    // Directory + file name == Full file path
+    const std::filesystem::path savePath { std::filesystem::path{saveDirectoryPath} / fileName };
+
+    // Since we now have everything we need we can now save our image
+    // We will do it in a try...catch block as it might fail
+
+    bool result = false;
+
+    cv::TickMeter timer;
+    timer.start();
+
+    try {
+        result = CPP_CV::ReadWriteFiles::writePyramidalTIFF(savePath.string(), image, options);
+    }
+    catch (const cv::Exception& ex)
+    {
+        std::cerr << "\nERROR: " << ex.what();
+    }
+
+    timer.stop();
+
+    if (!result)
+    {
+        std::cerr << "\nERROR: Could not save image to pyramidal file: " << savePath << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nSaved pyramidal image to file: " << savePath << " (" << std::filesystem::file_size(savePath)
+              << " bytes) in " << timer.getTimeMilli() << " ms\n";
+
+    // Tile sizes are rounded up to a multiple of 16, as writePyramidalTIFF() does
+    const int savedTileSize { (tileSize + 15) / 16 * 16 };
+    const std::vector<cv::Size> levelSizes { CPP_CV::ReadWriteFiles::pyramidLevelSizes(image.size(),
+                                                                                      cv::Size(savedTileSize, savedTileSize)) };
+
+    std::cout << "\n" << std::left << std::setw(8) << "Page" << std::setw(16) << "Downsample"
+              << std::setw(24) << "Width x Height" << "Tiles" << '\n';
+    for (std::size_t level {0}; level < levelSizes.size(); ++level)
+    {
+        const cv::Size& size { levelSizes[level] };
+        const int tilesAcross { (size.width + savedTileSize - 1) / savedTileSize };
+        const int tilesDown { (size.height + savedTileSize - 1) / savedTileSize };
+
+        std::cout << std::setw(8) << level << std::setw(16) << ("1/" + std::to_string(1 << level))
+                  << std::setw(24) << (std::to_string(size.width) + " x " + std::to_string(size.height))
+                  << tilesAcross * tilesDown << '\n';
+    }
+
+    //----------------------- End of Save To Pyramidal TIFF Image File -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/**
+ * @brief Convert a compression name to a lossless TIFF compression scheme
+ *
+ * @param name one of none, lzw or deflate
+ * @param compression TIFF compression scheme matching name
+ * @return true if name is a supported compression scheme
+ * @return false otherwise
+ */
+bool parseTiffCompression(const std::string& name, CPP_CV::ReadWriteFiles::TiffCompression& compression)
+{
+    using CPP_CV::ReadWriteFiles::TiffCompression;
+
+    if (name == "none")         { compression = TiffCompression::none; }
+    else if (name == "lzw")     { compression = TiffCompression::lzw; }
+    else if (name == "deflate") { compression = TiffCompression::deflate; }
+    else                        { return false; }
+
+    return true;
+}
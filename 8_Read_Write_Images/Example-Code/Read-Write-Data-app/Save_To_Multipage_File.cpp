@@ -2,18 +2,93 @@
 
 /* 
  * Program saves multiple images into a single TIFF multi-page image file
+ *
+ * Optionally the pages can be compressed (LZW, Deflate or JPEG), written as tiles instead
+ * of strips, and have a predictor applied before compression. Predictors make neighbouring
+ * pixel values smaller (by storing differences) which helps LZW and Deflate a lot on
+ * photographs and scientific data.
+ *
+ * With the 'benchmark' option the program saves the pages with every combination of
+ * compression, predictor and tiling and reports the file size, write time and read time
+ * of each, so you can pick the best settings for your images.
+ *
+ * In watch mode (Linux only), the program keeps watching the directory instead. Each new
+ * image file is read as soon as the program writing it has closed it (e.g. a camera), and
+ * every 'pagesPerFile' new images are saved as a numbered multi-page file. The time from
+ * each file arriving to its page being saved is reported.
+ *
+ * With the 'recursive' option the images in all sub-directories are saved too. The directory
+ * tree is scanned on several threads, and files are filtered by extension before we ask
+ * OpenCV whether it can read them. Pages are saved in order of their full path.
+ *
  * Program inputs are provided through the command line 
 */
 
 #include "opencv2/core.hpp"            // for core data types
-#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser
-#include "opencv2/imgcodecs.hpp"       // for cv::imread() and cv::imwrite()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgcodecs.hpp"       // for cv::imread(), cv::imreadmulti() and cv::imwrite()
 
 #include <UtilityFunctions/utility_functions.h> // for user-defined functions
 
 #include <iostream>
+#include <iomanip>     // for std::setw
 #include <vector>
+#include <string>
+#include <algorithm>   // for std::sort, std::all_of
+#include <optional>
+#include <sstream>     // for std::ostringstream
 #include <filesystem>  // handles files
+#include <set>
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Convert a compression name to a TIFF compression scheme
+ *
+ * @param name one of none, lzw, deflate or jpeg
+ * @param compression TIFF compression scheme matching name
+ * @return true if name is a supported compression scheme
+ * @return false otherwise
+ */
+bool parseTiffCompression(const std::string& name, CPP_CV::ReadWriteFiles::TiffCompression& compression);
+
+/**
+ * @brief Save pages to a TIFF file. cv::imwrite() is used whenever it supports the 
+ *        requested options, otherwise CPP_CV::ReadWriteFiles::writeMultipageTIFF()
+ *
+ * @param filePath full path of TIFF file
+ * @param pages images to save, one per page
+ * @param options compression, predictor and tiling options
+ * @return true if file was saved
+ * @return false otherwise
+ */
+bool saveTIFF(const std::string& filePath, const std::vector<cv::Mat>& pages, 
+              const CPP_CV::ReadWriteFiles::TiffWriteOptions& options);
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values);
+
+/**
+ * @brief Watch a directory, and save every 'pagesPerFile' new images to a numbered TIFF 
+ *        multi-page file, e.g. pages_1.tiff, pages_2.tiff, ... Stops on Ctrl+C (or SIGTERM), 
+ *        or when no image arrives for timeoutSeconds, after saving any remaining images
+ *
+ * @param directory full path to directory to watch
+ * @param savePath full path of TIFF file. The file number is added to its name
+ * @param options compression, predictor and tiling options
+ * @param pagesPerFile no. of images saved in each file
+ * @param timeoutSeconds stop after this many seconds without a new file. 0 = never (stop with Ctrl+C)
+ * @return int 0 if the directory could be watched, -1 otherwise
+ */
+int watchDirectoryToTIFF(const std::string& directory, const std::filesystem::path& savePath, 
+                         const CPP_CV::ReadWriteFiles::TiffWriteOptions& options, int pagesPerFile, int timeoutSeconds);
+
+//-------------------------- End of Function Declarations ---------------------//
 
 int main(int argc, char* argv[])
 {
@@ -27,12 +102,39 @@ int main(int argc, char* argv[])
      *      2. path to directory to save image
      *      3. name of file to save image 
      * 
+     * and the following are optional:
+     *      4. compression scheme
+     *      5. predictor applied before LZW or Deflate compression
+     *      6. size of square tiles. 0 saves pages as strips
+     *      7. no. of rows per strip. 0 lets libtiff choose
+     *      8. quality (1 - 100). JPEG uses it as is, Deflate maps it to a level (1 - 9)
+     *      9. benchmark all compression, predictor and tiling settings
+     *     10. no. of times each setting is written and read when benchmarking
+     *     11. manifest file, so a re-run skips the job if no image has changed
+     *     12. watch the directory and save new images as they arrive
+     *     13. no. of images in each file, and how long to wait for new images, in watch mode
+     *     14. also save the images in all sub-directories
+     *     15. only save files with these extensions
+     * 
     */
     const cv::String keys = 
         "{help h usage ? | | Save multiple images as a TIFF multi-page file }"
         "{@path1 | <none> | full path to directory with multiple images }"
         "{@path2 | <none> | full path to directory to save multi-page image file }"
-        "{@fileName| <none> | name of multi-page image file with extension .tiff }";
+        "{@fileName| <none> | name of multi-page image file with extension .tiff }"
+        "{compression | lzw | compression scheme: none, lzw (default of cv::imwrite()), deflate or jpeg }"
+        "{predictor | 1 | 1 = none, 2 = horizontal differencing, 3 = floating point. Used with lzw and deflate }"
+        "{tileSize | 0 | width and height of tiles (multiple of 16). 0 saves pages as strips }"
+        "{rowsPerStrip | 0 | no. of rows in each strip. 0 lets libtiff choose }"
+        "{quality | -1 | 1 - 100, higher keeps more detail (JPEG) or makes a smaller file (Deflate level 1 - 9). -1 uses the defaults }"
+        "{benchmark | false | compare file size, write and read time of all compression settings }"
+        "{repeat | 3 | no. of times each setting is written and read when benchmarking }"
+        "{manifest | | full path to manifest file (.xml, .yml, .yaml or .json). Skip the job if the images and settings have not changed }"
+        "{watch | false | keep watching the directory and save new images as they arrive (Linux) }"
+        "{pagesPerFile | 10 | watch mode: no. of new images saved in each numbered multi-page file }"
+        "{watchTimeout | 0 | watch mode: stop after this many seconds without a new file. 0 = never }"
+        "{recursive | false | also save the images in all sub-directories (not in watch mode) }"
+        "{extensions | | comma separated list of file extensions to save, e.g. jpg,png. Empty saves all image files }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -45,6 +147,19 @@ int main(int argc, char* argv[])
     cv::String multipleImagesDirectoryPath = parser.get<cv::String>("@path1"); // full path to directory with multiple images
     cv::String saveDirectoryPath = parser.get<cv::String>("@path2"); // full path to directory to save image
     cv::String fileName = parser.get<cv::String>("@fileName"); // name of multi-page image file
+    cv::String compressionName = parser.get<cv::String>("compression"); // compression scheme
+    int predictor = parser.get<int>("predictor"); // predictor used with LZW and Deflate
+    int tileSize = parser.get<int>("tileSize"); // 0 = strips
+    int rowsPerStrip = parser.get<int>("rowsPerStrip"); // 0 = libtiff default
+    int quality = parser.get<int>("quality"); // JPEG quality, also mapped to a Deflate level
+    bool benchmark = parser.get<bool>("benchmark"); // compare all settings
+    int repeat = parser.get<int>("repeat"); // no. of runs per setting when benchmarking
+    cv::String manifestPath = parser.get<cv::String>("manifest"); // record of images saved by previous runs
+    bool watchMode = parser.get<bool>("watch"); // save new images as they arrive
+    int pagesPerFile = parser.get<int>("pagesPerFile"); // no. of images per file in watch mode
+    int watchTimeout = parser.get<int>("watchTimeout"); // seconds without a new file before watch mode stops
+    bool recursive = parser.get<bool>("recursive"); // also save images in sub-directories
+    cv::String extensions = parser.get<cv::String>("extensions"); // e.g. jpg,png
 
     // Check for any errors encountered 
     if(!parser.check())
@@ -63,52 +178,142 @@ int main(int argc, char* argv[])
         return -1;
     }
 
+    // Collect the TIFF options into a single structure
+    CPP_CV::ReadWriteFiles::TiffWriteOptions options;
+    if (!parseTiffCompression(compressionName, options.compression))
+    {
+        std::cerr << "\nERROR: Unknown compression '" << compressionName << "'. Use none, lzw, deflate or jpeg.\n";
+
+        return -1;
+    }
+
+    if ((predictor < 1) || (predictor > 3) || (tileSize < 0) || (rowsPerStrip < 0) || (repeat <= 0))
+    {
+        std::cerr << "\nERROR: Predictor should be 1, 2 or 3, tile size and rows per strip should not be negative, "
+                  << "and repeat should be greater than 0.\n";
+
+        return -1;
+    }
+
+    if ((quality != -1) && ((quality < 1) || (quality > 100)))
+    {
+        std::cerr << "\nERROR: Quality should be 1 to 100, or -1 for the defaults.\n";
+
+        return -1;
+    }
+
+    options.predictor = predictor;
+    options.tileWidth = tileSize;
+    options.tileHeight = tileSize;
+    options.rowsPerStrip = rowsPerStrip;
+    // One quality setting for both, so the benchmark compares JPEG and Deflate at the same setting
+    if (quality != -1)
+    {
+        options.jpegQuality = quality;
+        options.deflateLevel = CPP_CV::ReadWriteFiles::qualityToDeflateLevel(quality);
+    }
+
+    // Which files in the directory tree to save
+    CPP_CV::Directories::ScanOptions scanOptions;
+    scanOptions.recursive = recursive;
+    scanOptions.extensions = CPP_CV::Directories::parseExtensionList(extensions);
+
     //------------------------- End of Extracting Command Line Arguments ---------------------//
 
+    // In watch mode only new images are saved, so the images already in the directory are not read
+    if (watchMode)
+    {
+        if ((pagesPerFile <= 0) || (watchTimeout < 0))
+        {
+            std::cerr << "\nERROR: Pages per file should be greater than 0, and watch timeout should not be negative.\n";
+
+            return -1;
+        }
+
+        return watchDirectoryToTIFF(multipleImagesDirectoryPath, std::filesystem::path{saveDirectoryPath} / fileName, 
+                                    options, pagesPerFile, watchTimeout);
+    }
+
     ///////////////////////// 2. Read Image Files from Directory //////////////////////////////////
 
+    const std::string outputPath { (std::filesystem::path{saveDirectoryPath} / fileName).string() };
+
+    // Settings that change the output file. If any of them change, the file is written again
+    std::ostringstream settings;
+    settings << "compression=" << compressionName << ";predictor=" << predictor << ";tileSize=" << tileSize 
+             << ";rowsPerStrip=" << rowsPerStrip << ";quality=" << quality;
+
+    /*
+     * With a manifest, we first check (without decoding any image) if the directory still has 
+     * exactly the images the output file was last made from, and none of them has changed. 
+     * If so there is nothing to do. A multi-page file cannot be partly updated, so if any 
+     * image was added, removed or changed, all the images are read and the file is written again.
+    */
+    std::optional<CPP_CV::ReadWriteFiles::ProcessingManifest> manifest;
+    if (!manifestPath.empty())
+    {
+        manifest.emplace(manifestPath);
+
+        const std::vector<std::string> imageFiles { CPP_CV::Directories::listFiles(multipleImagesDirectoryPath, scanOptions) };
+
+        const bool upToDate { !imageFiles.empty() && (manifest->inputsOf(outputPath).size() == imageFiles.size()) &&
+                              std::all_of(imageFiles.begin(), imageFiles.end(), [&](const std::string& imageFile) {
+                                  return manifest->isUpToDate(imageFile, outputPath, settings.str());
+                              }) };
+
+        if (upToDate && !benchmark)
+        {
+            std::cout << "\nSkipped: none of the " << imageFiles.size() << " images has changed since " 
+                      << outputPath << " was saved.\n\n";
+
+            return 0;
+        }
+    }
+
     // We will go through a directory/folder and save all images that 
     // we can read with OpenCV into a std::vector
     std::vector<cv::Mat> multipleImages; // container for multiple images
+    std::vector<std::string> multipleImagePaths; // full path to each image in 'multipleImages'
 
     /* 
-     * We will use an iterator 'directory_iterator' from std::filesystem to 
-     * go through the directory contents. First, you need to create a 'std::filesystem::path'
-     * object using the directory full path.
+     * We will use our DirectoryScanner (through listFiles()) to go through the directory 
+     * contents, and the contents of its sub-directories if 'recursive' is set. The files 
+     * are sorted by their full path, so the pages are always saved in the same order.
      *  
-     * However, this iterator will not go through any sub-directories
+     * We check for an image reader ourselves below, so we can report the files we cannot read
     */
-    const std::filesystem::path multipleImagesDir {multipleImagesDirectoryPath}; 
+    scanOptions.checkImageReader = false;
 
-    for (auto const& dir_entry :std::filesystem::directory_iterator{multipleImagesDir})
+    for (auto const& filePath : CPP_CV::Directories::listFiles(multipleImagesDirectoryPath, scanOptions))
     {
         /* 
          * Before attempting to read the file, check if it is an image file by 
          * using cv::haveImageReader(). Even if it is an image file, here we can 
          * also check if we have an image reader for that image file
         */
-        if(!cv::haveImageReader(dir_entry.path().string()))
+        if(!cv::haveImageReader(filePath))
         {
-            std::cerr << "\nCannot read the file: " << dir_entry.path() 
+            std::cerr << "\nCannot read the file: " << filePath 
                       << " as an image file." << '\n';           
         }
         else 
         {
             // Use cv::imread() to read an image file as is 
             // and save the image as a cv::Mat array
-            cv::Mat image { cv::imread(dir_entry.path().string(), cv::IMREAD_UNCHANGED) };    
+            cv::Mat image { cv::imread(filePath, cv::IMREAD_UNCHANGED) };    
 
             // check if we have successfully opened the image
             if (image.empty())
             {
                 std::cerr << "Could not read data from image file: " 
-                        << dir_entry.path().string() << '\n';
+                        << filePath << '\n';
                 
             }
             else // if we can read image data
             {
                 // Place image file into std::vector
                 multipleImages.push_back(image);
+                multipleImagePaths.push_back(filePath);
             }
 
         }
@@ -138,7 +343,7 @@ int main(int argc, char* argv[])
     bool result = false;
 
     try {
-        result = cv::imwrite(savePath.string(), multipleImages);
+        result = saveTIFF(savePath.string(), multipleImages, options);
     } 
     catch (const cv::Exception& ex)
     {
@@ -149,18 +354,387 @@ int main(int argc, char* argv[])
     if(result)
     {
         std::cout << "\nSaved multiple images to single file: " 
-                  << savePath << '\n'; 
+                  << savePath << " (" << std::filesystem::file_size(savePath) << " bytes)\n"; 
+
+        // Replace what the manifest knows about the file with the images it now holds
+        if (manifest)
+        {
+            manifest->forgetOutput(savePath.string());
+
+            bool recorded {true};
+            for (const auto& imagePath : multipleImagePaths)
+            {
+                recorded = manifest->record(imagePath, savePath.string(), settings.str()) && recorded;
+            }
+
+            if (!recorded || !manifest->save())
+            {
+                std::cerr << "\nWarning: Could not update manifest file " << manifestPath << '\n';
+            }
+        }
     }
     else 
     {
-        std::cerr << "\nERROR: Could not multiple images to fingle file: " 
+        std::cerr << "\nERROR: Could not save multiple images to single file: " 
                   << savePath << '\n';
     }
     
     //----------------------- End of Save To Multi-page TIFF Image File -------------------//
 
+
+    //////////////////////// 4. Benchmark Compression Settings ////////////////////////////////
+
+    if (benchmark)
+    {
+        /*
+         * Each setting is written to the same scratch file 'repeat' times and read back
+         * with cv::imreadmulti(). The first row uses cv::imwrite() with its defaults as a 
+         * baseline. Predictors only apply to LZW and Deflate, and the floating point 
+         * predictor is only tried when every page is CV_32F or CV_64F.
+        */
+        using CPP_CV::ReadWriteFiles::TiffCompression;
+        using CPP_CV::ReadWriteFiles::TiffWriteOptions;
+
+        const bool allFloatingPoint = std::all_of(multipleImages.begin(), multipleImages.end(), 
+                                                  [](const cv::Mat& page) { 
+                                                      return (page.depth() == CV_32F) || (page.depth() == CV_64F); 
+                                                  });
+        const bool jpegSupported = std::all_of(multipleImages.begin(), multipleImages.end(), 
+                                               [](const cv::Mat& page) { 
+                                                   return (page.depth() == CV_8U) && ((page.channels() == 1) || (page.channels() == 3)); 
+                                               });
+
+        struct BenchmarkSetting 
+        {
+            std::string name;
+            bool useImwrite;
+            TiffWriteOptions options;
+        };
+
+        std::vector<BenchmarkSetting> settings;
+        settings.push_back({ "imwrite default", true, TiffWriteOptions() });
+
+        const std::vector<std::pair<std::string, TiffCompression>> compressions {
+            {"none", TiffCompression::none}, {"lzw", TiffCompression::lzw}, 
+            {"deflate", TiffCompression::deflate}, {"jpeg", TiffCompression::jpeg} };
+
+        for (const auto& [compressionLabel, compression] : compressions)
+        {
+            if ((compression == TiffCompression::jpeg) && !jpegSupported)
+            {
+                continue;
+            }
+
+            std::vector<int> predictors {1};
+            if ((compression == TiffCompression::lzw) || (compression == TiffCompression::deflate))
+            {
+                predictors.push_back(allFloatingPoint ? 3 : 2);
+            }
+
+            for (int benchmarkPredictor : predictors)
+            {
+                for (int benchmarkTileSize : {0, 256})
+                {
+                    TiffWriteOptions benchmarkOptions;
+                    benchmarkOptions.compression = compression;
+                    benchmarkOptions.predictor = benchmarkPredictor;
+                    benchmarkOptions.tileWidth = benchmarkTileSize;
+                    benchmarkOptions.tileHeight = benchmarkTileSize;
+                    benchmarkOptions.jpegQuality = options.jpegQuality;
+                    benchmarkOptions.deflateLevel = options.deflateLevel;
+
+                    std::string name { compressionLabel };
+                    name += (benchmarkPredictor > 1) ? " +pred" + std::to_string(benchmarkPredictor) : "";
+                    name += (benchmarkTileSize > 0) ? " tiled" : " strips";
+
+                    settings.push_back({ name, false, benchmarkOptions });
+                }
+            }
+        }
+
+        const std::filesystem::path scratchPath { std::filesystem::path{saveDirectoryPath} / "benchmark_scratch.tiff" };
+
+        std::cout << "\nBenchmark (" << repeat << " runs per setting, median times)\n\n"
+                  << std::left << std::setw(22) << "Setting" << std::right
+                  << std::setw(14) << "Size (bytes)" << std::setw(10) << "Ratio"
+                  << std::setw(14) << "Write (ms)" << std::setw(14) << "Read (ms)" << '\n';
+
+        std::uintmax_t uncompressedSize {0};
+
+        for (const BenchmarkSetting& setting : settings)
+        {
+            std::vector<double> writeTimes;
+            std::vector<double> readTimes;
+            bool settingResult = true;
+
+            for (int i {0}; (i < repeat) && settingResult; ++i)
+            {
+                cv::TickMeter timer;
+                timer.start();
+                try {
+                    settingResult = setting.useImwrite ? cv::imwrite(scratchPath.string(), multipleImages)
+                                                       : CPP_CV::ReadWriteFiles::writeMultipageTIFF(scratchPath.string(), 
+                                                                                                      multipleImages, 
+                                                                                                      setting.options);
+                }
+                catch (const cv::Exception& ex)
+                {
+                    std::cerr << "\nERROR: " << ex.what();
+                    settingResult = false;
+                }
+                timer.stop();
+                writeTimes.push_back(timer.getTimeMilli());
+
+                std::vector<cv::Mat> pagesRead;
+                timer.reset();
+                timer.start();
+                settingResult = settingResult && cv::imreadmulti(scratchPath.string(), pagesRead, cv::IMREAD_UNCHANGED);
+                timer.stop();
+                readTimes.push_back(timer.getTimeMilli());
+            }
+
+            if (!settingResult)
+            {
+                std::cout << std::left << std::setw(22) << setting.name << std::right << std::setw(14) << "failed" << '\n';
+                continue;
+            }
+
+            const std::uintmax_t fileSize { std::filesystem::file_size(scratchPath) };
+            if ((setting.options.compression == TiffCompression::none) && !setting.useImwrite && (uncompressedSize == 0))
+            {
+                uncompressedSize = fileSize;
+            }
+
+            std::cout << std::left << std::setw(22) << setting.name << std::right
+                      << std::setw(14) << fileSize;
+            if (uncompressedSize > 0)
+            {
+                std::cout << std::setw(9) << std::fixed << std::setprecision(2) 
+                          << static_cast<double>(uncompressedSize) / static_cast<double>(fileSize) << 'x';
+            }
+            else 
+            {
+                std::cout << std::setw(10) << "-";
+            }
+            std::cout << std::setw(14) << std::fixed << std::setprecision(2) << median(writeTimes)
+                      << std::setw(14) << median(readTimes) << '\n';
+        }
+
+        std::filesystem::remove(scratchPath);
+    }
+
+    //----------------------- End of Benchmark Compression Settings -------------------//
+
     
     std::cout << '\n';
 
     return 0;
-}
\ No newline at end of file
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Convert a compression name to a TIFF compression scheme
+ *
+ * @param name one of none, lzw, deflate or jpeg
+ * @param compression TIFF compression scheme matching name
+ * @return true if name is a supported compression scheme
+ * @return false otherwise
+ */
+bool parseTiffCompression(const std::string& name, CPP_CV::ReadWriteFiles::TiffCompression& compression)
+{
+    using CPP_CV::ReadWriteFiles::TiffCompression;
+
+    if (name == "none")         { compression = TiffCompression::none; }
+    else if (name == "lzw")     { compression = TiffCompression::lzw; }
+    else if (name == "deflate") { compression = TiffCompression::deflate; }
+    else if (name == "jpeg")    { compression = TiffCompression::jpeg; }
+    else                        { return false; }
+
+    return true;
+}
+
+/**
+ * @brief Save pages to a TIFF file. cv::imwrite() is used whenever it supports the 
+ *        requested options, otherwise CPP_CV::ReadWriteFiles::writeMultipageTIFF()
+ *
+ * @param filePath full path of TIFF file
+ * @param pages images to save, one per page
+ * @param options compression, predictor and tiling options
+ * @return true if file was saved
+ * @return false otherwise
+ */
+bool saveTIFF(const std::string& filePath, const std::vector<cv::Mat>& pages, 
+              const CPP_CV::ReadWriteFiles::TiffWriteOptions& options)
+{
+    using CPP_CV::ReadWriteFiles::TiffCompression;
+
+    /*
+     * cv::imwrite() only lets us choose the compression scheme. It always writes strips,
+     * never applies a predictor and uses the default JPEG quality and Deflate level, 
+     * so any other option needs our own libtiff based writer
+    */
+    const CPP_CV::ReadWriteFiles::TiffWriteOptions defaults;
+    const bool imwriteSupportsOptions { (options.predictor == 1) && (options.tileWidth == 0) && 
+                                        (options.rowsPerStrip == 0) && 
+                                        (options.jpegQuality == defaults.jpegQuality) && 
+                                        (options.deflateLevel == defaults.deflateLevel) };
+
+    if (imwriteSupportsOptions)
+    {
+        return cv::imwrite(filePath, pages, { cv::IMWRITE_TIFF_COMPRESSION, static_cast<int>(options.compression) });
+    }
+
+    return CPP_CV::ReadWriteFiles::writeMultipageTIFF(filePath, pages, options);
+}
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    const std::size_t middle { values.size() / 2 };
+
+    return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+/**
+ * @brief Watch a directory, and save every 'pagesPerFile' new images to a numbered TIFF 
+ *        multi-page file, e.g. pages_1.tiff, pages_2.tiff, ... Stops on Ctrl+C (or SIGTERM), 
+ *        or when no image arrives for timeoutSeconds, after saving any remaining images
+ *
+ * @param directory full path to directory to watch
+ * @param savePath full path of TIFF file. The file number is added to its name
+ * @param options compression, predictor and tiling options
+ * @param pagesPerFile no. of images saved in each file
+ * @param timeoutSeconds stop after this many seconds without a new file. 0 = never (stop with Ctrl+C)
+ * @return int 0 if the directory could be watched, -1 otherwise
+ */
+int watchDirectoryToTIFF(const std::string& directory, const std::filesystem::path& savePath, 
+                         const CPP_CV::ReadWriteFiles::TiffWriteOptions& options, int pagesPerFile, int timeoutSeconds)
+{
+    // New files are queued by the watcher's own thread, so their arrival time is 
+    // recorded even while we are still reading an earlier file or saving a file
+    CPP_CV::Watch::DirectoryWatcher watcher(directory);
+    if (!watcher.isOpen())
+    {
+        return -1;
+    }
+
+    // If we save into the watched directory, the files we save must not be read as new images
+    std::error_code error;
+    const bool savingToWatchedDirectory { std::filesystem::equivalent(directory, savePath.parent_path(), error) };
+    std::set<std::string> savedFileNames;
+
+    std::cout << "\nWatching " << directory << " for new image files. Every " << pagesPerFile 
+              << " images are saved to a new file. Stop with Ctrl+C"
+              << (timeoutSeconds > 0 ? ", or wait " + std::to_string(timeoutSeconds) + " s without a new file" : "") << ".\n";
+
+    std::vector<cv::Mat> pages;
+    std::vector<int64> arrivals; // arrival time of each page
+    CPP_CV::Watch::LatencyReport latencies;
+    int fileNumber {0};
+
+    // Save the pages collected so far to the next numbered file
+    auto savePages = [&]() {
+        ++fileNumber;
+        const std::filesystem::path numberedPath { savePath.parent_path() / 
+                                                   (savePath.stem().string() + "_" + std::to_string(fileNumber) + savePath.extension().string()) };
+        savedFileNames.insert(numberedPath.filename().string());
+
+        bool result {false};
+        try {
+            result = saveTIFF(numberedPath.string(), pages, options);
+        } 
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nERROR: " << ex.what();
+        }
+
+        if (result)
+        {
+            for (const int64 arrival : arrivals)
+            {
+                latencies.add(arrival);
+            }
+            std::cout << "\nSaved " << pages.size() << " images to " << numberedPath << " (" << watcher.pending() << " files waiting)";
+        }
+        else 
+        {
+            std::cerr << "\nERROR: Could not save multiple images to single file: " << numberedPath << '\n';
+        }
+
+        pages.clear();
+        arrivals.clear();
+    };
+
+    int64 lastArrival { cv::getTickCount() };
+
+    // Ctrl+C only ends the loop, so the pages we hold are still saved and the latencies reported
+    CPP_CV::Watch::installStopHandler();
+
+    while (watcher.isWatching() && !CPP_CV::Watch::stopRequested())
+    {
+        CPP_CV::Watch::ArrivedFile file;
+        if (!watcher.next(file, 100))
+        {
+            if ((timeoutSeconds > 0) && ((cv::getTickCount() - lastArrival) / cv::getTickFrequency() > timeoutSeconds))
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        lastArrival = file.arrivalTicks;
+
+        const std::filesystem::path filePath {file.path};
+        if ((savingToWatchedDirectory && (savedFileNames.count(filePath.filename().string()) > 0)) || 
+            !cv::haveImageReader(file.path))
+        {
+            continue;
+        }
+
+        cv::Mat image;
+        try 
+        {
+            image = cv::imread(file.path, cv::IMREAD_UNCHANGED);
+        }
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nError reading " << file.path << ": " << ex.what();
+        }
+
+        if (image.empty())
+        {
+            std::cerr << "\nCould not read data from image file: " << file.path << '\n';
+            continue;
+        }
+
+        pages.push_back(image);
+        arrivals.push_back(file.arrivalTicks);
+
+        if (static_cast<int>(pages.size()) == pagesPerFile)
+        {
+            savePages();
+        }
+    }
+
+    if (!pages.empty())
+    {
+        savePages();
+    }
+
+    std::cout << '\n';
+    latencies.print();
+    std::cout << '\n';
+
+    return 0;
+}
+
+//-------------------------- End of Function Definitions ---------------------//
\ No newline at end of file
@@ -0,0 +1,265 @@
+// Program: batch_tensor_loader.cpp
+
+/*
+ * Program reads the images in a directory in batches ready to be fed to a neural network:
+ * each image is resized, normalised with a mean and standard deviation per channel, turned
+ * from BGR to RGB, and stored as 32-bit floats in NCHW or NHWC layout in one contiguous block.
+ *
+ * Two ways of making each batch are timed:
+ *      1. One image at a time with cv::imread(), cv::resize(), cv::cvtColor(),
+ *         cv::Mat::convertTo(), cv::subtract(), cv::divide() and cv::split(), each making
+ *         another copy of the image, before the result is copied into the batch
+ *      2. CPP_CV::Tensors::loadTensorBatch(), which decodes the images in parallel, and
+ *         normalises, reorders and lays out each resized image in a single pass straight
+ *         into the batch
+ *
+ * We report the images per second of each, and the largest difference between the two
+ * batches. With reduced decoding, JPEG files are decoded at a smaller scale before resizing,
+ * so the values differ slightly - set 'reduced' to false to compare identical decodes.
+ *
+ * Inputs are provided through the command line
+ *
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core types, cv::split() and cv::norm()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgcodecs.hpp"       // for cv::imread()
+#include "opencv2/imgproc.hpp"         // for cv::resize() and cv::cvtColor()
+
+#include "UtilityFunctions/utility_functions.h" // for loadTensorBatch() and listFiles()
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>   // for std::min, std::max
+#include <cstring>     // for std::memcpy
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Make a batch one image at a time, the way our programs read and convert single images
+ *
+ * @param filePaths full paths to the image files in the batch
+ * @param options size, layout and normalisation of the images
+ * @param batch receives the 4-dimensional CV_32F batch
+ */
+void loadBatchOneByOne(const std::vector<std::string>& filePaths, const CPP_CV::Tensors::TensorOptions& options,
+                       cv::Mat& batch);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to directory with image files
+     *      2. No. of images per batch, and width and height of each image in the batch
+     *      3. Layout of the batch, and whether to use the ImageNet mean and standard deviation
+     *      4. Whether JPEG files can be decoded at a reduced scale
+     *      5. Whether to search sub-directories, and which file extensions to read
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Read images in batches of normalised 32-bit floats }"
+        "{dir | <none> | full path to directory/folder with image files }"
+        "{batchSize | 32 | no. of images in each batch }"
+        "{width | 224 | width of each image in the batch }"
+        "{height | 224 | height of each image in the batch }"
+        "{layout | nchw | layout of the batch: nchw or nhwc }"
+        "{imagenet | true | normalise with the ImageNet mean and standard deviation, otherwise only scale to [0, 1] }"
+        "{reduced | true | decode JPEG files at 1/2, 1/4 or 1/8 scale when still larger than the batch images }"
+        "{recursive | false | also read the images in all sub-directories }"
+        "{extensions | | comma separated list of file extensions to read, e.g. jpg,png. Empty reads all image files }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nRead the images in a directory into batches for a neural network.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String dirPath = parser.get<cv::String>("dir");
+    int batchSize = parser.get<int>("batchSize");
+    int width = parser.get<int>("width");
+    int height = parser.get<int>("height");
+    cv::String layout = parser.get<cv::String>("layout");
+    bool imagenet = parser.get<bool>("imagenet");
+    bool reduced = parser.get<bool>("reduced");
+    bool recursive = parser.get<bool>("recursive");
+    cv::String extensions = parser.get<cv::String>("extensions");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if ((batchSize <= 0) || (width <= 0) || (height <= 0) || ((layout != "nchw") && (layout != "nhwc")))
+    {
+        std::cerr << "\nBatch size, width and height should be greater than 0, and layout should be nchw or nhwc.\n";
+
+        return -1;
+    }
+
+    CPP_CV::Tensors::TensorOptions options;
+    options.size = cv::Size(width, height);
+    options.layout = (layout == "nchw") ? CPP_CV::Tensors::TensorLayout::NCHW : CPP_CV::Tensors::TensorLayout::NHWC;
+    options.reducedDecode = reduced;
+    if (imagenet)
+    {
+        options.mean = cv::Scalar(0.485, 0.456, 0.406); // RGB order
+        options.std = cv::Scalar(0.229, 0.224, 0.225);
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Collect Image Files ///////////////////////////////
+
+    // Nothing is decoded yet. Files are sorted, so the batches are the same every time
+    CPP_CV::Directories::ScanOptions scanOptions;
+    scanOptions.recursive = recursive;
+    scanOptions.extensions = CPP_CV::Directories::parseExtensionList(extensions);
+
+    const std::vector<std::string> imageFiles { CPP_CV::Directories::listFiles(dirPath, scanOptions) };
+
+    if (imageFiles.empty())
+    {
+        std::cout << "\nNo image files found in " << dirPath << '\n';
+
+        return 0;
+    }
+
+    std::cout << "\nFound " << imageFiles.size() << " image files.\n";
+
+    //---------------------- End of Collect Image Files -------------------//
+
+    ///////////////////////// 3. Load the Images in Batches //////////////////////
+
+    // Both batches are allocated once and re-used for every batch of the same size
+    cv::Mat batchOneByOne;
+    cv::Mat batch;
+    std::vector<uchar> loaded;
+
+    double oneByOneSeconds {0.0};
+    double fusedSeconds {0.0};
+    double maxDifference {0.0};
+    int loadedImages {0};
+
+    for (std::size_t first {0}; first < imageFiles.size(); first += static_cast<std::size_t>(batchSize))
+    {
+        const std::size_t last { std::min(first + static_cast<std::size_t>(batchSize), imageFiles.size()) };
+        const std::vector<std::string> batchFiles(imageFiles.begin() + first, imageFiles.begin() + last);
+
+        try
+        {
+            // a. One image at a time
+            cv::TickMeter timer;
+            timer.start();
+            loadBatchOneByOne(batchFiles, options, batchOneByOne);
+            timer.stop();
+            oneByOneSeconds += timer.getTimeSec();
+
+            // b. Decoded in parallel and written straight into the batch
+            timer.reset();
+            timer.start();
+            loadedImages += CPP_CV::Tensors::loadTensorBatch(batchFiles, options, batch, loaded);
+            timer.stop();
+            fusedSeconds += timer.getTimeSec();
+        }
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nERROR: " << ex.what();
+
+            return -1;
+        }
+
+        maxDifference = std::max(maxDifference, cv::norm(batchOneByOne, batch, cv::NORM_INF));
+    }
+
+    //---------------------- End of Load the Images in Batches -------------------//
+
+    ///////////////////////// 4. Report Results //////////////////////
+
+    std::cout << "\nBatch shape: " << batch.size[0] << " x " << batch.size[1] << " x " << batch.size[2]
+              << " x " << batch.size[3] << " (" << layout << ")"
+              << "\nImages read: " << loadedImages << " of " << imageFiles.size()
+              << "\nOne image at a time: " << imageFiles.size() / oneByOneSeconds << " images/s"
+              << "\nloadTensorBatch():   " << imageFiles.size() / fusedSeconds << " images/s"
+              << "\nLargest difference between the batches: " << maxDifference << '\n';
+
+    //---------------------- End of Report Results -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Make a batch one image at a time, the way our programs read and convert single images
+ *
+ * @param filePaths full paths to the image files in the batch
+ * @param options size, layout and normalisation of the images
+ * @param batch receives the 4-dimensional CV_32F batch
+ */
+void loadBatchOneByOne(const std::vector<std::string>& filePaths, const CPP_CV::Tensors::TensorOptions& options,
+                       cv::Mat& batch)
+{
+    const int count { static_cast<int>(filePaths.size()) };
+    const int width { options.size.width };
+    const int height { options.size.height };
+    const bool nchw { options.layout == CPP_CV::Tensors::TensorLayout::NCHW };
+
+    const int nchwSizes[4] { count, 3, height, width };
+    const int nhwcSizes[4] { count, height, width, 3 };
+    batch.create(4, nchw ? nchwSizes : nhwcSizes, CV_32F);
+    batch.setTo(cv::Scalar(0));
+
+    const std::size_t planeSize { static_cast<std::size_t>(width) * height };
+
+    for (int i {0}; i < count; ++i)
+    {
+        cv::Mat image { cv::imread(filePaths[i], cv::IMREAD_COLOR) };
+        if (image.empty())
+        {
+            continue;
+        }
+
+        cv::Mat resized, rgb, floats;
+        cv::resize(image, resized, options.size, 0.0, 0.0, options.interpolation);
+        if (options.swapRB)
+        {
+            cv::cvtColor(resized, rgb, cv::COLOR_BGR2RGB);
+        }
+        else
+        {
+            rgb = resized;
+        }
+        rgb.convertTo(floats, CV_32F, options.scale);
+        cv::subtract(floats, options.mean, floats);
+        cv::divide(floats, options.std, floats);
+
+        float* tensor { batch.ptr<float>() + planeSize * 3 * i };
+        if (nchw)
+        {
+            std::vector<cv::Mat> planes;
+            cv::split(floats, planes);
+            for (int c {0}; c < 3; ++c)
+            {
+                std::memcpy(tensor + planeSize * c, planes[c].ptr<float>(), planeSize * sizeof(float));
+            }
+        }
+        else
+        {
+            std::memcpy(tensor, floats.ptr<float>(), planeSize * 3 * sizeof(float));
+        }
+    }
+}
+
+//-------------------------- End of Function Definitions ---------------------//
@@ -0,0 +1,478 @@
+// Program: decode_benchmark.cpp
+
+/*
+ * Program benchmarks image de-compression (decoding). An input image is first saved in each 
+ * of the image file formats used by image_compression.cpp. For every format we then measure:
+ *      1. cv::imread() - reading and decoding the image file from disk
+ *      2. cv::imdecode() - decoding the compressed image from a memory buffer
+ * 
+ * with the full resolution (cv::IMREAD_UNCHANGED), grayscale (cv::IMREAD_GRAYSCALE) and 
+ * reduced resolution (cv::IMREAD_REDUCED_*) flags. For each case we report the latency 
+ * distribution, throughput and peak memory use (resident set size, RSS). 
+ * 
+ * We then decode the same image on several threads at once to show how decoding 
+ * throughput scales with the no. of threads.
+ * 
+ * Finally we compare cv::imread() with memory mapping (MappedImage) for uncompressed 
+ * PGM, PPM and TIFF files, where cv::imread() only copies the pixels.
+ * 
+ * Inputs are provided through the command line
+ * 
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core data types
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser, cv::TickMeter, cv::parallel_for_
+#include "opencv2/imgcodecs.hpp"       // for cv::imread(), cv::imwrite() and cv::imdecode()
+#include "opencv2/imgproc.hpp"         // for cv::cvtColor()
+
+#include "UtilityFunctions/utility_functions.h" // for readFileToVector(), MappedImage
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <fstream>     // for std::ifstream
+#include <vector>
+#include <string>
+#include <algorithm>   // for std::sort
+#include <cmath>       // for std::ceil
+#include <functional>  // for std::function
+#include <filesystem>
+#include <memory>      // for std::unique_ptr
+#include <utility>     // for std::pair
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h> // for getrusage()
+#endif
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+using namespace std::string_literals; // allows easy access to the std::string suffix 's'
+
+// Image file formats we can handle
+const std::string commonOpenCVImageFileFormats[] { "jpeg"s, "jpg"s, "jp2"s, "png"s, "webp"s, "tiff"s };
+
+/**
+ * @brief A cv::imread()/cv::imdecode() flag and its name
+ */
+struct DecodeFlag 
+{
+    std::string name;
+    int flag;
+};
+
+
+/**
+ * @brief Time a decode function several times and print its latency distribution, 
+ *        throughput and peak memory use
+ * 
+ * @param label description of what is being decoded 
+ * @param repetitions no. of times to run the decode function 
+ * @param decode function that decodes the image and returns the decoded image
+ */
+void benchmarkDecode(const std::string& label, int repetitions, const std::function<cv::Mat()>& decode);
+
+
+/**
+ * @brief Decode the same buffer on 1, 2, 4, ... threads at once and print the throughput
+ * 
+ * @param buffer compressed image 
+ * @param maxThreads largest no. of threads to test
+ * @param repetitions no. of decodes per thread
+ */
+void benchmarkThreadScaling(const std::vector<uchar>& buffer, int maxThreads, int repetitions);
+
+
+/**
+ * @brief Reset the peak resident set size (RSS) of this process so we can measure 
+ *        the peak memory use of the next piece of work. Only supported on Linux.
+ */
+void resetPeakRSS();
+
+
+/**
+ * @brief Return the peak resident set size (RSS) of this process in kilobytes
+ * 
+ * @return long peak RSS in kB, or -1 if not available on this system
+ */
+long peakRSSkB();
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments 
+     *      1. Full path to image used to create the test files 
+     *      2. Full path to directory to save the test files
+     *      3. No. of times to repeat each decode 
+     *      4. Largest no. of threads for the thread scaling test
+     * 
+    */
+    const cv::String keys = 
+        "{help h usage ? | | Benchmark image decoding }"
+        "{image | <none> | full path to image used to create the test files }"
+        "{dirPath | <none> | full path to directory to save the test files }"
+        "{repeat | 20 | no. of times to repeat each decode }"
+        "{threads | 0 | largest no. of threads for the thread scaling test. 0 means no. of CPUs }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nBenchmark cv::imread() and cv::imdecode() with full, grayscale and reduced resolution flags"
+                 "\nfor png, jpeg, jpg, jp2, webp and tiff files.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("image");
+    cv::String saveDirectoryPath = parser.get<cv::String>("dirPath");
+    int repetitions = parser.get<int>("repeat");
+    int maxThreads = parser.get<int>("threads");
+
+    // check for any errors encountered 
+    if(!parser.check())
+    {
+        parser.printErrors();
+
+        return -1;
+    }
+
+    if (repetitions <= 0)
+    {
+        std::cout << "\nNo. of repetitions should be greater than 0.\n";
+
+        return -1;
+    }
+
+    if (maxThreads <= 0)
+    {
+        maxThreads = cv::getNumberOfCPUs();
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ////////////////////////// 2. Read Input Image /////////////////////
+
+    if (!cv::haveImageReader(imagePath))
+    {
+        std::cout << "\nCannot read input image file: " << imagePath << '\n';
+
+        return -1;
+    }
+
+    cv::Mat image { cv::imread(imagePath, cv::IMREAD_UNCHANGED) };
+    if (image.empty())
+    {
+        std::cerr << "Image file is empty: " << imagePath << '\n';
+
+        return -1;
+    }
+
+    std::cout << "\nImage size (width x height): " << image.cols << " x " << image.rows 
+              << "\nNo. of channels: " << image.channels() << '\n';
+
+    //---------------------- End of Read Input Image -------------------//
+
+    ////////////////////////// 3. Benchmark Each Format /////////////////////
+
+    const std::vector<DecodeFlag> flags {
+        { "IMREAD_UNCHANGED"s,           cv::IMREAD_UNCHANGED },
+        { "IMREAD_GRAYSCALE"s,           cv::IMREAD_GRAYSCALE },
+        { "IMREAD_REDUCED_COLOR_2"s,     cv::IMREAD_REDUCED_COLOR_2 },
+        { "IMREAD_REDUCED_COLOR_4"s,     cv::IMREAD_REDUCED_COLOR_4 },
+        { "IMREAD_REDUCED_COLOR_8"s,     cv::IMREAD_REDUCED_COLOR_8 },
+        { "IMREAD_REDUCED_GRAYSCALE_2"s, cv::IMREAD_REDUCED_GRAYSCALE_2 },
+        { "IMREAD_REDUCED_GRAYSCALE_4"s, cv::IMREAD_REDUCED_GRAYSCALE_4 },
+        { "IMREAD_REDUCED_GRAYSCALE_8"s, cv::IMREAD_REDUCED_GRAYSCALE_8 }
+    };
+
+    for (const auto& format : commonOpenCVImageFileFormats)
+    {
+        // a. Save the input image in this format
+        std::filesystem::path testFile {saveDirectoryPath};
+        testFile /= "decode_benchmark."s + format;
+
+        bool saved {false};
+        try 
+        {
+            saved = cv::imwrite(testFile.string(), image);
+        }
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nError saving test file: " << ex.what();
+        }
+
+        if (!saved)
+        {
+            std::cout << "\n=== " << format << ": cannot save this image in this format - skipped\n";
+
+            continue;
+        }
+
+        // b. Load the compressed file into memory for cv::imdecode()
+        std::vector<uchar> buffer;
+        CPP_CV::ReadWriteFiles::readFileToVector(testFile.string(), buffer);
+
+        std::cout << "\n=== " << format << " (" << buffer.size() << " bytes) ===\n";
+
+        // c. Time each flag with cv::imread() and cv::imdecode()
+        for (const auto& decodeFlag : flags)
+        {
+            benchmarkDecode("imread   " + decodeFlag.name, repetitions, [&]() {
+                return cv::imread(testFile.string(), decodeFlag.flag);
+            });
+
+            benchmarkDecode("imdecode " + decodeFlag.name, repetitions, [&]() {
+                return cv::imdecode(buffer, decodeFlag.flag);
+            });
+        }
+
+        // d. Decode on several threads at once
+        benchmarkThreadScaling(buffer, maxThreads, repetitions);
+
+        std::filesystem::remove(testFile);
+    }
+
+    //---------------------- End of Benchmark Each Format -------------------//
+
+    ////////////////////////// 4. Benchmark Memory Mapped Loading /////////////////////
+
+    /*
+     * Uncompressed files need no decoding, yet cv::imread() still copies every pixel into 
+     * a new cv::Mat. MappedImage maps the file into memory instead, and wraps a cv::Mat 
+     * around the pixels where they are. Pages of a mapped file are only read when first 
+     * used, so both loaders sum the pixels to compare the cost of actually using them.
+    */
+    cv::Mat gray { image };   // PGM files hold 1 channel
+    cv::Mat colour { image }; // and PPM files 3 channels
+    if (image.channels() == 1)
+    {
+        cv::cvtColor(image, colour, cv::COLOR_GRAY2BGR);
+    }
+    else
+    {
+        if (image.channels() == 4)
+        {
+            cv::cvtColor(image, colour, cv::COLOR_BGRA2BGR);
+        }
+        cv::cvtColor(colour, gray, cv::COLOR_BGR2GRAY);
+    }
+
+    // TIFF files are saved without compression
+    const std::vector<std::pair<std::string, cv::Mat>> uncompressedFormats { {"pgm"s, gray}, {"ppm"s, colour}, {"tiff"s, image} };
+    const std::vector<int> tiffParameters { cv::IMWRITE_TIFF_COMPRESSION, 1 };
+
+    for (const auto& [format, formatImage] : uncompressedFormats)
+    {
+        std::filesystem::path testFile {saveDirectoryPath};
+        testFile /= "decode_benchmark_uncompressed."s + format;
+
+        bool saved {false};
+        try 
+        {
+            saved = cv::imwrite(testFile.string(), formatImage, (format == "tiff"s) ? tiffParameters : std::vector<int>());
+        }
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nError saving test file: " << ex.what();
+        }
+
+        if (!saved)
+        {
+            std::cout << "\n=== uncompressed " << format << ": cannot save this image in this format - skipped\n";
+
+            continue;
+        }
+
+        std::cout << "\n=== uncompressed " << format << " (" << std::filesystem::file_size(testFile) << " bytes, " 
+                  << (CPP_CV::ReadWriteFiles::MappedImage(testFile.string()).isMapped() ? "mapped" : "copied by cv::imread()") 
+                  << ") ===\n";
+
+        benchmarkDecode("imread + sum", repetitions, [&]() {
+            cv::Mat loaded { cv::imread(testFile.string(), cv::IMREAD_UNCHANGED) };
+            cv::sum(loaded);
+            return loaded;
+        });
+
+        // The mapping is kept until the next run, as the returned cv::Mat points into it
+        std::unique_ptr<CPP_CV::ReadWriteFiles::MappedImage> mapped;
+        benchmarkDecode("MappedImage + sum", repetitions, [&]() {
+            mapped = std::make_unique<CPP_CV::ReadWriteFiles::MappedImage>(testFile.string());
+            cv::sum(mapped->image());
+            return mapped->image();
+        });
+
+        mapped.reset();
+        std::filesystem::remove(testFile);
+    }
+
+    //---------------------- End of Benchmark Memory Mapped Loading -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Time a decode function several times and print its latency distribution, 
+ *        throughput and peak memory use
+ * 
+ * @param label description of what is being decoded 
+ * @param repetitions no. of times to run the decode function 
+ * @param decode function that decodes the image and returns the decoded image
+ */
+void benchmarkDecode(const std::string& label, int repetitions, const std::function<cv::Mat()>& decode)
+{
+    std::vector<double> times; // time of each run in milliseconds
+    cv::Size decodedSize;
+
+    resetPeakRSS();
+
+    for (int i {0}; i < repetitions; ++i)
+    {
+        cv::TickMeter timer;
+        timer.start();
+        cv::Mat decoded { decode() };
+        timer.stop();
+
+        if (decoded.empty())
+        {
+            std::cout << std::left << std::setw(36) << label << " decode failed\n";
+
+            return;
+        }
+
+        decodedSize = decoded.size();
+        times.push_back(timer.getTimeMilli());
+    }
+
+    std::sort(times.begin(), times.end());
+
+    // Nearest-rank percentile
+    auto percentile = [&times](double p) {
+        const auto rank { static_cast<std::size_t>(std::ceil(p / 100.0 * times.size())) };
+        return times[std::clamp<std::size_t>(rank, 1, times.size()) - 1];
+    };
+
+    const double megapixels { static_cast<double>(decodedSize.area()) / 1e6 };
+
+    std::cout << std::left << std::setw(36) << label << std::right << std::fixed << std::setprecision(2)
+              << " " << std::setw(5) << decodedSize.width << "x" << std::left << std::setw(5) << decodedSize.height << std::right
+              << " min " << std::setw(8) << times.front() 
+              << "  p50 " << std::setw(8) << percentile(50) 
+              << "  p90 " << std::setw(8) << percentile(90) 
+              << "  p99 " << std::setw(8) << percentile(99) 
+              << "  max " << std::setw(8) << times.back() << " ms"
+              << "  " << std::setw(8) << (megapixels / (percentile(50) / 1000.0)) << " MP/s";
+
+    // On systems where the peak cannot be reset it only grows, so it may include earlier runs
+    const long peakRSS { peakRSSkB() };
+    if (peakRSS >= 0)
+    {
+        std::cout << "  peak RSS " << std::setw(8) << peakRSS / 1024.0 << " MB";
+    }
+
+    std::cout << '\n';
+}
+
+
+/**
+ * @brief Decode the same buffer on 1, 2, 4, ... threads at once and print the throughput
+ * 
+ * @param buffer compressed image 
+ * @param maxThreads largest no. of threads to test
+ * @param repetitions no. of decodes per thread
+ */
+void benchmarkThreadScaling(const std::vector<uchar>& buffer, int maxThreads, int repetitions)
+{
+    const int defaultThreads { cv::getNumThreads() };
+
+    std::cout << "\nimdecode IMREAD_UNCHANGED thread scaling:\n";
+
+    double singleThreadRate {0.0};
+
+    for (int threads {1}; ; threads *= 2)
+    {
+        threads = std::min(threads, maxThreads);
+
+        // Let OpenCV's thread pool run 'threads' decodes at the same time
+        cv::setNumThreads(threads);
+
+        const int totalDecodes { threads * repetitions };
+        std::size_t totalPixels {0};
+        std::vector<std::size_t> pixelsPerDecode(totalDecodes, 0);
+
+        cv::TickMeter timer;
+        timer.start();
+        cv::parallel_for_(cv::Range(0, totalDecodes), [&](const cv::Range& r) {
+            for (int i { r.start }; i < r.end; ++i)
+            {
+                pixelsPerDecode[i] = cv::imdecode(buffer, cv::IMREAD_UNCHANGED).total();
+            }
+        }, totalDecodes);
+        timer.stop();
+
+        for (std::size_t pixels : pixelsPerDecode) totalPixels += pixels;
+
+        const double decodesPerSecond { totalDecodes / timer.getTimeSec() };
+        if (threads == 1) singleThreadRate = decodesPerSecond;
+
+        std::cout << "  " << std::setw(3) << threads << " threads: " 
+                  << std::setw(9) << decodesPerSecond << " images/s  " 
+                  << std::setw(9) << (static_cast<double>(totalPixels) / 1e6) / timer.getTimeSec() << " MP/s  "
+                  << "speed-up " << std::setw(5) << decodesPerSecond / singleThreadRate << "x\n";
+
+        if (threads == maxThreads) break;
+    }
+
+    cv::setNumThreads(defaultThreads); // restore OpenCV's default
+}
+
+
+/**
+ * @brief Reset the peak resident set size (RSS) of this process so we can measure 
+ *        the peak memory use of the next piece of work. Only supported on Linux.
+ */
+void resetPeakRSS()
+{
+#if defined(__linux__)
+    // Writing '5' to clear_refs resets the peak RSS (VmHWM) to the current RSS (Linux 4.0+)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+#endif
+}
+
+
+/**
+ * @brief Return the peak resident set size (RSS) of this process in kilobytes
+ * 
+ * @return long peak RSS in kB, or -1 if not available on this system
+ */
+long peakRSSkB()
+{
+#if defined(__linux__)
+    // VmHWM is the peak RSS and can be reset with resetPeakRSS()
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmHWM:", 0) == 0)
+        {
+            return std::stol(line.substr(6)); // value is in kB
+        }
+    }
+
+    return -1;
+#elif defined(__APPLE__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return -1;
+#endif
+}
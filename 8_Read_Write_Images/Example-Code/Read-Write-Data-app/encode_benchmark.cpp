@@ -0,0 +1,437 @@
+// Program: encode_benchmark.cpp
+
+/*
+ * Program benchmarks the image writers used by Save_Image_As.cpp. Every image in a 
+ * directory (the corpus) is compressed with the JPEG, PNG, WebP, JPEG 2000 and TIFF 
+ * codecs at a sweep of quality/compression values. Each setting is repeated several 
+ * times and we report:
+ *      1. Encode latency percentiles (p50, p90, p99) in milliseconds
+ *      2. Throughput in megapixels per second (using the median latency)
+ *      3. Size of the compressed image in bytes and the compression ratio
+ *      4. PSNR of the de-compressed image compared to the original
+ * 
+ * Results are saved as CSV (.csv) or through cv::FileStorage (.json, .yml, .yaml or .xml)
+ * 
+ * We compress into memory with cv::imencode() so that disk speed does not affect the results.
+ * 
+ * Inputs are provided through the command line
+ * 
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core data types and cv::PSNR()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/core/persistence.hpp" // for cv::FileStorage
+#include "opencv2/imgcodecs.hpp"       // for cv::imread(), cv::imencode() and cv::imdecode()
+#include "opencv2/imgproc.hpp"         // for cv::cvtColor()
+
+#include "UtilityFunctions/utility_functions.h" // for getFileExtension()
+
+#include <iostream>
+#include <fstream>     // for std::ofstream
+#include <vector>
+#include <string>
+#include <algorithm>   // for std::sort, std::find
+#include <cmath>       // for std::ceil
+#include <filesystem>
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+using namespace std::string_literals; // allows easy access to the std::string suffix 's'
+
+/**
+ * @brief An image codec and the quality/compression values we want to test it with
+ */
+struct CodecSweep 
+{
+    std::string ext;             // image file extension without the leading dot/period
+    cv::ImwriteFlags flag;       // compression flag passed to cv::imencode()
+    std::vector<int> values;     // compression values to test
+};
+
+/**
+ * @brief Results of compressing one image with one codec setting 
+ */
+struct EncodeResult 
+{
+    std::string image;       // image file name
+    std::string ext;         // codec file extension
+    int value {0};           // quality/compression value
+    double p50 {0.0};        // encode latency percentiles in milliseconds
+    double p90 {0.0};
+    double p99 {0.0};
+    double megapixelsPerSecond {0.0};
+    std::size_t fileSize {0};    // size of compressed image in bytes
+    double compressionRatio {0.0}; // size of raw pixel data / size of compressed image
+    double psnr {0.0};       // in dB. Lossless codecs report 361 dB, -1 if the images could not be compared
+};
+
+
+/**
+ * @brief Return the value at a given percentile of a sorted list (nearest-rank method)
+ * 
+ * @param sortedValues values sorted in ascending order. Must not be empty
+ * @param percentile percentile between 0 and 100
+ * @return double value at percentile
+ */
+double percentile(const std::vector<double>& sortedValues, double percentile);
+
+
+/**
+ * @brief Compress an image several times with one codec setting and collect the results
+ * 
+ * @param image image to compress 
+ * @param imageName image file name (used in the results)
+ * @param codec codec to use 
+ * @param value quality/compression value 
+ * @param repetitions no. of times to compress the image 
+ * @param result results of the benchmark
+ * @return true if the image was compressed
+ * @return false if the codec cannot compress this image (e.g. unsupported data type)
+ */
+bool benchmarkEncode(const cv::Mat& image, const std::string& imageName, const CodecSweep& codec, 
+                     int value, int repetitions, EncodeResult& result);
+
+
+/**
+ * @brief Save benchmark results as a CSV file 
+ * 
+ * @param filePath full path to CSV file
+ * @param results benchmark results 
+ */
+void saveResultsCSV(const std::string& filePath, const std::vector<EncodeResult>& results);
+
+
+/**
+ * @brief Save benchmark results with cv::FileStorage (JSON, YAML or XML)
+ * 
+ * @param filePath full path to output file (.json, .yml, .yaml or .xml) 
+ * @param results benchmark results 
+ */
+void saveResultsFileStorage(const std::string& filePath, const std::vector<EncodeResult>& results);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments 
+     *      1. Full path to directory with the images to compress (the corpus)
+     *      2. Full path to results file
+     *      3. No. of times to compress each image at each setting
+     *      4. Comma seperated list of codecs to test
+     * 
+    */
+    const cv::String keys = 
+        "{help h usage ? | | Benchmark image codecs }"
+        "{dir | <none> | full path to directory with images to compress }"
+        "{output | <none> | full path to results file (.csv, .json, .yml, .yaml or .xml) }"
+        "{repeat | 10 | no. of times to compress each image at each setting }"
+        "{codecs | jpg,png,webp,jp2,tiff | comma seperated list of codecs to test }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nBenchmark the JPEG, PNG, WebP, JPEG 2000 and TIFF image writers over a sweep of"
+                 "\nquality/compression values. Reports encode latency, throughput, file size and PSNR.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String corpusPath = parser.get<cv::String>("dir");
+    cv::String outputPath = parser.get<cv::String>("output");
+    int repetitions = parser.get<int>("repeat");
+    cv::String codecList = parser.get<cv::String>("codecs");
+
+    // check for any errors encountered 
+    if(!parser.check())
+    {
+        parser.printErrors();
+
+        return -1;
+    }
+
+    if (repetitions <= 0)
+    {
+        std::cout << "\nNo. of repetitions should be greater than 0.\n";
+
+        return -1;
+    }
+
+    // Results can be saved as CSV or any file type cv::FileStorage can write
+    const std::string outputExt { CPP_CV::ReadWriteFiles::getFileExtension(outputPath) };
+    const bool saveAsCSV { outputExt == "csv"s };
+    if (!saveAsCSV && (std::find(CPP_CV::General::fileTypes.cbegin(), CPP_CV::General::fileTypes.cend(), outputExt) 
+                        == CPP_CV::General::fileTypes.cend()))
+    {
+        std::cout << "\nResults file extension should be one of: csv, xml, yml, yaml, json or gz.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ////////////////////////// 2. Select Codecs to Test /////////////////////
+
+    // Quality/compression values to sweep for each codec
+    //  - jpg: quality 0 to 100 (higher is better quality)
+    //  - png: compression level 0 to 9 (higher is smaller and slower, always lossless)
+    //  - webp: quality 1 to 100 (higher is better quality). Values above 100 are lossless
+    //  - jp2: compression x 1000, 0 to 1000 (higher is better quality)
+    //  - tiff: compression scheme - 1 (none), 5 (LZW), 8 (Adobe Deflate), 32773 (PackBits)
+    const std::vector<CodecSweep> allCodecs {
+        { "jpg"s,  cv::IMWRITE_JPEG_QUALITY,              { 50, 60, 70, 75, 80, 85, 90, 95, 100 } },
+        { "png"s,  cv::IMWRITE_PNG_COMPRESSION,           { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 } },
+        { "webp"s, cv::IMWRITE_WEBP_QUALITY,              { 50, 60, 70, 75, 80, 85, 90, 95, 100, 101 } },
+        { "jp2"s,  cv::IMWRITE_JPEG2000_COMPRESSION_X1000, { 100, 250, 500, 750, 1000 } },
+        { "tiff"s, cv::IMWRITE_TIFF_COMPRESSION,          { 1, 5, 8, 32773 } }
+    };
+
+    std::vector<CodecSweep> codecs;
+    for (const auto& codec : allCodecs)
+    {
+        // Only test codecs requested by the user, and that our OpenCV build can write
+        const bool requested { ("," + codecList + ",").find("," + codec.ext + ",") != std::string::npos };
+
+        if (requested && cv::haveImageWriter("test." + codec.ext))
+        {
+            codecs.push_back(codec);
+        }
+        else if (requested)
+        {
+            std::cout << "\nSkipping codec without an image writer: " << codec.ext << '\n';
+        }
+    }
+
+    //---------------------- End of Select Codecs to Test -------------------//
+
+    ////////////////////////// 3. Compress Each Image in Corpus /////////////////////
+
+    std::vector<EncodeResult> results;
+
+    // We will use an iterator 'directory_iterator' from std::filesystem to 
+    // go through the directory contents. This iterator will not go through any sub-directories
+    const std::filesystem::path corpusDir {corpusPath};
+
+    for (auto const& dir_entry : std::filesystem::directory_iterator{corpusDir})
+    {
+        if (!cv::haveImageReader(dir_entry.path().string()))
+        {
+            continue; // not an image file
+        }
+
+        cv::Mat image { cv::imread(dir_entry.path().string(), cv::IMREAD_UNCHANGED) };
+        if (image.empty())
+        {
+            std::cerr << "Could not read data from image file: " << dir_entry.path().string() << '\n';
+
+            continue;
+        }
+
+        const std::string imageName { dir_entry.path().filename().string() };
+        std::cout << "\nBenchmarking " << imageName << " (" << image.cols << " x " << image.rows 
+                  << ", " << image.channels() << " channels)\n";
+
+        for (const auto& codec : codecs)
+        {
+            for (int value : codec.values)
+            {
+                EncodeResult result;
+                if (benchmarkEncode(image, imageName, codec, value, repetitions, result))
+                {
+                    std::cout << "  " << codec.ext << " @ " << value 
+                              << ": p50 = " << result.p50 << " ms, size = " << result.fileSize 
+                              << " bytes, PSNR = " << result.psnr << " dB\n";
+
+                    results.push_back(result);
+                }
+                else 
+                {
+                    std::cout << "  " << codec.ext << ": cannot compress this image - skipped\n";
+
+                    break; // other values will fail too
+                }
+            }
+        }
+    }
+
+    //---------------------- End of Compress Each Image in Corpus -------------------//
+
+    ////////////////////////// 4. Save Results /////////////////////
+
+    if (saveAsCSV)
+    {
+        saveResultsCSV(outputPath, results);
+    }
+    else 
+    {
+        saveResultsFileStorage(outputPath, results);
+    }
+
+    std::cout << "\nSaved " << results.size() << " results to " << outputPath << '\n';
+
+    //---------------------- End of Save Results -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Return the value at a given percentile of a sorted list (nearest-rank method)
+ * 
+ * @param sortedValues values sorted in ascending order. Must not be empty
+ * @param percentile percentile between 0 and 100
+ * @return double value at percentile
+ */
+double percentile(const std::vector<double>& sortedValues, double percentile)
+{
+    const auto rank { static_cast<std::size_t>(std::ceil(percentile / 100.0 * sortedValues.size())) };
+
+    return sortedValues[std::clamp<std::size_t>(rank, 1, sortedValues.size()) - 1];
+}
+
+
+/**
+ * @brief Compress an image several times with one codec setting and collect the results
+ * 
+ * @param image image to compress 
+ * @param imageName image file name (used in the results)
+ * @param codec codec to use 
+ * @param value quality/compression value 
+ * @param repetitions no. of times to compress the image 
+ * @param result results of the benchmark
+ * @return true if the image was compressed
+ * @return false if the codec cannot compress this image (e.g. unsupported data type)
+ */
+bool benchmarkEncode(const cv::Mat& image, const std::string& imageName, const CodecSweep& codec, 
+                     int value, int repetitions, EncodeResult& result)
+{
+    const std::string ext { "."s + codec.ext };
+    const std::vector<int> params { codec.flag, value };
+
+    std::vector<uchar> buffer;
+    std::vector<double> times; // encode time of each run in milliseconds
+
+    try 
+    {
+        // Warm-up run - the first call loads the codec and allocates the buffer
+        if (!cv::imencode(ext, image, buffer, params))
+        {
+            return false;
+        }
+
+        for (int i {0}; i < repetitions; ++i)
+        {
+            cv::TickMeter timer;
+            timer.start();
+            cv::imencode(ext, image, buffer, params);
+            timer.stop();
+
+            times.push_back(timer.getTimeMilli());
+        }
+    }
+    catch (const cv::Exception&)
+    {
+        return false; // codec does not support this image e.g. 16-bit JPEG
+    }
+
+    std::sort(times.begin(), times.end());
+
+    result.image = imageName;
+    result.ext = codec.ext;
+    result.value = value;
+    result.p50 = percentile(times, 50);
+    result.p90 = percentile(times, 90);
+    result.p99 = percentile(times, 99);
+    result.megapixelsPerSecond = (static_cast<double>(image.total()) / 1e6) / (result.p50 / 1000.0);
+    result.fileSize = buffer.size();
+    result.compressionRatio = static_cast<double>(image.total() * image.elemSize()) / buffer.size();
+
+    // De-compress to measure the quality we lost. Some codecs drop the 
+    // alpha channel so we compare the colour channels only
+    cv::Mat decoded { cv::imdecode(buffer, cv::IMREAD_UNCHANGED) };
+    cv::Mat reference { image };
+    if ((image.channels() == 4) && (decoded.channels() == 3))
+    {
+        cv::cvtColor(image, reference, cv::COLOR_BGRA2BGR);
+    }
+
+    // cv::PSNR() returns 361 dB for identical images i.e. lossless compression
+    const double maxPixelValue { (image.depth() == CV_16U) ? 65535.0 : 255.0 };
+    if (!decoded.empty() && (decoded.size() == reference.size()) && (decoded.type() == reference.type()))
+    {
+        result.psnr = cv::PSNR(reference, decoded, maxPixelValue);
+    }
+    else 
+    {
+        result.psnr = -1.0; // de-compressed image cannot be compared e.g. the codec changed the data type
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Save benchmark results as a CSV file 
+ * 
+ * @param filePath full path to CSV file
+ * @param results benchmark results 
+ */
+void saveResultsCSV(const std::string& filePath, const std::vector<EncodeResult>& results)
+{
+    std::ofstream file(filePath);
+
+    file << "image,codec,value,p50_ms,p90_ms,p99_ms,megapixels_per_second,file_size_bytes,compression_ratio,psnr_db\n";
+
+    for (const auto& r : results)
+    {
+        file << r.image << ',' << r.ext << ',' << r.value << ',' 
+             << r.p50 << ',' << r.p90 << ',' << r.p99 << ',' 
+             << r.megapixelsPerSecond << ',' << r.fileSize << ',' 
+             << r.compressionRatio << ',' << r.psnr << '\n';
+    }
+}
+
+
+/**
+ * @brief Save benchmark results with cv::FileStorage (JSON, YAML or XML)
+ * 
+ * @param filePath full path to output file (.json, .yml, .yaml or .xml) 
+ * @param results benchmark results 
+ */
+void saveResultsFileStorage(const std::string& filePath, const std::vector<EncodeResult>& results)
+{
+    cv::FileStorage fs(filePath, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        std::cerr << "\nCould not open results file for writing: " << filePath << '\n';
+
+        return;
+    }
+
+    // Results are saved as a sequence of maps
+    fs << "results" << "[";
+    for (const auto& r : results)
+    {
+        fs << "{" 
+           << "image" << r.image 
+           << "codec" << r.ext 
+           << "value" << r.value 
+           << "p50_ms" << r.p50 
+           << "p90_ms" << r.p90 
+           << "p99_ms" << r.p99 
+           << "megapixels_per_second" << r.megapixelsPerSecond 
+           << "file_size_bytes" << static_cast<double>(r.fileSize) // cv::FileStorage has no 64-bit integer type
+           << "compression_ratio" << r.compressionRatio 
+           << "psnr_db" << r.psnr 
+           << "}";
+    }
+    fs << "]";
+
+    fs.release();
+}
@@ -4,24 +4,42 @@
  * Program compresses an image into a std::vector character buffer, which has a smaller size than the 
  * original image file. We then save the buffer to a file for future use
  * 
+ * Files with the extension qoi are compressed with our own lossless QOI codec, which is 
+ * many times faster than PNG for a slightly larger file. It suits intermediate images 
+ * that are saved and read back soon after. 8-bit images only.
+ * 
+ * Instead of using a fixed "best quality" compression value, the program can also search 
+ * for the compression value that meets a target file size or a target image quality (PSNR or SSIM)
+ * 
+ * Files with the extension shard hold many compressed images, e.g. millions of thumbnails, 
+ * instead of one file each. 'image' can then be a directory: every image in it and its 
+ * sub-directories is compressed with the codec in 'format' and added to the shard, keyed by 
+ * its path relative to the directory. Opening, writing and closing one file per image is 
+ * much slower than appending to one file, and every file uses an inode.
+ * 
  * Inputs are provided through the command line
  * 
 */
 
 #include "opencv2/core.hpp"            // for OpenCV core data types
-#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser
-#include "opencv2/imgcodecs.hpp"       // for cv::imread() and cv::imencode()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser, cv::TickMeter and cv::parallel_for_()
+#include "opencv2/imgcodecs.hpp"       // for cv::imread(), cv::imencode() and cv::imdecode()
+#include "opencv2/imgproc.hpp"         // for cv::GaussianBlur() and cv::cvtColor()
+#include "opencv2/core/persistence.hpp" // for cv::FileStorage
 
 #include "UtilityFunctions/utility_functions.h"
 
 #include <iostream>
 #include <vector>
-#include <algorithm> // for std::find, std::copy
+#include <algorithm> // for std::find, std::copy, std::max
 #include <string>
 #include <tuple>
-#include <fstream>   // for std::ofstream
-#include <iterator>  // std::ostream_iterator
 #include <filesystem>
+#include <map>
+#include <optional>
+#include <cstdint>   // for std::uint64_t
+#include <sstream>   // for std::ostringstream
+#include <iomanip>   // for std::hex
 
 //////////////////////////// Function Declarations ////////////////////////////
 
@@ -29,24 +47,131 @@ using namespace std::string_literals; // allows easy access to the std::string s
                                       // This allows us to easily convert string literals to std::string
 
 // Image file formats we can handle
-const std::string commonOpenCVImageFileFormats[] { "jpeg"s, "jpg"s, "jp2"s, "png"s, "webp"s, "tiff"s };
+// qoi is compressed with our own lossless codec, CPP_CV::ReadWriteFiles::encodeQOI()
+const std::string commonOpenCVImageFileFormats[] { "jpeg"s, "jpg"s, "jp2"s, "png"s, "webp"s, "tiff"s, "qoi"s };
 
 /**
- * @brief Write the contents of a std::vector<unsigned char> image buffer to file
+ * @brief Return the cv::ImwriteFlag and best quality compression value for an appropriate image file extension
  * 
- * @param filePath full path to save data to including image file extension
- * @param buffer std::vector<unsigned char>
+ * @param fileExtension image file extension
+ * @return std::tuple [cv::ImwriteFlag, int] - the compression flag and best quality compression value
+ */
+std::tuple<cv::ImwriteFlags, int> imageWriteFlag(const cv::String& fileExtension);
+
+
+// What the compression value search is trying to achieve
+enum class TuningTarget { FileSize, PSNR, SSIM };
+
+/**
+ * @brief Result of compressing an image with one compression value
  */
-void writeVectorBufferToFile(const std::string& filePath, std::vector<uchar>& buffer);
+struct TuningCandidate 
+{
+    int parameterValue {0};      // compression value used
+    std::size_t fileSize {0};    // size of compressed buffer in bytes
+    double quality {0.0};        // PSNR (dB) or SSIM of the de-compressed image. Not computed for TuningTarget::FileSize
+    bool evaluated {false};      // false if the codec could not compress, de-compress or compare the image
+};
 
 
 /**
- * @brief Return the cv::ImwriteFlag and best quality compression value for an appropriate image file extension
+ * @brief Return the cv::ImwriteFlag and the range of compression values that control the 
+ *        quality (and therefore size) of a lossy image file format
  * 
- * @param fileExtension image file extension
- * @return std::tuple [cv::ImwriteFlag, int] - the compression flag and best quality compression value
+ * @param fileExtension image file extension (without the leading dot/period)
+ * @return std::optional<std::tuple<cv::ImwriteFlags, int, int>> [flag, lowest value, highest value]. 
+ *         Lossless formats (png, tiff, qoi) return std::nullopt since their compression value does not 
+ *         change image quality
  */
-std::tuple<cv::ImwriteFlags, int> imageWriteFlag(const cv::String& fileExtension);
+std::optional<std::tuple<cv::ImwriteFlags, int, int>> imageWriteQualityRange(const cv::String& fileExtension);
+
+
+/**
+ * @brief Search for the compression value that meets a target file size or image quality. 
+ *        Each round of the search evaluates several compression values in parallel and 
+ *        narrows the search interval around the target (with a single thread this is a 
+ *        plain bisection).
+ * 
+ * @param image image to be compressed
+ * @param ext image file extension with the leading dot/period e.g. ".jpg"
+ * @param flag compression flag e.g. cv::IMWRITE_JPEG_QUALITY
+ * @param minValue lowest compression value for the flag
+ * @param maxValue highest compression value for the flag
+ * @param target what we are aiming for i.e. file size, PSNR or SSIM
+ * @param targetValue maximum file size in bytes (TuningTarget::FileSize) or minimum PSNR/SSIM 
+ * @return std::optional<TuningCandidate> the highest compression value whose file is no larger than 
+ *         the target size, or the lowest compression value whose quality is at least the target 
+ *         quality. Returns std::nullopt if no compression value meets the target
+ */
+std::optional<TuningCandidate> searchCompressionValue(const cv::Mat& image, const std::string& ext, 
+                                                      cv::ImwriteFlags flag, int minValue, int maxValue, 
+                                                      TuningTarget target, double targetValue);
+
+
+/**
+ * @brief Compute the Structural Similarity Index (SSIM) between two images of the same size 
+ *        and type. Result is the average SSIM of all channels.
+ * 
+ * @param image1 first image
+ * @param image2 second image
+ * @return double SSIM value between 0 and 1 (1 means the images are identical)
+ */
+double computeSSIM(const cv::Mat& image1, const cv::Mat& image2);
+
+
+/**
+ * @brief Convert an image to the no. of channels and data type of its de-compressed copy, so 
+ *        the two can be compared. Codecs differ in what they keep: JPEG drops the alpha channel 
+ *        and 16-bit data, while WebP and JPEG 2000 keep the alpha channel
+ * 
+ * @param image image that was compressed
+ * @param decoded de-compressed image
+ * @param reference receives 'image' with the channels and data type of 'decoded'
+ * @return true if 'reference' can be compared with 'decoded'
+ * @return false if 'decoded' is empty, or its size or channels cannot be matched
+ */
+bool matchDecodedFormat(const cv::Mat& image, const cv::Mat& decoded, cv::Mat& reference);
+
+
+/**
+ * @brief Compute a 64-bit FNV-1a hash of the pixel values of an image. Used to recognise 
+ *        images we have already tuned.
+ * 
+ * @param image input image
+ * @return std::string hash as a hexadecimal string
+ */
+std::string imageHash(const cv::Mat& image);
+
+
+/**
+ * @brief Read previously tuned compression values from a cache file 
+ * 
+ * @param cachePath full path to cache file (.xml, .yml, .yaml or .json)
+ * @return std::map<std::string, int> cache key -> compression value. Empty if file does not exist
+ */
+std::map<std::string, int> readTuningCache(const std::string& cachePath);
+
+
+/**
+ * @brief Write tuned compression values to a cache file 
+ * 
+ * @param cachePath full path to cache file (.xml, .yml, .yaml or .json)
+ * @param cache cache key -> compression value
+ */
+void writeTuningCache(const std::string& cachePath, const std::map<std::string, int>& cache);
+
+
+/**
+ * @brief Compress an image, or every image in a directory and its sub-directories, into a 
+ *        single shard file. Images are read and compressed in parallel a batch at a time, 
+ *        while the directory is still being scanned, and appended to the shard
+ * 
+ * @param inputPath full path to image file, or to directory with image files
+ * @param shardPath full path to shard file
+ * @param format codec used for every image: jpeg, jpg, jp2, png, webp, tiff or qoi
+ * @return int 0 if the shard was saved, -1 otherwise
+ */
+int compressToShard(const std::string& inputPath, const std::string& shardPath, const std::string& format);
 
 //-------------------------- End of Function Declarations ---------------------//
 
@@ -62,12 +187,32 @@ int main(int argc, char* argv[])
      *      2. Full path to directory to save compressed file
      *      3. Name of compressed file without a file extension
      * 
+     * The following arguments are optional. Provide only one of the targets:
+     *      4. Target file size in bytes 
+     *      5. Target PSNR in decibels
+     *      6. Target SSIM between 0 and 1
+     *      7. Full path to a cache file with previously tuned compression values
+     *      8. Whether to sync the compressed file to disk before exiting
+     *      9. Whether to write to a temporary file, then rename it to the final file name
+     *     10. Full path to a manifest file, so a re-run skips an image that has not changed
+     *     11. Codec used for the images in a shard file
+     * 
     */
     const cv::String keys = 
         "{help h usage ? | | Compress an image into a character buffer }"
         "{image | <none> | full path to image to be compressed }"
         "{dirPath | <none> | full path to directory to save compressed file }"
-        "{fileName| <none> | name of compressed file (including file extension) }";
+        "{fileName| <none> | name of compressed file (including file extension) }"
+        "{targetSize | 0 | search for the best quality file no larger than this size in bytes (jpeg, jpg, jp2, webp only) }"
+        "{targetPSNR | 0 | search for the smallest file with at least this PSNR in dB (jpeg, jpg, jp2, webp only) }"
+        "{targetSSIM | 0 | search for the smallest file with at least this SSIM (jpeg, jpg, jp2, webp only) }"
+        "{cache | | full path to cache file (.xml, .yml, .yaml or .json) with previously tuned compression values }"
+        "{sync | false | make sure the compressed file is on disk (fsync) before exiting }"
+        "{atomic | false | write to a temporary file then rename it, so readers never see a partial file }"
+        "{parallelPNG | false | compress png files on all threads with our parallel deflate encoder instead of cv::imencode() }"
+        "{frames | 1 | compress the image this many times (as in a per-frame loop) and report the time and allocations per frame }"
+        "{manifest | | full path to manifest file (.xml, .yml, .yaml or .json). Skip the image if it was already compressed with the same settings and has not changed }"
+        "{format | jpg | codec for the images in a shard file: jpeg, jpg, jp2, png, webp, tiff or qoi }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -75,13 +220,23 @@ int main(int argc, char* argv[])
     // We also want to display a message about the program
     parser.about("\nCompress an image"
                  "\nCodec used during compression depends on the file extension provided by the user."
-                 "\nAcceptable file extensions are png, jpeg, jpg, jp2, webp or tiff.\n");
+                 "\nAcceptable file extensions are png, jpeg, jpg, jp2, webp, tiff, qoi or shard.\n");
     parser.printMessage();
 
     // Now lets extract our command line arguments
     cv::String imagePath = parser.get<cv::String>("image");
     cv::String saveDirectoryPath = parser.get<cv::String>("dirPath");
     cv::String fileName = parser.get<cv::String>("fileName"); 
+    double targetSize = parser.get<double>("targetSize");
+    double targetPSNR = parser.get<double>("targetPSNR");
+    double targetSSIM = parser.get<double>("targetSSIM");
+    cv::String cachePath = parser.get<cv::String>("cache");
+    bool syncToDisk = parser.get<bool>("sync");
+    bool atomicWrite = parser.get<bool>("atomic");
+    bool parallelPNG = parser.get<bool>("parallelPNG");
+    int frames = parser.get<int>("frames");
+    cv::String manifestPath = parser.get<cv::String>("manifest");
+    cv::String shardFormat = parser.get<cv::String>("format");
 
     // check for any errors encountered 
     if(!parser.check())
@@ -99,6 +254,21 @@ int main(int argc, char* argv[])
     // a. Extract file extension without the leading dot
     std::string ext { CPP_CV::ReadWriteFiles::getFileExtension(fileName)};
 
+    // A shard file holds many images, each compressed with the codec in 'format'
+    if (ext == "shard"s)
+    {
+        if (std::find(std::begin(commonOpenCVImageFileFormats), std::end(commonOpenCVImageFileFormats), 
+                      shardFormat) == std::end(commonOpenCVImageFileFormats))
+        {
+            std::cout << "\nThis application cannot compress images in a shard file with " << shardFormat 
+                      << ". Acceptable formats are png, jpeg, jpg, jp2, webp, tiff or qoi.\n";
+
+            return -1;
+        }
+
+        return compressToShard(imagePath, (std::filesystem::path{saveDirectoryPath} / fileName).string(), shardFormat);
+    }
+
     // b. Find the file extension from array with image file formats we can handle
     auto found { std::find(std::begin(commonOpenCVImageFileFormats), 
                            std::end(commonOpenCVImageFileFormats), 
@@ -110,10 +280,18 @@ int main(int argc, char* argv[])
     if (found == std::end(commonOpenCVImageFileFormats))
     {
         std::cout << "\nThis application cannot handle such an image file format." 
-                  << "Acceptable file extensions are png, jpeg, jpg, jp2, webp or tiff.\n";
+                  << "Acceptable file extensions are png, jpeg, jpg, jp2, webp, tiff or qoi.\n";
 
         return -1;
     } 
+
+    // d. Only one target can be used to search for a compression value
+    if (((targetSize > 0) + (targetPSNR > 0) + (targetSSIM > 0)) > 1)
+    {
+        std::cout << "\nPlease provide only one of targetSize, targetPSNR or targetSSIM.\n";
+
+        return -1;
+    }
     
     /////////////////////////// 3. Read Image and Encode /////////////////////////////
 
@@ -125,6 +303,32 @@ int main(int argc, char* argv[])
         return -1;
     }
 
+    /*
+     * A nightly job re-compresses mostly the same images. If a manifest is used, skip the image 
+     * (without even decoding it) when the manifest shows it was already compressed to the same 
+     * output file with the same settings, and neither the image nor the output has gone since.
+     * A frames benchmark always runs.
+    */
+    const std::string outputPath { (std::filesystem::path{saveDirectoryPath} / fileName).string() };
+
+    std::ostringstream settings;
+    settings << "targetSize=" << targetSize << ";targetPSNR=" << targetPSNR << ";targetSSIM=" << targetSSIM 
+             << ";parallelPNG=" << parallelPNG;
+
+    std::optional<CPP_CV::ReadWriteFiles::ProcessingManifest> manifest;
+    if (!manifestPath.empty() && (frames == 1))
+    {
+        manifest.emplace(manifestPath);
+
+        if (manifest->isUpToDate(imagePath, outputPath, settings.str()))
+        {
+            std::cout << "\nSkipped: " << imagePath << " has not changed since it was compressed to " 
+                      << outputPath << "\n\n";
+
+            return 0;
+        }
+    }
+
     // b. Use cv::imread() to read an image file as is and save the image as a cv::Mat array
     cv::Mat image { cv::imread(imagePath, cv::IMREAD_UNCHANGED) };    
 
@@ -144,28 +348,165 @@ int main(int argc, char* argv[])
 
     // get parameterID and parameter value
     auto [parameterID, parameterValue] = imageWriteFlag(ext); // from C++17 onwards
+
+    // If the user has provided a target, search for the compression value that meets it
+    if ((targetSize > 0) || (targetPSNR > 0) || (targetSSIM > 0))
+    {
+        TuningTarget target { TuningTarget::FileSize };
+        double targetValue { targetSize };
+        std::string targetName { "size" };
+
+        if (targetPSNR > 0) 
+        {
+            target = TuningTarget::PSNR;
+            targetValue = targetPSNR;
+            targetName = "psnr";
+        }
+        else if (targetSSIM > 0)
+        {
+            target = TuningTarget::SSIM;
+            targetValue = targetSSIM;
+            targetName = "ssim";
+        }
+
+        auto qualityRange { imageWriteQualityRange(ext) };
+
+        if (!qualityRange)
+        {
+            std::cout << "\nThe " << ext << " format is lossless - using the default compression value " 
+                      << parameterValue << ".\n";
+        }
+        else
+        {
+            auto [flag, minValue, maxValue] = *qualityRange;
+
+            // The cache key combines the image contents with the format and target, 
+            // so the same image tuned for a different target is searched again.
+            // Keys are prefixed with a letter since cv::FileStorage keys cannot start with a digit
+            std::ostringstream key;
+            key << "img_" << imageHash(image) << '_' << ext << '_' << targetName << '_' 
+                << static_cast<long long>(targetValue * 1000);
+
+            std::map<std::string, int> cache;
+            if (!cachePath.empty())
+            {
+                cache = readTuningCache(cachePath);
+            }
+
+            if (auto cached { cache.find(key.str()) }; cached != cache.end())
+            {
+                parameterValue = cached->second;
+
+                std::cout << "\nUsing cached compression value: " << parameterValue << '\n';
+            }
+            else 
+            {
+                cv::TickMeter timer;
+                timer.start();
+
+                auto best { searchCompressionValue(image, "."s + ext, flag, minValue, maxValue, target, targetValue) };
+
+                timer.stop();
+
+                if (best)
+                {
+                    parameterValue = best->parameterValue;
+
+                    std::cout << "\nFound compression value " << parameterValue 
+                              << " (file size = " << best->fileSize << " bytes";
+                    if (target != TuningTarget::FileSize)
+                    {
+                        std::cout << ", " << targetName << " = " << best->quality;
+                    }
+                    std::cout << ") in " << timer.getTimeMilli() << " ms.\n";
+
+                    if (!cachePath.empty())
+                    {
+                        cache[key.str()] = parameterValue;
+                        writeTuningCache(cachePath, cache);
+                    }
+                }
+                else 
+                {
+                    // Fall back to the value that gets us closest to the target
+                    parameterValue = (target == TuningTarget::FileSize) ? minValue : maxValue;
+
+                    std::cout << "\nNo compression value meets the target. Using the closest value: " 
+                              << parameterValue << '\n';
+                }
+            }
+        }
+    }
+
     compression_params.push_back(parameterID); // add parameterID
     compression_params.push_back(parameterValue); // add parameter value
 
     // d. Since we now have all our parameters checked out we can now compress our image
     //    We will do it in a try...catch block as it might fail
 
-    // Let's create a character buffer to store our compressed image
-    std::vector<uchar> imageBuffer;
+    // A codec session owns the character buffer that stores our compressed image. 
+    // The buffer is re-used by every frame, so it is only allocated when it has to grow
+    CPP_CV::ReadWriteFiles::CodecSession session;
+    std::vector<uchar> parallelBuffer; // only used by our parallel PNG encoder
+    std::vector<uchar> qoiBuffer;      // only used by our QOI encoder
+    const std::vector<uchar>* imageBuffer { &parallelBuffer };
     
     bool result = false; // Keeps track of whether we have successfully compressed our image
 
     // we need to add a dot to our file extension before using it in cv::imencode()
     ext = "."s + ext; 
+
+    cv::TickMeter encodeTimer;
     
     try {
-        result = cv::imencode(ext, image, imageBuffer, compression_params);
+        for (int frame {0}; frame < std::max(frames, 1); ++frame)
+        {
+            encodeTimer.start();
+
+            if (parallelPNG && (ext == ".png"))
+            {
+                // Rows are filtered and deflated on all the threads available to OpenCV
+                result = CPP_CV::ReadWriteFiles::encodePNGParallel(image, parallelBuffer, parameterValue);
+            }
+            else if (ext == ".qoi")
+            {
+                // cv::imencode() has no QOI codec. The buffer keeps its memory between frames
+                result = CPP_CV::ReadWriteFiles::encodeQOI(image, qoiBuffer);
+                imageBuffer = &qoiBuffer;
+            }
+            else 
+            {
+                imageBuffer = &session.encode(ext, image, compression_params);
+                result = !imageBuffer->empty();
+            }
+
+            encodeTimer.stop();
+        }
     } 
     catch (const cv::Exception& ex)
     {
         std::cerr << "\nError compressing image: " << ex.what();
     }
 
+    if (result && (frames > 1))
+    {
+        std::cout << "\nCompressed " << frames << " frames: " << encodeTimer.getTimeMilli() / frames << " ms per frame, ";
+
+        // Only the session counts its allocations. Our parallel PNG and QOI encoders do not use it 
+        // (the parallel PNG encoder allocates filter and deflate buffers on every frame), so the 
+        // session's count of 0 would be wrong for them
+        if (session.statistics().encodeCalls > 0)
+        {
+            std::cout << session.statistics().allocationsPerFrame() << " buffer allocations per frame (" 
+                      << session.statistics().encodeAllocations << " in total)\n";
+        }
+        else 
+        {
+            std::cout << "buffer allocations not counted (" 
+                      << ((ext == ".qoi") ? "QOI" : "parallel PNG") << " encoder does not use the codec session)\n";
+        }
+    }
+
     ///////////////////////////// 4. Save Image Buffer to File /////////////////////
 
 
@@ -186,9 +527,27 @@ int main(int argc, char* argv[])
         std::filesystem::path savePath {saveDirectoryPath}; // Directory to save image to
         savePath /= fileName; // Directory + file name == Full file path
         
-        // Save buffer to file
-        writeVectorBufferToFile(savePath, imageBuffer);
+        // Save buffer to file. The whole buffer is handed to the operating 
+        // system in a few large writes instead of one character at a time
+        CPP_CV::ReadWriteFiles::WriteOptions writeOptions;
+        writeOptions.preallocate = true;
+        writeOptions.syncToDisk = syncToDisk;
+        writeOptions.atomic = atomicWrite;
+
+        if (!CPP_CV::ReadWriteFiles::writeBufferToFile(savePath.string(), *imageBuffer, writeOptions))
+        {
+            std::cerr << "\nError: Could not save compressed image to " << savePath << '\n';
+
+            return -1;
+        }
 
+        std::cout << "\nSaved compressed image (" << imageBuffer->size() << " bytes) to " << savePath << '\n';
+
+        // Remember the image, so the next run with the same settings can skip it
+        if (manifest && (!manifest->record(imagePath, savePath.string(), settings.str()) || !manifest->save()))
+        {
+            std::cerr << "\nWarning: Could not update manifest file " << manifestPath << '\n';
+        }
     }
     else 
     {
@@ -204,7 +563,7 @@ int main(int argc, char* argv[])
 
 /**
  * @brief Return the cv::ImwriteFlag and best quality compression value for 
- *        images with file extensions jpg, jpeg, jp2, png, webp and tiff
+ *        images with file extensions jpg, jpeg, jp2, png, webp, tiff and qoi
  * 
  * @param fileExtension image file extension (without the leading dot/period)
  * @return std::tuple [cv::ImwriteFlag, int] - the compression flag and best quality compression value
@@ -216,21 +575,506 @@ std::tuple<cv::ImwriteFlags, int> imageWriteFlag(const cv::String& fileExtension
     else if (fileExtension == "jp2"s) return { cv::IMWRITE_JPEG2000_COMPRESSION_X1000, 1000 };
     else if (fileExtension == "webp"s) return { cv::IMWRITE_WEBP_QUALITY, 45 };
     else if (fileExtension == "tiff"s) return { cv::IMWRITE_TIFF_COMPRESSION, 5 };    
+    else if (fileExtension == "qoi"s) return { cv::IMWRITE_PNG_COMPRESSION, 0 }; // not used - QOI has no compression value
+}
+
+
+/**
+ * @brief Return the cv::ImwriteFlag and the range of compression values that control the 
+ *        quality (and therefore size) of a lossy image file format
+ * 
+ * @param fileExtension image file extension (without the leading dot/period)
+ * @return std::optional<std::tuple<cv::ImwriteFlags, int, int>> [flag, lowest value, highest value]. 
+ *         Lossless formats (png, tiff, qoi) return std::nullopt since their compression value does not 
+ *         change image quality
+ */
+std::optional<std::tuple<cv::ImwriteFlags, int, int>> imageWriteQualityRange(const cv::String& fileExtension)
+{
+    if (fileExtension == "jpeg"s || fileExtension == "jpg"s) return std::make_tuple(cv::IMWRITE_JPEG_QUALITY, 0, 100);
+    else if (fileExtension == "jp2"s) return std::make_tuple(cv::IMWRITE_JPEG2000_COMPRESSION_X1000, 0, 1000);
+    else if (fileExtension == "webp"s) return std::make_tuple(cv::IMWRITE_WEBP_QUALITY, 1, 100); // values above 100 are lossless
+    else return std::nullopt;
 }
 
 
 /**
- * @brief Write the contents of a std::vector<unsigned char> image buffer to file
+ * @brief Search for the compression value that meets a target file size or image quality. 
+ *        Each round of the search evaluates several compression values in parallel and 
+ *        narrows the search interval around the target (with a single thread this is a 
+ *        plain bisection).
  * 
- * @param filePath full path to save data to including image file extension
- * @param buffer std::vector<unsigned char>
+ * @param image image to be compressed
+ * @param ext image file extension with the leading dot/period e.g. ".jpg"
+ * @param flag compression flag e.g. cv::IMWRITE_JPEG_QUALITY
+ * @param minValue lowest compression value for the flag
+ * @param maxValue highest compression value for the flag
+ * @param target what we are aiming for i.e. file size, PSNR or SSIM
+ * @param targetValue maximum file size in bytes (TuningTarget::FileSize) or minimum PSNR/SSIM 
+ * @return std::optional<TuningCandidate> the highest compression value whose file is no larger than 
+ *         the target size, or the lowest compression value whose quality is at least the target 
+ *         quality. Returns std::nullopt if no compression value meets the target
  */
-void writeVectorBufferToFile(const std::string& filePath, std::vector<uchar>& buffer)
+std::optional<TuningCandidate> searchCompressionValue(const cv::Mat& image, const std::string& ext, 
+                                                      cv::ImwriteFlags flag, int minValue, int maxValue, 
+                                                      TuningTarget target, double targetValue)
 {
-    // Create an output stream to write 
-    std::ofstream file(filePath, std::ios::out);
+    // A larger compression value means better quality and a larger file, for all the 
+    // formats we tune. File size targets therefore want the highest passing value, 
+    // quality targets want the lowest passing value.
+    const bool wantHighestValue { target == TuningTarget::FileSize };
+
+    std::optional<TuningCandidate> best;
+
+    int low { minValue };   // lowest compression value not yet ruled out
+    int high { maxValue };  // highest compression value not yet ruled out
+
+    // Evaluate as many compression values per round as we have threads
+    const int numberOfThreads { std::max(1, cv::getNumThreads()) };
+
+    while (low <= high)
+    {
+        // a. Pick evenly spaced compression values inside [low, high]
+        const int range { high - low + 1 };
+        const int count { std::min(numberOfThreads, range) };
+
+        std::vector<TuningCandidate> candidates(count);
+        for (int i {0}; i < count; ++i)
+        {
+            candidates[i].parameterValue = (count == range) ? (low + i) 
+                                                            : (low + ((i + 1) * (range + 1)) / (count + 1) - 1);
+        }
+
+        // b. Compress (and for quality targets de-compress) each candidate in parallel
+        cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& r) {
+            for (int i { r.start }; i < r.end; ++i)
+            {
+                // A codec that cannot handle the image only fails this candidate, not the whole search
+                try 
+                {
+                    std::vector<uchar> buffer;
+                    if (!cv::imencode(ext, image, buffer, { flag, candidates[i].parameterValue }))
+                    {
+                        continue;
+                    }
+                    candidates[i].fileSize = buffer.size();
+
+                    if (target != TuningTarget::FileSize)
+                    {
+                        cv::Mat decoded { cv::imdecode(buffer, cv::IMREAD_UNCHANGED) };
+                        cv::Mat reference;
+                        if (!matchDecodedFormat(image, decoded, reference))
+                        {
+                            continue;
+                        }
+
+                        // PSNR needs the maximum possible pixel value of the de-compressed data type
+                        const double maxPixelValue { (decoded.depth() == CV_16U) ? 65535.0 : 255.0 };
+                        candidates[i].quality = (target == TuningTarget::PSNR) ? cv::PSNR(reference, decoded, maxPixelValue) 
+                                                                               : computeSSIM(reference, decoded);
+                    }
+
+                    candidates[i].evaluated = true;
+                }
+                catch (const cv::Exception& ex)
+                {
+                    std::cerr << "\nCould not evaluate compression value " << candidates[i].parameterValue 
+                              << ": " << ex.what();
+                }
+            }
+        });
+
+        // c. Narrow the search interval around the boundary between passing and failing values
+        auto passes = [&](const TuningCandidate& c) {
+            return c.evaluated && ((target == TuningTarget::FileSize) ? (static_cast<double>(c.fileSize) <= targetValue) 
+                                                                      : (c.quality >= targetValue));
+        };
+
+        if (wantHighestValue)
+        {
+            // Values below a passing value also pass, so find the last passing candidate
+            int lastPass {-1};
+            for (int i {0}; i < count; ++i)
+            {
+                if (passes(candidates[i])) lastPass = i;
+            }
+
+            if (lastPass >= 0)
+            {
+                best = candidates[lastPass];
+                low = candidates[lastPass].parameterValue + 1;
+            }
+            high = (lastPass + 1 < count) ? candidates[lastPass + 1].parameterValue - 1 : high;
+        }
+        else 
+        {
+            // Values above a passing value also pass, so find the first passing candidate
+            int firstPass {count};
+            for (int i { count - 1 }; i >= 0; --i)
+            {
+                if (passes(candidates[i])) firstPass = i;
+            }
+
+            if (firstPass < count)
+            {
+                best = candidates[firstPass];
+                high = candidates[firstPass].parameterValue - 1;
+            }
+            low = (firstPass > 0) ? candidates[firstPass - 1].parameterValue + 1 : low;
+        }
+    }
+
+    return best;
+}
+
 
-    // Use the copy algorithm, to copy our vector contents to a output iterator that will write 
-    // them to our file
-    std::copy(buffer.cbegin(), buffer.cend(), std::ostream_iterator<unsigned char>(file));
+/**
+ * @brief Convert an image to the no. of channels and data type of its de-compressed copy, so 
+ *        the two can be compared. Codecs differ in what they keep: JPEG drops the alpha channel 
+ *        and 16-bit data, while WebP and JPEG 2000 keep the alpha channel
+ * 
+ * @param image image that was compressed
+ * @param decoded de-compressed image
+ * @param reference receives 'image' with the channels and data type of 'decoded'
+ * @return true if 'reference' can be compared with 'decoded'
+ * @return false if 'decoded' is empty, or its size or channels cannot be matched
+ */
+bool matchDecodedFormat(const cv::Mat& image, const cv::Mat& decoded, cv::Mat& reference)
+{
+    if (decoded.empty() || (decoded.size() != image.size()))
+    {
+        return false;
+    }
+
+    // 1. Channels
+    if (image.channels() == decoded.channels())
+    {
+        reference = image;
+    }
+    else if ((image.channels() == 4) && (decoded.channels() == 3))
+    {
+        cv::cvtColor(image, reference, cv::COLOR_BGRA2BGR);
+    }
+    else if ((image.channels() == 3) && (decoded.channels() == 1))
+    {
+        cv::cvtColor(image, reference, cv::COLOR_BGR2GRAY);
+    }
+    else if ((image.channels() == 4) && (decoded.channels() == 1))
+    {
+        cv::cvtColor(image, reference, cv::COLOR_BGRA2GRAY);
+    }
+    else 
+    {
+        return false;
+    }
+
+    // 2. Data type e.g. 16-bit data saved as 8-bit JPEG
+    if (reference.depth() != decoded.depth())
+    {
+        const double scale { (reference.depth() == CV_16U) && (decoded.depth() == CV_8U) ? 1.0 / 257.0 : 
+                             (reference.depth() == CV_8U) && (decoded.depth() == CV_16U) ? 257.0 : 1.0 };
+        reference.convertTo(reference, decoded.depth(), scale);
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Compute the Structural Similarity Index (SSIM) between two images of the same size 
+ *        and type. Result is the average SSIM of all channels.
+ * 
+ * @param image1 first image
+ * @param image2 second image
+ * @return double SSIM value between 0 and 1 (1 means the images are identical)
+ */
+double computeSSIM(const cv::Mat& image1, const cv::Mat& image2)
+{
+    // Constants used to stabilise the division with weak denominators
+    const double maxPixelValue { (image1.depth() == CV_16U) ? 65535.0 : 255.0 };
+    const double C1 { (0.01 * maxPixelValue) * (0.01 * maxPixelValue) };
+    const double C2 { (0.03 * maxPixelValue) * (0.03 * maxPixelValue) };
+
+    cv::Mat I1, I2;
+    image1.convertTo(I1, CV_32F);
+    image2.convertTo(I2, CV_32F);
+
+    cv::Mat I1_2 { I1.mul(I1) };   // I1^2
+    cv::Mat I2_2 { I2.mul(I2) };   // I2^2
+    cv::Mat I1_I2 { I1.mul(I2) };  // I1 * I2
+
+    // Local means, variances and covariance using a gaussian window
+    cv::Mat mu1, mu2;
+    cv::GaussianBlur(I1, mu1, cv::Size(11, 11), 1.5);
+    cv::GaussianBlur(I2, mu2, cv::Size(11, 11), 1.5);
+
+    cv::Mat mu1_2 { mu1.mul(mu1) };
+    cv::Mat mu2_2 { mu2.mul(mu2) };
+    cv::Mat mu1_mu2 { mu1.mul(mu2) };
+
+    cv::Mat sigma1_2, sigma2_2, sigma12;
+    cv::GaussianBlur(I1_2, sigma1_2, cv::Size(11, 11), 1.5);
+    sigma1_2 -= mu1_2;
+    cv::GaussianBlur(I2_2, sigma2_2, cv::Size(11, 11), 1.5);
+    sigma2_2 -= mu2_2;
+    cv::GaussianBlur(I1_I2, sigma12, cv::Size(11, 11), 1.5);
+    sigma12 -= mu1_mu2;
+
+    // SSIM = ((2*mu1*mu2 + C1) * (2*sigma12 + C2)) / ((mu1^2 + mu2^2 + C1) * (sigma1^2 + sigma2^2 + C2))
+    cv::Mat t1 { 2 * mu1_mu2 + C1 };
+    cv::Mat t2 { 2 * sigma12 + C2 };
+    cv::Mat t3 { t1.mul(t2) };
+
+    t1 = mu1_2 + mu2_2 + C1;
+    t2 = sigma1_2 + sigma2_2 + C2;
+    t1 = t1.mul(t2);
+
+    cv::Mat ssimMap;
+    cv::divide(t3, t1, ssimMap);
+
+    // Average over all channels
+    cv::Scalar mssim { cv::mean(ssimMap) };
+    double sum {0.0};
+    for (int c {0}; c < image1.channels(); ++c)
+    {
+        sum += mssim[c];
+    }
+
+    return sum / image1.channels();
+}
+
+
+/**
+ * @brief Compute a 64-bit FNV-1a hash of the pixel values of an image. Used to recognise 
+ *        images we have already tuned.
+ * 
+ * @param image input image
+ * @return std::string hash as a hexadecimal string
+ */
+std::string imageHash(const cv::Mat& image)
+{
+    std::uint64_t hash { 14695981039346656037ULL }; // FNV offset basis
+
+    // Hash row by row since the image may not be continuous in memory
+    const std::size_t rowSize { image.cols * image.elemSize() };
+    for (int row {0}; row < image.rows; ++row)
+    {
+        const uchar* p { image.ptr<uchar>(row) };
+        for (std::size_t i {0}; i < rowSize; ++i)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL; // FNV prime
+        }
+    }
+
+    // Include the image dimensions and type so images with the same 
+    // bytes but a different shape get different hashes
+    std::ostringstream out;
+    out << std::hex << hash << '_' << std::dec << image.cols << 'x' << image.rows << '_' << image.type();
+
+    return out.str();
+}
+
+
+/**
+ * @brief Read previously tuned compression values from a cache file 
+ * 
+ * @param cachePath full path to cache file (.xml, .yml, .yaml or .json)
+ * @return std::map<std::string, int> cache key -> compression value. Empty if file does not exist
+ */
+std::map<std::string, int> readTuningCache(const std::string& cachePath)
+{
+    std::map<std::string, int> cache;
+
+    if (!std::filesystem::exists(cachePath))
+    {
+        return cache;
+    }
+
+    cv::FileStorage fs(cachePath, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        std::cerr << "\nCould not open cache file for reading: " << cachePath << '\n';
+
+        return cache;
+    }
+
+    // Each entry in the cache file is a (key, compression value) pair
+    cv::FileNode root { fs.root() };
+    for (cv::FileNodeIterator it = root.begin(); it != root.end(); ++it)
+    {
+        cv::FileNode entry { *it };
+        cache[entry.name()] = static_cast<int>(entry);
+    }
+
+    fs.release();
+
+    return cache;
+}
+
+
+/**
+ * @brief Write tuned compression values to a cache file 
+ * 
+ * @param cachePath full path to cache file (.xml, .yml, .yaml or .json)
+ * @param cache cache key -> compression value
+ */
+void writeTuningCache(const std::string& cachePath, const std::map<std::string, int>& cache)
+{
+    cv::FileStorage fs(cachePath, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        std::cerr << "\nCould not open cache file for writing: " << cachePath << '\n';
+
+        return;
+    }
+
+    for (const auto& [key, value] : cache)
+    {
+        fs << key << value;
+    }
+
+    fs.release();
+}
+
+
+/**
+ * @brief Compress an image, or every image in a directory and its sub-directories, into a 
+ *        single shard file. Images are read and compressed in parallel a batch at a time, 
+ *        while the directory is still being scanned, and appended to the shard
+ * 
+ * @param inputPath full path to image file, or to directory with image files
+ * @param shardPath full path to shard file
+ * @param format codec used for every image: jpeg, jpg, jp2, png, webp, tiff or qoi
+ * @return int 0 if the shard was saved, -1 otherwise
+ */
+int compressToShard(const std::string& inputPath, const std::string& shardPath, const std::string& format)
+{
+    // Keys are paths relative to the directory, with '/' separators on every operating system
+    const bool isDirectory { std::filesystem::is_directory(inputPath) };
+    const std::filesystem::path root { isDirectory ? std::filesystem::path{inputPath} : std::filesystem::path{inputPath}.parent_path() };
+
+    // Files are handed to us while the directory tree is still being scanned
+    std::optional<CPP_CV::Directories::DirectoryScanner> scanner;
+    if (isDirectory)
+    {
+        scanner.emplace(inputPath);
+    }
+    bool singleFileTaken { false };
+
+    CPP_CV::ReadWriteFiles::ShardWriter shard(shardPath);
+    if (!shard.isOpen())
+    {
+        return -1;
+    }
+
+    auto [parameterID, parameterValue] = imageWriteFlag(format);
+    const std::vector<int> parameters { parameterID, parameterValue };
+    const std::string extension { "."s + format };
+
+    // Each thread compresses into its own buffer, then the buffers are appended in order
+    constexpr std::size_t batchSize {256};
+    std::vector<std::string> batch;
+    std::vector<std::vector<uchar>> buffers(batchSize);
+    int failed {0};
+
+    cv::TickMeter timer;
+    timer.start();
+
+    while (true)
+    {
+        // a. Collect the next batch of image files
+        batch.clear();
+        CPP_CV::Directories::ScannedFile file;
+        while (batch.size() < batchSize)
+        {
+            if (scanner && scanner->next(file))
+            {
+                batch.push_back(file.path);
+            }
+            else if (!scanner && !singleFileTaken)
+            {
+                batch.push_back(inputPath);
+                singleFileTaken = true;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (batch.empty())
+        {
+            break;
+        }
+
+        // b. Read and compress the batch on all threads
+        cv::parallel_for_(cv::Range(0, static_cast<int>(batch.size())), [&](const cv::Range& range) {
+            for (int i {range.start}; i < range.end; ++i)
+            {
+                buffers[i].clear();
+
+                try 
+                {
+                    const cv::Mat image { cv::imread(batch[i], cv::IMREAD_UNCHANGED) };
+                    if (image.empty())
+                    {
+                        continue;
+                    }
+
+                    if (format == "qoi"s)
+                    {
+                        if (!CPP_CV::ReadWriteFiles::encodeQOI(image, buffers[i]))
+                        {
+                            buffers[i].clear();
+                        }
+                    }
+                    else if (!cv::imencode(extension, image, buffers[i], parameters))
+                    {
+                        buffers[i].clear();
+                    }
+                }
+                catch (const cv::Exception&)
+                {
+                    buffers[i].clear();
+                }
+            }
+        });
+
+        // c. Append the compressed images to the shard
+        for (std::size_t i {0}; i < batch.size(); ++i)
+        {
+            const std::string key { std::filesystem::path{batch[i]}.lexically_relative(root).generic_string() };
+            if (buffers[i].empty() || !shard.add(key, format, buffers[i]))
+            {
+                std::cerr << "\nCould not compress image file: " << batch[i] << '\n';
+                ++failed;
+            }
+        }
+    }
+
+    const std::size_t images { shard.size() };
+    const std::uint64_t bytes { shard.bytes() };
+    const bool saved { shard.close() };
+
+    timer.stop();
+
+    if (scanner && (scanner->directoryErrors() > 0))
+    {
+        std::cerr << "\nCould not open " << scanner->directoryErrors() << " directories.\n";
+    }
+
+    if (!saved)
+    {
+        return -1;
+    }
+
+    std::cout << "\nSaved " << images << " compressed images (" << bytes << " bytes) to " << shardPath 
+              << " in " << timer.getTimeSec() << " s (" << images / timer.getTimeSec() << " images/s)";
+    if (failed > 0)
+    {
+        std::cout << ". " << failed << " files could not be compressed";
+    }
+    std::cout << "\n\n";
+
+    return 0;
 }
\ No newline at end of file
@@ -5,6 +5,17 @@
  *      1. De-compresses an image file
  *      2. Displays the image
  * 
+ * The image can be de-compressed several times (as in a per-frame loop). A codec 
+ * session re-uses the same destination array for every frame, and we report the 
+ * time and no. of memory allocations per frame.
+ * 
+ * Files with the extension qoi are de-compressed with our own QOI codec, 
+ * CPP_CV::ReadWriteFiles::decodeQOI(), which re-uses the destination array too.
+ * 
+ * Files with the extension shard hold many compressed images. The shard is memory mapped 
+ * and the image with the given key is found with one lookup in its index, so only that 
+ * image is read from disk. Without a key, the images in the shard are listed.
+ * 
  * Inputs are provided through the command line
  * 
 */
@@ -18,6 +29,9 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <algorithm> // for std::max, std::min
+#include <optional>
 
 int main(int argc, char* argv[])
 {
@@ -28,10 +42,16 @@ int main(int argc, char* argv[])
      * We need 1 arguments:
      *      1. Full path to compressed image file 
      * 
+     * Optional arguments:
+     *      2. No. of times to de-compress the image
+     *      3. Key of the image to de-compress from a shard file
+     * 
     */
     const cv::String keys = 
         "{help h usage ? | | De-compress an image file }"
-        "{compressedImage | <none> | Full path to compressed image file }";
+        "{compressedImage | <none> | Full path to compressed image file }"
+        "{frames | 1 | de-compress the image this many times (as in a per-frame loop) and report the time and allocations per frame }"
+        "{key | | key of the image to de-compress from a shard file. If empty, the images in the shard are listed }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -42,6 +62,8 @@ int main(int argc, char* argv[])
 
     // Now lets extract our command line arguments
     cv::String compressedFile = parser.get<cv::String>("compressedImage");
+    int frames = parser.get<int>("frames");
+    cv::String key = parser.get<cv::String>("key");
 
     // check for any errors encountered 
     if(!parser.check())
@@ -58,8 +80,57 @@ int main(int argc, char* argv[])
     // We will read our compressed image file into a std::vector<uchar>
     std::vector<uchar> buffer;
 
-    // Call function to read image file into std::vector<uchar> container
-    CPP_CV::ReadWriteFiles::readFileToVector(compressedFile, buffer);
+    // A shard file is not read, only memory mapped. Its index is read when it is opened
+    const bool isShard { CPP_CV::ReadWriteFiles::getFileExtension(compressedFile) == "shard" };
+    std::optional<CPP_CV::ReadWriteFiles::ShardReader> shard;
+
+    if (isShard)
+    {
+        cv::TickMeter openTimer;
+        openTimer.start();
+        shard.emplace(compressedFile);
+        openTimer.stop();
+
+        if (!shard->isOpen())
+        {
+            std::cout << "\nError: Could not open shard file: " << compressedFile << '\n';
+
+            return -1;
+        }
+
+        std::cout << "\nOpened shard with " << shard->size() << " images in " << openTimer.getTimeMilli() << " ms\n";
+
+        // Without a key, list the first images in the shard
+        if (key.empty())
+        {
+            const std::size_t listed { std::min<std::size_t>(shard->size(), 100) };
+            for (std::size_t i {0}; i < listed; ++i)
+            {
+                const auto& record { shard->records()[i] };
+                std::cout << record.key << " (" << record.type << ", " << record.length << " bytes)\n";
+            }
+            if (listed < shard->size())
+            {
+                std::cout << "... and " << shard->size() - listed << " more\n";
+            }
+
+            std::cout << '\n';
+
+            return 0;
+        }
+
+        if (shard->find(key) == nullptr)
+        {
+            std::cout << "\nError: No image with key " << key << " in shard file: " << compressedFile << '\n';
+
+            return -1;
+        }
+    }
+    else 
+    {
+        // Call function to read image file into std::vector<uchar> container
+        CPP_CV::ReadWriteFiles::readFileToVector(compressedFile, buffer);
+    }
 
     //std::cout << "\nSize of compressed image: " 
               //<< buffer.size() * sizeof(unsigned char) << " bytes.\n";
@@ -68,11 +139,49 @@ int main(int argc, char* argv[])
 
     //////////////////////// 3. De-compress Image File ////////////////////////////
         
-    // Decode image file
-    cv::Mat image { cv::imdecode(buffer, cv::IMREAD_UNCHANGED) };
+    // Decode image file. The codec session owns the destination array and re-uses 
+    // it for every frame, so memory is only allocated for the first frame
+    CPP_CV::ReadWriteFiles::CodecSession session;
+    cv::Mat image;
+
+    // cv::imdecode() has no QOI codec, so QOI files are decoded by our own
+    const bool isQOI { CPP_CV::ReadWriteFiles::getFileExtension(compressedFile) == "qoi" };
+
+    cv::TickMeter decodeTimer;
+    for (int frame {0}; frame < std::max(frames, 1); ++frame)
+    {
+        decodeTimer.start();
+        if (isShard)
+        {
+            image = shard->decode(key, cv::IMREAD_UNCHANGED);
+        }
+        else if (isQOI)
+        {
+            if (!CPP_CV::ReadWriteFiles::decodeQOI(buffer, image))
+            {
+                image.release();
+            }
+        }
+        else 
+        {
+            image = session.decode(buffer, cv::IMREAD_UNCHANGED);
+        }
+        decodeTimer.stop();
+    }
+
+    if (!image.empty() && (frames > 1))
+    {
+        std::cout << "\nDe-compressed " << frames << " frames: " << decodeTimer.getTimeMilli() / frames << " ms per frame";
+        if (!isQOI && !isShard)
+        {
+            std::cout << ", " << session.statistics().allocationsPerFrame() 
+                      << " allocations per frame (" << session.statistics().decodeAllocations << " in total)";
+        }
+        std::cout << '\n';
+    }
 
     // If the buffer is too short or contains invalid data, 
-    // cv::imdecode() returns an empty array
+    // cv::imdecode() returns an empty array (and we release ours)
     if(image.empty())
     {
         std::cout << "\nError: Decompressed image array is empty.\n";
@@ -0,0 +1,208 @@
+// Program: png_encode_benchmark.cpp
+
+/*
+ * Program compares our multi-threaded PNG encoder, CPP_CV::ReadWriteFiles::encodePNGParallel(),
+ * against cv::imwrite() at every PNG compression level (0 to 9).
+ *
+ * cv::imwrite() filters and deflates the image on a single thread. Our encoder filters rows
+ * in parallel, deflates independent chunks of the filtered data on all the threads available
+ * to OpenCV and joins them into one zlib stream (the approach used by pigz). For each level
+ * we report:
+ *      1. Median time to save the image with cv::imwrite() and with our encoder in milliseconds
+ *      2. Speed up of our encoder over cv::imwrite()
+ *      3. Size of both PNG files in bytes
+ *      4. Whether our PNG file decodes to exactly the same pixels as the input image
+ *
+ * Both encoders are given the same zlib strategy, so only the threading differs.
+ *
+ * Inputs are provided through the command line
+ *
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core data types and cv::norm()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser, cv::TickMeter and cv::getNumThreads()
+#include "opencv2/imgcodecs.hpp"       // for cv::imread() and cv::imwrite()
+
+#include "UtilityFunctions/utility_functions.h" // for encodePNGParallel() and writeBufferToFile()
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <vector>
+#include <string>
+#include <algorithm>   // for std::sort
+#include <filesystem>
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to image to compress
+     *      2. Full path to directory to save the PNG files to
+     *      3. No. of times to save the image at each level
+     *      4. No. of threads used by our encoder
+     *      5. zlib strategy used by both encoders
+     *      6. No. of bytes deflated by each task of our encoder
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Benchmark multi-threaded PNG encoding }"
+        "{image | <none> | full path to image to compress }"
+        "{dirPath | <none> | full path to directory to save the PNG files to }"
+        "{repeat | 5 | no. of times to save the image at each compression level }"
+        "{threads | 0 | no. of threads for our encoder. 0 uses the OpenCV default }"
+        "{strategy | 3 | zlib strategy used by both encoders (see cv::ImwritePNGFlags). 3 is the cv::imwrite() default }"
+        "{chunkSize | 262144 | no. of bytes of filtered image data deflated by each task }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nCompare our multi-threaded PNG encoder against cv::imwrite() at compression levels 0 to 9.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("image");
+    cv::String saveDirectoryPath = parser.get<cv::String>("dirPath");
+    int repeat = parser.get<int>("repeat");
+    int threads = parser.get<int>("threads");
+    int strategy = parser.get<int>("strategy");
+    int chunkSize = parser.get<int>("chunkSize");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if ((repeat <= 0) || (threads < 0) || (chunkSize <= 0))
+    {
+        std::cerr << "\nRepeat and chunk size should be greater than 0, and threads should not be negative.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Read Image ///////////////////////////////
+
+    cv::Mat image { cv::imread(imagePath, cv::IMREAD_UNCHANGED) };
+    if (image.empty())
+    {
+        std::cerr << "\nCould not read data from image file: " << imagePath << '\n';
+
+        return -1;
+    }
+
+    if (threads > 0)
+    {
+        cv::setNumThreads(threads);
+    }
+
+    std::cout << "\nImage size (width x height): " << image.cols << " x " << image.rows
+              << "\nNo. of channels: " << image.channels()
+              << "\nThreads used by our encoder: " << cv::getNumThreads() << '\n';
+
+    const std::filesystem::path directory {saveDirectoryPath};
+    const std::string imwritePath { (directory / "imwrite.png").string() };
+    const std::string parallelPath { (directory / "parallel.png").string() };
+
+    ///////////////////////// 3. Benchmark each compression level //////////////////////
+
+    std::cout << '\n' << std::setw(6) << "Level"
+              << std::setw(16) << "imwrite (ms)" << std::setw(16) << "parallel (ms)" << std::setw(10) << "Speed up"
+              << std::setw(16) << "imwrite bytes" << std::setw(16) << "parallel bytes" << std::setw(10) << "Lossless" << '\n';
+
+    for (int level {0}; level <= 9; ++level)
+    {
+        std::vector<double> imwriteTimes;
+        std::vector<double> parallelTimes;
+
+        for (int i {0}; i < repeat; ++i)
+        {
+            // a. Single-threaded cv::imwrite()
+            cv::TickMeter timer;
+            timer.start();
+            bool result = cv::imwrite(imwritePath, image, { cv::IMWRITE_PNG_COMPRESSION, level, cv::IMWRITE_PNG_STRATEGY, strategy });
+            timer.stop();
+
+            if (!result)
+            {
+                std::cerr << "\nError: cv::imwrite() could not save " << imwritePath << '\n';
+
+                return -1;
+            }
+            imwriteTimes.push_back(timer.getTimeMilli());
+
+            // b. Our multi-threaded encoder. Saving the buffer to file is included in the time
+            timer.reset();
+            timer.start();
+            std::vector<uchar> buffer;
+            result = CPP_CV::ReadWriteFiles::encodePNGParallel(image, buffer, level, strategy, static_cast<std::size_t>(chunkSize)) &&
+                     CPP_CV::ReadWriteFiles::writeBufferToFile(parallelPath, buffer);
+            timer.stop();
+
+            if (!result)
+            {
+                std::cerr << "\nError: our encoder could not save " << parallelPath
+                          << ". Only 8-bit and 16-bit images with 1, 3 or 4 channels are supported.\n";
+
+                return -1;
+            }
+            parallelTimes.push_back(timer.getTimeMilli());
+        }
+
+        // PNG is lossless, so our file must decode to the input image
+        const cv::Mat decoded { cv::imread(parallelPath, cv::IMREAD_UNCHANGED) };
+        const bool lossless { (decoded.size() == image.size()) && (decoded.type() == image.type()) &&
+                              (cv::norm(decoded, image, cv::NORM_INF) == 0) };
+
+        const double imwriteMilliseconds { median(imwriteTimes) };
+        const double parallelMilliseconds { median(parallelTimes) };
+
+        std::cout << std::setw(6) << level
+                  << std::setw(16) << imwriteMilliseconds << std::setw(16) << parallelMilliseconds
+                  << std::setw(9) << imwriteMilliseconds / parallelMilliseconds << 'x'
+                  << std::setw(16) << std::filesystem::file_size(imwritePath)
+                  << std::setw(16) << std::filesystem::file_size(parallelPath)
+                  << std::setw(10) << (lossless ? "yes" : "NO") << '\n';
+    }
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    const std::size_t middle { values.size() / 2 };
+
+    return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+//-------------------------- End of Function Definitions ---------------------//
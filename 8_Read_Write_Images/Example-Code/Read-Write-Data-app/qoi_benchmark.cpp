@@ -0,0 +1,249 @@
+// Program: qoi_benchmark.cpp
+
+/*
+ * Program compares our lossless QOI codec, CPP_CV::ReadWriteFiles::encodeQOI() and
+ * CPP_CV::ReadWriteFiles::decodeQOI(), against PNG at every compression level (0 to 9),
+ * for images kept as intermediate results between the steps of a pipeline.
+ *
+ * Both codecs compress to and de-compress from a memory buffer, so only the codecs are
+ * timed and not the disk. For PNG at each level, and for QOI, we report:
+ *      1. Median time to compress the image with cv::imencode() or encodeQOI() in milliseconds
+ *      2. Median time to de-compress the image with cv::imdecode() or decodeQOI() in milliseconds
+ *      3. Size of the compressed image in bytes, and the compression ratio
+ *         (size of the image pixels / size of the compressed image)
+ *      4. Whether the image de-compresses to exactly the same pixels as the input image
+ *
+ * Inputs are provided through the command line
+ *
+*/
+
+#include "opencv2/core.hpp"            // for OpenCV core data types and cv::norm()
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
+#include "opencv2/imgcodecs.hpp"       // for cv::imread(), cv::imencode() and cv::imdecode()
+
+#include "UtilityFunctions/utility_functions.h" // for encodeQOI() and decodeQOI()
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <vector>
+#include <string>
+#include <algorithm>   // for std::sort
+#include <functional>  // for std::function
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values);
+
+
+/**
+ * @brief Compress and de-compress an image several times with one codec, and print a row
+ *        of the results table
+ *
+ * @param name name of codec shown in the table
+ * @param image image to compress
+ * @param repeat no. of times to compress and de-compress the image
+ * @param encode function that compresses an image into a buffer
+ * @param decode function that de-compresses a buffer into an image
+ * @return true if the codec compressed and de-compressed the image
+ * @return false otherwise
+ */
+bool benchmarkCodec(const std::string& name, const cv::Mat& image, int repeat,
+                    const std::function<bool(const cv::Mat&, std::vector<uchar>&)>& encode,
+                    const std::function<bool(const std::vector<uchar>&, cv::Mat&)>& decode);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments
+     *      1. Full path to image to compress
+     *      2. No. of times to compress and de-compress the image with each codec
+     *
+    */
+    const cv::String keys =
+        "{help h usage ? | | Benchmark our QOI codec against PNG }"
+        "{image | <none> | full path to 8-bit image (1, 3 or 4 channels) to compress }"
+        "{repeat | 5 | no. of times to compress and de-compress the image with each codec }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nCompare our lossless QOI codec against PNG at compression levels 0 to 9.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String imagePath = parser.get<cv::String>("image");
+    int repeat = parser.get<int>("repeat");
+
+    // check for any errors encountered
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if (repeat <= 0)
+    {
+        std::cerr << "\nRepeat should be greater than 0.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ///////////////////////////// 2. Read Image ///////////////////////////////
+
+    cv::Mat image { cv::imread(imagePath, cv::IMREAD_UNCHANGED) };
+    if (image.empty())
+    {
+        std::cerr << "\nCould not read data from image file: " << imagePath << '\n';
+
+        return -1;
+    }
+
+    if ((image.depth() != CV_8U) || (image.channels() == 2))
+    {
+        std::cerr << "\nOur QOI codec only compresses 8-bit images with 1, 3 or 4 channels.\n";
+
+        return -1;
+    }
+
+    std::cout << "\nImage size (width x height): " << image.cols << " x " << image.rows
+              << "\nNo. of channels: " << image.channels()
+              << "\nSize of image pixels: " << image.total() * image.elemSize() << " bytes\n";
+
+    //---------------------- End of Read Image -------------------//
+
+    ///////////////////////// 3. Benchmark each codec //////////////////////
+
+    std::cout << '\n' << std::left << std::setw(10) << "Codec" << std::right
+              << std::setw(16) << "encode (ms)" << std::setw(16) << "decode (ms)"
+              << std::setw(14) << "bytes" << std::setw(8) << "ratio" << std::setw(10) << "Lossless" << '\n';
+
+    // a. PNG at every compression level with cv::imencode() and cv::imdecode()
+    for (int level {0}; level <= 9; ++level)
+    {
+        const std::vector<int> parameters { cv::IMWRITE_PNG_COMPRESSION, level };
+
+        const bool result { benchmarkCodec("png " + std::to_string(level), image, repeat,
+            [&parameters](const cv::Mat& input, std::vector<uchar>& buffer) {
+                return cv::imencode(".png", input, buffer, parameters);
+            },
+            [](const std::vector<uchar>& buffer, cv::Mat& output) {
+                output = cv::imdecode(buffer, cv::IMREAD_UNCHANGED);
+                return !output.empty();
+            }) };
+
+        if (!result)
+        {
+            std::cerr << "\nError: could not compress the image to PNG at level " << level << '\n';
+
+            return -1;
+        }
+    }
+
+    // b. Our QOI codec. It has no compression level
+    if (!benchmarkCodec("qoi", image, repeat, CPP_CV::ReadWriteFiles::encodeQOI, CPP_CV::ReadWriteFiles::decodeQOI))
+    {
+        std::cerr << "\nError: could not compress the image with our QOI codec\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Benchmark each codec -------------------//
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Return the median of a list of values
+ *
+ * @param values list of values. Must not be empty
+ * @return double median value
+ */
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+
+    const std::size_t middle { values.size() / 2 };
+
+    return (values.size() % 2 == 1) ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+
+/**
+ * @brief Compress and de-compress an image several times with one codec, and print a row
+ *        of the results table
+ *
+ * @param name name of codec shown in the table
+ * @param image image to compress
+ * @param repeat no. of times to compress and de-compress the image
+ * @param encode function that compresses an image into a buffer
+ * @param decode function that de-compresses a buffer into an image
+ * @return true if the codec compressed and de-compressed the image
+ * @return false otherwise
+ */
+bool benchmarkCodec(const std::string& name, const cv::Mat& image, int repeat,
+                    const std::function<bool(const cv::Mat&, std::vector<uchar>&)>& encode,
+                    const std::function<bool(const std::vector<uchar>&, cv::Mat&)>& decode)
+{
+    std::vector<double> encodeTimes;
+    std::vector<double> decodeTimes;
+    std::vector<uchar> buffer;
+    cv::Mat decoded;
+
+    for (int i {0}; i < repeat; ++i)
+    {
+        cv::TickMeter timer;
+        timer.start();
+        bool result { encode(image, buffer) };
+        timer.stop();
+
+        if (!result)
+        {
+            return false;
+        }
+        encodeTimes.push_back(timer.getTimeMilli());
+
+        timer.reset();
+        timer.start();
+        result = decode(buffer, decoded);
+        timer.stop();
+
+        if (!result)
+        {
+            return false;
+        }
+        decodeTimes.push_back(timer.getTimeMilli());
+    }
+
+    // Both codecs are lossless, so the image must de-compress to the input image
+    const bool lossless { (decoded.size() == image.size()) && (decoded.type() == image.type()) &&
+                          (cv::norm(decoded, image, cv::NORM_INF) == 0) };
+
+    const double ratio { static_cast<double>(image.total() * image.elemSize()) / static_cast<double>(buffer.size()) };
+
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(16) << median(encodeTimes) << std::setw(16) << median(decodeTimes)
+              << std::setw(14) << buffer.size() << std::setw(8) << ratio
+              << std::setw(10) << (lossless ? "yes" : "NO") << '\n';
+
+    return true;
+}
+
+//-------------------------- End of Function Definitions ---------------------//
@@ -1,13 +1,92 @@
 // Program: read_and_display_image.cpp
 
+/*
+ * Program reads an image file and displays it, or saves it as a PNG file.
+ *
+ * Decoding a very large JPEG file can take seconds, and nothing can be shown until
+ * cv::imread() returns. By default the program is progressive: it first decodes the 
+ * image at 1/8 scale (JPEG files are scaled while decoding, which is many times faster
+ * than a full decode) and shows that, while the full resolution image is decoded on a 
+ * background thread. The full image replaces the preview as soon as it is ready.
+ *
+ * A gigapixel image may not even fit in memory once decoded. For tiled TIFF files the 
+ * program has a viewport mode, which never decodes the whole image. The window shows a 
+ * fixed size viewport onto the image that can be panned and zoomed, and only the tiles 
+ * inside the viewport are decoded, from the resolution level (page) of a pyramidal TIFF 
+ * file closest to the zoom. Decoded tiles are kept in a cache of limited size (the least 
+ * recently used tiles are removed first), and while the program waits for a key press it 
+ * decodes the tiles around the viewport, starting in the direction we are panning, so 
+ * they are ready when the viewport moves onto them. Save_Pyramidal_TIFF.cpp makes such files.
+ *
+ * cv::imread() decodes a JPEG file on a single core. A JPEG file written with restart 
+ * markers (e.g. by cameras, or 'cjpeg -restart 1') is made of intervals that can be 
+ * decoded on their own, so the program splits such images into bands of rows at the 
+ * restart markers and decodes the bands on all cores, straight into one cv::Mat. 
+ * JPEG files without restart markers, and other formats, are read by cv::imread().
+ *
+*/
+
 #include "opencv2/core.hpp"
-#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::TickMeter
 #include "opencv2/highgui.hpp"         // for functions related to displaying images e.g. cv::imshow(), cv::waitKey()
 #include "opencv2/imgcodecs.hpp"       // for cv::imread()
+#include "opencv2/imgproc.hpp"         // for cv::resize()
 
 #include <UtilityFunctions/utility_functions.h> // for user-defined functions
 
 #include <iostream>
+#include <filesystem> // for std::filesystem::path
+#include <string>
+#include <future>     // for std::async, std::future
+#include <chrono>     // for std::chrono::milliseconds
+#include <deque>      // for std::deque
+#include <cmath>      // for std::floor, std::ceil
+#include <algorithm>  // for std::min, std::max, std::clamp
+#include <utility>    // for std::move
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Draw the part of an image seen through a viewport. Only the tiles of one resolution 
+ *        level that intersect the viewport are used, and only those not in the cache are decoded
+ *
+ * @param reader open TIFF file
+ * @param cache decoded tiles
+ * @param center full resolution image coordinates of the center of the viewport
+ * @param zoom screen pixels per full resolution image pixel
+ * @param canvas receives the viewport. Areas outside the image are black
+ * @param level receives the resolution level drawn
+ * @return cv::Rect columns and rows of the tiles drawn, in the tile grid of level
+ */
+cv::Rect renderViewport(CPP_CV::ReadWriteFiles::TiffPyramidReader& reader, CPP_CV::ReadWriteFiles::TileCache& cache,
+                        const cv::Point2d& center, double zoom, cv::Mat& canvas, int& level);
+
+/**
+ * @brief List the tiles in a ring around the viewport, to be decoded while the program is idle.
+ *        Tiles in the direction we are panning are listed first
+ *
+ * @param reader open TIFF file
+ * @param level resolution level drawn
+ * @param tiles columns and rows of the tiles drawn
+ * @param panDirection direction of the last pan e.g. (1, 0) for right. (0, 0) after a zoom
+ * @param prefetch receives the tiles to decode
+ */
+void queuePrefetch(const CPP_CV::ReadWriteFiles::TiffPyramidReader& reader, int level, const cv::Rect& tiles,
+                   const cv::Point& panDirection, std::deque<CPP_CV::ReadWriteFiles::TileKey>& prefetch);
+
+/**
+ * @brief Show a TIFF image through a viewport that can be panned (w, a, s, d) and zoomed 
+ *        (+, -, f to fit) until q or Esc is pressed
+ *
+ * @param reader open TIFF file
+ * @param windowName name of window
+ * @param viewSize width and height of viewport in screen pixels
+ * @param cacheSize limit on the size of the tile cache, in bytes
+ */
+void runViewportViewer(CPP_CV::ReadWriteFiles::TiffPyramidReader& reader, const std::string& windowName, 
+                       const cv::Size& viewSize, std::size_t cacheSize);
+
+//-------------------------- End of Function Declarations ---------------------//
 
 int main(int argc, char* argv[])
 {
@@ -15,12 +94,29 @@ int main(int argc, char* argv[])
      * Define the command line arguments:
      *  1. image - full file path to image. This should not be empty
      *  2. title - string describing the image
+     *  3. list - text file with one image path per line. Every image is read and 
+     *            saved to 'outDir' without display windows (headless mode)
+     *  4. outDir - directory to save images to instead of displaying them
+     *  5. progressive - show a 1/8 scale preview while the full image is decoded
+     *  6. manifest - file recording the images saved by previous headless runs, so 
+     *                unchanged images are skipped
+     *  7. viewport - show a tiled TIFF file through a viewport, decoding only the visible tiles
+     *  8. viewWidth, viewHeight - size of viewport
+     *  9. cacheSize - limit on the memory used by decoded tiles
      * 
     */
     const cv::String keys = 
         "{help h usage ? | | Display an image without alterations }"
-        "{image | <none> | full path to image to be displayed }"
-        "{title |        | short text describing the image }";
+        "{image |        | full path to image to be displayed }"
+        "{title |        | short text describing the image }"
+        "{list |         | headless mode: text file with the full path to an image on each line }"
+        "{outDir |       | directory to save images to (as PNG) instead of displaying them }"
+        "{progressive | true | show a 1/8 scale preview while the full resolution image is decoded }"
+        "{manifest |     | headless mode: manifest file (.xml, .yml, .yaml or .json). Images saved by a previous run that have not changed are skipped }"
+        "{viewport | false | show a tiled TIFF image through a viewport, decoding only the tiles in view }"
+        "{viewWidth | 1280 | viewport mode: width of viewport in pixels }"
+        "{viewHeight | 800 | viewport mode: height of viewport in pixels }"
+        "{cacheSize | 256 | viewport mode: limit on memory used by decoded tiles, in MB }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -32,6 +128,14 @@ int main(int argc, char* argv[])
     // Now lets extract user input
     cv::String imagePath = parser.get<cv::String>("image");
     cv::String imageTitle = parser.get<cv::String>("title");
+    cv::String listPath = parser.get<cv::String>("list");
+    cv::String outputDirectory = parser.get<cv::String>("outDir");
+    bool progressive = parser.get<bool>("progressive");
+    cv::String manifestPath = parser.get<cv::String>("manifest");
+    bool viewport = parser.get<bool>("viewport");
+    int viewWidth = parser.get<int>("viewWidth");
+    int viewHeight = parser.get<int>("viewHeight");
+    int cacheSize = parser.get<int>("cacheSize");
 
     // check for any errors encountered 
     if(!parser.check())
@@ -41,6 +145,100 @@ int main(int argc, char* argv[])
         return -1; // Early exit
     }
 
+    if (imagePath.empty() && listPath.empty())
+    {
+        std::cerr << "\nPlease provide an image or a list of images.\n";
+
+        return -1;
+    }
+
+    if (!listPath.empty() && outputDirectory.empty())
+    {
+        std::cerr << "\nPlease provide a directory to save the images to (outDir).\n";
+
+        return -1;
+    }
+
+    // In headless mode every image in the list is read and saved to disk. 
+    // No windows are created, and the time spent in each stage is reported
+    if (!listPath.empty())
+    {
+        const auto inputs { CPP_CV::Headless::readInputList(listPath) };
+        if (!inputs || !CPP_CV::Headless::createOutputDirectory(outputDirectory))
+        {
+            return -1;
+        }
+
+        CPP_CV::Headless::StageTimer timer;
+        cv::TickMeter wallTime;
+        wallTime.start();
+
+        int processed {0};
+
+        // Without a manifest file the manifest is empty, so every image is processed
+        CPP_CV::ReadWriteFiles::ProcessingManifest manifest(manifestPath);
+
+        for (const auto& path : *inputs)
+        {
+            const std::string fileName { std::filesystem::path(path).stem().string() + ".png" };
+            const std::string outputPath { (std::filesystem::path(outputDirectory) / fileName).string() };
+
+            if (!manifestPath.empty())
+            {
+                timer.start("check");
+                const bool upToDate { manifest.isUpToDate(path, outputPath) };
+                timer.stop();
+
+                if (upToDate)
+                {
+                    continue;
+                }
+            }
+
+            timer.start("decode");
+            cv::Mat listImage { CPP_CV::ReadWriteFiles::imreadParallel(path, cv::IMREAD_UNCHANGED) };
+            timer.stop();
+
+            if (listImage.empty())
+            {
+                std::cerr << "Could not read input image file data: " << path << '\n';
+
+                continue;
+            }
+
+            if (CPP_CV::Headless::writeResult(outputDirectory, fileName, listImage, timer))
+            {
+                ++processed;
+
+                if (!manifestPath.empty())
+                {
+                    manifest.record(path, outputPath);
+                }
+            }
+        }
+
+        if (!manifestPath.empty())
+        {
+            manifest.save();
+        }
+
+        wallTime.stop();
+
+        std::cout << "\nProcessed " << processed << " images in " << wallTime.getTimeSec() << " s ("
+                  << processed / wallTime.getTimeSec() << " images/s)\n";
+
+        if (!manifestPath.empty())
+        {
+            std::cout << "Skipped " << manifest.statistics().upToDate << " unchanged images ("
+                      << manifest.statistics().hashed << " had to be hashed to find out)\n";
+        }
+        timer.print();
+
+        std::cout << '\n';
+
+        return 0;
+    }
+
     // Before attempting to read the image, check if we have an 
     // image reader for that particular image file first
     if(!cv::haveImageReader(imagePath))
@@ -51,9 +249,100 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    // Use cv::imread() to read an image file as is 
-    // and save the image as a cv::Mat array
-    cv::Mat image { cv::imread(imagePath, cv::IMREAD_UNCHANGED) };    
+    // If the user did not provide an image title
+    if(imageTitle.empty()) 
+    {
+        imageTitle = "Image"; // We simply name it 'Image'
+    }
+
+    // In viewport mode a tiled TIFF image is shown without decoding the whole image. 
+    // Other images are shown the normal way
+    if (viewport && outputDirectory.empty())
+    {
+        const std::string extension { CPP_CV::ReadWriteFiles::getFileExtension(imagePath) };
+
+        if ((viewWidth <= 0) || (viewHeight <= 0) || (cacheSize <= 0))
+        {
+            std::cerr << "\nViewport width, height and cache size should be greater than 0.\n";
+
+            return -1;
+        }
+
+        if ((extension == "tif") || (extension == "tiff") || (extension == "TIF") || (extension == "TIFF"))
+        {
+            CPP_CV::ReadWriteFiles::TiffPyramidReader reader(imagePath);
+            if (reader.isOpen())
+            {
+                runViewportViewer(reader, imageTitle, cv::Size(viewWidth, viewHeight), 
+                                  static_cast<std::size_t>(cacheSize) << 20);
+
+                std::cout << '\n';
+
+                return 0;
+            }
+        }
+
+        std::cout << "\nViewport mode needs a TIFF file. Decoding the whole image instead.\n";
+    }
+
+    // A preview is only useful if we are going to display the image
+    progressive = progressive && outputDirectory.empty();
+
+    cv::Mat image;
+
+    if (progressive)
+    {
+        cv::TickMeter timer;
+        timer.start();
+
+        /*
+         * Start decoding the full resolution image on a background thread. Only the 
+         * decoding happens there - all windows are created and updated on this thread,
+         * as HighGUI requires
+        */
+        std::future<cv::Mat> fullDecode { std::async(std::launch::async, [&imagePath]() {
+            return CPP_CV::ReadWriteFiles::imreadParallel(imagePath, cv::IMREAD_UNCHANGED);
+        }) };
+
+        /*
+         * Decode a 1/8 scale 8-bit colour preview. The JPEG decoder skips most of the 
+         * inverse DCT work at this scale. Other formats are decoded in full and resized.
+         * cv::IMREAD_UNCHANGED ignores the EXIF orientation, so the preview does too.
+        */
+        cv::Mat preview { cv::imread(imagePath, cv::IMREAD_REDUCED_COLOR_8 | cv::IMREAD_IGNORE_ORIENTATION) };
+
+        if (!preview.empty())
+        {
+            // Size the window for the full image, so the preview is simply scaled up
+            cv::namedWindow(imageTitle, cv::WINDOW_NORMAL);
+            cv::resizeWindow(imageTitle, preview.cols * 8, preview.rows * 8);
+            cv::imshow(imageTitle, preview);
+            cv::waitKey(1); // lets HighGUI draw the window
+
+            // The timer keeps adding to its total when restarted
+            timer.stop();
+            std::cout << "\nPreview (" << preview.cols << " x " << preview.rows << ") shown after " 
+                      << timer.getTimeMilli() << " ms\n";
+            timer.start();
+        }
+
+        // Keep the preview window responsive until the full image is ready
+        while (fullDecode.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+        {
+            cv::waitKey(15);
+        }
+
+        image = fullDecode.get();
+        timer.stop();
+
+        std::cout << "Full image decoded after " << timer.getTimeMilli() << " ms\n";
+    }
+    else 
+    {
+        // Read an image file as is and save the image as a cv::Mat array. JPEG files 
+        // with restart markers are decoded on several threads, anything else by cv::imread()
+        image = CPP_CV::ReadWriteFiles::imreadParallel(imagePath, cv::IMREAD_UNCHANGED);
+    }
 
     // check if we have successfully opened the image
     if (image.empty())
@@ -61,6 +350,8 @@ int main(int argc, char* argv[])
         std::cerr << "Could not read input image file data: " 
                   << imagePath << '\n';
         
+        cv::destroyAllWindows();
+
         return -1;
     }
 
@@ -70,17 +361,32 @@ int main(int argc, char* argv[])
               << "\nNo. of channels: " << image.channels() 
               << "\nData type: " << CPP_CV::General::openCVDescriptiveDataType(image.type()) << '\n';
 
-    // If the user did not provide an image title
-    if(imageTitle.empty()) 
+    // Save the image instead of displaying it if the user provided a directory
+    if (!outputDirectory.empty())
     {
-        imageTitle = "Image"; // We simply name it 'Image'
+        CPP_CV::Headless::StageTimer timer;
+        const std::string fileName { std::filesystem::path(imagePath).stem().string() + ".png" };
+        if (!CPP_CV::Headless::createOutputDirectory(outputDirectory) || 
+            !CPP_CV::Headless::writeResult(outputDirectory, fileName, image, timer))
+        {
+            std::cerr << "\nCould not save image to: " << outputDirectory << '\n';
+
+            return -1;
+        }
+
+        timer.print();
+
+        std::cout << '\n';
+
+        return 0;
     }
 
     // We use the image title as the window name
-    // The user will be able to resize the image window
+    // The user will be able to resize the image window.
+    // If a preview is shown, this is the window it is in
     cv::namedWindow(imageTitle, cv::WINDOW_NORMAL);
 
-    // Show image on screen
+    // Show image on screen. This replaces the preview
     cv::imshow(imageTitle, image);
 
     // Image window will be displayed until a user presses any key
@@ -93,4 +399,261 @@ int main(int argc, char* argv[])
     std::cout << '\n';
 
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Draw the part of an image seen through a viewport. Only the tiles of one resolution 
+ *        level that intersect the viewport are used, and only those not in the cache are decoded
+ *
+ * @param reader open TIFF file
+ * @param cache decoded tiles
+ * @param center full resolution image coordinates of the center of the viewport
+ * @param zoom screen pixels per full resolution image pixel
+ * @param canvas receives the viewport. Areas outside the image are black
+ * @param level receives the resolution level drawn
+ * @return cv::Rect columns and rows of the tiles drawn, in the tile grid of level
+ */
+cv::Rect renderViewport(CPP_CV::ReadWriteFiles::TiffPyramidReader& reader, CPP_CV::ReadWriteFiles::TileCache& cache,
+                        const cv::Point2d& center, double zoom, cv::Mat& canvas, int& level)
+{
+    // Use the smallest level that still has at least one pixel for every screen pixel
+    level = 0;
+    while ((level + 1 < reader.levels()) &&
+           (static_cast<double>(reader.size(level + 1).width) / reader.size(0).width >= zoom))
+    {
+        ++level;
+    }
+
+    const cv::Size levelSize { reader.size(level) };
+    const cv::Size tileSize { reader.tileSize(level) };
+    const double levelScale { static_cast<double>(levelSize.width) / reader.size(0).width }; // level pixels per full resolution pixel
+    const double levelZoom { zoom / levelScale };                                           // screen pixels per level pixel
+
+    canvas.setTo(cv::Scalar::all(0));
+
+    // Top left corner of the viewport, and the part of the level inside the viewport, in level pixels
+    const double left { center.x * levelScale - canvas.cols / (2.0 * levelZoom) };
+    const double top { center.y * levelScale - canvas.rows / (2.0 * levelZoom) };
+    const cv::Rect visible { cv::Rect(static_cast<int>(std::floor(left)), static_cast<int>(std::floor(top)),
+                                      static_cast<int>(std::ceil(canvas.cols / levelZoom)) + 1,
+                                      static_cast<int>(std::ceil(canvas.rows / levelZoom)) + 1) & 
+                             cv::Rect(0, 0, levelSize.width, levelSize.height) };
+
+    if (visible.empty())
+    {
+        return cv::Rect();
+    }
+
+    const cv::Rect tiles { cv::Point(visible.x / tileSize.width, visible.y / tileSize.height),
+                           cv::Point((visible.x + visible.width - 1) / tileSize.width + 1, 
+                                     (visible.y + visible.height - 1) / tileSize.height + 1) };
+
+    // Assemble the visible part of the level from its tiles
+    cv::Mat region(visible.size(), reader.type(), cv::Scalar::all(0));
+
+    for (int row {tiles.y}; row < tiles.y + tiles.height; ++row)
+    {
+        for (int column {tiles.x}; column < tiles.x + tiles.width; ++column)
+        {
+            const CPP_CV::ReadWriteFiles::TileKey key { level, column, row };
+
+            // A new Mat for every tile, so tiles already in the cache are not decoded over
+            cv::Mat decoded;
+            const cv::Mat* tile { cache.find(key) };
+            if (tile == nullptr)
+            {
+                if (!reader.readTile(level, column, row, decoded))
+                {
+                    continue;
+                }
+
+                // The cache shares the pixels of 'decoded', which are only read from here on
+                cache.insert(key, decoded);
+                tile = &decoded;
+            }
+
+            // Copy the part of the tile that is visible
+            const cv::Rect tileArea { column * tileSize.width, row * tileSize.height, tile->cols, tile->rows };
+            const cv::Rect overlap { tileArea & visible };
+            (*tile)(overlap - tileArea.tl()).copyTo(region(overlap - visible.tl()));
+        }
+    }
+
+    // Scale the region to the screen. Zoomed in, pixels are shown as squares
+    const cv::Rect screenArea { static_cast<int>(std::lround((visible.x - left) * levelZoom)), 
+                                static_cast<int>(std::lround((visible.y - top) * levelZoom)),
+                                std::max(1, static_cast<int>(std::lround(visible.width * levelZoom))),
+                                std::max(1, static_cast<int>(std::lround(visible.height * levelZoom))) };
+
+    cv::Mat scaled;
+    cv::resize(region, scaled, screenArea.size(), 0, 0, levelZoom < 1.0 ? cv::INTER_AREA : cv::INTER_NEAREST);
+
+    const cv::Rect shown { screenArea & cv::Rect(0, 0, canvas.cols, canvas.rows) };
+    if (!shown.empty())
+    {
+        scaled(shown - screenArea.tl()).copyTo(canvas(shown));
+    }
+
+    return tiles;
+}
+
+/**
+ * @brief List the tiles in a ring around the viewport, to be decoded while the program is idle.
+ *        Tiles in the direction we are panning are listed first
+ *
+ * @param reader open TIFF file
+ * @param level resolution level drawn
+ * @param tiles columns and rows of the tiles drawn
+ * @param panDirection direction of the last pan e.g. (1, 0) for right. (0, 0) after a zoom
+ * @param prefetch receives the tiles to decode
+ */
+void queuePrefetch(const CPP_CV::ReadWriteFiles::TiffPyramidReader& reader, int level, const cv::Rect& tiles,
+                   const cv::Point& panDirection, std::deque<CPP_CV::ReadWriteFiles::TileKey>& prefetch)
+{
+    // Tiles queued for the old viewport are no longer needed
+    prefetch.clear();
+
+    if (tiles.empty())
+    {
+        return;
+    }
+
+    const cv::Size grid { reader.tileGrid(level) };
+
+    for (int row {tiles.y - 1}; row <= tiles.y + tiles.height; ++row)
+    {
+        for (int column {tiles.x - 1}; column <= tiles.x + tiles.width; ++column)
+        {
+            if (tiles.contains(cv::Point(column, row)) || (column < 0) || (row < 0) || 
+                (column >= grid.width) || (row >= grid.height))
+            {
+                continue;
+            }
+
+            const bool ahead { ((panDirection.x > 0) && (column == tiles.x + tiles.width)) ||
+                               ((panDirection.x < 0) && (column == tiles.x - 1)) ||
+                               ((panDirection.y > 0) && (row == tiles.y + tiles.height)) ||
+                               ((panDirection.y < 0) && (row == tiles.y - 1)) };
+
+            if (ahead)
+            {
+                prefetch.push_front({ level, column, row });
+            }
+            else 
+            {
+                prefetch.push_back({ level, column, row });
+            }
+        }
+    }
+}
+
+/**
+ * @brief Show a TIFF image through a viewport that can be panned (w, a, s, d) and zoomed 
+ *        (+, -, f to fit) until q or Esc is pressed
+ *
+ * @param reader open TIFF file
+ * @param windowName name of window
+ * @param viewSize width and height of viewport in screen pixels
+ * @param cacheSize limit on the size of the tile cache, in bytes
+ */
+void runViewportViewer(CPP_CV::ReadWriteFiles::TiffPyramidReader& reader, const std::string& windowName, 
+                       const cv::Size& viewSize, std::size_t cacheSize)
+{
+    const cv::Size imageSize { reader.size(0) };
+
+    std::cout << "\nImage size (width x height): " << imageSize.width << " x " << imageSize.height
+              << "\nData type: " << CPP_CV::General::openCVDescriptiveDataType(reader.type())
+              << "\nResolution levels: " << reader.levels()
+              << "\nTile size (level 0): " << reader.tileSize(0).width << " x " << reader.tileSize(0).height
+              << "\n\nPan with w, a, s, d. Zoom with + and -, fit with f. Quit with q or Esc.\n";
+
+    CPP_CV::ReadWriteFiles::TileCache cache(cacheSize);
+    std::deque<CPP_CV::ReadWriteFiles::TileKey> prefetch;
+    std::uint64_t prefetched {0};
+
+    // Start with the whole image in view
+    const double fitZoom { std::min(static_cast<double>(viewSize.width) / imageSize.width,
+                                    static_cast<double>(viewSize.height) / imageSize.height) };
+    double zoom { fitZoom };
+    cv::Point2d center { imageSize.width / 2.0, imageSize.height / 2.0 };
+    cv::Point panDirection {0, 0};
+
+    cv::Mat canvas(viewSize, reader.type());
+    cv::TickMeter renderTime;
+    int renders {0};
+    bool redraw {true};
+
+    cv::namedWindow(windowName, cv::WINDOW_AUTOSIZE);
+
+    while (true)
+    {
+        if (redraw)
+        {
+            const std::uint64_t decodedBefore { reader.tilesDecoded() };
+
+            int level {0};
+            renderTime.start();
+            const cv::Rect tiles { renderViewport(reader, cache, center, zoom, canvas, level) };
+            renderTime.stop();
+            ++renders;
+
+            cv::imshow(windowName, canvas);
+            cv::setWindowTitle(windowName, windowName + " - zoom " + std::to_string(static_cast<int>(zoom * 100.0 + 0.5)) + 
+                                           "%, level " + std::to_string(level) + ", " + 
+                                           std::to_string(reader.tilesDecoded() - decodedBefore) + " tiles decoded");
+
+            queuePrefetch(reader, level, tiles, panDirection, prefetch);
+            redraw = false;
+        }
+
+        // Only wait briefly while there are tiles to prefetch
+        const int key { cv::waitKey(prefetch.empty() ? 50 : 1) };
+
+        if ((key == 'q') || (key == 27) || (cv::getWindowProperty(windowName, cv::WND_PROP_VISIBLE) < 1.0))
+        {
+            break;
+        }
+
+        // Pan by a quarter of the viewport, or zoom by a factor of 2 about the center
+        const double step { viewSize.width / (4.0 * zoom) };
+        switch (key)
+        {
+            case 'a': center.x -= step; panDirection = cv::Point(-1, 0); redraw = true; break;
+            case 'd': center.x += step; panDirection = cv::Point(1, 0);  redraw = true; break;
+            case 'w': center.y -= step; panDirection = cv::Point(0, -1); redraw = true; break;
+            case 's': center.y += step; panDirection = cv::Point(0, 1);  redraw = true; break;
+            case '+': 
+            case '=': zoom = std::min(zoom * 2.0, 32.0);          panDirection = cv::Point(0, 0); redraw = true; break;
+            case '-': zoom = std::max(zoom / 2.0, fitZoom / 2.0); panDirection = cv::Point(0, 0); redraw = true; break;
+            case 'f': zoom = fitZoom; center = cv::Point2d(imageSize.width / 2.0, imageSize.height / 2.0);
+                      panDirection = cv::Point(0, 0); redraw = true; break;
+            default: break;
+        }
+
+        center.x = std::clamp(center.x, 0.0, static_cast<double>(imageSize.width));
+        center.y = std::clamp(center.y, 0.0, static_cast<double>(imageSize.height));
+
+        // No key pressed - decode the next tile around the viewport
+        if ((key == -1) && !prefetch.empty())
+        {
+            const CPP_CV::ReadWriteFiles::TileKey next { prefetch.front() };
+            prefetch.pop_front();
+
+            cv::Mat tile;
+            if (!cache.contains(next) && reader.readTile(next.level, next.column, next.row, tile))
+            {
+                cache.insert(next, std::move(tile));
+                ++prefetched;
+            }
+        }
+    }
+
+    cv::destroyWindow(windowName);
+
+    const CPP_CV::ReadWriteFiles::TileCache::Statistics& statistics { cache.statistics() };
+    std::cout << "\nViews drawn: " << renders << " (average " << renderTime.getTimeMilli() / renders << " ms)"
+              << "\nTiles decoded: " << reader.tilesDecoded() << " (" << prefetched << " prefetched)"
+              << "\nTile cache: " << statistics.hits << " hits, " << statistics.misses << " misses, "
+              << statistics.evictions << " evictions, " << cache.size() << " tiles (" 
+              << (cache.bytes() >> 20) << " MB) held\n";
+}
@@ -2,16 +2,93 @@
 
 // In this program we read multiple images from a folder/directory, then 
 // display each in a seperate window.
+//
+// In gallery mode, the images are instead decoded at a reduced resolution 
+// (in parallel) and displayed as thumbnails in a single mosaic window.
+//
+// If an output directory is provided, nothing is displayed (headless mode). 
+// Each image (or each gallery page) is saved to the directory instead, and 
+// the time spent decoding, encoding and writing is reported.
+//
+// In watch mode (Linux only), the program keeps watching the directory and 
+// reads each new image file as soon as the program writing it has closed 
+// it, e.g. images saved by a camera. Each image is shown in a single window 
+// (or saved in headless mode), and the time from the file arriving to the 
+// image being shown or saved is reported.
+//
+// Sub-directories are searched when 'recursive' is set. The directory tree 
+// is scanned on several threads, and files are filtered by extension before 
+// we ask OpenCV whether it can read them, so we can start reading the first 
+// images long before the scan of a large tree has finished. In headless mode 
+// the sub-directories are re-created in the output directory.
 
 #include "opencv2/core.hpp"
-#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser and cv::parallel_for_()
 #include "opencv2/highgui.hpp"         // for functions related to displaying images e.g. cv::imshow(), cv::waitKey()
 #include "opencv2/imgcodecs.hpp"       // for cv::imread()
+#include "opencv2/imgproc.hpp"         // for cv::resize()
 
 #include <UtilityFunctions/utility_functions.h> // for user-defined functions
 
 #include <iostream>
 #include <filesystem> // for handling file systems
+#include <vector>
+#include <string>
+#include <algorithm>  // for std::max, std::min
+#include <cmath>      // for std::ceil
+#include <iomanip>    // for std::setprecision
+
+///////////////////////////// Function Declarations //////////////////////////////
+
+/**
+ * @brief Choose the cv::imread() flag that decodes an image at the smallest reduced 
+ *        resolution (1/2, 1/4 or 1/8) that is still at least as large as the thumbnail. 
+ *        JPEG files are reduced while decoding (in the DCT domain), which is much faster 
+ *        than decoding at full resolution and resizing.
+ * 
+ * @param imageSize size of the full resolution image. If empty, the size is unknown
+ * @param thumbnailSize width and height of the (square) thumbnail in pixels
+ * @return int cv::IMREAD_COLOR or one of cv::IMREAD_REDUCED_COLOR_2/4/8
+ */
+int reducedReadFlag(cv::Size imageSize, int thumbnailSize);
+
+
+/**
+ * @brief Read an image as a thumbnail that fits inside a square of thumbnailSize pixels
+ * 
+ * @param filePath full path to image file
+ * @param thumbnailSize width and height of the (square) thumbnail in pixels
+ * @return cv::Mat 3-channel, 8-bit thumbnail. Empty if the image could not be read
+ */
+cv::Mat readThumbnail(const std::string& filePath, int thumbnailSize);
+
+
+/**
+ * @brief Decode a page of thumbnails in parallel and place them in a mosaic image
+ * 
+ * @param filePaths full paths to the image files on this page
+ * @param thumbnailSize width and height of each (square) thumbnail in pixels
+ * @param columns no. of thumbnails in each row of the mosaic
+ * @return cv::Mat 3-channel, 8-bit mosaic image
+ */
+cv::Mat createMosaic(const std::vector<std::string>& filePaths, int thumbnailSize, int columns);
+
+
+/**
+ * @brief Watch a directory and read each new image file as soon as it is complete. Each 
+ *        image is shown in a single window, or saved to a directory in headless mode. 
+ *        Stops when 'q' or Esc is pressed (window), on Ctrl+C (or SIGTERM), or when no image 
+ *        arrives for timeoutSeconds
+ * 
+ * @param directory full path to directory to watch
+ * @param outputDirectory directory to save images to. If empty, images are displayed
+ * @param timeoutSeconds stop after this many seconds without a new file. 0 = never
+ * @return int 0 if the directory could be watched, -1 otherwise
+ */
+int watchDirectory(const std::string& directory, const std::string& outputDirectory, int timeoutSeconds);
+
+////////////////////////// End of Function Declarations //////////////////////////
+
 
 int main(int argc, char* argv[])
 {
@@ -19,11 +96,29 @@ int main(int argc, char* argv[])
      * Define the command line arguments:
      *  1. dir - full file path directory/folder with image files. 
      *           This should not be empty
+     *  2. gallery - display thumbnails in a single mosaic window instead of 
+     *               one window per image
+     *  3. thumbSize - width and height of each thumbnail in gallery mode
+     *  4. columns, rows - no. of thumbnails per row/column on each gallery page
+     *  5. outDir - directory to save images (or gallery pages) to instead of displaying them
+     *  6. watch - keep watching the directory and read new image files as they arrive
+     *  7. watchTimeout - stop watching after this many seconds without a new file
+     *  8. recursive - also read the images in all sub-directories
+     *  9. extensions - only read files with these extensions, e.g. jpg,png
      * 
     */
     const cv::String keys = 
         "{help h usage ? | | Display images without alterations }"
-        "{dir | <none> | full path to directory/folder with image files }";
+        "{dir | <none> | full path to directory/folder with image files }"
+        "{gallery | false | display reduced resolution thumbnails in a single mosaic window }"
+        "{thumbSize | 256 | width and height of each thumbnail in pixels (gallery mode) }"
+        "{columns | 8 | no. of thumbnails per row (gallery mode) }"
+        "{rows | 6 | no. of thumbnail rows per page (gallery mode) }"
+        "{outDir | | directory to save images (or gallery pages) to as PNG instead of displaying them }"
+        "{watch | false | keep watching the directory and read each new image file as soon as it is written (Linux) }"
+        "{watchTimeout | 0 | watch mode: stop after this many seconds without a new file. 0 = never }"
+        "{recursive | false | also read the images in all sub-directories }"
+        "{extensions | | comma separated list of file extensions to read, e.g. jpg,png. Empty reads all image files }";
 
     // Define a cv::CommandLineParser object
     cv::CommandLineParser parser(argc, argv, keys);
@@ -34,6 +129,16 @@ int main(int argc, char* argv[])
 
     // Now lets extract user input
     cv::String dirPath = parser.get<cv::String>("dir");
+    bool galleryMode = parser.get<bool>("gallery");
+    int thumbnailSize = parser.get<int>("thumbSize");
+    int columns = parser.get<int>("columns");
+    int rows = parser.get<int>("rows");
+    cv::String outputDirectory = parser.get<cv::String>("outDir");
+    const bool headless { !outputDirectory.empty() };
+    bool watchMode = parser.get<bool>("watch");
+    int watchTimeout = parser.get<int>("watchTimeout");
+    bool recursive = parser.get<bool>("recursive");
+    cv::String extensions = parser.get<cv::String>("extensions");
 
     // check for any errors encountered 
     if(!parser.check())
@@ -43,33 +148,166 @@ int main(int argc, char* argv[])
         return -1; // Early exit
     }
 
+    if (headless && !CPP_CV::Headless::createOutputDirectory(outputDirectory))
+    {
+        return -1;
+    }
+
     // We need to go through the contents of our directory and read 
-    // the image files. We will use an iterator 'directory_iterator' 
-    // from std::filesystem to go through the directory contents.
-    // However, this iterator will not go through any sub-directories
-    const std::filesystem::path directory {dirPath}; // Get 'dirPath' as a 'path' object
+    // the image files. We will use our DirectoryScanner, which goes 
+    // through the directory (and its sub-directories if 'recursive' 
+    // is set) on several threads, and hands us each file that passes 
+    // the filters as soon as it is found
+    CPP_CV::Directories::ScanOptions scanOptions;
+    scanOptions.recursive = recursive;
+    scanOptions.extensions = CPP_CV::Directories::parseExtensionList(extensions);
+
+    // Files already in the directory are not read in watch mode, only new ones
+    if (watchMode)
+    {
+        if (watchTimeout < 0)
+        {
+            std::cerr << "\nWatch timeout should not be negative.\n";
+
+            return -1;
+        }
+
+        return watchDirectory(dirPath, outputDirectory, watchTimeout);
+    }
+
+    if (galleryMode)
+    {
+        if ((thumbnailSize <= 0) || (columns <= 0) || (rows <= 0))
+        {
+            std::cerr << "\nThumbnail size, columns and rows should be greater than 0.\n";
+
+            return -1;
+        }
+
+        // a. Collect the image files we can read, sorted so the pages are the same 
+        //    every time. Nothing is decoded yet
+        const std::vector<std::string> imageFiles { CPP_CV::Directories::listFiles(dirPath, scanOptions) };
+
+        if (imageFiles.empty())
+        {
+            std::cout << "\nNo image files found in " << dirPath << '\n';
+
+            return 0;
+        }
+
+        // b. Only the thumbnails on the current page are decoded, so the time to 
+        //    show a page does not depend on the no. of images in the directory
+        const int imagesPerPage { columns * rows };
+        const int numberOfPages { static_cast<int>(std::ceil(static_cast<double>(imageFiles.size()) / imagesPerPage)) };
+
+        std::cout << "\nFound " << imageFiles.size() << " image files (" << numberOfPages << " pages).\n";
+
+        // In headless mode every page is created and saved to disk
+        if (headless)
+        {
+            CPP_CV::Headless::StageTimer timer;
+            for (int p {0}; p < numberOfPages; ++p)
+            {
+                const std::size_t first { static_cast<std::size_t>(p) * imagesPerPage };
+                const std::size_t last { std::min(first + imagesPerPage, imageFiles.size()) };
+                const std::vector<std::string> pageFiles(imageFiles.begin() + first, imageFiles.begin() + last);
+
+                timer.start("decode");
+                cv::Mat mosaic { createMosaic(pageFiles, thumbnailSize, columns) };
+                timer.stop();
+
+                CPP_CV::Headless::writeResult(outputDirectory, "gallery_page_" + std::to_string(p + 1) + ".png", mosaic, timer);
+            }
+
+            timer.print();
+
+            std::cout << '\n';
+
+            return 0;
+        }
+
+        std::cout << "Press 'n' or space for the next page, 'p' for the previous page, 'q' or Esc to quit.\n";
+
+        const cv::String windowName { "Gallery" };
+        cv::namedWindow(windowName, cv::WINDOW_NORMAL);
+
+        int page {0};
+        while (true)
+        {
+            const std::size_t first { static_cast<std::size_t>(page) * imagesPerPage };
+            const std::size_t last { std::min(first + imagesPerPage, imageFiles.size()) };
+            const std::vector<std::string> pageFiles(imageFiles.begin() + first, imageFiles.begin() + last);
+
+            cv::TickMeter timer;
+            timer.start();
+            cv::Mat mosaic { createMosaic(pageFiles, thumbnailSize, columns) };
+            timer.stop();
+
+            std::cout << "\nPage " << page + 1 << " of " << numberOfPages << ": images " << first + 1 
+                      << " to " << last << " decoded in " << timer.getTimeMilli() << " ms\n";
+
+            cv::setWindowTitle(windowName, "Gallery - page " + std::to_string(page + 1) + " of " + std::to_string(numberOfPages));
+            cv::imshow(windowName, mosaic);
+
+            const int key { cv::waitKey(0) };
+            if ((key == 'q') || (key == 27) || (key < 0)) // 'q', Esc or window closed
+            {
+                break;
+            }
+            else if ((key == 'p') && (page > 0))
+            {
+                --page;
+            }
+            else if (((key == 'n') || (key == ' ')) && (page + 1 < numberOfPages))
+            {
+                ++page;
+            }
+        }
+
+        cv::destroyAllWindows();
+
+        std::cout << '\n';
+
+        return 0;
+    }
+
+    CPP_CV::Headless::StageTimer timer; // only used in headless mode
+    cv::TickMeter wallTime;
+    wallTime.start();
 
-    for (auto const& dir_entry :std::filesystem::directory_iterator{directory})
+    int processed {0};
+
+    // We check for an image reader ourselves below, so we can report the 
+    // files we cannot read
+    scanOptions.checkImageReader = false;
+    CPP_CV::Directories::DirectoryScanner scanner(dirPath, scanOptions);
+
+    CPP_CV::Directories::ScannedFile file;
+    while (scanner.next(file))
     {
+        const std::filesystem::path filePath {file.path}; // Get 'file.path' as a 'path' object
+
         // Before attempting to read the file, check if it is an image file by 
         // using cv::haveImageReader(). Even if it is an image file, here we can 
         // also check if we have an image reader for that image file
-        if(!cv::haveImageReader(dir_entry.path().string()))
+        if(!cv::haveImageReader(filePath.string()))
         {
-            std::cerr << "\nCannot read the file: " << dir_entry.path() 
+            std::cerr << "\nCannot read the file: " << filePath 
                       << " as an image file." << '\n';           
         }
         else 
         {
             // Use cv::imread() to read an image file as is 
             // and save the image as a cv::Mat array
-            cv::Mat image { cv::imread(dir_entry.path().string(), cv::IMREAD_UNCHANGED) };    
+            if (headless) timer.start("decode");
+            cv::Mat image { cv::imread(filePath.string(), cv::IMREAD_UNCHANGED) };    
+            if (headless) timer.stop();
 
             // check if we have successfully opened the image
             if (image.empty())
             {
                 std::cerr << "Could not read data from image file: " 
-                        << dir_entry.path().string() << '\n';
+                        << filePath.string() << '\n';
                 
             }
             else // if we can read image data
@@ -77,16 +315,35 @@ int main(int argc, char* argv[])
 
                 // We also want to display some other information about the image 
                 // (1)No. of channels, (2) image size, (3) data type
-                std::cout << "\nImage file: " << dir_entry.path().filename().string() 
+                std::cout << "\nImage file: " << filePath.filename().string() 
                         << "\nImage size (width x height): " << image.cols << " x " << image.rows 
                         << "\nNo. of channels: " << image.channels() 
                         << "\nData type: " << CPP_CV::General::openCVDescriptiveDataType(image.type()) << '\n';
 
+                // Save the image instead of displaying it. The sub-directories of 'dirPath' are 
+                // mirrored in the output directory, so files with the same name in different 
+                // sub-directories do not overwrite each other
+                if (headless)
+                {
+                    std::filesystem::path fileName { filePath.lexically_relative(dirPath) };
+                    fileName.replace_extension(".png");
+
+                    std::error_code error;
+                    std::filesystem::create_directories(std::filesystem::path{outputDirectory} / fileName.parent_path(), error);
+
+                    if (CPP_CV::Headless::writeResult(outputDirectory, fileName.string(), image, timer))
+                    {
+                        ++processed;
+                    }
+
+                    continue;
+                }
+
                 // We will use image file name for the window name
-                cv::namedWindow(dir_entry.path().filename().string(), cv::WINDOW_NORMAL);
+                cv::namedWindow(filePath.filename().string(), cv::WINDOW_NORMAL);
 
                 // Show image on screen            
-                cv::imshow(dir_entry.path().filename().string(), image);
+                cv::imshow(filePath.filename().string(), image);
 
                 // Image window will be displayed until a user presses any key
                 // on the keyboard
@@ -97,10 +354,257 @@ int main(int argc, char* argv[])
 
     }     
 
+    wallTime.stop();
+
+    if (scanner.directoryErrors() > 0)
+    {
+        std::cerr << "\nCould not open " << scanner.directoryErrors() << " directories.\n";
+    }
+
+    if (headless)
+    {
+        std::cout << "\nProcessed " << processed << " images in " << wallTime.getTimeSec() << " s ("
+                  << processed / wallTime.getTimeSec() << " images/s)\n";
+        timer.print();
+    }
+
     // Release all memory by destroying all windows
     cv::destroyAllWindows();
 
     std::cout << '\n';
 
     return 0;
-}
\ No newline at end of file
+}
+
+//////////////////// Function Definitions ///////////////////////////////////////
+
+/**
+ * @brief Choose the cv::imread() flag that decodes an image at the smallest reduced 
+ *        resolution (1/2, 1/4 or 1/8) that is still at least as large as the thumbnail. 
+ *        JPEG files are reduced while decoding (in the DCT domain), which is much faster 
+ *        than decoding at full resolution and resizing.
+ * 
+ * @param imageSize size of the full resolution image. If empty, the size is unknown
+ * @param thumbnailSize width and height of the (square) thumbnail in pixels
+ * @return int cv::IMREAD_COLOR or one of cv::IMREAD_REDUCED_COLOR_2/4/8
+ */
+int reducedReadFlag(cv::Size imageSize, int thumbnailSize)
+{
+    if (imageSize.empty())
+    {
+        return cv::IMREAD_COLOR; // we cannot tell how much we can reduce the image
+    }
+
+    // The longest side of the image decides how much the thumbnail is scaled down
+    const int longestSide { std::max(imageSize.width, imageSize.height) };
+
+    if (longestSide / 8 >= thumbnailSize) return cv::IMREAD_REDUCED_COLOR_8;
+    else if (longestSide / 4 >= thumbnailSize) return cv::IMREAD_REDUCED_COLOR_4;
+    else if (longestSide / 2 >= thumbnailSize) return cv::IMREAD_REDUCED_COLOR_2;
+    else return cv::IMREAD_COLOR;
+}
+
+
+/**
+ * @brief Read an image as a thumbnail that fits inside a square of thumbnailSize pixels
+ * 
+ * @param filePath full path to image file
+ * @param thumbnailSize width and height of the (square) thumbnail in pixels
+ * @return cv::Mat 3-channel, 8-bit thumbnail. Empty if the image could not be read
+ */
+cv::Mat readThumbnail(const std::string& filePath, int thumbnailSize)
+{
+    // Reading the image size from the file header only costs a few bytes of I/O. 
+    // Formats other than JPEG and PNG are decoded at full resolution
+    const cv::Size imageSize { CPP_CV::ReadWriteFiles::readImageSize(filePath) };
+
+    cv::Mat image;
+    try 
+    {
+        image = cv::imread(filePath, reducedReadFlag(imageSize, thumbnailSize));
+    }
+    catch (const cv::Exception& ex)
+    {
+        std::cerr << "\nError reading " << filePath << ": " << ex.what();
+    }
+
+    if (image.empty())
+    {
+        return image;
+    }
+
+    // Scale the (reduced) image to fit inside the thumbnail, keeping its aspect ratio
+    const double scale { std::min(static_cast<double>(thumbnailSize) / image.cols, 
+                                  static_cast<double>(thumbnailSize) / image.rows) };
+    if (scale < 1.0)
+    {
+        cv::Mat thumbnail;
+        cv::resize(image, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA);
+
+        return thumbnail;
+    }
+
+    return image;
+}
+
+
+/**
+ * @brief Decode a page of thumbnails in parallel and place them in a mosaic image
+ * 
+ * @param filePaths full paths to the image files on this page
+ * @param thumbnailSize width and height of each (square) thumbnail in pixels
+ * @param columns no. of thumbnails in each row of the mosaic
+ * @return cv::Mat 3-channel, 8-bit mosaic image
+ */
+cv::Mat createMosaic(const std::vector<std::string>& filePaths, int thumbnailSize, int columns)
+{
+    const int count { static_cast<int>(filePaths.size()) };
+    const int rows { (count + columns - 1) / columns };
+
+    // Dark gray background so empty cells and thumbnail borders are visible
+    cv::Mat mosaic(rows * thumbnailSize, std::min(count, columns) * thumbnailSize, CV_8UC3, cv::Scalar(40, 40, 40));
+
+    // Each thumbnail is decoded into its own cell, so no two threads write to the same pixels
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+        for (int i { range.start }; i < range.end; ++i)
+        {
+            cv::Mat thumbnail { readThumbnail(filePaths[i], thumbnailSize) };
+            if (thumbnail.empty())
+            {
+                continue;
+            }
+
+            // Centre the thumbnail inside its cell
+            const int x { (i % columns) * thumbnailSize + (thumbnailSize - thumbnail.cols) / 2 };
+            const int y { (i / columns) * thumbnailSize + (thumbnailSize - thumbnail.rows) / 2 };
+            thumbnail.copyTo(mosaic(cv::Rect(x, y, thumbnail.cols, thumbnail.rows)));
+        }
+    }, count);
+
+    return mosaic;
+}
+
+
+/**
+ * @brief Watch a directory and read each new image file as soon as it is complete. Each 
+ *        image is shown in a single window, or saved to a directory in headless mode. 
+ *        Stops when 'q' or Esc is pressed (window), on Ctrl+C (or SIGTERM), or when no image 
+ *        arrives for timeoutSeconds
+ * 
+ * @param directory full path to directory to watch
+ * @param outputDirectory directory to save images to. If empty, images are displayed
+ * @param timeoutSeconds stop after this many seconds without a new file. 0 = never
+ * @return int 0 if the directory could be watched, -1 otherwise
+ */
+int watchDirectory(const std::string& directory, const std::string& outputDirectory, int timeoutSeconds)
+{
+    // New files are queued by the watcher's own thread, so their arrival time is 
+    // recorded even while we are still reading an earlier file
+    CPP_CV::Watch::DirectoryWatcher watcher(directory);
+    if (!watcher.isOpen())
+    {
+        return -1;
+    }
+
+    const bool headless { !outputDirectory.empty() };
+    const cv::String windowName { "Watch - " + directory };
+    if (!headless)
+    {
+        cv::namedWindow(windowName, cv::WINDOW_NORMAL);
+    }
+
+    std::cout << "\nWatching " << directory << " for new image files. " 
+              << (headless ? "Stop with Ctrl+C" : "Press 'q' or Esc in the window to stop")
+              << (timeoutSeconds > 0 ? ", or wait " + std::to_string(timeoutSeconds) + " s without a new file" : "") << ".\n";
+
+    CPP_CV::Headless::StageTimer timer; // only used in headless mode
+    CPP_CV::Watch::LatencyReport latencies;
+    int64 lastArrival { cv::getTickCount() };
+
+    // Ctrl+C only ends the loop, so the latency report is still printed
+    CPP_CV::Watch::installStopHandler();
+
+    while (watcher.isWatching() && !CPP_CV::Watch::stopRequested())
+    {
+        // Wait a short time for a file, so the window stays responsive
+        CPP_CV::Watch::ArrivedFile file;
+        if (!watcher.next(file, 30))
+        {
+            if ((timeoutSeconds > 0) && ((cv::getTickCount() - lastArrival) / cv::getTickFrequency() > timeoutSeconds))
+            {
+                break;
+            }
+
+            if (!headless)
+            {
+                const int key { cv::waitKey(1) };
+                if ((key == 'q') || (key == 27))
+                {
+                    break;
+                }
+            }
+
+            continue;
+        }
+
+        lastArrival = file.arrivalTicks;
+
+        if (!cv::haveImageReader(file.path))
+        {
+            continue; // not an image file, e.g. a temporary file
+        }
+
+        if (headless) timer.start("decode");
+        cv::Mat image;
+        try 
+        {
+            image = cv::imread(file.path, cv::IMREAD_UNCHANGED);
+        }
+        catch (const cv::Exception& ex)
+        {
+            std::cerr << "\nError reading " << file.path << ": " << ex.what();
+        }
+        if (headless) timer.stop();
+
+        if (image.empty())
+        {
+            std::cerr << "Could not read data from image file: " << file.path << '\n';
+            continue;
+        }
+
+        const std::filesystem::path filePath {file.path};
+        if (headless)
+        {
+            if (!CPP_CV::Headless::writeResult(outputDirectory, filePath.stem().string() + ".png", image, timer))
+            {
+                continue;
+            }
+        }
+        else 
+        {
+            cv::imshow(windowName, image);
+            cv::waitKey(1); // draws the image
+        }
+
+        // Time from the file arriving until it was shown or saved
+        const double latency { latencies.add(file.arrivalTicks) };
+        std::cout << "\nImage file: " << filePath.filename().string() << " (" << image.cols << " x " << image.rows 
+                  << ") - latency " << std::fixed << std::setprecision(2) << latency << " ms, " 
+                  << watcher.pending() << " files waiting";
+    }
+
+    std::cout << '\n';
+    latencies.print();
+    if (headless)
+    {
+        timer.print();
+    }
+
+    cv::destroyAllWindows();
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+//////////////////// End of Function Definitions ////////////////////////////////////
\ No newline at end of file
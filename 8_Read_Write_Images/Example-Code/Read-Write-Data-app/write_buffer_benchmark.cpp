@@ -0,0 +1,206 @@
+// Program: write_buffer_benchmark.cpp
+
+/*
+ * Program measures how fast we can save a large in-memory buffer (e.g. a compressed image 
+ * from cv::imencode()) to disk. We compare:
+ *      1. Copying the buffer one character at a time through a std::ostream_iterator
+ *      2. A single std::ofstream::write() call
+ *      3. CPP_CV::ReadWriteFiles::writeBufferToFile() - large pwrite() calls
+ *      4. As (3), but pre-allocating the file first
+ *      5. As (4), but also syncing the data to disk (fsync)
+ *      6. As (5), but writing to a temporary file then renaming it (atomic write)
+ * 
+ * Methods 1 to 4 only measure how fast data is copied into the operating system's 
+ * page cache. Methods 5 and 6 include the time taken to reach the disk.
+ * 
+ * Inputs are provided through the command line
+ * 
+*/
+
+#include "opencv2/core.hpp"            // for cv::Mat, cv::randu(), cv::TickMeter
+#include "opencv2/core/utility.hpp"    // for cv::CommandLineParser
+
+#include "UtilityFunctions/utility_functions.h" // for writeBufferToFile()
+
+#include <iostream>
+#include <iomanip>     // for std::setw
+#include <vector>
+#include <string>
+#include <functional>  // for std::function
+#include <algorithm>   // for std::copy, std::sort
+#include <fstream>     // for std::ofstream
+#include <iterator>    // for std::ostream_iterator
+#include <filesystem>
+
+//////////////////////////// Function Declarations ////////////////////////////
+
+/**
+ * @brief Run a write method several times and print its median and best time 
+ * 
+ * @param name description of write method 
+ * @param repetitions no. of times to run the write method 
+ * @param bufferSize no. of bytes written per run - used to compute throughput 
+ * @param writeMethod function that writes the buffer to disk. Returns false on failure
+ */
+void benchmarkWriteMethod(const std::string& name, int repetitions, std::size_t bufferSize, 
+                          const std::function<bool()>& writeMethod);
+
+//-------------------------- End of Function Declarations ---------------------//
+
+
+int main(int argc, char* argv[])
+{
+    ////////////////////////// 1. Extract CommandLine Arguments /////////////////////
+
+    /*
+     * Define the command line arguments 
+     *      1. Full path to directory to write the test file to
+     *      2. Size of test buffer in megabytes 
+     *      3. No. of times to repeat each write method
+     *      4. Whether to include the (very slow) std::ostream_iterator method
+     * 
+    */
+    const cv::String keys = 
+        "{help h usage ? | | Benchmark writing a large buffer to file }"
+        "{dirPath | <none> | full path to directory to write the test file to }"
+        "{sizeMB | 512 | size of test buffer in megabytes }"
+        "{repeat | 5 | no. of times to repeat each write method }"
+        "{iterator | true | also time the std::ostream_iterator method (slow for large buffers) }";
+
+    // Define a cv::CommandLineParser object
+    cv::CommandLineParser parser(argc, argv, keys);
+
+    // We also want to display a message about the program
+    parser.about("\nBenchmark different ways of saving a large buffer to file.\n");
+    parser.printMessage();
+
+    // Now lets extract our command line arguments
+    cv::String saveDirectoryPath = parser.get<cv::String>("dirPath");
+    int sizeMB = parser.get<int>("sizeMB");
+    int repetitions = parser.get<int>("repeat");
+    bool timeIterator = parser.get<bool>("iterator");
+
+    // check for any errors encountered 
+    if(!parser.check())
+    {
+        parser.printErrors();
+
+        return -1;
+    }
+
+    if ((sizeMB <= 0) || (repetitions <= 0))
+    {
+        std::cout << "\nBuffer size and no. of repetitions should be greater than 0.\n";
+
+        return -1;
+    }
+
+    //---------------------- End of Extract Command Line Arguments -------------------//
+
+    ////////////////////////// 2. Create Test Buffer /////////////////////
+
+    // Fill the buffer with random values so the file system cannot compress 
+    // or de-duplicate the data (some do)
+    const std::size_t bufferSize { static_cast<std::size_t>(sizeMB) << 20 };
+    std::vector<uchar> buffer(bufferSize);
+
+    cv::Mat bufferView(1, static_cast<int>(bufferSize), CV_8U, buffer.data()); // no copy - wraps the vector data
+    cv::randu(bufferView, cv::Scalar(0), cv::Scalar(256));
+
+    std::filesystem::path filePath {saveDirectoryPath};
+    filePath /= "write_buffer_benchmark.bin";
+
+    std::cout << "\nWriting " << sizeMB << " MB to " << filePath 
+              << " (" << repetitions << " repetitions per method)\n\n";
+
+    //---------------------- End of Create Test Buffer -------------------//
+
+    ////////////////////////// 3. Time Each Write Method /////////////////////
+
+    if (timeIterator)
+    {
+        benchmarkWriteMethod("std::ostream_iterator", repetitions, bufferSize, [&]() {
+            std::ofstream file(filePath, std::ios::out | std::ios::binary);
+            std::copy(buffer.cbegin(), buffer.cend(), std::ostream_iterator<unsigned char>(file));
+            return static_cast<bool>(file);
+        });
+    }
+
+    benchmarkWriteMethod("std::ofstream::write", repetitions, bufferSize, [&]() {
+        std::ofstream file(filePath, std::ios::out | std::ios::binary);
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        return static_cast<bool>(file);
+    });
+
+    CPP_CV::ReadWriteFiles::WriteOptions options;
+
+    benchmarkWriteMethod("writeBufferToFile", repetitions, bufferSize, [&]() {
+        return CPP_CV::ReadWriteFiles::writeBufferToFile(filePath.string(), buffer, options);
+    });
+
+    options.preallocate = true;
+    benchmarkWriteMethod("+ preallocate", repetitions, bufferSize, [&]() {
+        return CPP_CV::ReadWriteFiles::writeBufferToFile(filePath.string(), buffer, options);
+    });
+
+    options.syncToDisk = true;
+    benchmarkWriteMethod("+ preallocate + fsync", repetitions, bufferSize, [&]() {
+        return CPP_CV::ReadWriteFiles::writeBufferToFile(filePath.string(), buffer, options);
+    });
+
+    options.atomic = true;
+    benchmarkWriteMethod("+ preallocate + fsync + atomic", repetitions, bufferSize, [&]() {
+        return CPP_CV::ReadWriteFiles::writeBufferToFile(filePath.string(), buffer, options);
+    });
+
+    //---------------------- End of Time Each Write Method -------------------//
+
+    // Clean up test file
+    std::filesystem::remove(filePath);
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/////////////////////// Function Definitions ///////////////////////
+
+/**
+ * @brief Run a write method several times and print its median and best time 
+ * 
+ * @param name description of write method 
+ * @param repetitions no. of times to run the write method 
+ * @param bufferSize no. of bytes written per run - used to compute throughput 
+ * @param writeMethod function that writes the buffer to disk. Returns false on failure
+ */
+void benchmarkWriteMethod(const std::string& name, int repetitions, std::size_t bufferSize, 
+                          const std::function<bool()>& writeMethod)
+{
+    std::vector<double> times; // time of each run in milliseconds
+
+    for (int i {0}; i < repetitions; ++i)
+    {
+        cv::TickMeter timer;
+        timer.start();
+        bool result { writeMethod() };
+        timer.stop();
+
+        if (!result)
+        {
+            std::cerr << name << ": write failed.\n";
+
+            return;
+        }
+
+        times.push_back(timer.getTimeMilli());
+    }
+
+    std::sort(times.begin(), times.end());
+    const double median { times[times.size() / 2] };
+    const double megabytes { static_cast<double>(bufferSize) / (1 << 20) };
+
+    std::cout << std::left << std::setw(34) << name 
+              << " median = " << std::right << std::setw(9) << std::fixed << std::setprecision(1) << median << " ms"
+              << "   best = " << std::setw(9) << times.front() << " ms"
+              << "   throughput = " << std::setw(8) << (megabytes / (median / 1000.0)) << " MB/s\n";
+}
@@ -3,12 +3,32 @@
 
 #include "opencv2/core.hpp" 
 #include "opencv2/core/persistence.hpp" // for cv::FileStorage
+#include "opencv2/imgcodecs.hpp"        // for cv::IMREAD_UNCHANGED
+#include "opencv2/imgproc.hpp"          // for cv::INTER_LINEAR
 
 #include <string_view> // Good for passing around const string's. No unnecessary copying
 #include <string>
 #include <array>
 #include <vector>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <cstdint>     // for std::uint64_t, std::int64_t
+#include <memory>      // for std::unique_ptr
+#include <list>
+#include <tuple>       // for std::tie
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>  // for std::filesystem::path
+#include <fstream>     // for std::ofstream
+#include <unordered_map>
+#include <unordered_set>
+
+// libtiff file handle (TIFF). Declared here so users of this header do not need tiffio.h
+struct tiff;
 
 namespace CPP_CV {
 
@@ -364,6 +384,820 @@ namespace CPP_CV {
         }
 
 
+        /**
+         * @brief Read the width and height of a JPEG or PNG image from its file header, 
+         *        without decoding the image. Only the first few bytes of a PNG file, or the 
+         *        markers up to the start of frame of a JPEG file, are read.
+         * 
+         * @param filePath full path to image file
+         * @return cv::Size image size (width x height). An empty cv::Size is returned for other 
+         *         image file formats or if the header cannot be read
+         */
+        cv::Size readImageSize(const std::string& filePath);
+
+
+        /**
+         * @brief Decode a baseline JPEG image on several threads. A JPEG file written with 
+         *        restart markers is made of intervals that can each be decoded on their own. 
+         *        The image is split into bands of rows that start and end at restart markers, 
+         *        and each band is decoded by its own libjpeg decoder straight into its rows 
+         *        of the output image. Each band also decodes one restart-aligned row of blocks 
+         *        above and below it (which it throws away), so colour upsampling at the band 
+         *        edges gives the same result as decoding the whole image at once.
+         * 
+         * @param data contents of a JPEG file
+         * @param maxBands largest no. of bands to split the image into. 0 = cv::getNumThreads()
+         * @return cv::Mat decoded image (CV_8UC3 BGR or CV_8UC1), the same as cv::imdecode() with 
+         *         cv::IMREAD_UNCHANGED gives. An empty cv::Mat if the image cannot be split (not a 
+         *         JPEG file, progressive or arithmetic coded, no restart markers, or too few of them) 
+         *         or could not be decoded
+         */
+        cv::Mat decodeJpegInBands(const std::vector<uchar>& data, int maxBands = 0);
+
+
+        /**
+         * @brief cv::imread() that decodes large JPEG files with restart markers on several 
+         *        threads with decodeJpegInBands(). Any other image, or a JPEG file that cannot 
+         *        be split, is read with cv::imread()
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes. Only cv::IMREAD_UNCHANGED uses the parallel decoder, as 
+         *              other flags may rotate or convert the image
+         * @return cv::Mat decoded image. An empty cv::Mat if the file could not be read
+         */
+        cv::Mat imreadParallel(const std::string& filePath, int flags = cv::IMREAD_UNCHANGED);
+
+
+        /**
+         * @brief Options that control how writeBufferToFile() saves a buffer to disk
+         */
+        struct WriteOptions 
+        {
+            bool preallocate {false};          // Reserve the full file size on disk before writing (Linux only)
+            bool syncToDisk {false};           // Call fsync() so the data is on disk (not just in the page cache) before returning
+            bool atomic {false};               // Write to a uniquely named temporary file, then rename it to the final file path. 
+                                               // Readers never see a partially written file, and a failed write leaves no file behind
+            std::size_t chunkSize {8 << 20};   // No. of bytes handed to the operating system per write call
+        };
+
+
+        /**
+         * @brief Write the contents of a buffer to file using a few large write calls 
+         *        instead of one call per character. On POSIX systems the data is written 
+         *        with pwrite(), optionally into a pre-allocated file. 
+         * 
+         * @param filePath full path to save data to including file extension
+         * @param data pointer to first byte of buffer
+         * @param size no. of bytes in buffer
+         * @param options see WriteOptions
+         * @return true if all the data was written
+         * @return false if the file could not be created, written, synced or renamed. 
+         *         A message describing the error is printed to std::cerr
+         */
+        bool writeBufferToFile(const std::string& filePath, const uchar* data, std::size_t size, 
+                               const WriteOptions& options = WriteOptions());
+
+
+        /**
+         * @brief Write the contents of a std::vector<unsigned char> buffer to file. 
+         *        See writeBufferToFile(const std::string&, const uchar*, std::size_t, const WriteOptions&)
+         * 
+         * @param filePath full path to save data to including file extension
+         * @param buffer std::vector<unsigned char>
+         * @param options see WriteOptions
+         * @return true if all the data was written
+         * @return false if the data could not be written
+         */
+        bool writeBufferToFile(const std::string& filePath, const std::vector<uchar>& buffer, 
+                               const WriteOptions& options = WriteOptions());
+
+
+        /**
+         * @brief Compress an image to PNG format in memory using all the threads available to 
+         *        OpenCV (see cv::setNumThreads()). Rows are filtered in parallel, and the filtered 
+         *        data is split into chunks that are deflated on separate threads (in the same way 
+         *        as pigz). The compressed chunks and their checksums are then joined into a single, 
+         *        valid zlib stream. The output can be read by any PNG decoder, e.g. cv::imdecode().
+         *        Each chunk starts with the last 32 KB of the previous chunk as its dictionary, 
+         *        so the file is only slightly larger than one compressed on a single thread.
+         * 
+         * @param image 8-bit or 16-bit image with 1 (grayscale), 3 (BGR) or 4 (BGRA) channels
+         * @param buffer output buffer. Resized to fit the PNG file
+         * @param compressionLevel zlib compression level from 0 (no compression) to 9 (smallest size), 
+         *                         as used by cv::IMWRITE_PNG_COMPRESSION
+         * @param strategy zlib compression strategy, as used by cv::IMWRITE_PNG_STRATEGY. The default 
+         *                 (cv::IMWRITE_PNG_STRATEGY_RLE) is the one used by cv::imwrite()
+         * @param chunkSize no. of bytes of filtered image data deflated by each task
+         * @return true if the image was compressed
+         * @return false if the image type is not supported or zlib reported an error
+         */
+        bool encodePNGParallel(const cv::Mat& image, std::vector<uchar>& buffer, int compressionLevel = 1, 
+                               int strategy = 3, std::size_t chunkSize = 256 << 10);
+
+
+        /**
+         * @brief Compress an 8-bit image in the lossless QOI ("Quite OK Image") format. Every 
+         *        pixel is written as a run of the previous pixel, a reference to one of the last 
+         *        64 different pixels seen, a small difference from the previous pixel, or as is. 
+         *        Files are usually a little larger than PNG files, but are compressed and 
+         *        de-compressed many times faster, which suits images that are saved and read 
+         *        back soon after, such as intermediate results.
+         * 
+         *        3 and 4 channel images are standard QOI files (stored as RGB(A)). Grayscale 
+         *        images are stored with 1 channel in the header, which only decodeQOI() reads.
+         * 
+         * @param image 8-bit image with 1 (grayscale), 3 (BGR) or 4 (BGRA) channels
+         * @param buffer output buffer. Resized to fit the QOI file. Its memory is re-used, so 
+         *               passing the same buffer for every frame avoids allocations
+         * @return true if the image was compressed
+         * @return false if the image type is not supported
+         */
+        bool encodeQOI(const cv::Mat& image, std::vector<uchar>& buffer);
+
+
+        /**
+         * @brief De-compress a QOI file made by encodeQOI() or any other QOI encoder
+         * 
+         * @param buffer contents of QOI file
+         * @param image receives the 8-bit grayscale, BGR or BGRA image. Its memory is re-used 
+         *              if it already has the right size and type
+         * @return true if the image was de-compressed
+         * @return false if the buffer is not a valid QOI file
+         */
+        bool decodeQOI(const std::vector<uchar>& buffer, cv::Mat& image);
+
+
+        /**
+         * @brief Compresses and de-compresses images with cv::imencode() and cv::imdecode() 
+         *        while re-using its memory across calls. Useful in per-frame loops, where a 
+         *        new buffer per cv::imencode() and a new cv::Mat per cv::imdecode() would 
+         *        allocate (and free) memory on every frame.
+         * 
+         *        Encoded images are written into a ring of growable buffers, so the buffers 
+         *        of the last few frames stay valid (e.g. while another thread saves them). 
+         *        Images are decoded into a destination cv::Mat that is only re-allocated 
+         *        when the image size or type changes.
+         */
+        class CodecSession 
+        {
+        public:
+
+            /**
+             * @brief No. of calls and memory allocations made by a session
+             */
+            struct Statistics 
+            {
+                std::size_t encodeCalls {0};
+                std::size_t decodeCalls {0};
+                std::size_t encodeAllocations {0}; // times an encode buffer had to grow
+                std::size_t decodeAllocations {0}; // times the decode destination had to be (re-)allocated
+
+                /**
+                 * @brief Average no. of allocations per frame. A frame is one encode and/or 
+                 *        one decode, so this is 0 once the session has warmed up.
+                 */
+                double allocationsPerFrame() const;
+            };
+
+
+            /**
+             * @brief Create a session
+             * 
+             * @param numberOfEncodeBuffers no. of encode buffers used in turn. The buffer returned by 
+             *                              encode() is overwritten after this many more encode() calls
+             * @param initialEncodeCapacity no. of bytes reserved in each encode buffer up front
+             */
+            explicit CodecSession(int numberOfEncodeBuffers = 1, std::size_t initialEncodeCapacity = 0);
+
+
+            /**
+             * @brief Allocate the decode destination up front, so even the first decode() of 
+             *        an image with this size and type does not allocate memory
+             * 
+             * @param size image size 
+             * @param type image type e.g. CV_8UC3
+             */
+            void reserveDecode(cv::Size size, int type);
+
+
+            /**
+             * @brief Compress an image into the next encode buffer with cv::imencode()
+             * 
+             * @param ext file extension (including the leading dot) that selects the codec e.g. ".jpg"
+             * @param image image to compress
+             * @param params pairs of (cv::ImwriteFlags, value) passed to cv::imencode()
+             * @return const std::vector<uchar>& compressed image. Empty if the image could not be compressed
+             */
+            const std::vector<uchar>& encode(const cv::String& ext, const cv::Mat& image, 
+                                             const std::vector<int>& params = std::vector<int>());
+
+
+            /**
+             * @brief De-compress an image into the session's destination with cv::imdecode()
+             * 
+             * @param buffer compressed image 
+             * @param flags cv::ImreadModes e.g. cv::IMREAD_UNCHANGED
+             * @return const cv::Mat& de-compressed image. It is overwritten by the next decode(), 
+             *         so clone() it to keep it. Empty if the buffer could not be de-compressed
+             */
+            const cv::Mat& decode(const std::vector<uchar>& buffer, int flags);
+
+
+            /**
+             * @brief Return the no. of calls and memory allocations made so far
+             */
+            const Statistics& statistics() const { return m_statistics; }
+
+        private:
+
+            std::vector<std::vector<uchar>> m_encodeBuffers;   // ring of encode buffers
+            std::size_t m_nextEncodeBuffer {0};                 // buffer used by the next encode()
+            std::size_t m_largestEncodedSize {0};               // largest compressed image so far
+            cv::Mat m_decoded;                                  // decode destination
+            Statistics m_statistics;
+        };
+
+
+        /**
+         * @brief TIFF compression schemes. The values are the TIFF Compression tag values
+         */
+        enum class TiffCompression 
+        {
+            none = 1,       // no compression
+            lzw = 5,        // lossless Lempel-Ziv-Welch
+            jpeg = 7,       // lossy JPEG (8-bit images only)
+            deflate = 8     // lossless Deflate (zlib) - usually smaller but slower than LZW
+        };
+
+
+        /**
+         * @brief Options that control how writeMultipageTIFF() and writePyramidalTIFF() lay out 
+         *        and compress each page
+         */
+        struct TiffWriteOptions 
+        {
+            TiffCompression compression {TiffCompression::lzw}; // the same default as cv::imwrite()
+            int predictor {1};          // 1 = none, 2 = horizontal differencing (integer images), 
+                                        // 3 = floating point (CV_32F/CV_64F images). Used with LZW and Deflate
+            int tileWidth {0};          // 0 = store pages in strips of rows, otherwise the tile size in 
+            int tileHeight {0};         // pixels (rounded up to a multiple of 16)
+            int rowsPerStrip {0};       // no. of rows in each strip. 0 = libtiff default (about 8 KB per strip)
+            int jpegQuality {75};       // 1 to 100. Used with JPEG compression
+            int deflateLevel {6};       // 1 to 9. Used with Deflate compression
+        };
+
+
+        /**
+         * @brief Convert a JPEG style quality (1 - 100) to a zlib Deflate level (1 - 9), so one 
+         *        quality setting can be used with either compression. Quality 1 gives level 1 
+         *        (fastest), 75 gives level 7 and 100 gives level 9 (smallest file)
+         * 
+         * @param quality 1 to 100
+         * @return int Deflate level, or -1 if quality is out of range
+         */
+        int qualityToDeflateLevel(int quality);
+
+
+        /**
+         * @brief Save images as the pages of one TIFF file using libtiff. Unlike cv::imwrite(), 
+         *        this lets us choose the predictor and store pages as tiles or in strips of a given size. 
+         *        BGR(A) images are saved as RGB(A), as cv::imwrite() does.
+         * 
+         * @param filePath full path to TIFF file (.tif or .tiff)
+         * @param pages images to save, one per page. 1 to 4 channels of any OpenCV depth except CV_16F
+         * @param options see TiffWriteOptions
+         * @return true if all pages were saved
+         * @return false if the file could not be written, the JPEG quality or Deflate level is 
+         *         out of range, or a page cannot be saved with the options (e.g. JPEG compression 
+         *         of a 16-bit image)
+         */
+        bool writeMultipageTIFF(const std::string& filePath, const std::vector<cv::Mat>& pages, 
+                                const TiffWriteOptions& options = TiffWriteOptions());
+
+
+        /**
+         * @brief Return the size of each level of a TIFF image pyramid. Each level is half 
+         *        the width and height of the level before it (rounded up), and the last 
+         *        level is the first that fits in one tile
+         * 
+         * @param imageSize width and height of full resolution image (level 0)
+         * @param tileSize width and height of tiles
+         * @return std::vector<cv::Size> size of each level, starting with the full resolution image
+         */
+        std::vector<cv::Size> pyramidLevelSizes(const cv::Size& imageSize, const cv::Size& tileSize);
+
+
+        /**
+         * @brief Save an image as a tiled pyramidal TIFF file. The first page holds the full 
+         *        resolution image, and each following page (marked as a reduced resolution 
+         *        image) is half the width and height of the page before it, down to a page 
+         *        that fits in one tile. A viewer can then show any part of the image at any 
+         *        zoom by reading a few tiles from the page closest to the zoom.
+         * 
+         *        All levels are made in one pass over the image, one row of tiles at a time. 
+         *        Reduced levels are written to temporary files next to filePath as their rows 
+         *        are completed, then their compressed tiles are copied to the end of the file, 
+         *        so only one row of tiles per level is held in memory.
+         * 
+         * @param filePath full path to TIFF file (.tif or .tiff)
+         * @param image image to save. 1 to 4 channels of any OpenCV depth except CV_16F. 
+         *              BGR(A) images are saved as RGB(A)
+         * @param options see TiffWriteOptions. Tile width and height default to 256, and 
+         *                rowsPerStrip is not used. JPEG compression is not supported
+         * @return true if the image was saved
+         * @return false otherwise
+         */
+        bool writePyramidalTIFF(const std::string& filePath, const cv::Mat& image, 
+                                const TiffWriteOptions& options = TiffWriteOptions());
+
+
+        /**
+         * @brief Compute the 64-bit xxHash (XXH64) of the contents of a file. xxHash reads 
+         *        several GB/s, so hashing a file costs far less than decoding it
+         * 
+         * @param filePath full path to file
+         * @return std::optional<std::uint64_t> hash, or std::nullopt if the file could not be read
+         */
+        std::optional<std::uint64_t> hashFileContents(const std::string& filePath);
+
+
+        /**
+         * @brief Remembers the input files a batch job has processed, so the next run of the job 
+         *        can skip inputs that have not changed since. 
+         * 
+         *        For each input the manifest records its content hash, modification time and 
+         *        size, the output it produced and the settings used. An input is up to date if 
+         *        its output still exists, the settings are the same and its contents are the same.
+         *        When the size and modification time match, the contents are assumed to be the 
+         *        same without hashing the file. When only the modification time differs (e.g. 
+         *        the file was copied or touched) the file is hashed to find out.
+         * 
+         *        The manifest is stored with cv::FileStorage (.xml, .yml, .yaml or .json).
+         */
+        class ProcessingManifest 
+        {
+        public:
+
+            /**
+             * @brief What the manifest knows about one input file
+             */
+            struct Entry 
+            {
+                std::uint64_t hash {0};             // xxHash of file contents
+                std::int64_t modifiedTime {0};      // std::filesystem::last_write_time() in file clock ticks
+                std::uint64_t size {0};             // file size in bytes
+                std::string output;                 // full path to output produced from the input
+                std::string settings;               // settings the output was produced with e.g. "quality=95"
+            };
+
+
+            /**
+             * @brief No. of inputs checked by a manifest and how each was decided
+             */
+            struct Statistics 
+            {
+                std::size_t upToDate {0};    // inputs that can be skipped
+                std::size_t outOfDate {0};   // new or changed inputs, or inputs with a missing output
+                std::size_t hashed {0};      // inputs whose contents had to be hashed
+            };
+
+
+            /**
+             * @brief Load a manifest. A manifest file that does not exist yet is an empty manifest
+             * 
+             * @param manifestPath full path to manifest file (.xml, .yml, .yaml or .json)
+             */
+            explicit ProcessingManifest(const std::string& manifestPath);
+
+
+            /**
+             * @brief Check if an input was already processed into output with the same settings, 
+             *        and has not changed since
+             * 
+             * @param inputPath full path to input file
+             * @param outputPath full path to output produced from the input
+             * @param settings settings the output is produced with
+             * @return true if the input can be skipped
+             * @return false if the input must be processed
+             */
+            bool isUpToDate(const std::string& inputPath, const std::string& outputPath, const std::string& settings = "");
+
+
+            /**
+             * @brief Record that an input was processed. Call save() to keep the manifest for the next run
+             * 
+             * @param inputPath full path to input file
+             * @param outputPath full path to output produced from the input
+             * @param settings settings the output was produced with
+             * @return true if the input was recorded
+             * @return false if the input file could not be read
+             */
+            bool record(const std::string& inputPath, const std::string& outputPath, const std::string& settings = "");
+
+
+            /**
+             * @brief Return the inputs recorded as producing an output e.g. the pages of a multi-page file
+             * 
+             * @param outputPath full path to output
+             * @return std::vector<std::string> full paths to inputs, in alphabetical order
+             */
+            std::vector<std::string> inputsOf(const std::string& outputPath) const;
+
+
+            /**
+             * @brief Forget every input recorded as producing an output, e.g. before a 
+             *        multi-page file is written again from a different set of inputs
+             * 
+             * @param outputPath full path to output
+             */
+            void forgetOutput(const std::string& outputPath);
+
+
+            /**
+             * @brief Save the manifest to the file it was loaded from
+             * 
+             * @return true if the manifest was saved
+             * @return false otherwise
+             */
+            bool save() const;
+
+
+            /**
+             * @brief Return the no. of inputs checked so far and how each was decided
+             */
+            const Statistics& statistics() const { return m_statistics; }
+
+        private:
+
+            std::string m_manifestPath;
+            std::map<std::string, Entry> m_entries;     // normalised absolute input path -> entry
+            std::map<std::string, Entry> m_checked;     // files examined by isUpToDate(), so record() does not hash them again
+            Statistics m_statistics;
+        };
+
+
+        /**
+         * @brief Closes a libtiff file handle. Lets us keep the handle in a std::unique_ptr
+         *        without including tiffio.h in this header
+         */
+        struct TiffCloser
+        {
+            void operator()(tiff* handle) const;
+        };
+
+
+        /**
+         * @brief Decodes single tiles of a tiled TIFF file at any of its resolution levels. 
+         *        Level 0 is the first page of the file. The reduced resolution pages that 
+         *        follow it (e.g. those written by writePyramidalTIFF()) are levels 1, 2, ... 
+         *        Striped files also work; each strip is then a tile as wide as the image.
+         */
+        class TiffPyramidReader
+        {
+        public:
+
+            /**
+             * @brief Open a TIFF file and find its resolution levels. Use isOpen() to check if it succeeded
+             * 
+             * @param filePath full path to TIFF file
+             */
+            explicit TiffPyramidReader(const std::string& filePath);
+
+            /**
+             * @brief Check if the file was opened and its first page has a pixel layout we 
+             *        can read (1 to 4 interleaved grey or RGB channels of a type OpenCV supports)
+             */
+            bool isOpen() const { return static_cast<bool>(m_tiff); }
+
+            int levels() const { return static_cast<int>(m_levels.size()); }         // no. of resolution levels
+            cv::Size size(int level = 0) const { return m_levels[level].size; }       // width and height of a level
+            cv::Size tileSize(int level = 0) const { return m_levels[level].tileSize; } // size of a tile or strip of a level
+            int type() const { return m_type; }                                       // OpenCV type e.g. CV_8UC3
+            std::uint64_t tilesDecoded() const { return m_tilesDecoded; }             // no. of tiles decoded so far
+
+            /**
+             * @brief Return the no. of tile columns and rows of a level
+             */
+            cv::Size tileGrid(int level) const;
+
+            /**
+             * @brief Decode one tile. Colour images are returned in BGR(A) order
+             * 
+             * @param level resolution level
+             * @param column column of tile in the tile grid of the level
+             * @param row row of tile in the tile grid of the level
+             * @param tile receives the tile. Tiles at the right and bottom edges are cropped to the image
+             * @return true if the tile was decoded
+             * @return false otherwise
+             */
+            bool readTile(int level, int column, int row, cv::Mat& tile);
+
+        private:
+
+            /**
+             * @brief One resolution level (page) of the file
+             */
+            struct Level 
+            {
+                int directory {0};      // TIFF directory (page) no.
+                cv::Size size;          // width and height
+                cv::Size tileSize;      // size of a tile, or of a strip (full level width)
+                bool tiled {false};     // true for tiled pages, false for striped pages
+            };
+
+            /**
+             * @brief Make a level the current TIFF directory, unless it already is
+             */
+            bool selectLevel(int level);
+
+            std::unique_ptr<tiff, TiffCloser> m_tiff;   // open file. Empty if the file could not be opened
+            std::vector<Level> m_levels;
+            int m_type {-1};                            // OpenCV type of every level
+            bool m_rgb {false};                         // true if the file stores colour as RGB(A)
+            int m_currentLevel {-1};                    // level of the current TIFF directory
+            std::vector<uchar> m_tileBuffer;            // decoded tile, padded to the full tile size
+            std::uint64_t m_tilesDecoded {0};
+        };
+
+
+        /**
+         * @brief Identifies a tile: resolution level, then column and row in the tile grid of the level
+         */
+        struct TileKey 
+        {
+            int level {0};
+            int column {0};
+            int row {0};
+
+            bool operator<(const TileKey& other) const
+            {
+                return std::tie(level, row, column) < std::tie(other.level, other.row, other.column);
+            }
+        };
+
+
+        /**
+         * @brief Holds decoded tiles up to a limit on their total size in bytes. When a new 
+         *        tile does not fit, the least recently used tiles are removed (LRU).
+         */
+        class TileCache 
+        {
+        public:
+
+            /**
+             * @brief No. of lookups that found or missed a tile, and no. of tiles removed to make room
+             */
+            struct Statistics 
+            {
+                std::uint64_t hits {0};
+                std::uint64_t misses {0};
+                std::uint64_t evictions {0};
+            };
+
+            /**
+             * @brief Create an empty cache
+             * 
+             * @param capacity limit on the total size of the tiles held, in bytes
+             */
+            explicit TileCache(std::size_t capacity) : m_capacity {capacity} {}
+
+            /**
+             * @brief Look up a tile, and make it the most recently used
+             * 
+             * @param key tile to look up
+             * @return const cv::Mat* the tile, or nullptr if it is not in the cache
+             */
+            const cv::Mat* find(const TileKey& key);
+
+            /**
+             * @brief Check if a tile is in the cache without counting a hit or miss, 
+             *        or changing the order tiles are removed in
+             */
+            bool contains(const TileKey& key) const { return m_index.count(key) > 0; }
+
+            /**
+             * @brief Add a tile as the most recently used, removing the least recently used 
+             *        tiles until it fits. A tile larger than the capacity is not added.
+             *        The pixels are not copied, so a caller that keeps writing to its Mat 
+             *        should pass tile.clone()
+             * 
+             * @param key tile
+             * @param tile decoded tile
+             */
+            void insert(const TileKey& key, cv::Mat tile);
+
+            std::size_t size() const { return m_tiles.size(); }   // no. of tiles held
+            std::size_t bytes() const { return m_bytes; }         // total size of tiles held
+            const Statistics& statistics() const { return m_statistics; }
+
+        private:
+
+            std::size_t m_capacity {0};
+            std::size_t m_bytes {0};
+            std::list<std::pair<TileKey, cv::Mat>> m_tiles;     // most recently used first
+            std::map<TileKey, std::list<std::pair<TileKey, cv::Mat>>::iterator> m_index;
+            Statistics m_statistics;
+        };
+
+
+        /**
+         * @brief Loads an uncompressed image file (PGM, PPM, BMP or TIFF) by memory mapping it. 
+         *        Where the pixels are stored in a layout a cv::Mat can describe, image() is a 
+         *        read-only cv::Mat header around the pixels in the mapped file, so no pixel is 
+         *        copied, and pages are only read from disk when they are first used. Other files 
+         *        (compressed, 16-bit PGM/PPM which are big-endian, bottom-up BMP, palette images, 
+         *        ...) are read into memory by cv::imread().
+         * 
+         *        Only top-down BMP files (negative height) are mapped. Most BMP files, including 
+         *        those saved by cv::imwrite(), store the bottom row first. A cv::Mat cannot step 
+         *        backwards through memory, so these are always copied by cv::imread().
+         * 
+         *        The pixels are only valid while the MappedImage exists, and writing to them 
+         *        crashes the program - clone() image() to get an image that can be changed.
+         */
+        class MappedImage 
+        {
+        public:
+
+            /**
+             * @brief Map an image file. Use isOpen() to check if it succeeded
+             * 
+             * @param filePath full path to image file
+             */
+            explicit MappedImage(const std::string& filePath);
+
+            ~MappedImage();
+
+            MappedImage(const MappedImage&) = delete;
+            MappedImage& operator=(const MappedImage&) = delete;
+
+            bool isOpen() const { return !m_image.empty(); }
+            const cv::Mat& image() const { return m_image; }  // pixels, as cv::imread() with cv::IMREAD_UNCHANGED reads them, except for channel order
+            bool isMapped() const { return m_address != nullptr; } // true if image() points into the mapped file
+            bool isRGB() const { return m_rgb; }                  // true if colour is in RGB(A) order (PPM and TIFF files), false for BGR(A)
+
+        private:
+
+            void* m_address {nullptr};  // start of the mapped file. nullptr if the file was read by cv::imread()
+            std::size_t m_length {0};   // no. of bytes mapped
+            cv::Mat m_image;
+            bool m_rgb {false};
+        };
+
+
+        /**
+         * @brief A compressed image in a shard file: its key, the codec it was compressed with, 
+         *        and where its bytes are in the file
+         */
+        struct ShardRecord 
+        {
+            std::string key;            // unique name, e.g. path of the image relative to its directory
+            std::string type;           // file extension given to cv::imencode() without the dot, or "qoi"
+            std::uint64_t offset {0};   // no. of bytes from the start of the shard file
+            std::uint64_t length {0};   // no. of bytes
+        };
+
+
+        /**
+         * @brief Writes many compressed images into a single shard file. Millions of small images 
+         *        saved one file each spend most of their time opening and closing files, and use 
+         *        an inode each. A shard file is laid out as:
+         * 
+         *          "CVSHARD1" | image 0 | image 1 | ... | index | footer
+         * 
+         *        Images are stored exactly as cv::imencode() (or encodeQOI()) compressed them. The 
+         *        index lists the key, type, offset and length of every image. The 32 byte footer 
+         *        holds the offset and length of the index, the no. of images, the CRC-32 of the 
+         *        index and "CVSHARD1" again. Numbers are little-endian.
+         * 
+         *        The shard is written to a temporary file (shard path + ".tmp"), which close() 
+         *        renames to the shard path, so a reader never sees a partial shard.
+         */
+        class ShardWriter 
+        {
+        public:
+
+            /**
+             * @brief Create an empty shard. Use isOpen() to check if it succeeded
+             * 
+             * @param shardPath full path to shard file, e.g. thumbnails.shard
+             */
+            explicit ShardWriter(const std::string& shardPath);
+
+            ~ShardWriter(); // calls close() if it has not been called
+
+            ShardWriter(const ShardWriter&) = delete;
+            ShardWriter& operator=(const ShardWriter&) = delete;
+
+            /**
+             * @brief Append a compressed image to the shard
+             * 
+             * @param key unique name of the image, used to find it again
+             * @param type codec the image was compressed with, e.g. "jpg", "png" or "qoi"
+             * @param buffer compressed image
+             * @return true if the image was added
+             * @return false if the key is already in the shard, or the shard could not be written
+             */
+            bool add(const std::string& key, const std::string& type, const std::vector<uchar>& buffer);
+
+            /**
+             * @brief Write the index and footer, and rename the temporary file to the shard path. 
+             *        No more images can be added
+             * 
+             * @return true if the shard was saved
+             * @return false otherwise. The temporary file is removed
+             */
+            bool close();
+
+            bool isOpen() const { return m_file.is_open(); }
+            std::size_t size() const { return m_records.size(); } // no. of images added
+            std::uint64_t bytes() const { return m_offset; }      // size of the shard so far, without index and footer
+
+        private:
+
+            std::string m_shardPath;
+            std::string m_writePath;           // temporary file renamed to m_shardPath by close()
+            std::ofstream m_file;
+            std::uint64_t m_offset {0};        // where the next image is written
+            std::vector<ShardRecord> m_records;
+            std::unordered_set<std::string> m_keys;
+            bool m_failed {false};             // a write failed, so close() does not save the shard
+        };
+
+
+        /**
+         * @brief Reads images from a shard file made by ShardWriter. The shard is memory mapped and 
+         *        its index read once into a hash table, so finding an image is one lookup and 
+         *        only the pages of the images we decode are read from disk. On systems without 
+         *        mmap() the whole shard is read into memory.
+         * 
+         *        find(), buffer() and decode() do not change the reader, so any no. of threads 
+         *        can call them at the same time.
+         */
+        class ShardReader 
+        {
+        public:
+
+            /**
+             * @brief Open a shard and read its index. Use isOpen() to check if it succeeded
+             * 
+             * @param shardPath full path to shard file
+             */
+            explicit ShardReader(const std::string& shardPath);
+
+            ~ShardReader();
+
+            ShardReader(const ShardReader&) = delete;
+            ShardReader& operator=(const ShardReader&) = delete;
+
+            /**
+             * @brief Look up an image by its key
+             * 
+             * @param key key the image was added with
+             * @return const ShardRecord* the image, or nullptr if it is not in the shard
+             */
+            const ShardRecord* find(const std::string& key) const;
+
+            /**
+             * @brief The compressed bytes of an image, without copying them
+             * 
+             * @param record image returned by find() or records()
+             * @return cv::Mat read-only 1-row CV_8UC1 header around the bytes. Only valid while 
+             *         the ShardReader exists
+             */
+            cv::Mat buffer(const ShardRecord& record) const;
+
+            /**
+             * @brief Find and de-compress an image. QOI images are always decoded as they were 
+             *        stored, other images with cv::imdecode() and the given flags
+             * 
+             * @param key key the image was added with
+             * @param flags cv::ImreadModes flags for cv::imdecode()
+             * @return cv::Mat image. Empty if the key is not in the shard or the image could not be decoded
+             */
+            cv::Mat decode(const std::string& key, int flags = cv::IMREAD_UNCHANGED) const;
+
+            bool isOpen() const { return m_data != nullptr; }
+            bool isMapped() const { return m_address != nullptr; }                    // false if the shard was read into memory
+            std::size_t size() const { return m_records.size(); }                     // no. of images
+            const std::vector<ShardRecord>& records() const { return m_records; }     // every image, in the order they were added
+
+        private:
+
+            bool readIndex();
+
+            void* m_address {nullptr};          // start of the mapped shard. nullptr if it was read into memory
+            std::size_t m_length {0};           // no. of bytes in the shard
+            std::vector<uchar> m_contents;      // shard contents when it could not be mapped
+            const uchar* m_data {nullptr};      // start of the shard, mapped or in m_contents. nullptr if not open
+            std::vector<ShardRecord> m_records;
+            std::unordered_map<std::string, std::size_t> m_index; // key -> position in m_records
+        };
+
+
+
+
+
     }
 
 
@@ -386,6 +1220,363 @@ namespace CPP_CV {
             }    
         }
     }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Measures the wall time spent in each stage of a batch job (e.g. decode, 
+         *        process, encode, write) over many images. Stages are printed in the 
+         *        order they were first timed.
+         */
+        class StageTimer 
+        {
+        public:
+
+            /**
+             * @brief Start timing a stage. A stage that is still being timed is stopped first.
+             * 
+             * @param stage name of stage e.g. "decode"
+             */
+            void start(const std::string& stage);
+
+
+            /**
+             * @brief Stop timing the current stage and add its time to the stage total
+             */
+            void stop();
+
+
+            /**
+             * @brief Print the no. of runs, total time, mean time and share of the 
+             *        total time of each stage
+             * 
+             * @param out stream to print to e.g. std::cout
+             */
+            void print(std::ostream& out = std::cout) const;
+
+        private:
+
+            struct Stage 
+            {
+                std::string name;
+                int count {0};                  // no. of times the stage was timed
+                double totalMilliseconds {0.0}; // total time spent in the stage
+            };
+
+            std::vector<Stage> m_stages;    // stages in the order they were first timed
+            std::string m_currentStage;     // stage being timed. Empty if no stage is being timed
+            int64 m_startTicks {0};         // value of cv::getTickCount() when the current stage started
+        };
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened (a message is printed to std::cerr)
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath);
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise (a message is printed to std::cerr)
+         */
+        bool createOutputDirectory(const std::string& outputDirectory);
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer);
+    }
+
+    namespace Tensors {
+
+        /**
+         * @brief Order of the values in a batch of images
+         */
+        enum class TensorLayout
+        {
+            NCHW = 0,   // image, channel, row, column - each channel is a separate plane (PyTorch, ONNX)
+            NHWC = 1    // image, row, column, channel - channels are interleaved (TensorFlow)
+        };
+
+        /**
+         * @brief How each image is turned into the values of a batch. Every pixel value v 
+         *        becomes (v * scale - mean) / std
+         */
+        struct TensorOptions 
+        {
+            cv::Size size {224, 224};               // width and height every image is resized to
+            TensorLayout layout {TensorLayout::NCHW};
+            bool swapRB {true};                     // store channels in RGB order instead of OpenCV's BGR
+            double scale {1.0 / 255.0};             // applied first, e.g. to bring values to [0, 1]
+            cv::Scalar mean {0.0, 0.0, 0.0};        // per channel, in the order they are stored (RGB if swapRB)
+            cv::Scalar std {1.0, 1.0, 1.0};         // per channel, in the order they are stored. Must not be 0
+            int interpolation {cv::INTER_LINEAR};   // used by cv::resize()
+            bool reducedDecode {true};              // decode JPEG files at 1/2, 1/4 or 1/8 scale when still larger than size
+            int threads {0};                        // no. of images decoded at once, on threads of their own. 
+                                                    // 0 = use OpenCV's thread pool (cv::getNumThreads())
+        };
+
+        /**
+         * @brief Read a batch of images into one contiguous block of 32-bit floats, ready to be 
+         *        fed to a neural network. The images are decoded in parallel, and each image is 
+         *        resized and then normalised, reordered (BGR to RGB) and written in the requested 
+         *        layout in a single pass straight into its place in the batch, so the only image 
+         *        made along the way is the resized 8-bit image.
+         *
+         * @param filePaths full paths to the image files. Each is read as a 3 channel colour image
+         * @param options size, layout and normalisation of the images
+         * @param batch receives the images as a 4-dimensional CV_32F array of N x 3 x H x W (NCHW) 
+         *              or N x H x W x 3 (NHWC) values. If it already has those dimensions, its memory 
+         *              is re-used, so a cv::Mat header around a buffer allocated by the caller (e.g. 
+         *              an inference engine's input buffer) is filled in place
+         * @param loaded set to 1 for each image that was read, and 0 for each image that could not 
+         *               be read (its values are set to 0)
+         * @return int no. of images read
+         */
+        int loadTensorBatch(const std::vector<std::string>& filePaths, const TensorOptions& options, 
+                            cv::Mat& batch, std::vector<uchar>& loaded);
+    }
+
+    namespace Watch {
+
+        /**
+         * @brief A file that has been completely written to a watched directory
+         */
+        struct ArrivedFile 
+        {
+            std::string path;       // full path to the file
+            int64 arrivalTicks {0}; // value of cv::getTickCount() when we were told the file was complete
+        };
+
+
+        /**
+         * @brief Watches a directory (not its sub-directories) for new files with inotify (Linux). 
+         *        A file is only reported once it is complete: when the program writing it closes 
+         *        it (IN_CLOSE_WRITE), or when it is moved into the directory (IN_MOVED_TO), which 
+         *        is how many cameras and tools publish a finished file. Events are read on a 
+         *        background thread and the files are placed in a queue, so the time a file 
+         *        arrived is recorded even while the program is busy with earlier files.
+         */
+        class DirectoryWatcher 
+        {
+        public:
+
+            /**
+             * @brief Start watching a directory. Use isOpen() to check if it succeeded
+             * 
+             * @param directory full path to directory
+             */
+            explicit DirectoryWatcher(const std::string& directory);
+
+            ~DirectoryWatcher();
+
+            DirectoryWatcher(const DirectoryWatcher&) = delete;
+            DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+            bool isOpen() const { return m_watch >= 0; }
+            bool isWatching() const { return isOpen() && !m_finished; } // false once the directory is removed or an error occurs
+
+
+            /**
+             * @brief Take the next file from the queue, waiting for one to arrive if the queue is empty
+             * 
+             * @param file receives the file
+             * @param timeoutMilliseconds longest time to wait. Negative waits until a file arrives 
+             *                            or the watcher stops
+             * @return true if a file was taken from the queue
+             * @return false if no file arrived in time, or the watcher stopped
+             */
+            bool next(ArrivedFile& file, int timeoutMilliseconds = -1);
+
+
+            /**
+             * @brief Return the no. of files waiting in the queue
+             */
+            std::size_t pending() const;
+
+        private:
+
+            void readEvents(); // runs on m_thread until m_stop is set
+
+            std::string m_directory;
+            int m_descriptor {-1};              // inotify instance
+            int m_watch {-1};                   // watch on m_directory. -1 if not watching
+            std::thread m_thread;
+            std::atomic<bool> m_stop {false};     // asks m_thread to finish
+            std::atomic<bool> m_finished {false}; // set by m_thread when it finishes
+
+            mutable std::mutex m_mutex;         // guards m_queue
+            std::condition_variable m_arrived;  // signalled when a file is queued or m_thread finishes
+            std::deque<ArrivedFile> m_queue;
+        };
+
+
+        /**
+         * @brief Collects the time between files arriving and being processed, and prints a 
+         *        summary (count, mean, median, 95th percentile and maximum)
+         */
+        class LatencyReport 
+        {
+        public:
+
+            /**
+             * @brief Add the latency of a file
+             * 
+             * @param arrivalTicks value of cv::getTickCount() when the file arrived
+             * @return double latency in milliseconds, from arrivalTicks until now
+             */
+            double add(int64 arrivalTicks);
+
+            void print(std::ostream& out = std::cout) const;
+
+        private:
+
+            std::vector<double> m_milliseconds;
+        };
+
+
+        /**
+         * @brief Catch Ctrl+C (SIGINT) and SIGTERM instead of letting them end the program, so a 
+         *        watch loop can finish saving the files it holds and print its report. The loop 
+         *        checks stopRequested(). A second Ctrl+C ends the program at once
+         */
+        void installStopHandler();
+
+        bool stopRequested(); // true once SIGINT or SIGTERM has been received after installStopHandler()
+    }
+
+    namespace Directories {
+
+        /**
+         * @brief Which files a DirectoryScanner reports. The cheapest tests are made first: the 
+         *        extension (from the name only), then the size (one stat() call, only if a size 
+         *        limit is set), and last cv::haveImageReader(), which opens the file
+         */
+        struct ScanOptions 
+        {
+            bool recursive {true};                  // also scan sub-directories (symbolic links to directories are not followed)
+            std::vector<std::string> extensions;    // lower case, without the dot, e.g. {"jpg", "png"}. Empty = any extension
+            std::uintmax_t minSize {0};             // smallest file size in bytes
+            std::uintmax_t maxSize {UINTMAX_MAX};   // largest file size in bytes
+            bool checkImageReader {true};           // only report files cv::haveImageReader() can read
+            int threads {0};                        // no. of directories scanned at once. 0 = cv::getNumThreads()
+            std::size_t queueCapacity {4096};       // files waiting to be taken with next() before scanning pauses
+        };
+
+
+        /**
+         * @brief A file found by a DirectoryScanner
+         */
+        struct ScannedFile 
+        {
+            std::string path;           // full path to the file
+            std::uintmax_t size {0};    // size in bytes. Only known (otherwise 0) if a size limit was set
+        };
+
+
+        /**
+         * @brief Scans a directory tree on several threads and streams the files that pass the 
+         *        filters to the caller as they are found, so the first files can be processed long 
+         *        before a large tree has been fully scanned. Each thread takes a directory from a 
+         *        shared queue of directories, queues the sub-directories it finds, and puts the files 
+         *        that pass the filters in a bounded queue read with next(). Files come in no 
+         *        particular order.
+         */
+        class DirectoryScanner 
+        {
+        public:
+
+            /**
+             * @brief Start scanning a directory
+             * 
+             * @param directory full path to directory
+             * @param options filters, no. of threads and size of the queue of files
+             */
+            explicit DirectoryScanner(const std::string& directory, const ScanOptions& options = ScanOptions());
+
+            ~DirectoryScanner(); // stops the scan if it has not finished
+
+            DirectoryScanner(const DirectoryScanner&) = delete;
+            DirectoryScanner& operator=(const DirectoryScanner&) = delete;
+
+
+            /**
+             * @brief Take the next file found, waiting for one if none is waiting
+             * 
+             * @param file receives the file
+             * @return true if a file was taken
+             * @return false if the scan has finished and every file has been taken
+             */
+            bool next(ScannedFile& file);
+
+            std::size_t directoriesScanned() const { return m_directoriesScanned; }
+            std::size_t filesSeen() const { return m_filesSeen; }           // files looked at, before filtering
+            std::size_t directoryErrors() const { return m_directoryErrors; } // directories that could not be read
+
+        private:
+
+            void scan(); // runs on each thread in m_threads
+
+            ScanOptions m_options;
+            std::vector<std::thread> m_threads;
+
+            std::mutex m_directoryMutex;                // guards m_directories and m_busyDirectories
+            std::condition_variable m_directoryQueued;  // signalled when a directory is queued or the scan ends
+            std::deque<std::filesystem::path> m_directories;
+            std::size_t m_busyDirectories {0};          // directories queued or being scanned. 0 = scan finished
+
+            std::mutex m_fileMutex;                     // guards m_files and m_scanning
+            std::condition_variable m_fileQueued;       // signalled when a file is queued or the scan ends
+            std::condition_variable m_fileTaken;        // signalled when a file is taken, or we are stopping
+            std::deque<ScannedFile> m_files;
+            bool m_scanning {true};
+
+            std::atomic<bool> m_stop {false};
+            std::atomic<std::size_t> m_directoriesScanned {0};
+            std::atomic<std::size_t> m_filesSeen {0};
+            std::atomic<std::size_t> m_directoryErrors {0};
+        };
+
+
+        /**
+         * @brief Scan a directory tree with a DirectoryScanner and return all the files found, 
+         *        sorted by path. Use a DirectoryScanner directly to process files as they are found
+         * 
+         * @param directory full path to directory
+         * @param options filters and no. of threads
+         * @return std::vector<std::string> full paths to the files, sorted
+         */
+        std::vector<std::string> listFiles(const std::string& directory, const ScanOptions& options = ScanOptions());
+
+
+        /**
+         * @brief Turn a comma separated list of file extensions into the form ScanOptions::extensions 
+         *        expects, e.g. ".JPG, png,tif" becomes {"jpg", "png", "tif"}
+         * 
+         * @param list comma separated list of extensions, with or without dots
+         * @return std::vector<std::string> lower case extensions without dots. Empty if list is empty
+         */
+        std::vector<std::string> parseExtensionList(const std::string& list);
+    }
 }
 
 
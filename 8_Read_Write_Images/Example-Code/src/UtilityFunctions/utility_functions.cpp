@@ -1,7 +1,45 @@
 #include "UtilityFunctions/utility_functions.h"
 
 
+#include "opencv2/imgcodecs.hpp" // for cv::imencode()
+#include "opencv2/imgproc.hpp"   // for cv::resize()
+
 #include <filesystem> // handles files
+#include <fstream>    // for std::ifstream, std::ofstream
+#include <iomanip>    // for std::setw
+#include <algorithm>  // for std::find_if, std::any_of, std::min_element, std::fill, std::count, std::transform
+#include <cstring>    // for std::strerror, std::memcpy, std::memcmp
+#include <cerrno>     // for errno
+#include <cstdlib>    // for std::abs
+#include <sstream>    // for std::ostringstream, std::istringstream
+#include <iterator>   // for std::next, std::istreambuf_iterator
+#include <numeric>    // for std::gcd, std::accumulate
+#include <csetjmp>    // for std::jmp_buf, setjmp(), std::longjmp
+#include <cstdio>     // for FILE, which jpeglib.h uses
+#include <cctype>     // for std::isspace, std::isdigit, std::tolower
+#include <climits>    // for INT_MAX
+#include <cmath>      // for std::ceil
+#include <chrono>     // for std::chrono::milliseconds
+#include <random>     // for std::random_device
+#include <charconv>   // for std::from_chars
+#include <csignal>    // for std::signal, std::sig_atomic_t
+#include <utility>    // for std::move
+
+#include <zlib.h>     // for deflate(), adler32(), crc32()
+#include <jpeglib.h>  // for jpeg_read_scanlines(), jpeg_mem_src()
+#include <tiffio.h>   // for TIFFOpen(), TIFFWriteEncodedTile(), TIFFWriteRawTile(), TIFFReadEncodedTile()
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>    // for open(), posix_fallocate()
+#include <unistd.h>   // for pwrite(), fsync(), close(), getpid()
+#include <sys/mman.h> // for mmap(), munmap()
+#include <sys/stat.h> // for fstat()
+#endif
+
+#if defined(__linux__)
+#include <sys/inotify.h> // for inotify_init1(), inotify_add_watch()
+#include <poll.h>        // for poll()
+#endif
 
 namespace CPP_CV {
 
@@ -104,5 +142,4359 @@ namespace CPP_CV {
                 return substring;
             }
         }
+
+
+        /**
+         * @brief Read the width and height of a JPEG or PNG image from its file header, 
+         *        without decoding the image. Only the first few bytes of a PNG file, or the 
+         *        markers up to the start of frame of a JPEG file, are read.
+         * 
+         * @param filePath full path to image file
+         * @return cv::Size image size (width x height). An empty cv::Size is returned for other 
+         *         image file formats or if the header cannot be read
+         */
+        cv::Size readImageSize(const std::string& filePath)
+        {
+            std::ifstream file(filePath, std::ios::in | std::ios::binary);
+            if (!file)
+            {
+                return cv::Size();
+            }
+
+            // Read a big-endian 16-bit or 32-bit unsigned integer from the file
+            auto readUInt16 = [&file]() {
+                unsigned char b[2] {};
+                file.read(reinterpret_cast<char*>(b), 2);
+                return (static_cast<unsigned int>(b[0]) << 8) | b[1];
+            };
+            auto readUInt32 = [&file]() {
+                unsigned char b[4] {};
+                file.read(reinterpret_cast<char*>(b), 4);
+                return (static_cast<unsigned int>(b[0]) << 24) | (static_cast<unsigned int>(b[1]) << 16) | 
+                       (static_cast<unsigned int>(b[2]) << 8) | b[3];
+            };
+
+            unsigned char signature[8] {};
+            file.read(reinterpret_cast<char*>(signature), 8);
+            if (!file)
+            {
+                return cv::Size();
+            }
+
+            // a. PNG - the first chunk is always IHDR, which starts with the width and height
+            const unsigned char pngSignature[8] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+            if (std::equal(std::begin(pngSignature), std::end(pngSignature), signature))
+            {
+                readUInt32(); // chunk length
+                char chunkType[4] {};
+                file.read(chunkType, 4);
+                if (std::string(chunkType, 4) != "IHDR")
+                {
+                    return cv::Size();
+                }
+
+                const unsigned int width { readUInt32() };
+                const unsigned int height { readUInt32() };
+
+                return file ? cv::Size(static_cast<int>(width), static_cast<int>(height)) : cv::Size();
+            }
+
+            // b. JPEG - walk through the markers until we reach a start of frame (SOFn) marker
+            if ((signature[0] != 0xFF) || (signature[1] != 0xD8))
+            {
+                return cv::Size(); // neither PNG nor JPEG
+            }
+
+            file.seekg(2); // skip start of image (SOI) marker
+            while (file)
+            {
+                // Markers start with 0xFF, which may be repeated as fill bytes
+                int byte { file.get() };
+                if (byte != 0xFF) 
+                {
+                    return cv::Size();
+                }
+                while (byte == 0xFF) 
+                {
+                    byte = file.get();
+                }
+
+                const int marker { byte };
+
+                // Markers without a length field
+                if ((marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD7)))
+                {
+                    continue;
+                }
+                if ((marker == 0xD9) || (marker == 0xDA)) // end of image or start of scan - no frame found
+                {
+                    return cv::Size();
+                }
+
+                const unsigned int length { readUInt16() }; // includes the 2 length bytes
+
+                // SOF0 to SOF15, except DHT (0xC4), JPG (0xC8) and DAC (0xCC)
+                if ((marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+                {
+                    file.get(); // sample precision
+                    const unsigned int height { readUInt16() };
+                    const unsigned int width { readUInt16() };
+
+                    return file ? cv::Size(static_cast<int>(width), static_cast<int>(height)) : cv::Size();
+                }
+
+                if (length < 2)
+                {
+                    return cv::Size(); // corrupt segment
+                }
+                file.seekg(length - 2, std::ios::cur);
+            }
+
+            return cv::Size();
+        }
+
+
+        /**
+         * @brief Where the restart intervals of a baseline JPEG file are, and how they 
+         *        map to the rows of the image
+         */
+        struct JpegRestartLayout
+        {
+            cv::Size size;                           // image width x height
+            int components {0};                      // 1 = grayscale, 3 = colour
+            cv::Size mcuSize;                        // pixels covered by one minimum coded unit (MCU)
+            int restartInterval {0};                 // no. of MCUs in each restart interval
+            std::size_t heightOffset {0};            // offset of the image height in the start of frame segment
+            std::size_t scanStart {0};               // offset of the first byte of entropy coded data
+            std::vector<std::size_t> intervalStarts; // offset of the first byte of each interval
+            std::vector<std::size_t> intervalEnds;   // offset of the marker that ends each interval
+        };
+
+
+        /**
+         * @brief Find the restart intervals in a JPEG file. Only baseline (and extended 
+         *        sequential 8-bit) Huffman coded files with a single scan of 1 or 3 colour 
+         *        components and a restart marker after every interval are accepted
+         * 
+         * @param data contents of a JPEG file
+         * @param layout receives the position of every restart interval
+         * @return true if the file has restart intervals that can be decoded on their own
+         * @return false otherwise
+         */
+        static bool findJpegRestartIntervals(const std::vector<uchar>& data, JpegRestartLayout& layout)
+        {
+            const std::size_t size { data.size() };
+            if ((size < 4) || (data[0] != 0xFF) || (data[1] != 0xD8))
+            {
+                return false;
+            }
+
+            auto readUInt16 = [&data](std::size_t offset) {
+                return (static_cast<unsigned int>(data[offset]) << 8) | data[offset + 1];
+            };
+
+            //------------------ 1. Read the markers up to the start of scan ------------------//
+
+            int maxHorizontal {1};
+            int maxVertical {1};
+            bool frameFound {false};
+
+            std::size_t offset {2}; // skip start of image (SOI) marker
+            while (true)
+            {
+                // Markers start with 0xFF, which may be repeated as fill bytes
+                if ((offset >= size) || (data[offset] != 0xFF))
+                {
+                    return false;
+                }
+                while ((offset < size) && (data[offset] == 0xFF))
+                {
+                    ++offset;
+                }
+                if (offset + 2 >= size)
+                {
+                    return false;
+                }
+
+                const int marker { data[offset++] };
+                if ((marker == 0x01) || ((marker >= 0xD0) && (marker <= 0xD7)))
+                {
+                    continue;
+                }
+                if (marker == 0xD9) // end of image before any scan
+                {
+                    return false;
+                }
+
+                const std::size_t length { readUInt16(offset) }; // includes the 2 length bytes
+                if ((length < 2) || (offset + length > size))
+                {
+                    return false;
+                }
+
+                // Every segment read below is at least as long as the fields we read from it, 
+                // and lies inside the file (checked above), so a short segment cannot read past the end
+                if ((marker == 0xC0) || (marker == 0xC1)) // baseline or extended sequential, Huffman coded
+                {
+                    if (length < 8)
+                    {
+                        return false;
+                    }
+
+                    const int components { data[offset + 7] };
+                    if ((data[offset + 2] != 8) || (length != 8 + 3 * static_cast<std::size_t>(components)) ||
+                        ((components != 1) && (components != 3)))
+                    {
+                        return false;
+                    }
+
+                    layout.heightOffset = offset + 3;
+                    layout.size = cv::Size(static_cast<int>(readUInt16(offset + 5)), static_cast<int>(readUInt16(offset + 3)));
+                    layout.components = components;
+
+                    for (int c {0}; c < components; ++c)
+                    {
+                        const int sampling { data[offset + 9 + 3 * c] };
+                        maxHorizontal = std::max(maxHorizontal, sampling >> 4);
+                        maxVertical = std::max(maxVertical, sampling & 0x0F);
+                    }
+
+                    frameFound = true;
+                }
+                else if ((marker >= 0xC2) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+                {
+                    return false; // progressive, lossless or arithmetic coded
+                }
+                else if (marker == 0xDD) // define restart interval (DRI)
+                {
+                    if (length < 4)
+                    {
+                        return false;
+                    }
+
+                    layout.restartInterval = static_cast<int>(readUInt16(offset + 2));
+                }
+                else if (marker == 0xDA) // start of scan (SOS)
+                {
+                    // The scan must hold every component, so the whole image is a single scan
+                    if (!frameFound || (length < 3) || (data[offset + 2] != layout.components))
+                    {
+                        return false;
+                    }
+
+                    layout.scanStart = offset + length;
+                    break;
+                }
+
+                offset += length;
+            }
+
+            // A height of 0 means the height follows the scan in a DNL marker
+            if ((layout.restartInterval == 0) || layout.size.empty())
+            {
+                return false;
+            }
+
+            // A single component scan is coded in 8 x 8 blocks, whatever its sampling factors
+            layout.mcuSize = (layout.components == 1) ? cv::Size(8, 8) : cv::Size(8 * maxHorizontal, 8 * maxVertical);
+
+            //------------------ 2. Find the restart markers in the entropy coded data ------------------//
+
+            // In entropy coded data 0xFF is followed by 0x00 (a stuffed byte), 0xFF (fill), 
+            // a restart marker RST0 - RST7, or the marker that ends the scan
+            layout.intervalStarts.assign(1, layout.scanStart);
+            layout.intervalEnds.clear();
+
+            offset = layout.scanStart;
+            while (true)
+            {
+                const void* found { std::memchr(data.data() + offset, 0xFF, size - offset) };
+                if (found == nullptr)
+                {
+                    return false; // no end of image
+                }
+                offset = static_cast<std::size_t>(static_cast<const uchar*>(found) - data.data());
+                if (offset + 1 >= size)
+                {
+                    return false;
+                }
+
+                const int next { data[offset + 1] };
+                if ((next == 0x00) || (next == 0xFF))
+                {
+                    offset += (next == 0x00) ? 2 : 1;
+                }
+                else if ((next >= 0xD0) && (next <= 0xD7))
+                {
+                    layout.intervalEnds.push_back(offset);
+                    layout.intervalStarts.push_back(offset + 2);
+                    offset += 2;
+                }
+                else
+                {
+                    layout.intervalEnds.push_back(offset);
+                    break;
+                }
+            }
+
+            // Only a single scan followed by the end of image (EOI) marker, with every restart marker present
+            const long long mcusPerRow { (layout.size.width + layout.mcuSize.width - 1) / layout.mcuSize.width };
+            const long long mcuRows { (layout.size.height + layout.mcuSize.height - 1) / layout.mcuSize.height };
+            const long long intervals { (mcusPerRow * mcuRows + layout.restartInterval - 1) / layout.restartInterval };
+
+            return (data[offset + 1] == 0xD9) && (static_cast<long long>(layout.intervalStarts.size()) == intervals);
+        }
+
+
+        /**
+         * @brief Error manager for decoding a band of a JPEG image. Errors jump back to 
+         *        the decoder instead of ending the program, and messages are not printed
+         */
+        struct JpegBandErrorManager
+        {
+            jpeg_error_mgr base;
+            std::jmp_buf jump;
+        };
+
+        static void jpegBandErrorExit(j_common_ptr info)
+        {
+            std::longjmp(reinterpret_cast<JpegBandErrorManager*>(info->err)->jump, 1);
+        }
+
+        static void jpegBandOutputMessage(j_common_ptr) {}
+
+
+        /**
+         * @brief Decode a JPEG stream that holds a band of rows of a larger image, and copy 
+         *        some of its rows into the larger image
+         * 
+         * @param stream JPEG stream of the band, including rows above and below the rows kept
+         * @param skipRows no. of rows at the top of the stream that are decoded and thrown away
+         * @param rows rows of the larger image that receive the decoded rows (CV_8UC1 or CV_8UC3)
+         * @param scratchRow buffer for the rows thrown away, at least one row of rows long
+         * @return true if the rows were decoded without any errors or warnings
+         * @return false otherwise
+         */
+        static bool decodeJpegBand(const std::vector<uchar>& stream, int skipRows, cv::Mat& rows, std::vector<uchar>& scratchRow)
+        {
+            // Only plain C data lives in this function, as longjmp() does not call destructors
+            jpeg_decompress_struct info {};
+            JpegBandErrorManager errorManager {};
+            info.err = jpeg_std_error(&errorManager.base);
+            errorManager.base.error_exit = jpegBandErrorExit;
+            errorManager.base.output_message = jpegBandOutputMessage;
+
+            if (setjmp(errorManager.jump))
+            {
+                jpeg_destroy_decompress(&info);
+
+                return false;
+            }
+
+            jpeg_create_decompress(&info);
+            jpeg_mem_src(&info, stream.data(), static_cast<unsigned long>(stream.size()));
+            jpeg_read_header(&info, TRUE);
+
+#ifdef JCS_EXTENSIONS
+            info.out_color_space = (rows.channels() == 3) ? JCS_EXT_BGR : JCS_GRAYSCALE; // libjpeg-turbo
+#else
+            info.out_color_space = (rows.channels() == 3) ? JCS_RGB : JCS_GRAYSCALE;
+#endif
+            jpeg_start_decompress(&info);
+
+            if ((static_cast<int>(info.output_width) != rows.cols) || (info.output_components != rows.channels()) ||
+                (static_cast<int>(info.output_height) < skipRows + rows.rows))
+            {
+                jpeg_destroy_decompress(&info);
+
+                return false;
+            }
+
+            // The decoder reads ahead to upsample the colour of the last row, so it can be 
+            // stopped as soon as the last row we keep has been decoded
+            for (int y {0}; y < skipRows + rows.rows; ++y)
+            {
+                JSAMPROW row { (y < skipRows) ? scratchRow.data() : rows.ptr<uchar>(y - skipRows) };
+                jpeg_read_scanlines(&info, &row, 1);
+            }
+
+            const bool decoded { errorManager.base.num_warnings == 0 }; // warnings mean corrupt data
+            jpeg_abort_decompress(&info);
+            jpeg_destroy_decompress(&info);
+
+#ifndef JCS_EXTENSIONS
+            if (decoded && (rows.channels() == 3))
+            {
+                cv::cvtColor(rows, rows, cv::COLOR_RGB2BGR);
+            }
+#endif
+
+            return decoded;
+        }
+
+
+        /**
+         * @brief Decode a baseline JPEG image on several threads. A JPEG file written with 
+         *        restart markers is made of intervals that can each be decoded on their own. 
+         *        The image is split into bands of rows that start and end at restart markers, 
+         *        and each band is decoded by its own libjpeg decoder straight into its rows 
+         *        of the output image. Each band also decodes one restart-aligned row of blocks 
+         *        above and below it (which it throws away), so colour upsampling at the band 
+         *        edges gives the same result as decoding the whole image at once.
+         * 
+         * @param data contents of a JPEG file
+         * @param maxBands largest no. of bands to split the image into. 0 = cv::getNumThreads()
+         * @return cv::Mat decoded image (CV_8UC3 BGR or CV_8UC1), the same as cv::imdecode() with 
+         *         cv::IMREAD_UNCHANGED gives. An empty cv::Mat if the image cannot be split (not a 
+         *         JPEG file, progressive or arithmetic coded, no restart markers, or too few of them) 
+         *         or could not be decoded
+         */
+        cv::Mat decodeJpegInBands(const std::vector<uchar>& data, int maxBands)
+        {
+            JpegRestartLayout layout;
+            if (!findJpegRestartIntervals(data, layout))
+            {
+                return cv::Mat();
+            }
+
+            //------------------ 1. Split the image into bands of MCU rows ------------------//
+
+            // A band can only start where a restart interval starts at the beginning of a 
+            // row of MCUs, which happens every 'step' rows of MCUs
+            const int mcusPerRow { (layout.size.width + layout.mcuSize.width - 1) / layout.mcuSize.width };
+            const int mcuRows { (layout.size.height + layout.mcuSize.height - 1) / layout.mcuSize.height };
+            const int step { layout.restartInterval / std::gcd(layout.restartInterval, mcusPerRow) };
+            const long long intervalsPerStep { static_cast<long long>(step) * mcusPerRow / layout.restartInterval };
+            const int steps { (mcuRows + step - 1) / step };
+
+            const int numberOfBands { std::min(maxBands > 0 ? maxBands : cv::getNumThreads(), steps) };
+            if (numberOfBands < 2)
+            {
+                return cv::Mat();
+            }
+
+            cv::Mat image(layout.size, CV_8UC(layout.components));
+
+            // The header up to the start of scan is the same for every band, except for the height
+            const std::vector<uchar> header(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(layout.scanStart));
+
+            //------------------ 2. Decode the bands in parallel ------------------//
+
+            std::vector<int> bandStatus(numberOfBands, 0);
+
+            cv::parallel_for_(cv::Range(0, numberOfBands), [&](const cv::Range& range) {
+                std::vector<uchar> stream;
+                std::vector<uchar> scratchRow(image.step);
+
+                for (int band { range.start }; band < range.end; ++band)
+                {
+                    // MCU rows kept [first, last), and decoded [decodeFirst, decodeLast)
+                    const int first { static_cast<int>(static_cast<long long>(band) * steps / numberOfBands) * step };
+                    const int last { std::min(static_cast<int>(static_cast<long long>(band + 1) * steps / numberOfBands) * step, mcuRows) };
+                    const int decodeFirst { std::max(first - step, 0) };
+                    const int decodeLast { std::min(last + step, mcuRows) };
+
+                    const int rowsKept { std::min(last * layout.mcuSize.height, image.rows) - first * layout.mcuSize.height };
+                    const int bandHeight { std::min(decodeLast * layout.mcuSize.height, image.rows) - decodeFirst * layout.mcuSize.height };
+
+                    // Build a JPEG stream holding only the intervals of the decoded rows. The 
+                    // restart markers are numbered again from RST0, as a decoder expects
+                    stream = header;
+                    stream[layout.heightOffset] = static_cast<uchar>(bandHeight >> 8);
+                    stream[layout.heightOffset + 1] = static_cast<uchar>(bandHeight & 0xFF);
+
+                    const std::size_t firstInterval { static_cast<std::size_t>(decodeFirst / step * intervalsPerStep) };
+                    const std::size_t lastInterval { (decodeLast == mcuRows) ? layout.intervalStarts.size() :
+                                                     static_cast<std::size_t>(decodeLast / step * intervalsPerStep) };
+
+                    for (std::size_t interval { firstInterval }; interval < lastInterval; ++interval)
+                    {
+                        if (interval > firstInterval)
+                        {
+                            stream.push_back(0xFF);
+                            stream.push_back(static_cast<uchar>(0xD0 + (interval - firstInterval - 1) % 8));
+                        }
+                        stream.insert(stream.end(), data.begin() + static_cast<std::ptrdiff_t>(layout.intervalStarts[interval]),
+                                      data.begin() + static_cast<std::ptrdiff_t>(layout.intervalEnds[interval]));
+                    }
+                    stream.push_back(0xFF);
+                    stream.push_back(0xD9); // end of image
+
+                    cv::Mat rows { image.rowRange(first * layout.mcuSize.height, first * layout.mcuSize.height + rowsKept) };
+                    bandStatus[band] = decodeJpegBand(stream, (first - decodeFirst) * layout.mcuSize.height, rows, scratchRow) ? 1 : 0;
+                }
+            });
+
+            if (std::find(bandStatus.begin(), bandStatus.end(), 0) != bandStatus.end())
+            {
+                return cv::Mat();
+            }
+
+            return image;
+        }
+
+
+        /**
+         * @brief cv::imread() that decodes large JPEG files with restart markers on several 
+         *        threads with decodeJpegInBands(). Any other image, or a JPEG file that cannot 
+         *        be split, is read with cv::imread()
+         * 
+         * @param filePath full path to image file
+         * @param flags cv::ImreadModes. Only cv::IMREAD_UNCHANGED uses the parallel decoder, as 
+         *              other flags may rotate or convert the image
+         * @return cv::Mat decoded image. An empty cv::Mat if the file could not be read
+         */
+        cv::Mat imreadParallel(const std::string& filePath, int flags)
+        {
+            if (flags == cv::IMREAD_UNCHANGED)
+            {
+                std::ifstream file(filePath, std::ios::in | std::ios::binary | std::ios::ate);
+                const std::streamoff fileSize { file ? static_cast<std::streamoff>(file.tellg()) : 0 };
+
+                unsigned char signature[2] {};
+                file.seekg(0);
+                file.read(reinterpret_cast<char*>(signature), 2);
+
+                if (file && (signature[0] == 0xFF) && (signature[1] == 0xD8))
+                {
+                    std::vector<uchar> data(static_cast<std::size_t>(fileSize));
+                    file.seekg(0);
+                    file.read(reinterpret_cast<char*>(data.data()), fileSize);
+                    if (!file)
+                    {
+                        return cv::Mat();
+                    }
+
+                    cv::Mat image { decodeJpegInBands(data) };
+
+                    // The file is already in memory, so decode it from there if it cannot be split
+                    return image.empty() ? cv::imdecode(data, flags) : image;
+                }
+            }
+
+            return cv::imread(filePath, flags);
+        }
+
+
+        /**
+         * @brief Write the contents of a buffer to file using a few large write calls 
+         *        instead of one call per character. On POSIX systems the data is written 
+         *        with pwrite(), optionally into a pre-allocated file. 
+         * 
+         * @param filePath full path to save data to including file extension
+         * @param data pointer to first byte of buffer
+         * @param size no. of bytes in buffer
+         * @param options see WriteOptions
+         * @return true if all the data was written
+         * @return false if the file could not be created, written, synced or renamed. 
+         *         A message describing the error is printed to std::cerr
+         */
+        bool writeBufferToFile(const std::string& filePath, const uchar* data, std::size_t size, 
+                               const WriteOptions& options)
+        {
+            const std::size_t chunkSize { std::max<std::size_t>(options.chunkSize, 1) };
+
+            // For atomic writes we write to a temporary file in the same directory 
+            // (so the rename does not cross file systems), then rename it. The name is 
+            // unique to this process and call, so two writers of one path never share it
+            static std::atomic<unsigned int> temporaryCount {0};
+
+            const std::filesystem::path finalPath { filePath };
+            std::filesystem::path writePath { finalPath };
+            if (options.atomic)
+            {
+#if defined(__unix__) || defined(__APPLE__)
+                const unsigned long processId { static_cast<unsigned long>(::getpid()) };
+#else
+                const unsigned long processId { std::random_device{}() };
+#endif
+                writePath += ".tmp" + std::to_string(processId) + "_" + std::to_string(temporaryCount++);
+            }
+
+            // Once the temporary file of an atomic write exists, every failure removes it
+            auto removeTemporaryFile = [&options, &writePath]() {
+                if (options.atomic)
+                {
+                    std::error_code ec;
+                    std::filesystem::remove(writePath, ec);
+                }
+            };
+
+#if defined(__unix__) || defined(__APPLE__)
+
+            // O_EXCL: never write into a file another writer already uses
+            const int flags { O_WRONLY | O_CREAT | O_CLOEXEC | (options.atomic ? O_EXCL : O_TRUNC) };
+            int fd { ::open(writePath.c_str(), flags, 0644) };
+            if (fd < 0)
+            {
+                std::cerr << "\nCould not create file " << writePath << ": " << std::strerror(errno) << '\n';
+
+                return false;
+            }
+
+            // Reserving the space up front lets the file system allocate contiguous 
+            // blocks and reports a full disk before we write any data
+#if defined(__linux__)
+            if (options.preallocate && (size > 0))
+            {
+                int error { ::posix_fallocate(fd, 0, static_cast<off_t>(size)) };
+
+                // Some file systems (e.g. tmpfs on older kernels) do not support 
+                // pre-allocation. That is not an error, we just write as normal
+                if ((error != 0) && (error != EOPNOTSUPP) && (error != EINVAL))
+                {
+                    std::cerr << "\nCould not pre-allocate " << size << " bytes for " 
+                              << writePath << ": " << std::strerror(error) << '\n';
+                    ::close(fd);
+                    removeTemporaryFile();
+
+                    return false;
+                }
+            }
+#endif
+
+            // Write the buffer in large chunks at explicit offsets
+            std::size_t offset {0};
+            while (offset < size)
+            {
+                const std::size_t count { std::min(chunkSize, size - offset) };
+                ssize_t written { ::pwrite(fd, data + offset, count, static_cast<off_t>(offset)) };
+
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue; // interrupted by a signal - try again
+
+                    std::cerr << "\nCould not write to file " << writePath << ": " << std::strerror(errno) << '\n';
+                    ::close(fd);
+                    removeTemporaryFile();
+
+                    return false;
+                }
+
+                offset += static_cast<std::size_t>(written);
+            }
+
+            if (options.syncToDisk && (::fsync(fd) != 0))
+            {
+                std::cerr << "\nCould not sync file " << writePath << ": " << std::strerror(errno) << '\n';
+                ::close(fd);
+                removeTemporaryFile();
+
+                return false;
+            }
+
+            if (::close(fd) != 0)
+            {
+                std::cerr << "\nCould not close file " << writePath << ": " << std::strerror(errno) << '\n';
+                removeTemporaryFile();
+
+                return false;
+            }
+
+#else
+
+            // Without POSIX we fall back to large writes through std::ofstream. 
+            // Pre-allocation and syncing are not available
+            std::ofstream file(writePath, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cerr << "\nCould not create file " << writePath << '\n';
+
+                return false;
+            }
+
+            for (std::size_t offset {0}; offset < size; offset += chunkSize)
+            {
+                const std::size_t count { std::min(chunkSize, size - offset) };
+                file.write(reinterpret_cast<const char*>(data + offset), static_cast<std::streamsize>(count));
+            }
+
+            file.close();
+            if (!file)
+            {
+                std::cerr << "\nCould not write to file " << writePath << '\n';
+                removeTemporaryFile();
+
+                return false;
+            }
+
+#endif
+
+            if (options.atomic)
+            {
+                std::error_code ec;
+                std::filesystem::rename(writePath, finalPath, ec);
+                if (ec)
+                {
+                    std::cerr << "\nCould not rename " << writePath << " to " << finalPath 
+                              << ": " << ec.message() << '\n';
+                    removeTemporaryFile();
+
+                    return false;
+                }
+
+#if defined(__unix__) || defined(__APPLE__)
+                // The rename itself is only durable once the directory entry is synced
+                if (options.syncToDisk)
+                {
+                    std::filesystem::path directory { finalPath.parent_path() };
+                    if (directory.empty()) directory = ".";
+
+                    int dirFd { ::open(directory.c_str(), O_RDONLY | O_CLOEXEC) };
+                    if (dirFd >= 0)
+                    {
+                        ::fsync(dirFd);
+                        ::close(dirFd);
+                    }
+                }
+#endif
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Write the contents of a std::vector<unsigned char> buffer to file. 
+         *        See writeBufferToFile(const std::string&, const uchar*, std::size_t, const WriteOptions&)
+         * 
+         * @param filePath full path to save data to including file extension
+         * @param buffer std::vector<unsigned char>
+         * @param options see WriteOptions
+         * @return true if all the data was written
+         * @return false if the data could not be written
+         */
+        bool writeBufferToFile(const std::string& filePath, const std::vector<uchar>& buffer, 
+                               const WriteOptions& options)
+        {
+            return writeBufferToFile(filePath, buffer.data(), buffer.size(), options);
+        }
+
+
+        /*
+         * Helpers for encodePNGParallel(). A PNG file is a signature followed by chunks. 
+         * Each chunk is: length (4 bytes, big-endian), type (4 characters), data, 
+         * CRC-32 of type and data (4 bytes, big-endian)
+        */
+        static void appendBigEndian32(std::vector<uchar>& buffer, uLong value)
+        {
+            buffer.push_back(static_cast<uchar>((value >> 24) & 0xFF));
+            buffer.push_back(static_cast<uchar>((value >> 16) & 0xFF));
+            buffer.push_back(static_cast<uchar>((value >> 8) & 0xFF));
+            buffer.push_back(static_cast<uchar>(value & 0xFF));
+        }
+
+        static void appendPNGChunk(std::vector<uchar>& buffer, const char* type, const uchar* data, std::size_t size)
+        {
+            appendBigEndian32(buffer, static_cast<uLong>(size));
+
+            const std::size_t typeStart { buffer.size() };
+            buffer.insert(buffer.end(), type, type + 4);
+            if (size > 0)
+            {
+                buffer.insert(buffer.end(), data, data + size);
+            }
+
+            appendBigEndian32(buffer, crc32(0L, buffer.data() + typeStart, static_cast<uInt>(size + 4)));
+        }
+
+        /*
+         * Predict a byte from its left (a), above (b) and above left (c) neighbours 
+         * with one of the 5 PNG filter types
+        */
+        static inline int predictPNGByte(int filterType, int a, int b, int c)
+        {
+            switch (filterType)
+            {
+                case 1: return a;           // Sub
+                case 2: return b;           // Up
+                case 3: return (a + b) / 2; // Average
+                case 4:                     // Paeth - whichever of a, b, c is closest to a + b - c
+                {
+                    const int pa { std::abs(b - c) };
+                    const int pb { std::abs(a - c) };
+                    const int pc { std::abs(a + b - 2 * c) };
+                    return ((pa <= pb) && (pa <= pc)) ? a : ((pb <= pc) ? b : c);
+                }
+                default: return 0;          // None
+            }
+        }
+
+        /*
+         * Filter one row of pixels with the PNG filter that gives the smallest sum of 
+         * absolute (signed) differences - the heuristic used by libpng. 'row' and 
+         * 'previousRow' hold RGB(A) samples in PNG byte order. 'previousRow' is nullptr 
+         * for the first row. 'out' receives the filter type byte, then the filtered row
+        */
+        static void filterPNGRow(const uchar* row, const uchar* previousRow, std::size_t rowBytes, 
+                                 int bytesPerPixel, bool adaptive, uchar* out)
+        {
+            const std::size_t bpp { static_cast<std::size_t>(bytesPerPixel) };
+
+            auto neighbours = [&](std::size_t i, int& a, int& b, int& c) {
+                a = i >= bpp ? row[i - bpp] : 0;
+                b = previousRow ? previousRow[i] : 0;
+                c = (previousRow && i >= bpp) ? previousRow[i - bpp] : 0;
+            };
+
+            // a. Score all 5 filters in one pass over the row
+            int bestFilter {0};
+            if (adaptive)
+            {
+                std::size_t sums[5] {};
+                for (std::size_t i {0}; i < rowBytes; ++i)
+                {
+                    int a, b, c;
+                    neighbours(i, a, b, c);
+
+                    const int x { row[i] };
+                    sums[0] += static_cast<std::size_t>(std::abs(static_cast<signed char>(x)));
+                    sums[1] += static_cast<std::size_t>(std::abs(static_cast<signed char>(x - a)));
+                    sums[2] += static_cast<std::size_t>(std::abs(static_cast<signed char>(x - b)));
+                    sums[3] += static_cast<std::size_t>(std::abs(static_cast<signed char>(x - (a + b) / 2)));
+                    sums[4] += static_cast<std::size_t>(std::abs(static_cast<signed char>(x - predictPNGByte(4, a, b, c))));
+                }
+
+                bestFilter = static_cast<int>(std::min_element(sums, sums + 5) - sums);
+            }
+
+            // b. Write the row with the best filter
+            out[0] = static_cast<uchar>(bestFilter);
+            for (std::size_t i {0}; i < rowBytes; ++i)
+            {
+                int a, b, c;
+                neighbours(i, a, b, c);
+
+                out[i + 1] = static_cast<uchar>(row[i] - predictPNGByte(bestFilter, a, b, c));
+            }
+        }
+
+
+        /**
+         * @brief Compress an image to PNG format in memory using all the threads available to 
+         *        OpenCV (see cv::setNumThreads()). Rows are filtered in parallel, and the filtered 
+         *        data is split into chunks that are deflated on separate threads (in the same way 
+         *        as pigz). The compressed chunks and their checksums are then joined into a single, 
+         *        valid zlib stream. The output can be read by any PNG decoder, e.g. cv::imdecode().
+         *        Each chunk starts with the last 32 KB of the previous chunk as its dictionary, 
+         *        so the file is only slightly larger than one compressed on a single thread.
+         * 
+         * @param image 8-bit or 16-bit image with 1 (grayscale), 3 (BGR) or 4 (BGRA) channels
+         * @param buffer output buffer. Resized to fit the PNG file
+         * @param compressionLevel zlib compression level from 0 (no compression) to 9 (smallest size), 
+         *                         as used by cv::IMWRITE_PNG_COMPRESSION
+         * @param strategy zlib compression strategy, as used by cv::IMWRITE_PNG_STRATEGY. The default 
+         *                 (cv::IMWRITE_PNG_STRATEGY_RLE) is the one used by cv::imwrite()
+         * @param chunkSize no. of bytes of filtered image data deflated by each task
+         * @return true if the image was compressed
+         * @return false if the image type is not supported or zlib reported an error
+         */
+        bool encodePNGParallel(const cv::Mat& image, std::vector<uchar>& buffer, int compressionLevel, 
+                               int strategy, std::size_t chunkSize)
+        {
+            const int channels { image.channels() };
+            if (image.empty() || (image.dims != 2) || 
+                ((image.depth() != CV_8U) && (image.depth() != CV_16U)) ||
+                ((channels != 1) && (channels != 3) && (channels != 4)))
+            {
+                return false;
+            }
+
+            compressionLevel = std::min(std::max(compressionLevel, 0), 9);
+            chunkSize = std::max<std::size_t>(chunkSize, 32 << 10);
+
+            const int bytesPerSample { image.depth() == CV_16U ? 2 : 1 };
+            const int bytesPerPixel { channels * bytesPerSample };
+            const std::size_t rowBytes { static_cast<std::size_t>(image.cols) * bytesPerPixel };
+            const std::size_t filteredRowBytes { rowBytes + 1 }; // each row starts with its filter type
+            const bool adaptiveFiltering { compressionLevel > 0 };
+
+            //------------------ 1. Filter rows in parallel -------------------//
+
+            // PNG stores RGB(A) with 16-bit samples in big-endian byte order, 
+            // while OpenCV stores BGR(A) in the byte order of the machine
+            auto toPNGByteOrder = [&](int y, uchar* out) {
+                if (bytesPerSample == 1)
+                {
+                    const uchar* in { image.ptr<uchar>(y) };
+                    for (int x {0}; x < image.cols; ++x, in += channels, out += channels)
+                    {
+                        out[0] = in[channels >= 3 ? 2 : 0];
+                        if (channels >= 3) { out[1] = in[1]; out[2] = in[0]; }
+                        if (channels == 4) { out[3] = in[3]; }
+                    }
+                }
+                else
+                {
+                    const ushort* in { image.ptr<ushort>(y) };
+                    for (int x {0}; x < image.cols; ++x, in += channels)
+                    {
+                        for (int c {0}; c < channels; ++c)
+                        {
+                            const ushort value { in[(channels >= 3 && c < 3) ? 2 - c : c] };
+                            *out++ = static_cast<uchar>(value >> 8);
+                            *out++ = static_cast<uchar>(value & 0xFF);
+                        }
+                    }
+                }
+            };
+
+            std::vector<uchar> filtered(filteredRowBytes * image.rows);
+
+            cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& range) {
+                std::vector<uchar> previousRow(rowBytes);
+                std::vector<uchar> row(rowBytes);
+
+                // Filters need the row above in PNG byte order, so the first row 
+                // of each stripe also converts the row above it
+                if (range.start > 0)
+                {
+                    toPNGByteOrder(range.start - 1, previousRow.data());
+                }
+
+                for (int y { range.start }; y < range.end; ++y)
+                {
+                    toPNGByteOrder(y, row.data());
+                    filterPNGRow(row.data(), y > 0 ? previousRow.data() : nullptr, rowBytes, bytesPerPixel, 
+                                 adaptiveFiltering, filtered.data() + y * filteredRowBytes);
+                    std::swap(row, previousRow);
+                }
+            });
+
+            //------------------ 2. Deflate chunks in parallel ------------------//
+
+            const std::size_t totalBytes { filtered.size() };
+            const int numberOfChunks { static_cast<int>((totalBytes + chunkSize - 1) / chunkSize) };
+            const std::size_t dictionarySize { 32 << 10 }; // size of the deflate window
+
+            std::vector<std::vector<uchar>> compressedChunks(numberOfChunks);
+            std::vector<uLong> chunkChecksums(numberOfChunks);
+            std::vector<int> chunkStatus(numberOfChunks, Z_OK);
+
+            cv::parallel_for_(cv::Range(0, numberOfChunks), [&](const cv::Range& range) {
+                for (int i { range.start }; i < range.end; ++i)
+                {
+                    const std::size_t start { i * chunkSize };
+                    const std::size_t size { std::min(chunkSize, totalBytes - start) };
+                    const bool lastChunk { i == numberOfChunks - 1 };
+
+                    chunkChecksums[i] = adler32(adler32(0L, Z_NULL, 0), filtered.data() + start, static_cast<uInt>(size));
+
+                    // Raw deflate (no zlib header or checksum) - those are written once for the whole stream
+                    z_stream stream {};
+                    int status { deflateInit2(&stream, compressionLevel, Z_DEFLATED, -15, 8, strategy) };
+                    if (status != Z_OK)
+                    {
+                        chunkStatus[i] = status;
+                        continue;
+                    }
+
+                    if (start > 0)
+                    {
+                        const std::size_t dictionaryStart { start - std::min(dictionarySize, start) };
+                        deflateSetDictionary(&stream, filtered.data() + dictionaryStart, static_cast<uInt>(start - dictionaryStart));
+                    }
+
+                    // A sync flush ends the chunk on a byte boundary with a non-final block, 
+                    // so the next chunk can simply be appended
+                    std::vector<uchar>& out { compressedChunks[i] };
+                    out.resize(deflateBound(&stream, static_cast<uLong>(size)) + 16);
+
+                    stream.next_in = filtered.data() + start;
+                    stream.avail_in = static_cast<uInt>(size);
+                    stream.next_out = out.data();
+                    stream.avail_out = static_cast<uInt>(out.size());
+
+                    status = deflate(&stream, lastChunk ? Z_FINISH : Z_SYNC_FLUSH);
+                    if ((lastChunk && (status != Z_STREAM_END)) || (!lastChunk && (status != Z_OK)) || (stream.avail_in != 0))
+                    {
+                        chunkStatus[i] = (status == Z_OK || status == Z_STREAM_END) ? Z_BUF_ERROR : status;
+                    }
+
+                    out.resize(stream.total_out);
+                    deflateEnd(&stream);
+                }
+            }, numberOfChunks);
+
+            if (std::any_of(chunkStatus.cbegin(), chunkStatus.cend(), [](int status) { return status != Z_OK; }))
+            {
+                return false;
+            }
+
+            //------------------ 3. Join the chunks into a PNG file -----------------//
+
+            std::size_t compressedBytes {0};
+            for (const auto& chunk : compressedChunks)
+            {
+                compressedBytes += chunk.size();
+            }
+
+            buffer.clear();
+            buffer.reserve(compressedBytes + 64);
+
+            static const uchar signature[8] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+            buffer.insert(buffer.end(), signature, signature + 8);
+
+            // IHDR - width, height, bit depth, colour type, compression, filter and interlace methods
+            std::vector<uchar> header;
+            appendBigEndian32(header, static_cast<uLong>(image.cols));
+            appendBigEndian32(header, static_cast<uLong>(image.rows));
+            header.push_back(static_cast<uchar>(bytesPerSample * 8));
+            header.push_back(static_cast<uchar>(channels == 1 ? 0 : (channels == 3 ? 2 : 6))); // grayscale, RGB or RGBA
+            header.push_back(0);
+            header.push_back(0);
+            header.push_back(0);
+            appendPNGChunk(buffer, "IHDR", header.data(), header.size());
+
+            // zlib stream = 2-byte header + deflate chunks + Adler-32 of the filtered data. 
+            // The header and checksum are written in their own IDAT chunks - a PNG decoder 
+            // joins the data of all IDAT chunks before decompressing it
+            const uchar compressionInfo { 0x78 }; // deflate with a 32 KB window
+            uchar flags { static_cast<uchar>((compressionLevel < 2 ? 0 : (compressionLevel < 6 ? 1 : (compressionLevel == 6 ? 2 : 3))) << 6) };
+            flags = static_cast<uchar>(flags + 31 - ((compressionInfo * 256 + flags) % 31));
+            const uchar zlibHeader[2] { compressionInfo, flags };
+            appendPNGChunk(buffer, "IDAT", zlibHeader, 2);
+
+            uLong checksum { adler32(0L, Z_NULL, 0) };
+            for (int i {0}; i < numberOfChunks; ++i)
+            {
+                const std::size_t size { std::min(chunkSize, totalBytes - i * chunkSize) };
+                checksum = adler32_combine(checksum, chunkChecksums[i], static_cast<z_off_t>(size));
+
+                appendPNGChunk(buffer, "IDAT", compressedChunks[i].data(), compressedChunks[i].size());
+            }
+
+            std::vector<uchar> trailer;
+            appendBigEndian32(trailer, checksum);
+            appendPNGChunk(buffer, "IDAT", trailer.data(), trailer.size());
+
+            appendPNGChunk(buffer, "IEND", nullptr, 0);
+
+            return true;
+        }
+
+
+        /*
+         * Helpers for encodeQOI() and decodeQOI(). A QOI file is a 14 byte header followed by 
+         * one operation (op) per pixel or run of pixels, and ends with 7 zero bytes and a one. 
+         * See https://qoiformat.org/qoi-specification.pdf
+        */
+        constexpr uchar qoiOpIndex {0x00}; // 00xxxxxx - pixel from the table of recently seen pixels
+        constexpr uchar qoiOpDiff  {0x40}; // 01rrggbb - red, green and blue differences of -2 to 1
+        constexpr uchar qoiOpLuma  {0x80}; // 10gggggg rrrrbbbb - green difference, and red and blue relative to it
+        constexpr uchar qoiOpRun   {0xC0}; // 11xxxxxx - run of 1 to 62 copies of the previous pixel
+        constexpr uchar qoiOpRGB   {0xFE}; // then red, green and blue
+        constexpr uchar qoiOpRGBA  {0xFF}; // then red, green, blue and alpha
+        constexpr uchar qoiMask    {0xC0};
+        constexpr std::size_t qoiHeaderSize {14};
+        constexpr uchar qoiEndMarker[8] { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+        struct QOIPixel
+        {
+            uchar r {0}, g {0}, b {0}, a {255};
+
+            bool operator==(const QOIPixel& other) const 
+            { 
+                return (r == other.r) && (g == other.g) && (b == other.b) && (a == other.a); 
+            }
+        };
+
+        static int qoiHash(const QOIPixel& pixel)
+        {
+            return (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+        }
+
+
+        /**
+         * @brief Compress an 8-bit image in the lossless QOI ("Quite OK Image") format. Every 
+         *        pixel is written as a run of the previous pixel, a reference to one of the last 
+         *        64 different pixels seen, a small difference from the previous pixel, or as is. 
+         *        Files are usually a little larger than PNG files, but are compressed and 
+         *        de-compressed many times faster, which suits images that are saved and read 
+         *        back soon after, such as intermediate results.
+         * 
+         *        3 and 4 channel images are standard QOI files (stored as RGB(A)). Grayscale 
+         *        images are stored with 1 channel in the header, which only decodeQOI() reads.
+         * 
+         * @param image 8-bit image with 1 (grayscale), 3 (BGR) or 4 (BGRA) channels
+         * @param buffer output buffer. Resized to fit the QOI file. Its memory is re-used, so 
+         *               passing the same buffer for every frame avoids allocations
+         * @return true if the image was compressed
+         * @return false if the image type is not supported
+         */
+        bool encodeQOI(const cv::Mat& image, std::vector<uchar>& buffer)
+        {
+            const int channels { image.channels() };
+            if (image.empty() || (image.depth() != CV_8U) || ((channels != 1) && (channels != 3) && (channels != 4)))
+            {
+                return false;
+            }
+
+            // Worst case: every pixel is written as is, with one extra byte for the op
+            const std::size_t pixels { image.total() };
+            buffer.resize(qoiHeaderSize + pixels * (std::max(channels, 3) + 1) + sizeof(qoiEndMarker));
+            uchar* out { buffer.data() };
+
+            // Header - magic, width and height (big-endian), no. of channels, colour space (0 = sRGB)
+            auto writeUInt32 = [&out](std::uint32_t value) {
+                for (int shift {24}; shift >= 0; shift -= 8)
+                {
+                    *out++ = static_cast<uchar>(value >> shift);
+                }
+            };
+            const char magic[4] { 'q', 'o', 'i', 'f' };
+            out = std::copy(std::begin(magic), std::end(magic), out);
+            writeUInt32(static_cast<std::uint32_t>(image.cols));
+            writeUInt32(static_cast<std::uint32_t>(image.rows));
+            *out++ = static_cast<uchar>(channels);
+            *out++ = 0;
+
+            QOIPixel recent[64] {};
+            QOIPixel previous;
+            int run {0};
+
+            for (int y {0}; y < image.rows; ++y)
+            {
+                const uchar* row { image.ptr<uchar>(y) };
+                for (int x {0}; x < image.cols; ++x, row += channels)
+                {
+                    // OpenCV stores colour as BGR(A), QOI as RGB(A)
+                    QOIPixel pixel;
+                    if (channels == 1)
+                    {
+                        pixel.r = pixel.g = pixel.b = row[0];
+                    }
+                    else
+                    {
+                        pixel.b = row[0];
+                        pixel.g = row[1];
+                        pixel.r = row[2];
+                        pixel.a = (channels == 4) ? row[3] : 255;
+                    }
+
+                    if (pixel == previous)
+                    {
+                        ++run;
+                        if (run == 62)
+                        {
+                            *out++ = static_cast<uchar>(qoiOpRun | (run - 1));
+                            run = 0;
+                        }
+                        continue;
+                    }
+
+                    if (run > 0)
+                    {
+                        *out++ = static_cast<uchar>(qoiOpRun | (run - 1));
+                        run = 0;
+                    }
+
+                    const int index { qoiHash(pixel) };
+                    if (recent[index] == pixel)
+                    {
+                        *out++ = static_cast<uchar>(qoiOpIndex | index);
+                    }
+                    else 
+                    {
+                        recent[index] = pixel;
+
+                        if (pixel.a == previous.a)
+                        {
+                            // Differences wrap around, e.g. 255 -> 0 is +1
+                            const int dr { static_cast<signed char>(pixel.r - previous.r) };
+                            const int dg { static_cast<signed char>(pixel.g - previous.g) };
+                            const int db { static_cast<signed char>(pixel.b - previous.b) };
+                            const int drdg { dr - dg };
+                            const int dbdg { db - dg };
+
+                            if ((dr >= -2) && (dr <= 1) && (dg >= -2) && (dg <= 1) && (db >= -2) && (db <= 1))
+                            {
+                                *out++ = static_cast<uchar>(qoiOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                            }
+                            else if ((dg >= -32) && (dg <= 31) && (drdg >= -8) && (drdg <= 7) && (dbdg >= -8) && (dbdg <= 7))
+                            {
+                                *out++ = static_cast<uchar>(qoiOpLuma | (dg + 32));
+                                *out++ = static_cast<uchar>(((drdg + 8) << 4) | (dbdg + 8));
+                            }
+                            else 
+                            {
+                                *out++ = qoiOpRGB;
+                                *out++ = pixel.r;
+                                *out++ = pixel.g;
+                                *out++ = pixel.b;
+                            }
+                        }
+                        else 
+                        {
+                            *out++ = qoiOpRGBA;
+                            *out++ = pixel.r;
+                            *out++ = pixel.g;
+                            *out++ = pixel.b;
+                            *out++ = pixel.a;
+                        }
+                    }
+
+                    previous = pixel;
+                }
+            }
+
+            if (run > 0)
+            {
+                *out++ = static_cast<uchar>(qoiOpRun | (run - 1));
+            }
+
+            out = std::copy(std::begin(qoiEndMarker), std::end(qoiEndMarker), out);
+            buffer.resize(static_cast<std::size_t>(out - buffer.data())); // keeps the memory for the next frame
+
+            return true;
+        }
+
+
+        /**
+         * @brief De-compress a QOI file held anywhere in memory, e.g. in a buffer or a memory mapped file
+         * 
+         * @param data start of QOI file
+         * @param size no. of bytes in QOI file
+         * @param image receives the 8-bit grayscale, BGR or BGRA image
+         * @return true if the image was de-compressed
+         * @return false if the data is not a valid QOI file
+         */
+        static bool decodeQOIBytes(const uchar* data, std::size_t size, cv::Mat& image)
+        {
+            if ((size < qoiHeaderSize + sizeof(qoiEndMarker)) || (data[0] != 'q') || (data[1] != 'o') || 
+                (data[2] != 'i') || (data[3] != 'f'))
+            {
+                return false;
+            }
+
+            auto readUInt32 = [data](std::size_t offset) {
+                return (static_cast<std::uint32_t>(data[offset]) << 24) | (static_cast<std::uint32_t>(data[offset + 1]) << 16) | 
+                       (static_cast<std::uint32_t>(data[offset + 2]) << 8) | data[offset + 3];
+            };
+
+            const std::uint32_t width { readUInt32(4) };
+            const std::uint32_t height { readUInt32(8) };
+            const int channels { data[12] };
+
+            // The QOI specification limits images to 400 million pixels
+            if ((width == 0) || (height == 0) || (width > INT_MAX) || (height > INT_MAX) || 
+                (static_cast<std::uint64_t>(width) * height > 400000000ULL) || 
+                ((channels != 1) && (channels != 3) && (channels != 4)))
+            {
+                return false;
+            }
+
+            image.create(static_cast<int>(height), static_cast<int>(width), CV_8UC(channels));
+
+            QOIPixel recent[64] {};
+            QOIPixel pixel;
+            int run {0};
+
+            const uchar* in { data + qoiHeaderSize };
+            const uchar* end { data + size - sizeof(qoiEndMarker) }; // no op reads into the end marker
+
+            for (int y {0}; y < image.rows; ++y)
+            {
+                uchar* row { image.ptr<uchar>(y) };
+                for (int x {0}; x < image.cols; ++x, row += channels)
+                {
+                    if (run > 0)
+                    {
+                        --run;
+                    }
+                    else 
+                    {
+                        if (in >= end)
+                        {
+                            return false; // truncated file
+                        }
+
+                        const uchar op { *in++ };
+                        if ((op == qoiOpRGB) || (op == qoiOpRGBA))
+                        {
+                            if (end - in < ((op == qoiOpRGB) ? 3 : 4))
+                            {
+                                return false;
+                            }
+                            pixel.r = *in++;
+                            pixel.g = *in++;
+                            pixel.b = *in++;
+                            if (op == qoiOpRGBA)
+                            {
+                                pixel.a = *in++;
+                            }
+                        }
+                        else if ((op & qoiMask) == qoiOpIndex)
+                        {
+                            pixel = recent[op];
+                        }
+                        else if ((op & qoiMask) == qoiOpDiff)
+                        {
+                            pixel.r = static_cast<uchar>(pixel.r + ((op >> 4) & 0x03) - 2);
+                            pixel.g = static_cast<uchar>(pixel.g + ((op >> 2) & 0x03) - 2);
+                            pixel.b = static_cast<uchar>(pixel.b + (op & 0x03) - 2);
+                        }
+                        else if ((op & qoiMask) == qoiOpLuma)
+                        {
+                            if (in >= end)
+                            {
+                                return false;
+                            }
+                            const uchar next { *in++ };
+                            const int dg { (op & 0x3F) - 32 };
+                            pixel.r = static_cast<uchar>(pixel.r + dg - 8 + ((next >> 4) & 0x0F));
+                            pixel.g = static_cast<uchar>(pixel.g + dg);
+                            pixel.b = static_cast<uchar>(pixel.b + dg - 8 + (next & 0x0F));
+                        }
+                        else // qoiOpRun
+                        {
+                            run = op & 0x3F;
+                        }
+
+                        recent[qoiHash(pixel)] = pixel;
+                    }
+
+                    if (channels == 1)
+                    {
+                        row[0] = pixel.r;
+                    }
+                    else 
+                    {
+                        row[0] = pixel.b;
+                        row[1] = pixel.g;
+                        row[2] = pixel.r;
+                        if (channels == 4)
+                        {
+                            row[3] = pixel.a;
+                        }
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief De-compress a QOI file made by encodeQOI() or any other QOI encoder
+         * 
+         * @param buffer contents of QOI file
+         * @param image receives the 8-bit grayscale, BGR or BGRA image. Its memory is re-used 
+         *              if it already has the right size and type
+         * @return true if the image was de-compressed
+         * @return false if the buffer is not a valid QOI file
+         */
+        bool decodeQOI(const std::vector<uchar>& buffer, cv::Mat& image)
+        {
+            return decodeQOIBytes(buffer.data(), buffer.size(), image);
+        }
+
+
+        /**
+         * @brief Average no. of allocations per frame. A frame is one encode and/or 
+         *        one decode, so this is 0 once the session has warmed up.
+         */
+        double CodecSession::Statistics::allocationsPerFrame() const
+        {
+            const std::size_t frames { std::max(encodeCalls, decodeCalls) };
+
+            return (frames > 0) ? static_cast<double>(encodeAllocations + decodeAllocations) / frames : 0.0;
+        }
+
+
+        /**
+         * @brief Create a session
+         * 
+         * @param numberOfEncodeBuffers no. of encode buffers used in turn. The buffer returned by 
+         *                              encode() is overwritten after this many more encode() calls
+         * @param initialEncodeCapacity no. of bytes reserved in each encode buffer up front
+         */
+        CodecSession::CodecSession(int numberOfEncodeBuffers, std::size_t initialEncodeCapacity)
+            : m_encodeBuffers(static_cast<std::size_t>(std::max(numberOfEncodeBuffers, 1)))
+        {
+            for (auto& buffer : m_encodeBuffers)
+            {
+                buffer.reserve(initialEncodeCapacity);
+            }
+        }
+
+
+        /**
+         * @brief Allocate the decode destination up front, so even the first decode() of 
+         *        an image with this size and type does not allocate memory
+         * 
+         * @param size image size 
+         * @param type image type e.g. CV_8UC3
+         */
+        void CodecSession::reserveDecode(cv::Size size, int type)
+        {
+            m_decoded.create(size, type);
+        }
+
+
+        /**
+         * @brief Compress an image into the next encode buffer with cv::imencode()
+         * 
+         * @param ext file extension (including the leading dot) that selects the codec e.g. ".jpg"
+         * @param image image to compress
+         * @param params pairs of (cv::ImwriteFlags, value) passed to cv::imencode()
+         * @return const std::vector<uchar>& compressed image. Empty if the image could not be compressed
+         */
+        const std::vector<uchar>& CodecSession::encode(const cv::String& ext, const cv::Mat& image, 
+                                                       const std::vector<int>& params)
+        {
+            std::vector<uchar>& buffer { m_encodeBuffers[m_nextEncodeBuffer] };
+            m_nextEncodeBuffer = (m_nextEncodeBuffer + 1) % m_encodeBuffers.size();
+
+            ++m_statistics.encodeCalls;
+
+            // Grow the buffer once, with some headroom, to the largest size seen so far 
+            // instead of letting the codec grow it step by step
+            if (buffer.capacity() < m_largestEncodedSize)
+            {
+                buffer.reserve(m_largestEncodedSize + m_largestEncodedSize / 4);
+                ++m_statistics.encodeAllocations;
+            }
+
+            // cv::imencode() writes into our vector. Clearing it keeps its capacity, so 
+            // memory is only allocated if the compressed image does not fit
+            const std::size_t capacity { buffer.capacity() };
+            buffer.clear();
+
+            bool result {false};
+            try 
+            {
+                result = cv::imencode(ext, image, buffer, params);
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nError compressing image: " << ex.what();
+            }
+
+            if (buffer.capacity() != capacity)
+            {
+                ++m_statistics.encodeAllocations;
+            }
+
+            if (!result)
+            {
+                buffer.clear();
+            }
+
+            m_largestEncodedSize = std::max(m_largestEncodedSize, buffer.size());
+
+            return buffer;
+        }
+
+
+        /**
+         * @brief De-compress an image into the session's destination with cv::imdecode()
+         * 
+         * @param buffer compressed image 
+         * @param flags cv::ImreadModes e.g. cv::IMREAD_UNCHANGED
+         * @return const cv::Mat& de-compressed image. It is overwritten by the next decode(), 
+         *         so clone() it to keep it. Empty if the buffer could not be de-compressed
+         */
+        const cv::Mat& CodecSession::decode(const std::vector<uchar>& buffer, int flags)
+        {
+            ++m_statistics.decodeCalls;
+
+            // cv::imdecode() calls create() on the destination, which only allocates 
+            // memory if the size or type of the image differs from the last one
+            const uchar* data { m_decoded.data };
+
+            bool result {false};
+            try 
+            {
+                // On failure the destination keeps its memory (and old contents), 
+                // so we check the returned array instead
+                result = !cv::imdecode(buffer, flags, &m_decoded).empty();
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nError de-compressing image: " << ex.what();
+            }
+
+            if (m_decoded.data != data)
+            {
+                ++m_statistics.decodeAllocations;
+            }
+
+            static const cv::Mat emptyImage;
+
+            return result ? m_decoded : emptyImage;
+        }
+
+
+        /**
+         * @brief Convert a JPEG style quality (1 - 100) to a zlib Deflate level (1 - 9), so one 
+         *        quality setting can be used with either compression
+         * 
+         * @param quality 1 to 100
+         * @return int Deflate level, or -1 if quality is out of range
+         */
+        int qualityToDeflateLevel(int quality)
+        {
+            if ((quality < 1) || (quality > 100))
+            {
+                return -1;
+            }
+
+            return 1 + static_cast<int>(std::lround((quality - 1) * 8.0 / 99.0));
+        }
+
+
+        /**
+         * @brief Check the JPEG quality and Deflate level of TIFF options. Out of range values 
+         *        are reported instead of being changed, so we never save with a setting that 
+         *        was not asked for
+         * 
+         * @param options TIFF options
+         * @return true if both are in range
+         * @return false otherwise
+         */
+        static bool validTiffQuality(const TiffWriteOptions& options)
+        {
+            if ((options.jpegQuality < 1) || (options.jpegQuality > 100) || (options.deflateLevel < 1) || (options.deflateLevel > 9))
+            {
+                std::cerr << "\nJPEG quality should be 1 to 100 and Deflate level 1 to 9 (got " 
+                          << options.jpegQuality << " and " << options.deflateLevel << ").\n";
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Set the tags that describe the size, pixel format and compression of an 
+         *        image on the current directory (page) of a TIFF file
+         * 
+         * @param tiff TIFF file open for writing
+         * @param size width and height of image
+         * @param type OpenCV type of image
+         * @param options compression, predictor and quality settings
+         */
+        static void setTiffImageTags(TIFF* tiff, const cv::Size& size, int type, const TiffWriteOptions& options)
+        {
+            const int channels { CV_MAT_CN(type) };
+            const int depth { CV_MAT_DEPTH(type) };
+            const int sampleFormat { (depth == CV_32F || depth == CV_64F) ? SAMPLEFORMAT_IEEEFP : 
+                                     ((depth == CV_8S || depth == CV_16S || depth == CV_32S) ? SAMPLEFORMAT_INT : SAMPLEFORMAT_UINT) };
+
+            TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(size.width));
+            TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(size.height));
+            TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, static_cast<int>(CV_ELEM_SIZE1(type) * 8));
+            TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, channels);
+            TIFFSetField(tiff, TIFFTAG_SAMPLEFORMAT, sampleFormat);
+            TIFFSetField(tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            TIFFSetField(tiff, TIFFTAG_PHOTOMETRIC, channels >= 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(tiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+
+            if ((channels == 2) || (channels == 4))
+            {
+                const uint16_t extraSample[] { EXTRASAMPLE_UNASSALPHA };
+                TIFFSetField(tiff, TIFFTAG_EXTRASAMPLES, 1, extraSample);
+            }
+
+            TIFFSetField(tiff, TIFFTAG_COMPRESSION, static_cast<int>(options.compression));
+            switch (options.compression)
+            {
+                case TiffCompression::jpeg:
+                    TIFFSetField(tiff, TIFFTAG_JPEGQUALITY, options.jpegQuality);
+                    break;
+                case TiffCompression::deflate:
+                    TIFFSetField(tiff, TIFFTAG_ZIPQUALITY, options.deflateLevel);
+                    [[fallthrough]];
+                case TiffCompression::lzw:
+                    // The floating point predictor only works on floating point samples
+                    if ((options.predictor == 2) || ((options.predictor == 3) && (sampleFormat == SAMPLEFORMAT_IEEEFP)))
+                    {
+                        TIFFSetField(tiff, TIFFTAG_PREDICTOR, options.predictor);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+
+        /**
+         * @brief Write one row of tiles to the current directory of a tiled TIFF file. 
+         *        Tiles at the right and bottom edges are padded with zeros
+         * 
+         * @param tiff TIFF file open for writing, with the tile size set
+         * @param rows image rows covered by the row of tiles (RGB(A) order). At most tileSize.height rows
+         * @param y image row of the first of rows. A multiple of tileSize.height
+         * @param tileSize width and height of tiles
+         * @param tile buffer for one tile. Kept by the caller so it is only allocated once
+         * @return true if all tiles were written
+         * @return false otherwise
+         */
+        static bool writeTileRow(TIFF* tiff, const cv::Mat& rows, int y, const cv::Size& tileSize, std::vector<uchar>& tile)
+        {
+            const std::size_t pixelBytes { rows.elemSize() };
+            const std::size_t tileRowBytes { tileSize.width * pixelBytes };
+            tile.resize(tileRowBytes * tileSize.height);
+
+            bool result {true};
+            for (int x {0}; (x < rows.cols) && result; x += tileSize.width)
+            {
+                // libtiff may apply the predictor in place, so the tile is refilled every time
+                std::fill(tile.begin(), tile.end(), uchar {0});
+
+                const int width { std::min(tileSize.width, rows.cols - x) };
+                for (int row {0}; row < rows.rows; ++row)
+                {
+                    const uchar* source { rows.ptr<uchar>(row) + x * pixelBytes };
+                    std::copy(source, source + width * pixelBytes, tile.data() + row * tileRowBytes);
+                }
+
+                const ttile_t index { TIFFComputeTile(tiff, static_cast<uint32_t>(x), static_cast<uint32_t>(y), 0, 0) };
+                result = TIFFWriteEncodedTile(tiff, index, tile.data(), static_cast<tmsize_t>(tile.size())) >= 0;
+            }
+
+            return result;
+        }
+
+
+        /**
+         * @brief Save images as the pages of one TIFF file using libtiff. Unlike cv::imwrite(), 
+         *        this lets us choose the predictor and store pages as tiles or in strips of a given size. 
+         *        BGR(A) images are saved as RGB(A), as cv::imwrite() does.
+         * 
+         * @param filePath full path to TIFF file (.tif or .tiff)
+         * @param pages images to save, one per page. 1 to 4 channels of any OpenCV depth except CV_16F
+         * @param options see TiffWriteOptions
+         * @return true if all pages were saved
+         * @return false if the file could not be written, or a page cannot be saved with 
+         *         the options (e.g. JPEG compression of a 16-bit image)
+         */
+        bool writeMultipageTIFF(const std::string& filePath, const std::vector<cv::Mat>& pages, 
+                                const TiffWriteOptions& options)
+        {
+            if (!validTiffQuality(options))
+            {
+                return false;
+            }
+
+            // Big TIFF ("w8") is needed once a file grows beyond 4 GB
+            std::size_t totalBytes {0};
+            for (const auto& page : pages)
+            {
+                totalBytes += page.total() * page.elemSize();
+            }
+
+            TIFF* tiff { TIFFOpen(filePath.c_str(), totalBytes > (std::size_t{3} << 30) ? "w8" : "w") };
+            if (tiff == nullptr)
+            {
+                std::cerr << "\nCould not open " << filePath << " for writing.\n";
+                return false;
+            }
+
+            bool result {true};
+
+            for (std::size_t p {0}; (p < pages.size()) && result; ++p)
+            {
+                const cv::Mat& page { pages[p] };
+                const int channels { page.channels() };
+                const int depth { page.depth() };
+
+                if (page.empty() || (page.dims != 2) || (channels > 4) || (depth == CV_16F) ||
+                    ((options.compression == TiffCompression::jpeg) && ((depth != CV_8U) || (channels == 2) || (channels == 4))))
+                {
+                    std::cerr << "\nCannot save page " << p << " (" << General::openCVDescriptiveDataType(page.type()) 
+                              << ") with the chosen TIFF options.\n";
+                    result = false;
+                    break;
+                }
+
+                // TIFF stores colour images as RGB(A)
+                cv::Mat rgb { page };
+                if (channels >= 3)
+                {
+                    rgb.create(page.size(), page.type());
+                    const int fromTo[] { 0, 2, 1, 1, 2, 0, 3, 3 };
+                    cv::mixChannels(&page, 1, &rgb, 1, fromTo, static_cast<std::size_t>(channels));
+                }
+
+                TIFFSetField(tiff, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+                TIFFSetField(tiff, TIFFTAG_PAGENUMBER, static_cast<int>(p), static_cast<int>(pages.size()));
+                setTiffImageTags(tiff, page.size(), page.type(), options);
+
+                const std::size_t rowBytes { page.cols * page.elemSize() };
+
+                if ((options.tileWidth > 0) && (options.tileHeight > 0))
+                {
+                    // Tiles must be a multiple of 16 pixels wide and high
+                    const int tileWidth { (options.tileWidth + 15) / 16 * 16 };
+                    const int tileHeight { (options.tileHeight + 15) / 16 * 16 };
+                    TIFFSetField(tiff, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tileWidth));
+                    TIFFSetField(tiff, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tileHeight));
+
+                    std::vector<uchar> tile;
+                    for (int y {0}; (y < page.rows) && result; y += tileHeight)
+                    {
+                        result = writeTileRow(tiff, rgb.rowRange(y, std::min(y + tileHeight, page.rows)), y, 
+                                              cv::Size(tileWidth, tileHeight), tile);
+                    }
+                }
+                else 
+                {
+                    // JPEG strips must hold a multiple of 16 rows
+                    uint32_t rowsPerStrip { TIFFDefaultStripSize(tiff, static_cast<uint32_t>(std::max(options.rowsPerStrip, 0))) };
+                    if (options.compression == TiffCompression::jpeg)
+                    {
+                        rowsPerStrip = (rowsPerStrip + 15) / 16 * 16;
+                    }
+                    TIFFSetField(tiff, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+
+                    // libtiff may apply the predictor in place, so each row is copied first
+                    std::vector<uchar> row(rowBytes);
+                    for (int y {0}; (y < page.rows) && result; ++y)
+                    {
+                        std::copy(rgb.ptr<uchar>(y), rgb.ptr<uchar>(y) + rowBytes, row.begin());
+                        result = TIFFWriteScanline(tiff, row.data(), static_cast<uint32_t>(y), 0) >= 0;
+                    }
+                }
+
+                result = result && TIFFWriteDirectory(tiff);
+            }
+
+            TIFFClose(tiff);
+
+            if (!result)
+            {
+                std::cerr << "\nError writing TIFF file " << filePath << '\n';
+            }
+
+            return result;
+        }
+
+
+        /**
+         * @brief Return the size of each level of a TIFF image pyramid. Each level is half 
+         *        the width and height of the level before it (rounded up), and the last 
+         *        level is the first that fits in one tile
+         * 
+         * @param imageSize width and height of full resolution image (level 0)
+         * @param tileSize width and height of tiles
+         * @return std::vector<cv::Size> size of each level, starting with the full resolution image
+         */
+        std::vector<cv::Size> pyramidLevelSizes(const cv::Size& imageSize, const cv::Size& tileSize)
+        {
+            std::vector<cv::Size> sizes { imageSize };
+
+            cv::Size size { imageSize };
+            while ((tileSize.width > 0) && (tileSize.height > 0) && 
+                   ((size.width > tileSize.width) || (size.height > tileSize.height)))
+            {
+                size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+                sizes.push_back(size);
+            }
+
+            return sizes;
+        }
+
+
+        // One level of the pyramid being written by writePyramidalTIFF()
+        struct PyramidLevel 
+        {
+            TIFF* tiff {nullptr};   // file the level is written to
+            std::string path;       // path to that file
+            cv::Size size;          // width and height of level
+            cv::Mat band;           // one row of tiles of the level
+            int bandRows {0};       // no. of rows of band filled so far
+            int y {0};              // level row of the first row of band
+            cv::Mat reduced;        // band at half size, passed on to the next level
+        };
+
+
+        /**
+         * @brief Halve the width and height of an image by averaging each 2 x 2 block of 
+         *        pixels (area interpolation). Odd widths and heights are rounded up
+         * 
+         * @param image image to reduce
+         * @param reduced receives the reduced image
+         */
+        static void halveImage(const cv::Mat& image, cv::Mat& reduced)
+        {
+            // Repeat the last column or row of odd sized images, so every output pixel 
+            // is the average of 2 x 2 input pixels
+            cv::Mat source { image };
+            if ((image.cols % 2 != 0) || (image.rows % 2 != 0))
+            {
+                cv::copyMakeBorder(image, source, 0, image.rows % 2, 0, image.cols % 2, cv::BORDER_REPLICATE);
+            }
+
+            const cv::Size size { source.cols / 2, source.rows / 2 };
+            const int depth { image.depth() };
+
+            // cv::resize() has no area interpolation for CV_8S and CV_32S images
+            if ((depth == CV_8S) || (depth == CV_32S))
+            {
+                source.convertTo(source, CV_64F);
+                cv::resize(source, reduced, size, 0, 0, cv::INTER_AREA);
+                reduced.convertTo(reduced, depth);
+            }
+            else 
+            {
+                cv::resize(source, reduced, size, 0, 0, cv::INTER_AREA);
+            }
+        }
+
+
+        /**
+         * @brief Add rows to a level of a pyramid. Each time the level has a whole row of 
+         *        tiles (or its last rows) they are written to its file, then halved and 
+         *        added to the next level
+         * 
+         * @param levels all levels of the pyramid
+         * @param l index of level to add rows to
+         * @param rows rows to add (RGB(A) order). The next rows of the level
+         * @param tileSize width and height of tiles
+         * @param tile buffer for one tile, shared by all levels
+         * @return true if all tiles completed by the rows were written
+         * @return false otherwise
+         */
+        static bool addPyramidRows(std::vector<PyramidLevel>& levels, std::size_t l, const cv::Mat& rows, 
+                                   const cv::Size& tileSize, std::vector<uchar>& tile)
+        {
+            PyramidLevel& level { levels[l] };
+
+            for (int offset {0}; offset < rows.rows; )
+            {
+                const int count { std::min(level.band.rows - level.bandRows, rows.rows - offset) };
+                rows.rowRange(offset, offset + count).copyTo(level.band.rowRange(level.bandRows, level.bandRows + count));
+                level.bandRows += count;
+                offset += count;
+
+                if ((level.bandRows < level.band.rows) && (level.y + level.bandRows < level.size.height))
+                {
+                    continue;
+                }
+
+                const cv::Mat band { level.band.rowRange(0, level.bandRows) };
+                if (!writeTileRow(level.tiff, band, level.y, tileSize, tile))
+                {
+                    return false;
+                }
+
+                if (l + 1 < levels.size())
+                {
+                    halveImage(band, level.reduced);
+                    if (!addPyramidRows(levels, l + 1, level.reduced, tileSize, tile))
+                    {
+                        return false;
+                    }
+                }
+
+                level.y += level.bandRows;
+                level.bandRows = 0;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Copy the compressed tiles of the first page of one TIFF file to the current 
+         *        page of another, without decompressing them. The tags of the current page 
+         *        must already be set to match
+         * 
+         * @param inputPath full path to TIFF file to copy from
+         * @param output TIFF file open for writing
+         * @return true if all tiles were copied and the page was written
+         * @return false otherwise
+         */
+        static bool copyRawTiles(const std::string& inputPath, TIFF* output)
+        {
+            TIFF* input { TIFFOpen(inputPath.c_str(), "r") };
+            if (input == nullptr)
+            {
+                return false;
+            }
+
+            uint64_t* byteCounts {nullptr};
+            bool result { TIFFGetField(input, TIFFTAG_TILEBYTECOUNTS, &byteCounts) == 1 };
+
+            std::vector<uchar> buffer;
+            const uint32_t tiles { TIFFNumberOfTiles(input) };
+            for (uint32_t t {0}; (t < tiles) && result; ++t)
+            {
+                const tmsize_t size { static_cast<tmsize_t>(byteCounts[t]) };
+                buffer.resize(static_cast<std::size_t>(size));
+                result = (TIFFReadRawTile(input, t, buffer.data(), size) == size) && 
+                         (TIFFWriteRawTile(output, t, buffer.data(), size) == size);
+            }
+
+            TIFFClose(input);
+
+            return result && TIFFWriteDirectory(output);
+        }
+
+
+        /**
+         * @brief Save an image as a tiled pyramidal TIFF file. The first page holds the full 
+         *        resolution image, and each following page (marked as a reduced resolution 
+         *        image) is half the width and height of the page before it, down to a page 
+         *        that fits in one tile. A viewer can then show any part of the image at any 
+         *        zoom by reading a few tiles from the page closest to the zoom.
+         * 
+         *        All levels are made in one pass over the image, one row of tiles at a time. 
+         *        Reduced levels are written to temporary files next to filePath as their rows 
+         *        are completed, then their compressed tiles are copied to the end of the file, 
+         *        so only one row of tiles per level is held in memory.
+         * 
+         * @param filePath full path to TIFF file (.tif or .tiff)
+         * @param image image to save. 1 to 4 channels of any OpenCV depth except CV_16F. 
+         *              BGR(A) images are saved as RGB(A)
+         * @param options see TiffWriteOptions. Tile width and height default to 256, and 
+         *                rowsPerStrip is not used. JPEG compression is not supported
+         * @return true if the image was saved
+         * @return false otherwise
+         */
+        bool writePyramidalTIFF(const std::string& filePath, const cv::Mat& image, const TiffWriteOptions& options)
+        {
+            if (!validTiffQuality(options))
+            {
+                return false;
+            }
+
+            const int channels { image.channels() };
+
+            if (image.empty() || (image.dims != 2) || (channels > 4) || (image.depth() == CV_16F) || 
+                (options.compression == TiffCompression::jpeg))
+            {
+                std::cerr << "\nCannot save " << General::openCVDescriptiveDataType(image.type()) 
+                          << " image as a pyramidal TIFF with the chosen options.\n";
+                return false;
+            }
+
+            // Tiles must be a multiple of 16 pixels wide and high
+            const cv::Size tileSize { options.tileWidth > 0 ? (options.tileWidth + 15) / 16 * 16 : 256, 
+                                      options.tileHeight > 0 ? (options.tileHeight + 15) / 16 * 16 : 256 };
+            const std::vector<cv::Size> levelSizes { pyramidLevelSizes(image.size(), tileSize) };
+
+            // The reduced levels add at most a third to the size of the file
+            const bool bigTiff { image.total() * image.elemSize() / 3 * 4 > (std::size_t{3} << 30) };
+
+            auto setLevelTags = [&](TIFF* tiff, std::size_t l) {
+                TIFFSetField(tiff, TIFFTAG_SUBFILETYPE, l > 0 ? FILETYPE_REDUCEDIMAGE : 0);
+                setTiffImageTags(tiff, levelSizes[l], image.type(), options);
+                TIFFSetField(tiff, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tileSize.width));
+                TIFFSetField(tiff, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tileSize.height));
+            };
+
+            bool result {true};
+
+            std::vector<PyramidLevel> levels(levelSizes.size());
+            for (std::size_t l {0}; (l < levels.size()) && result; ++l)
+            {
+                PyramidLevel& level { levels[l] };
+                level.path = (l == 0) ? filePath : filePath + ".level" + std::to_string(l) + ".tmp";
+                level.size = levelSizes[l];
+                level.band.create(std::min(tileSize.height, level.size.height), level.size.width, image.type());
+
+                level.tiff = TIFFOpen(level.path.c_str(), bigTiff ? "w8" : "w");
+                if (level.tiff == nullptr)
+                {
+                    std::cerr << "\nCould not open " << level.path << " for writing.\n";
+                    result = false;
+                    break;
+                }
+
+                setLevelTags(level.tiff, l);
+            }
+
+            // Pass the image through the pyramid one row of tiles at a time
+            std::vector<uchar> tile;
+            cv::Mat rgb;
+            for (int y {0}; (y < image.rows) && result; y += tileSize.height)
+            {
+                cv::Mat rows { image.rowRange(y, std::min(y + tileSize.height, image.rows)) };
+
+                // TIFF stores colour images as RGB(A)
+                if (channels >= 3)
+                {
+                    rgb.create(rows.size(), rows.type());
+                    const int fromTo[] { 0, 2, 1, 1, 2, 0, 3, 3 };
+                    cv::mixChannels(&rows, 1, &rgb, 1, fromTo, static_cast<std::size_t>(channels));
+                    rows = rgb;
+                }
+
+                result = addPyramidRows(levels, 0, rows, tileSize, tile);
+            }
+
+            // Finish the full resolution page, then append the reduced levels one page each
+            result = result && TIFFWriteDirectory(levels[0].tiff);
+
+            for (std::size_t l {1}; l < levels.size(); ++l)
+            {
+                if (levels[l].tiff != nullptr)
+                {
+                    result = result && TIFFWriteDirectory(levels[l].tiff);
+                    TIFFClose(levels[l].tiff);
+
+                    if (result)
+                    {
+                        setLevelTags(levels[0].tiff, l);
+                        result = copyRawTiles(levels[l].path, levels[0].tiff);
+                    }
+                }
+
+                std::error_code error;
+                std::filesystem::remove(levels[l].path, error);
+            }
+
+            if (levels[0].tiff != nullptr)
+            {
+                TIFFClose(levels[0].tiff);
+            }
+
+            if (!result)
+            {
+                std::cerr << "\nError writing TIFF file " << filePath << '\n';
+            }
+
+            return result;
+        }
+
+
+        // Primes used by xxHash (XXH64)
+        constexpr std::uint64_t xxPrime1 {11400714785074694791ULL};
+        constexpr std::uint64_t xxPrime2 {14029467366897019727ULL};
+        constexpr std::uint64_t xxPrime3 {1609587929392839161ULL};
+        constexpr std::uint64_t xxPrime4 {9650029242287828579ULL};
+        constexpr std::uint64_t xxPrime5 {2870177450012600261ULL};
+
+        static std::uint64_t rotateLeft(std::uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        // Read 8 or 4 little-endian bytes (every platform OpenCV runs on is little-endian)
+        static std::uint64_t read64(const uchar* p) { std::uint64_t value; std::memcpy(&value, p, 8); return value; }
+        static std::uint64_t read32(const uchar* p) { std::uint32_t value; std::memcpy(&value, p, 4); return value; }
+
+        static std::uint64_t xxRound(std::uint64_t accumulator, std::uint64_t input)
+        {
+            return rotateLeft(accumulator + input * xxPrime2, 31) * xxPrime1;
+        }
+
+        static std::uint64_t xxMergeRound(std::uint64_t hash, std::uint64_t accumulator)
+        {
+            return (hash ^ xxRound(0, accumulator)) * xxPrime1 + xxPrime4;
+        }
+
+
+        /**
+         * @brief Compute the 64-bit xxHash (XXH64) of the contents of a file. xxHash reads
+         *        several GB/s, so hashing a file costs far less than decoding it
+         *
+         * @param filePath full path to file
+         * @return std::optional<std::uint64_t> hash, or std::nullopt if the file could not be read
+         */
+        std::optional<std::uint64_t> hashFileContents(const std::string& filePath)
+        {
+            std::ifstream file(filePath, std::ios::in | std::ios::binary);
+            if (!file)
+            {
+                return std::nullopt;
+            }
+
+            // The file is read in chunks that hold a whole no. of 32 byte stripes, so
+            // only the last chunk can end with a partial stripe
+            constexpr std::size_t chunkSize {std::size_t{1} << 20};
+            std::vector<uchar> chunk(chunkSize);
+
+            std::uint64_t accumulators[4] { xxPrime1 + xxPrime2, xxPrime2, 0, 0 - xxPrime1 }; // seed = 0
+            std::uint64_t totalLength {0};
+            std::size_t tailLength {0};
+
+            while (file)
+            {
+                file.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(chunkSize));
+                const std::size_t length { static_cast<std::size_t>(file.gcount()) };
+                totalLength += length;
+
+                const std::size_t stripes { length / 32 };
+                for (std::size_t s {0}; s < stripes; ++s)
+                {
+                    const uchar* stripe { chunk.data() + s * 32 };
+                    for (int lane {0}; lane < 4; ++lane)
+                    {
+                        accumulators[lane] = xxRound(accumulators[lane], read64(stripe + lane * 8));
+                    }
+                }
+
+                tailLength = length - stripes * 32;
+                if (length < chunkSize)
+                {
+                    break;
+                }
+            }
+
+            if (file.bad())
+            {
+                return std::nullopt;
+            }
+
+            std::uint64_t hash {0};
+            if (totalLength >= 32)
+            {
+                hash = rotateLeft(accumulators[0], 1) + rotateLeft(accumulators[1], 7) +
+                       rotateLeft(accumulators[2], 12) + rotateLeft(accumulators[3], 18);
+                for (std::uint64_t accumulator : accumulators)
+                {
+                    hash = xxMergeRound(hash, accumulator);
+                }
+            }
+            else
+            {
+                hash = xxPrime5;
+            }
+
+            hash += totalLength;
+
+            // Mix in the bytes after the last whole stripe. They are at the end of the last chunk read
+            const uchar* p { chunk.data() + (totalLength % chunkSize == 0 && totalLength > 0 ? chunkSize : totalLength % chunkSize) - tailLength };
+            for (; tailLength >= 8; tailLength -= 8, p += 8)
+            {
+                hash = rotateLeft(hash ^ xxRound(0, read64(p)), 27) * xxPrime1 + xxPrime4;
+            }
+            if (tailLength >= 4)
+            {
+                hash = rotateLeft(hash ^ (read32(p) * xxPrime1), 23) * xxPrime2 + xxPrime3;
+                tailLength -= 4;
+                p += 4;
+            }
+            for (; tailLength > 0; --tailLength, ++p)
+            {
+                hash = rotateLeft(hash ^ (*p * xxPrime5), 11) * xxPrime1;
+            }
+
+            // Final avalanche
+            hash ^= hash >> 33;
+            hash *= xxPrime2;
+            hash ^= hash >> 29;
+            hash *= xxPrime3;
+            hash ^= hash >> 32;
+
+            return hash;
+        }
+
+
+        /**
+         * @brief Return a normalised absolute path, so the same file always gets the same manifest key
+         *
+         * @param path relative or absolute path
+         * @return std::string normalised absolute path
+         */
+        static std::string manifestKey(const std::string& path)
+        {
+            std::error_code error;
+            const std::filesystem::path absolutePath { std::filesystem::absolute(path, error) };
+
+            return (error ? std::filesystem::path(path) : absolutePath).lexically_normal().string();
+        }
+
+
+        /**
+         * @brief Read the size and modification time of a file
+         *
+         * @param path full path to file
+         * @param entry receives the size and modification time
+         * @return true if the file exists and is a regular file
+         * @return false otherwise
+         */
+        static bool readFileStatus(const std::string& path, ProcessingManifest::Entry& entry)
+        {
+            std::error_code error;
+            if (!std::filesystem::is_regular_file(path, error))
+            {
+                return false;
+            }
+
+            entry.size = std::filesystem::file_size(path, error);
+            const auto modifiedTime { std::filesystem::last_write_time(path, error) };
+            entry.modifiedTime = static_cast<std::int64_t>(modifiedTime.time_since_epoch().count());
+
+            return !error;
+        }
+
+
+        /**
+         * @brief Read a whole string as an integer without throwing, so a damaged manifest entry
+         *        is dropped instead of stopping the program
+         *
+         * @param text digits, with no leading or trailing characters
+         * @param value receives the integer
+         * @param base 10, or 16 for hashes
+         * @return true if all of 'text' is a valid integer that fits in 'value'
+         * @return false otherwise
+         */
+        template <typename T>
+        static bool parseInteger(const std::string& text, T& value, int base = 10)
+        {
+            const char* const end { text.data() + text.size() };
+            const auto [last, error] = std::from_chars(text.data(), end, value, base);
+
+            return !text.empty() && (error == std::errc()) && (last == end);
+        }
+
+
+        /**
+         * @brief Load a manifest. A manifest file that does not exist yet is an empty manifest. 
+         *        A damaged entry is dropped, so its input counts as changed and is processed again
+         *
+         * @param manifestPath full path to manifest file (.xml, .yml, .yaml or .json)
+         */
+        ProcessingManifest::ProcessingManifest(const std::string& manifestPath)
+            : m_manifestPath {manifestPath}
+        {
+            if (!std::filesystem::exists(manifestPath))
+            {
+                return;
+            }
+
+            // A manifest that cannot be parsed at all (e.g. cut short) is treated as empty, 
+            // so every input is processed again
+            cv::FileStorage fs;
+            try 
+            {
+                fs.open(manifestPath, cv::FileStorage::READ);
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nCould not read manifest file " << manifestPath << ": " << ex.what() << '\n';
+
+                return;
+            }
+
+            if (!fs.isOpened())
+            {
+                std::cerr << "\nCould not open manifest file for reading: " << manifestPath << '\n';
+
+                return;
+            }
+
+            // cv::FileStorage has no 64-bit integers, so the hash, time and size are stored as text
+            std::size_t dropped {0};
+            cv::FileNode files { fs["files"] };
+            for (cv::FileNodeIterator it = files.begin(); it != files.end(); ++it)
+            {
+                const cv::FileNode node { *it };
+                const std::string input { static_cast<std::string>(node["input"]) }; // empty if missing
+
+                Entry entry;
+                if (input.empty() || 
+                    !parseInteger(static_cast<std::string>(node["hash"]), entry.hash, 16) || 
+                    !parseInteger(static_cast<std::string>(node["modifiedTime"]), entry.modifiedTime) || 
+                    !parseInteger(static_cast<std::string>(node["size"]), entry.size))
+                {
+                    ++dropped;
+                    continue;
+                }
+
+                entry.output = static_cast<std::string>(node["output"]);
+                entry.settings = static_cast<std::string>(node["settings"]);
+
+                m_entries[input] = entry;
+            }
+
+            if (dropped > 0)
+            {
+                std::cerr << "\nWarning: Dropped " << dropped << " damaged entries from manifest " << manifestPath 
+                          << ". Their inputs will be processed again.\n";
+            }
+
+            fs.release();
+        }
+
+
+        /**
+         * @brief Check if an input was already processed into output with the same settings,
+         *        and has not changed since
+         *
+         * @param inputPath full path to input file
+         * @param outputPath full path to output produced from the input
+         * @param settings settings the output is produced with
+         * @return true if the input can be skipped
+         * @return false if the input must be processed
+         */
+        bool ProcessingManifest::isUpToDate(const std::string& inputPath, const std::string& outputPath, const std::string& settings)
+        {
+            const std::string key { manifestKey(inputPath) };
+
+            Entry current;
+            const auto found { m_entries.find(key) };
+
+            bool upToDate { readFileStatus(inputPath, current) && (found != m_entries.end()) &&
+                            (found->second.output == manifestKey(outputPath)) && (found->second.settings == settings) &&
+                            (found->second.size == current.size) && std::filesystem::exists(outputPath) };
+
+            // Same size but a different modification time - compare the contents
+            if (upToDate && (found->second.modifiedTime != current.modifiedTime))
+            {
+                ++m_statistics.hashed;
+
+                const auto hash { hashFileContents(inputPath) };
+                upToDate = hash && (*hash == found->second.hash);
+
+                if (hash)
+                {
+                    current.hash = *hash;
+                    m_checked[key] = current;
+                }
+
+                // Remember the new time, so the next run does not hash the file again
+                if (upToDate)
+                {
+                    found->second.modifiedTime = current.modifiedTime;
+                }
+            }
+
+            ++(upToDate ? m_statistics.upToDate : m_statistics.outOfDate);
+
+            return upToDate;
+        }
+
+
+        /**
+         * @brief Record that an input was processed. Call save() to keep the manifest for the next run
+         *
+         * @param inputPath full path to input file
+         * @param outputPath full path to output produced from the input
+         * @param settings settings the output was produced with
+         * @return true if the input was recorded
+         * @return false if the input file could not be read
+         */
+        bool ProcessingManifest::record(const std::string& inputPath, const std::string& outputPath, const std::string& settings)
+        {
+            const std::string key { manifestKey(inputPath) };
+
+            Entry entry;
+            if (!readFileStatus(inputPath, entry))
+            {
+                return false;
+            }
+
+            // Re-use the hash from isUpToDate() if the file has not changed since
+            const auto checked { m_checked.find(key) };
+            if ((checked != m_checked.end()) && (checked->second.size == entry.size) &&
+                (checked->second.modifiedTime == entry.modifiedTime))
+            {
+                entry.hash = checked->second.hash;
+            }
+            else
+            {
+                const auto hash { hashFileContents(inputPath) };
+                if (!hash)
+                {
+                    return false;
+                }
+                entry.hash = *hash;
+            }
+
+            entry.output = manifestKey(outputPath);
+            entry.settings = settings;
+            m_entries[key] = entry;
+
+            return true;
+        }
+
+
+        /**
+         * @brief Return the inputs recorded as producing an output e.g. the pages of a multi-page file
+         *
+         * @param outputPath full path to output
+         * @return std::vector<std::string> full paths to inputs, in alphabetical order
+         */
+        std::vector<std::string> ProcessingManifest::inputsOf(const std::string& outputPath) const
+        {
+            const std::string output { manifestKey(outputPath) };
+
+            std::vector<std::string> inputs;
+            for (const auto& [input, entry] : m_entries)
+            {
+                if (entry.output == output)
+                {
+                    inputs.push_back(input);
+                }
+            }
+
+            return inputs;
+        }
+
+
+        /**
+         * @brief Forget every input recorded as producing an output, e.g. before a
+         *        multi-page file is written again from a different set of inputs
+         *
+         * @param outputPath full path to output
+         */
+        void ProcessingManifest::forgetOutput(const std::string& outputPath)
+        {
+            const std::string output { manifestKey(outputPath) };
+
+            for (auto it = m_entries.begin(); it != m_entries.end(); )
+            {
+                it = (it->second.output == output) ? m_entries.erase(it) : std::next(it);
+            }
+        }
+
+
+        /**
+         * @brief Save the manifest to the file it was loaded from
+         *
+         * @return true if the manifest was saved
+         * @return false otherwise
+         */
+        bool ProcessingManifest::save() const
+        {
+            cv::FileStorage fs(m_manifestPath, cv::FileStorage::WRITE);
+            if (!fs.isOpened())
+            {
+                std::cerr << "\nCould not open manifest file for writing: " << m_manifestPath << '\n';
+
+                return false;
+            }
+
+            fs << "files" << "[";
+            for (const auto& [input, entry] : m_entries)
+            {
+                std::ostringstream hash;
+                hash << std::hex << std::setw(16) << std::setfill('0') << entry.hash;
+
+                fs << "{" << "input" << input
+                   << "hash" << hash.str()
+                   << "modifiedTime" << std::to_string(entry.modifiedTime)
+                   << "size" << std::to_string(entry.size)
+                   << "output" << entry.output
+                   << "settings" << entry.settings << "}";
+            }
+            fs << "]";
+
+            fs.release();
+
+            return true;
+        }
+
+        /**
+         * @brief Closes a libtiff file handle. Lets us keep the handle in a std::unique_ptr
+         *        without including tiffio.h in this header
+         */
+        void TiffCloser::operator()(tiff* handle) const
+        {
+            TIFFClose(handle);
+        }
+
+
+        /**
+         * @brief Find the OpenCV type of the pixels of the current page of a TIFF file. 
+         *        JPEG compressed YCbCr pages are set up to be decoded as RGB
+         * 
+         * @param file TIFF file open for reading
+         * @param rgb set to true if the page stores colour as RGB(A)
+         * @return int OpenCV type, or -1 if the pixel layout is not supported
+         */
+        static int tiffPixelType(TIFF* file, bool& rgb)
+        {
+            uint16_t bitsPerSample {0}, samplesPerPixel {0}, sampleFormat {0}, planarConfig {0}, photometric {0}, compression {0};
+            TIFFGetFieldDefaulted(file, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+            TIFFGetFieldDefaulted(file, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+            TIFFGetFieldDefaulted(file, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+            TIFFGetFieldDefaulted(file, TIFFTAG_PLANARCONFIG, &planarConfig);
+            TIFFGetFieldDefaulted(file, TIFFTAG_COMPRESSION, &compression);
+            TIFFGetField(file, TIFFTAG_PHOTOMETRIC, &photometric);
+
+            // Match the TIFF sample format and size to an OpenCV depth
+            int depth {-1};
+            switch (sampleFormat * 100 + bitsPerSample)
+            {
+                case SAMPLEFORMAT_UINT * 100 + 8:    depth = CV_8U;  break;
+                case SAMPLEFORMAT_INT * 100 + 8:     depth = CV_8S;  break;
+                case SAMPLEFORMAT_UINT * 100 + 16:   depth = CV_16U; break;
+                case SAMPLEFORMAT_INT * 100 + 16:    depth = CV_16S; break;
+                case SAMPLEFORMAT_INT * 100 + 32:    depth = CV_32S; break;
+                case SAMPLEFORMAT_IEEEFP * 100 + 32: depth = CV_32F; break;
+                case SAMPLEFORMAT_IEEEFP * 100 + 64: depth = CV_64F; break;
+                default: break;
+            }
+
+            // JPEG compressed files usually store YCbCr. libtiff converts it back to RGB for us
+            if ((photometric == PHOTOMETRIC_YCBCR) && (compression == COMPRESSION_JPEG))
+            {
+                TIFFSetField(file, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+                photometric = PHOTOMETRIC_RGB;
+            }
+
+            if ((depth < 0) || (samplesPerPixel < 1) || (samplesPerPixel > 4) || (planarConfig != PLANARCONFIG_CONTIG) ||
+                ((photometric != PHOTOMETRIC_MINISBLACK) && (photometric != PHOTOMETRIC_RGB)))
+            {
+                return -1;
+            }
+
+            rgb = (photometric == PHOTOMETRIC_RGB) && (samplesPerPixel >= 3);
+
+            return CV_MAKETYPE(depth, samplesPerPixel);
+        }
+
+
+        /**
+         * @brief Open a TIFF file and find its resolution levels. Use isOpen() to check if it succeeded
+         * 
+         * @param filePath full path to TIFF file
+         */
+        TiffPyramidReader::TiffPyramidReader(const std::string& filePath)
+            : m_tiff { TIFFOpen(filePath.c_str(), "r") }
+        {
+            if (!m_tiff)
+            {
+                std::cerr << "\nCould not open TIFF file " << filePath << '\n';
+                return;
+            }
+
+            TIFF* file { m_tiff.get() };
+            std::size_t largestTileBytes {0};
+
+            const int pages { static_cast<int>(TIFFNumberOfDirectories(file)) };
+            for (int directory {0}; (directory < pages) && TIFFSetDirectory(file, static_cast<tdir_t>(directory)); ++directory)
+            {
+                uint32_t width {0}, height {0}, subfileType {0};
+                TIFFGetField(file, TIFFTAG_IMAGEWIDTH, &width);
+                TIFFGetField(file, TIFFTAG_IMAGELENGTH, &height);
+                TIFFGetFieldDefaulted(file, TIFFTAG_SUBFILETYPE, &subfileType);
+
+                bool rgb {false};
+                const int type { tiffPixelType(file, rgb) };
+
+                Level level;
+                level.directory = directory;
+                level.size = cv::Size(static_cast<int>(width), static_cast<int>(height));
+                level.tiled = TIFFIsTiled(file) != 0;
+
+                if (directory == 0)
+                {
+                    if ((width == 0) || (height == 0) || (type < 0))
+                    {
+                        std::cerr << "\nUnsupported TIFF pixel layout in " << filePath
+                                  << ". Only 1 to 4 interleaved grey or RGB channels can be read.\n";
+                        m_tiff.reset();
+                        return;
+                    }
+
+                    m_type = type;
+                    m_rgb = rgb;
+                }
+                // Other pages are levels only if they are smaller, reduced resolution copies 
+                // of the image. Anything else (e.g. the pages of a multi-page file) is skipped
+                else if (((subfileType & FILETYPE_REDUCEDIMAGE) == 0) || (type != m_type) || (rgb != m_rgb) ||
+                         (level.size.width == 0) || (level.size.height == 0) ||
+                         (level.size.width >= m_levels.back().size.width) || (level.size.height >= m_levels.back().size.height))
+                {
+                    continue;
+                }
+
+                if (level.tiled)
+                {
+                    uint32_t tileWidth {0}, tileHeight {0};
+                    TIFFGetField(file, TIFFTAG_TILEWIDTH, &tileWidth);
+                    TIFFGetField(file, TIFFTAG_TILELENGTH, &tileHeight);
+                    level.tileSize = cv::Size(static_cast<int>(tileWidth), static_cast<int>(tileHeight));
+                }
+                else
+                {
+                    uint32_t rowsPerStrip {0};
+                    TIFFGetFieldDefaulted(file, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+                    level.tileSize = cv::Size(level.size.width, static_cast<int>(std::min(rowsPerStrip, height)));
+                }
+
+                largestTileBytes = std::max(largestTileBytes, static_cast<std::size_t>(level.tileSize.area()) * CV_ELEM_SIZE(m_type));
+                m_levels.push_back(level);
+            }
+
+            m_tileBuffer.resize(largestTileBytes);
+        }
+
+
+        /**
+         * @brief Return the no. of tile columns and rows of a level
+         */
+        cv::Size TiffPyramidReader::tileGrid(int level) const
+        {
+            const Level& current { m_levels[level] };
+
+            return cv::Size((current.size.width + current.tileSize.width - 1) / current.tileSize.width, 
+                            (current.size.height + current.tileSize.height - 1) / current.tileSize.height);
+        }
+
+
+        /**
+         * @brief Make a level the current TIFF directory, unless it already is
+         */
+        bool TiffPyramidReader::selectLevel(int level)
+        {
+            if (level == m_currentLevel)
+            {
+                return true;
+            }
+
+            TIFF* file { m_tiff.get() };
+            m_currentLevel = -1;
+
+            if (!TIFFSetDirectory(file, static_cast<tdir_t>(m_levels[level].directory)))
+            {
+                return false;
+            }
+
+            // Changing directory resets the JPEG colour mode
+            bool rgb {false};
+            tiffPixelType(file, rgb);
+
+            m_currentLevel = level;
+
+            return true;
+        }
+
+
+        /**
+         * @brief Decode one tile. Colour images are returned in BGR(A) order
+         * 
+         * @param level resolution level
+         * @param column column of tile in the tile grid of the level
+         * @param row row of tile in the tile grid of the level
+         * @param tile receives the tile. Tiles at the right and bottom edges are cropped to the image
+         * @return true if the tile was decoded
+         * @return false otherwise
+         */
+        bool TiffPyramidReader::readTile(int level, int column, int row, cv::Mat& tile)
+        {
+            if (!isOpen() || (level < 0) || (level >= levels()))
+            {
+                return false;
+            }
+
+            const cv::Size grid { tileGrid(level) };
+            if ((column < 0) || (row < 0) || (column >= grid.width) || (row >= grid.height) || !selectLevel(level))
+            {
+                return false;
+            }
+
+            const Level& current { m_levels[level] };
+            TIFF* file { m_tiff.get() };
+            const tmsize_t tileBytes { static_cast<tmsize_t>(current.tileSize.area()) * CV_ELEM_SIZE(m_type) };
+
+            tmsize_t decoded {-1};
+            if (current.tiled)
+            {
+                const ttile_t index { TIFFComputeTile(file, static_cast<uint32_t>(column * current.tileSize.width),
+                                                      static_cast<uint32_t>(row * current.tileSize.height), 0, 0) };
+                decoded = TIFFReadEncodedTile(file, index, m_tileBuffer.data(), tileBytes);
+            }
+            else
+            {
+                decoded = TIFFReadEncodedStrip(file, static_cast<uint32_t>(row), m_tileBuffer.data(), tileBytes);
+            }
+
+            if (decoded < 0)
+            {
+                return false;
+            }
+
+            ++m_tilesDecoded;
+
+            // Tiles at the right and bottom edges are padded beyond the image
+            const cv::Rect area { cv::Rect(column * current.tileSize.width, row * current.tileSize.height, 
+                                           current.tileSize.width, current.tileSize.height) & 
+                                  cv::Rect(0, 0, current.size.width, current.size.height) };
+            const cv::Mat decodedTile { cv::Mat(current.tileSize, m_type, m_tileBuffer.data())(cv::Rect(0, 0, area.width, area.height)) };
+
+            if (m_rgb)
+            {
+                // RGB(A) -> BGR(A)
+                tile.create(area.size(), m_type);
+                const int fromTo[] { 0, 2, 1, 1, 2, 0, 3, 3 };
+                cv::mixChannels(&decodedTile, 1, &tile, 1, fromTo, static_cast<std::size_t>(CV_MAT_CN(m_type)));
+            }
+            else 
+            {
+                decodedTile.copyTo(tile);
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Look up a tile, and make it the most recently used
+         * 
+         * @param key tile to look up
+         * @return const cv::Mat* the tile, or nullptr if it is not in the cache
+         */
+        const cv::Mat* TileCache::find(const TileKey& key)
+        {
+            const auto found { m_index.find(key) };
+            if (found == m_index.end())
+            {
+                ++m_statistics.misses;
+                return nullptr;
+            }
+
+            ++m_statistics.hits;
+
+            // Move the tile to the front of the list. splice() keeps every iterator valid
+            m_tiles.splice(m_tiles.begin(), m_tiles, found->second);
+
+            return &found->second->second;
+        }
+
+
+        /**
+         * @brief Add a tile as the most recently used, removing the least recently used 
+         *        tiles until it fits. A tile larger than the capacity is not added
+         * 
+         * @param key tile
+         * @param tile decoded tile
+         */
+        void TileCache::insert(const TileKey& key, cv::Mat tile)
+        {
+            // Replace an older copy of the tile
+            const auto found { m_index.find(key) };
+            if (found != m_index.end())
+            {
+                m_bytes -= found->second->second.total() * found->second->second.elemSize();
+                m_tiles.erase(found->second);
+                m_index.erase(found);
+            }
+
+            const std::size_t tileBytes { tile.total() * tile.elemSize() };
+            if (tileBytes > m_capacity)
+            {
+                return;
+            }
+
+            while (m_bytes + tileBytes > m_capacity)
+            {
+                const auto& [oldestKey, oldestTile] = m_tiles.back();
+                m_bytes -= oldestTile.total() * oldestTile.elemSize();
+                m_index.erase(oldestKey);
+                m_tiles.pop_back();
+                ++m_statistics.evictions;
+            }
+
+            m_tiles.emplace_front(key, std::move(tile));
+            m_index[key] = m_tiles.begin();
+            m_bytes += tileBytes;
+        }
+
+
+        /**
+         * @brief Find the pixels of a binary PGM (P5) or PPM (P6) file
+         * 
+         * @param data contents of file
+         * @param length no. of bytes in file
+         * @param size receives image width and height
+         * @param type receives OpenCV type of the pixels
+         * @param offset receives offset of the first pixel
+         * @return true if the file is an 8-bit PGM or PPM file
+         * @return false otherwise, including 16-bit files which are stored big-endian
+         */
+        static bool findPnmPixels(const uchar* data, std::size_t length, cv::Size& size, int& type, std::size_t& offset)
+        {
+            if ((length < 2) || (data[0] != 'P') || ((data[1] != '5') && (data[1] != '6')))
+            {
+                return false;
+            }
+
+            // Width, height and maximum value are separated by whitespace, and '#' starts a comment
+            std::size_t position {2};
+            long long values[3] {};
+            for (long long& value : values)
+            {
+                while (position < length)
+                {
+                    if (data[position] == '#')
+                    {
+                        while ((position < length) && (data[position] != '\n') && (data[position] != '\r'))
+                        {
+                            ++position;
+                        }
+                    }
+                    else if (std::isspace(data[position]))
+                    {
+                        ++position;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                if ((position >= length) || !std::isdigit(data[position]))
+                {
+                    return false;
+                }
+                while ((position < length) && std::isdigit(data[position]) && (value <= INT_MAX))
+                {
+                    value = value * 10 + (data[position++] - '0');
+                }
+            }
+
+            // A single whitespace character separates the maximum value from the pixels
+            if ((position >= length) || !std::isspace(data[position]) || (values[0] <= 0) || (values[1] <= 0) || 
+                (values[0] > INT_MAX) || (values[1] > INT_MAX) || (values[2] <= 0) || (values[2] > 255))
+            {
+                return false;
+            }
+
+            const int channels { (data[1] == '6') ? 3 : 1 };
+            offset = position + 1;
+            size = cv::Size(static_cast<int>(values[0]), static_cast<int>(values[1]));
+            type = CV_8UC(channels);
+
+            return length - offset >= static_cast<std::size_t>(size.width) * size.height * channels;
+        }
+
+
+        /**
+         * @brief Find the pixels of a top-down, uncompressed 24-bit or grayscale 8-bit BMP file
+         * 
+         * @param data contents of file
+         * @param length no. of bytes in file
+         * @param size receives image width and height
+         * @param type receives OpenCV type of the pixels
+         * @param offset receives offset of the first pixel
+         * @param step receives no. of bytes from one row to the next, including padding
+         * @return true if the pixels can be used as they are
+         * @return false otherwise, including bottom-up files whose last row is stored first
+         */
+        static bool findBmpPixels(const uchar* data, std::size_t length, cv::Size& size, int& type, std::size_t& offset, std::size_t& step)
+        {
+            // Little-endian fields of the file header (14 bytes) and info header (at least 40 bytes)
+            auto readUInt16 = [data](std::size_t position) {
+                return static_cast<std::uint32_t>(data[position]) | (static_cast<std::uint32_t>(data[position + 1]) << 8);
+            };
+            auto readUInt32 = [&readUInt16](std::size_t position) {
+                return readUInt16(position) | (readUInt16(position + 2) << 16);
+            };
+
+            if ((length < 54) || (data[0] != 'B') || (data[1] != 'M'))
+            {
+                return false;
+            }
+
+            const std::uint32_t infoSize { readUInt32(14) };
+            const auto width { static_cast<std::int32_t>(readUInt32(18)) };
+            const auto height { static_cast<std::int32_t>(readUInt32(22)) };
+            const std::uint32_t bitsPerPixel { readUInt16(28) };
+            const std::uint32_t compression { readUInt32(30) };
+
+            // A negative height means the first row is stored first
+            if ((infoSize < 40) || (width <= 0) || (height >= 0) || (height == INT32_MIN) || (compression != 0) ||
+                ((bitsPerPixel != 8) && (bitsPerPixel != 24)))
+            {
+                return false;
+            }
+
+            // 8-bit pixels are palette entries. They are grey levels only if the palette is 0, 1, ..., 255
+            if (bitsPerPixel == 8)
+            {
+                const std::uint32_t coloursUsed { readUInt32(46) };
+                const std::size_t paletteStart { 14 + static_cast<std::size_t>(infoSize) };
+                if (((coloursUsed != 0) && (coloursUsed != 256)) || (paletteStart + 256 * 4 > length))
+                {
+                    return false;
+                }
+                for (std::size_t i {0}; i < 256; ++i)
+                {
+                    const uchar* entry { data + paletteStart + i * 4 }; // blue, green, red, unused
+                    if ((entry[0] != i) || (entry[1] != i) || (entry[2] != i))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            size = cv::Size(width, -height);
+            type = (bitsPerPixel == 24) ? CV_8UC3 : CV_8UC1;
+            offset = readUInt32(10);
+            step = (static_cast<std::size_t>(width) * bitsPerPixel + 31) / 32 * 4; // rows are padded to 4 bytes
+
+            return (offset < length) && ((length - offset) / step >= static_cast<std::size_t>(size.height));
+        }
+
+
+        /**
+         * @brief Find the pixels of the first page of an uncompressed TIFF file stored in strips. 
+         *        The strips must follow each other in the file, and samples of more than 8 bits 
+         *        must be in the byte order of this computer
+         * 
+         * @param filePath full path to TIFF file
+         * @param length no. of bytes in file
+         * @param size receives image width and height
+         * @param type receives OpenCV type of the pixels
+         * @param rgb set to true if colour is stored as RGB(A)
+         * @param offset receives offset of the first pixel
+         * @return true if the pixels can be used as they are
+         * @return false otherwise
+         */
+        static bool findTiffPixels(const std::string& filePath, std::size_t length, cv::Size& size, int& type, bool& rgb, std::size_t& offset)
+        {
+            std::unique_ptr<tiff, TiffCloser> file { TIFFOpen(filePath.c_str(), "rm") }; // 'm' - libtiff need not map the file too
+
+            uint16_t compression {0};
+            std::uint32_t width {0}, height {0}, rowsPerStrip {0};
+            if (!file || TIFFIsTiled(file.get()) || !TIFFGetFieldDefaulted(file.get(), TIFFTAG_COMPRESSION, &compression) ||
+                (compression != COMPRESSION_NONE) || !TIFFGetField(file.get(), TIFFTAG_IMAGEWIDTH, &width) || 
+                !TIFFGetField(file.get(), TIFFTAG_IMAGELENGTH, &height) || (width == 0) || (height == 0) ||
+                (width > INT_MAX) || (height > INT_MAX))
+            {
+                return false;
+            }
+
+            type = tiffPixelType(file.get(), rgb);
+            if ((type < 0) || ((CV_ELEM_SIZE1(type) > 1) && TIFFIsByteSwapped(file.get())))
+            {
+                return false;
+            }
+
+            TIFFGetFieldDefaulted(file.get(), TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+            rowsPerStrip = std::min(rowsPerStrip, height);
+
+            // Every strip must start where the one before it ends
+            const std::size_t rowBytes { static_cast<std::size_t>(width) * CV_ELEM_SIZE(type) };
+            const std::uint32_t strips { TIFFNumberOfStrips(file.get()) };
+            std::uint64_t* stripOffsets {nullptr};
+            std::uint64_t* stripByteCounts {nullptr};
+            if ((strips == 0) || (rowsPerStrip == 0) || !TIFFGetField(file.get(), TIFFTAG_STRIPOFFSETS, &stripOffsets) ||
+                !TIFFGetField(file.get(), TIFFTAG_STRIPBYTECOUNTS, &stripByteCounts))
+            {
+                return false;
+            }
+
+            for (std::uint32_t strip {0}; strip < strips; ++strip)
+            {
+                const std::uint64_t rows { std::min<std::uint64_t>(rowsPerStrip, height - static_cast<std::uint64_t>(strip) * rowsPerStrip) };
+                if ((stripOffsets[strip] != stripOffsets[0] + static_cast<std::uint64_t>(strip) * rowsPerStrip * rowBytes) ||
+                    (stripByteCounts[strip] < rows * rowBytes))
+                {
+                    return false;
+                }
+            }
+
+            size = cv::Size(static_cast<int>(width), static_cast<int>(height));
+            offset = static_cast<std::size_t>(stripOffsets[0]);
+
+            return (offset < length) && ((length - offset) / rowBytes >= height);
+        }
+
+
+        /**
+         * @brief Map an image file. Use isOpen() to check if it succeeded
+         * 
+         * @param filePath full path to image file
+         */
+        MappedImage::MappedImage(const std::string& filePath)
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            const int descriptor { open(filePath.c_str(), O_RDONLY) };
+            struct stat status {};
+            if ((descriptor >= 0) && (fstat(descriptor, &status) == 0) && (status.st_size > 0))
+            {
+                m_length = static_cast<std::size_t>(status.st_size);
+                void* address { mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, descriptor, 0) };
+                m_address = (address == MAP_FAILED) ? nullptr : address;
+            }
+            if (descriptor >= 0)
+            {
+                close(descriptor); // the mapping stays valid after the file is closed
+            }
+
+            // Every format we map has a header longer than 8 bytes, so a shorter file is never 
+            // mapped as is. Checking the length first lets us read the signature bytes safely
+            if ((m_address != nullptr) && (m_length < 8))
+            {
+                munmap(m_address, m_length);
+                m_address = nullptr;
+            }
+
+            if (m_address != nullptr)
+            {
+                const uchar* data { static_cast<const uchar*>(m_address) };
+                cv::Size size;
+                int type {-1};
+                std::size_t offset {0};
+                std::size_t step {0};
+
+                bool found { findPnmPixels(data, m_length, size, type, offset) };
+                m_rgb = found && (CV_MAT_CN(type) == 3);
+                if (found)
+                {
+                    step = static_cast<std::size_t>(size.width) * CV_ELEM_SIZE(type);
+                }
+                else if (findBmpPixels(data, m_length, size, type, offset, step))
+                {
+                    found = true;
+                }
+                else if ((data[0] == data[1]) && ((data[0] == 'I') || (data[0] == 'M')) && 
+                         findTiffPixels(filePath, m_length, size, type, m_rgb, offset))
+                {
+                    step = static_cast<std::size_t>(size.width) * CV_ELEM_SIZE(type);
+                    found = true;
+                }
+
+                // Samples larger than a byte must also be aligned in memory
+                if (found && (offset % CV_ELEM_SIZE1(type) == 0))
+                {
+                    m_image = cv::Mat(size, type, const_cast<uchar*>(data) + offset, step);
+
+                    return;
+                }
+
+                munmap(m_address, m_length);
+                m_address = nullptr;
+                m_rgb = false;
+            }
+#endif
+
+            m_image = cv::imread(filePath, cv::IMREAD_UNCHANGED);
+        }
+
+
+        MappedImage::~MappedImage()
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            if (m_address != nullptr)
+            {
+                m_image.release();
+                munmap(m_address, m_length);
+            }
+#endif
+        }
+
+
+        /*
+         * Helpers for ShardWriter and ShardReader. A shard file starts and ends with shardMagic. 
+         * Every index entry is: key length (4 bytes), key, type length (1 byte), type, offset (8 bytes), 
+         * length (8 bytes). The footer is: index offset (8 bytes), index length (8 bytes), 
+         * no. of images (4 bytes), CRC-32 of index (4 bytes), shardMagic. All little-endian
+        */
+        constexpr char shardMagic[8] { 'C', 'V', 'S', 'H', 'A', 'R', 'D', '1' };
+        constexpr std::size_t shardFooterSize {32};
+        constexpr std::size_t shardMinimumEntrySize {4 + 1 + 8 + 8}; // entry with an empty key and type
+
+        static void appendLittleEndian(std::vector<uchar>& buffer, std::uint64_t value, int bytes)
+        {
+            for (int i {0}; i < bytes; ++i)
+            {
+                buffer.push_back(static_cast<uchar>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        static std::uint64_t readLittleEndian(const uchar* data, int bytes)
+        {
+            std::uint64_t value {0};
+            for (int i {bytes - 1}; i >= 0; --i)
+            {
+                value = (value << 8) | data[i];
+            }
+
+            return value;
+        }
+
+        // crc32() takes a 32-bit length, so a large index is checked in pieces
+        static std::uint32_t shardChecksum(const uchar* data, std::uint64_t size)
+        {
+            uLong crc { crc32(0L, Z_NULL, 0) };
+            while (size > 0)
+            {
+                const uInt piece { static_cast<uInt>(std::min<std::uint64_t>(size, 1U << 30)) };
+                crc = crc32(crc, data, piece);
+                data += piece;
+                size -= piece;
+            }
+
+            return static_cast<std::uint32_t>(crc);
+        }
+
+
+        /**
+         * @brief Create an empty shard. Use isOpen() to check if it succeeded
+         * 
+         * @param shardPath full path to shard file, e.g. thumbnails.shard
+         */
+        ShardWriter::ShardWriter(const std::string& shardPath) 
+            : m_shardPath {shardPath}, m_writePath {shardPath + ".tmp"}
+        {
+            m_file.open(m_writePath, std::ios::binary | std::ios::trunc);
+            if (!m_file.is_open())
+            {
+                std::cerr << "\nCould not create file " << m_writePath << ": " << std::strerror(errno) << '\n';
+
+                return;
+            }
+
+            m_file.write(shardMagic, sizeof(shardMagic));
+            m_offset = sizeof(shardMagic);
+        }
+
+
+        ShardWriter::~ShardWriter()
+        {
+            if (m_file.is_open())
+            {
+                close();
+            }
+        }
+
+
+        /**
+         * @brief Append a compressed image to the shard
+         * 
+         * @param key unique name of the image, used to find it again
+         * @param type codec the image was compressed with, e.g. "jpg", "png" or "qoi"
+         * @param buffer compressed image
+         * @return true if the image was added
+         * @return false if the key is already in the shard, or the shard could not be written
+         */
+        bool ShardWriter::add(const std::string& key, const std::string& type, const std::vector<uchar>& buffer)
+        {
+            if (!m_file.is_open() || m_failed || (key.size() > UINT32_MAX) || (type.size() > UINT8_MAX) || 
+                (m_records.size() >= UINT32_MAX) || !m_keys.insert(key).second)
+            {
+                return false;
+            }
+
+            if (!m_file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size())))
+            {
+                m_failed = true;
+
+                return false;
+            }
+
+            m_records.push_back(ShardRecord{ key, type, m_offset, buffer.size() });
+            m_offset += buffer.size();
+
+            return true;
+        }
+
+
+        /**
+         * @brief Write the index and footer, and rename the temporary file to the shard path. 
+         *        No more images can be added
+         * 
+         * @return true if the shard was saved
+         * @return false otherwise. The temporary file is removed
+         */
+        bool ShardWriter::close()
+        {
+            if (!m_file.is_open())
+            {
+                return false;
+            }
+
+            std::vector<uchar> index;
+            for (const auto& record : m_records)
+            {
+                appendLittleEndian(index, record.key.size(), 4);
+                index.insert(index.end(), record.key.begin(), record.key.end());
+                appendLittleEndian(index, record.type.size(), 1);
+                index.insert(index.end(), record.type.begin(), record.type.end());
+                appendLittleEndian(index, record.offset, 8);
+                appendLittleEndian(index, record.length, 8);
+            }
+
+            std::vector<uchar> footer;
+            appendLittleEndian(footer, m_offset, 8);
+            appendLittleEndian(footer, index.size(), 8);
+            appendLittleEndian(footer, m_records.size(), 4);
+            appendLittleEndian(footer, shardChecksum(index.data(), index.size()), 4);
+            footer.insert(footer.end(), std::begin(shardMagic), std::end(shardMagic));
+
+            m_file.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size()));
+            m_file.write(reinterpret_cast<const char*>(footer.data()), static_cast<std::streamsize>(footer.size()));
+            m_file.close();
+
+            std::error_code error;
+            if (!m_failed && !m_file.fail())
+            {
+                std::filesystem::rename(m_writePath, m_shardPath, error);
+                if (!error)
+                {
+                    return true;
+                }
+            }
+
+            std::cerr << "\nCould not save shard file " << m_shardPath << '\n';
+            std::filesystem::remove(m_writePath, error);
+
+            return false;
+        }
+
+
+        /**
+         * @brief Open a shard and read its index. Use isOpen() to check if it succeeded
+         * 
+         * @param shardPath full path to shard file
+         */
+        ShardReader::ShardReader(const std::string& shardPath)
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            const int descriptor { open(shardPath.c_str(), O_RDONLY) };
+            struct stat status {};
+            if ((descriptor >= 0) && (fstat(descriptor, &status) == 0) && (status.st_size > 0))
+            {
+                m_length = static_cast<std::size_t>(status.st_size);
+                void* address { mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, descriptor, 0) };
+                m_address = (address == MAP_FAILED) ? nullptr : address;
+            }
+            if (descriptor >= 0)
+            {
+                close(descriptor); // the mapping stays valid after the file is closed
+            }
+
+            if (m_address != nullptr)
+            {
+                m_data = static_cast<const uchar*>(m_address);
+            }
+#endif
+
+            // Without a mapping, read the whole shard into memory
+            if (m_data == nullptr)
+            {
+                std::ifstream file(shardPath, std::ios::binary);
+                m_contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                m_length = m_contents.size();
+                m_data = m_contents.empty() ? nullptr : m_contents.data();
+            }
+
+            if ((m_data != nullptr) && !readIndex())
+            {
+                std::cerr << "\nNot a valid shard file: " << shardPath << '\n';
+
+#if defined(__unix__) || defined(__APPLE__)
+                if (m_address != nullptr)
+                {
+                    munmap(m_address, m_length);
+                    m_address = nullptr;
+                }
+#endif
+                m_contents.clear();
+                m_data = nullptr;
+                m_records.clear();
+                m_index.clear();
+            }
+        }
+
+
+        ShardReader::~ShardReader()
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            if (m_address != nullptr)
+            {
+                munmap(m_address, m_length);
+            }
+#endif
+        }
+
+
+        /**
+         * @brief Check the magic numbers and footer, then read every index entry into 
+         *        m_records and m_index. Every offset and length is checked against the 
+         *        size of the shard, so a damaged shard cannot make us read outside it
+         * 
+         * @return true if the shard is valid
+         * @return false otherwise
+         */
+        bool ShardReader::readIndex()
+        {
+            if ((m_length < sizeof(shardMagic) + shardFooterSize) || 
+                (std::memcmp(m_data, shardMagic, sizeof(shardMagic)) != 0) || 
+                (std::memcmp(m_data + m_length - sizeof(shardMagic), shardMagic, sizeof(shardMagic)) != 0))
+            {
+                return false;
+            }
+
+            const uchar* footer { m_data + m_length - shardFooterSize };
+            const std::uint64_t indexOffset { readLittleEndian(footer, 8) };
+            const std::uint64_t indexLength { readLittleEndian(footer + 8, 8) };
+            const std::uint64_t count { readLittleEndian(footer + 16, 4) };
+            const std::uint32_t checksum { static_cast<std::uint32_t>(readLittleEndian(footer + 20, 4)) };
+
+            if ((indexOffset < sizeof(shardMagic)) || (indexOffset > m_length - shardFooterSize) || 
+                (indexLength != m_length - shardFooterSize - indexOffset) || 
+                (count > indexLength / shardMinimumEntrySize))
+            {
+                return false;
+            }
+
+            const uchar* in { m_data + indexOffset };
+            const uchar* end { in + indexLength };
+            if (shardChecksum(in, indexLength) != checksum)
+            {
+                return false;
+            }
+
+            m_records.reserve(static_cast<std::size_t>(count));
+            m_index.reserve(static_cast<std::size_t>(count));
+
+            for (std::uint64_t i {0}; i < count; ++i)
+            {
+                ShardRecord record;
+
+                if (end - in < 4)
+                {
+                    return false;
+                }
+                const std::uint64_t keyLength { readLittleEndian(in, 4) };
+                in += 4;
+
+                if (static_cast<std::uint64_t>(end - in) < keyLength + 1)
+                {
+                    return false;
+                }
+                record.key.assign(reinterpret_cast<const char*>(in), static_cast<std::size_t>(keyLength));
+                in += keyLength;
+
+                const std::size_t typeLength { *in++ };
+                if (static_cast<std::size_t>(end - in) < typeLength + 16)
+                {
+                    return false;
+                }
+                record.type.assign(reinterpret_cast<const char*>(in), typeLength);
+                in += typeLength;
+
+                record.offset = readLittleEndian(in, 8);
+                record.length = readLittleEndian(in + 8, 8);
+                in += 16;
+
+                // Images lie between the magic number and the index
+                if ((record.offset < sizeof(shardMagic)) || (record.offset > indexOffset) || 
+                    (record.length > indexOffset - record.offset))
+                {
+                    return false;
+                }
+
+                if (!m_index.emplace(record.key, m_records.size()).second)
+                {
+                    return false; // keys must be unique
+                }
+                m_records.push_back(std::move(record));
+            }
+
+            return in == end;
+        }
+
+
+        /**
+         * @brief Look up an image by its key
+         * 
+         * @param key key the image was added with
+         * @return const ShardRecord* the image, or nullptr if it is not in the shard
+         */
+        const ShardRecord* ShardReader::find(const std::string& key) const
+        {
+            const auto found { m_index.find(key) };
+
+            return (found == m_index.end()) ? nullptr : &m_records[found->second];
+        }
+
+
+        /**
+         * @brief The compressed bytes of an image, without copying them
+         * 
+         * @param record image returned by find() or records()
+         * @return cv::Mat read-only 1-row CV_8UC1 header around the bytes. Only valid while 
+         *         the ShardReader exists
+         */
+        cv::Mat ShardReader::buffer(const ShardRecord& record) const
+        {
+            if ((m_data == nullptr) || (record.length == 0) || (record.length > INT_MAX) || 
+                (record.offset > m_length) || (record.length > m_length - record.offset))
+            {
+                return cv::Mat();
+            }
+
+            return cv::Mat(1, static_cast<int>(record.length), CV_8UC1, const_cast<uchar*>(m_data + record.offset));
+        }
+
+
+        /**
+         * @brief Find and de-compress an image. QOI images are always decoded as they were 
+         *        stored, other images with cv::imdecode() and the given flags
+         * 
+         * @param key key the image was added with
+         * @param flags cv::ImreadModes flags for cv::imdecode()
+         * @return cv::Mat image. Empty if the key is not in the shard or the image could not be decoded
+         */
+        cv::Mat ShardReader::decode(const std::string& key, int flags) const
+        {
+            const ShardRecord* record { find(key) };
+            if (record == nullptr)
+            {
+                return cv::Mat();
+            }
+
+            const cv::Mat bytes { buffer(*record) };
+            if (bytes.empty())
+            {
+                return cv::Mat();
+            }
+
+            cv::Mat image;
+            if (record->type == "qoi")
+            {
+                // cv::imdecode() has no QOI codec
+                if (!decodeQOIBytes(bytes.ptr<uchar>(), bytes.total(), image))
+                {
+                    image.release();
+                }
+            }
+            else
+            {
+                image = cv::imdecode(bytes, flags);
+            }
+
+            return image;
+        }
+    }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Start timing a stage. A stage that is still being timed is stopped first.
+         * 
+         * @param stage name of stage e.g. "decode"
+         */
+        void StageTimer::start(const std::string& stage)
+        {
+            stop();
+
+            m_currentStage = stage;
+            m_startTicks = cv::getTickCount();
+        }
+
+
+        /**
+         * @brief Stop timing the current stage and add its time to the stage total
+         */
+        void StageTimer::stop()
+        {
+            if (m_currentStage.empty())
+            {
+                return; // no stage is being timed
+            }
+
+            const double milliseconds { (cv::getTickCount() - m_startTicks) * 1000.0 / cv::getTickFrequency() };
+
+            auto found { std::find_if(m_stages.begin(), m_stages.end(), 
+                                      [this](const Stage& s) { return s.name == m_currentStage; }) };
+            if (found == m_stages.end())
+            {
+                m_stages.push_back(Stage { m_currentStage, 0, 0.0 });
+                found = m_stages.end() - 1;
+            }
+
+            ++found->count;
+            found->totalMilliseconds += milliseconds;
+
+            m_currentStage.clear();
+        }
+
+
+        /**
+         * @brief Print the no. of runs, total time, mean time and share of the 
+         *        total time of each stage
+         * 
+         * @param out stream to print to e.g. std::cout
+         */
+        void StageTimer::print(std::ostream& out) const
+        {
+            double totalMilliseconds {0.0};
+            for (const auto& stage : m_stages)
+            {
+                totalMilliseconds += stage.totalMilliseconds;
+            }
+
+            out << "\nStage       Runs    Total (ms)    Mean (ms)    Share\n";
+
+            for (const auto& stage : m_stages)
+            {
+                out << std::left << std::setw(10) << stage.name << std::right 
+                    << std::setw(6) << stage.count 
+                    << std::fixed << std::setprecision(2)
+                    << std::setw(14) << stage.totalMilliseconds 
+                    << std::setw(13) << stage.totalMilliseconds / stage.count 
+                    << std::setw(8) << std::setprecision(1) 
+                    << ((totalMilliseconds > 0) ? 100.0 * stage.totalMilliseconds / totalMilliseconds : 0.0) << " %\n";
+            }
+
+            out << std::left << std::setw(10) << "total" << std::right << std::setw(20) 
+                << std::setprecision(2) << totalMilliseconds << '\n';
+        }
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath)
+        {
+            std::vector<std::string> inputs;
+
+            std::ifstream file(listPath);
+            if (!file)
+            {
+                std::cerr << "\nCould not open list of inputs: " << listPath << '\n';
+
+                return std::nullopt;
+            }
+
+            std::string line;
+            while (std::getline(file, line))
+            {
+                // Remove trailing white space, including '\r' from files saved on Windows
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+
+                if (!line.empty() && (line[0] != '#'))
+                {
+                    inputs.push_back(line);
+                }
+            }
+
+            return inputs;
+        }
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise
+         */
+        bool createOutputDirectory(const std::string& outputDirectory)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(outputDirectory, error);
+
+            if (error || !std::filesystem::is_directory(outputDirectory, error))
+            {
+                std::cerr << "\nCould not create output directory " << outputDirectory 
+                          << (error ? ": " + error.message() : std::string()) << '\n';
+
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer)
+        {
+            std::filesystem::path savePath { outputDirectory };
+            savePath /= fileName;
+
+            // a. Compress the image with the codec that matches the file extension
+            timer.start("encode");
+
+            std::vector<uchar> buffer;
+            bool result {false};
+            try 
+            {
+                result = cv::imencode(savePath.extension().string(), image, buffer);
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nError compressing " << fileName << ": " << ex.what();
+            }
+
+            timer.stop();
+
+            if (!result)
+            {
+                return false;
+            }
+
+            // b. Save the compressed image
+            timer.start("write");
+
+            result = CPP_CV::ReadWriteFiles::writeBufferToFile(savePath.string(), buffer);
+            timer.stop();
+
+            return result;
+        }
+    }
+
+    namespace Tensors {
+
+        /**
+         * @brief Choose the cv::imread() flag that decodes an image at the smallest reduced 
+         *        resolution (1/2, 1/4 or 1/8) that is still at least as large as the size the 
+         *        image is resized to. The image may be turned by its EXIF orientation, so both 
+         *        sides must stay at least as large as the longest side of the target size
+         *
+         * @param imageSize size of the full resolution image. If empty, the size is unknown
+         * @param targetSize size the image is resized to
+         * @return int cv::IMREAD_COLOR or one of cv::IMREAD_REDUCED_COLOR_2/4/8
+         */
+        static int reducedColorFlag(const cv::Size& imageSize, const cv::Size& targetSize)
+        {
+            if (imageSize.empty())
+            {
+                return cv::IMREAD_COLOR;
+            }
+
+            const int shortestSide { std::min(imageSize.width, imageSize.height) };
+            const int longestTarget { std::max(targetSize.width, targetSize.height) };
+
+            if (shortestSide / 8 >= longestTarget) return cv::IMREAD_REDUCED_COLOR_8;
+            else if (shortestSide / 4 >= longestTarget) return cv::IMREAD_REDUCED_COLOR_4;
+            else if (shortestSide / 2 >= longestTarget) return cv::IMREAD_REDUCED_COLOR_2;
+            else return cv::IMREAD_COLOR;
+        }
+
+
+        /**
+         * @brief Normalise an 8-bit, 3 channel image, reorder its channels and write it in the 
+         *        requested layout, in a single pass over its pixels
+         *
+         * @param image CV_8UC3 image of options.size
+         * @param options layout and channel order
+         * @param alpha per output channel, multiplies the pixel value (scale / std)
+         * @param beta per output channel, added after multiplying (-mean / std)
+         * @param tensor receives 3 x H x W (NCHW) or H x W x 3 (NHWC) values
+         */
+        static void writeTensor(const cv::Mat& image, const TensorOptions& options, const float alpha[3], 
+                                const float beta[3], float* tensor)
+        {
+            // Channel of the image that each output channel is taken from
+            const int source[3] { options.swapRB ? 2 : 0, 1, options.swapRB ? 0 : 2 };
+
+            const int width { image.cols };
+            const std::size_t planeSize { static_cast<std::size_t>(image.cols) * image.rows };
+
+            for (int y {0}; y < image.rows; ++y)
+            {
+                const uchar* row { image.ptr<uchar>(y) };
+
+                if (options.layout == TensorLayout::NCHW)
+                {
+                    float* red { tensor + static_cast<std::size_t>(y) * width };
+                    float* green { red + planeSize };
+                    float* blue { green + planeSize };
+
+                    for (int x {0}; x < width; ++x)
+                    {
+                        red[x] = row[3 * x + source[0]] * alpha[0] + beta[0];
+                        green[x] = row[3 * x + source[1]] * alpha[1] + beta[1];
+                        blue[x] = row[3 * x + source[2]] * alpha[2] + beta[2];
+                    }
+                }
+                else 
+                {
+                    float* pixels { tensor + static_cast<std::size_t>(y) * width * 3 };
+
+                    for (int x {0}; x < width; ++x)
+                    {
+                        pixels[3 * x] = row[3 * x + source[0]] * alpha[0] + beta[0];
+                        pixels[3 * x + 1] = row[3 * x + source[1]] * alpha[1] + beta[1];
+                        pixels[3 * x + 2] = row[3 * x + source[2]] * alpha[2] + beta[2];
+                    }
+                }
+            }
+        }
+
+
+        /**
+         * @brief Read a batch of images into one contiguous block of 32-bit floats, ready to be 
+         *        fed to a neural network. The images are decoded in parallel, and each image is 
+         *        resized and then normalised, reordered (BGR to RGB) and written in the requested 
+         *        layout in a single pass straight into its place in the batch, so the only image 
+         *        made along the way is the resized 8-bit image.
+         *
+         * @param filePaths full paths to the image files. Each is read as a 3 channel colour image
+         * @param options size, layout and normalisation of the images
+         * @param batch receives the images as a 4-dimensional CV_32F array of N x 3 x H x W (NCHW) 
+         *              or N x H x W x 3 (NHWC) values. If it already has those dimensions, its memory 
+         *              is re-used, so a cv::Mat header around a buffer allocated by the caller (e.g. 
+         *              an inference engine's input buffer) is filled in place
+         * @param loaded set to 1 for each image that was read, and 0 for each image that could not 
+         *               be read (its values are set to 0)
+         * @return int no. of images read
+         */
+        int loadTensorBatch(const std::vector<std::string>& filePaths, const TensorOptions& options, 
+                            cv::Mat& batch, std::vector<uchar>& loaded)
+        {
+            if (options.size.empty() || (options.std[0] == 0.0) || (options.std[1] == 0.0) || (options.std[2] == 0.0))
+            {
+                std::cerr << "\nERROR: The batch image size must not be empty, and std must not be 0.\n";
+
+                return 0;
+            }
+
+            const int count { static_cast<int>(filePaths.size()) };
+            loaded.assign(filePaths.size(), 0);
+            if (count == 0)
+            {
+                return 0;
+            }
+
+            const int width { options.size.width };
+            const int height { options.size.height };
+            const int nchw[4] { count, 3, height, width };
+            const int nhwc[4] { count, height, width, 3 };
+            batch.create(4, (options.layout == TensorLayout::NCHW) ? nchw : nhwc, CV_32F);
+
+            // (v * scale - mean) / std == v * alpha + beta
+            float alpha[3];
+            float beta[3];
+            for (int c {0}; c < 3; ++c)
+            {
+                alpha[c] = static_cast<float>(options.scale / options.std[c]);
+                beta[c] = static_cast<float>(-options.mean[c] / options.std[c]);
+            }
+
+            const std::size_t imageValues { static_cast<std::size_t>(width) * height * 3 };
+            float* const values { batch.ptr<float>() };
+
+            // Read one image into its own part of the batch, so no two threads write to the same values
+            auto loadImage = [&](int i, cv::Mat& resized) {
+                float* tensor { values + imageValues * i };
+
+                cv::Mat image;
+                try 
+                {
+                    const int flag { options.reducedDecode ? reducedColorFlag(CPP_CV::ReadWriteFiles::readImageSize(filePaths[i]), options.size) 
+                                                           : cv::IMREAD_COLOR };
+                    image = cv::imread(filePaths[i], flag);
+
+                    if (!image.empty() && (image.size() != options.size))
+                    {
+                        cv::resize(image, resized, options.size, 0.0, 0.0, options.interpolation);
+                        image = resized;
+                    }
+
+                    if (!image.empty())
+                    {
+                        writeTensor(image, options, alpha, beta, tensor);
+                        loaded[i] = 1;
+
+                        return;
+                    }
+                }
+                catch (const cv::Exception& ex)
+                {
+                    std::cerr << "\nError reading " << filePaths[i] << ": " << ex.what();
+                }
+
+                std::fill(tensor, tensor + imageValues, 0.0f);
+            };
+
+            if (options.threads <= 0)
+            {
+                cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+                    cv::Mat resized; // re-used for every image in this range
+
+                    for (int i { range.start }; i < range.end; ++i)
+                    {
+                        loadImage(i, resized);
+                    }
+                });
+            }
+            else 
+            {
+                // cv::parallel_for_() has no thread count of its own, and cv::setNumThreads() would 
+                // change it for the whole program, so a fixed no. of threads gets its own workers. 
+                // Each worker takes the next image that has not been started
+                std::atomic<int> nextImage {0};
+                auto worker = [&]() {
+                    cv::Mat resized; // re-used for every image this worker reads
+
+                    for (int i { nextImage++ }; i < count; i = nextImage++)
+                    {
+                        loadImage(i, resized);
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                for (int t {1}; t < std::min(options.threads, count); ++t)
+                {
+                    workers.emplace_back(worker);
+                }
+                worker(); // this thread is a worker too
+
+                for (auto& thread : workers)
+                {
+                    thread.join();
+                }
+            }
+
+            return static_cast<int>(std::count(loaded.begin(), loaded.end(), 1));
+        }
+    }
+
+    namespace Watch {
+
+        /**
+         * @brief Start watching a directory. Use isOpen() to check if it succeeded
+         * 
+         * @param directory full path to directory
+         */
+        DirectoryWatcher::DirectoryWatcher(const std::string& directory)
+            : m_directory {directory}
+        {
+#if defined(__linux__)
+            m_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (m_descriptor < 0)
+            {
+                std::cerr << "\nERROR: Could not start inotify: " << std::strerror(errno) << '\n';
+
+                return;
+            }
+
+            // IN_ONLYDIR refuses paths that are not directories
+            m_watch = inotify_add_watch(m_descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+            if (m_watch < 0)
+            {
+                std::cerr << "\nERROR: Could not watch directory " << directory << ": " << std::strerror(errno) << '\n';
+                close(m_descriptor);
+                m_descriptor = -1;
+
+                return;
+            }
+
+            m_thread = std::thread(&DirectoryWatcher::readEvents, this);
+#else
+            std::cerr << "\nERROR: Watching directory " << directory << " needs inotify, which is only available on Linux.\n";
+#endif
+        }
+
+
+        DirectoryWatcher::~DirectoryWatcher()
+        {
+            m_stop = true;
+            if (m_thread.joinable())
+            {
+                m_thread.join();
+            }
+
+#if defined(__linux__)
+            if (m_descriptor >= 0)
+            {
+                close(m_descriptor); // also removes the watch
+            }
+#endif
+        }
+
+
+        /**
+         * @brief Read inotify events until the watcher is destroyed, the directory is removed, 
+         *        or an error occurs, and queue every file that is complete
+         */
+        void DirectoryWatcher::readEvents()
+        {
+#if defined(__linux__)
+            // Large enough for many events. inotify events are aligned like struct inotify_event
+            alignas(inotify_event) char buffer[64 * 1024];
+
+            bool watching {true};
+            while (watching && !m_stop)
+            {
+                // Wake up every 100 ms to check if we have been asked to stop
+                pollfd descriptor { m_descriptor, POLLIN, 0 };
+                const int ready { poll(&descriptor, 1, 100) };
+                if ((ready < 0) && (errno != EINTR))
+                {
+                    std::cerr << "\nERROR: Could not wait for inotify events: " << std::strerror(errno) << '\n';
+                    break;
+                }
+                if (ready <= 0)
+                {
+                    continue;
+                }
+
+                const ssize_t length { read(m_descriptor, buffer, sizeof(buffer)) };
+                if (length <= 0)
+                {
+                    if ((length < 0) && (errno != EAGAIN) && (errno != EINTR))
+                    {
+                        std::cerr << "\nERROR: Could not read inotify events: " << std::strerror(errno) << '\n';
+                        break;
+                    }
+                    continue;
+                }
+
+                // Every file in this read arrived by now
+                const int64 arrivalTicks { cv::getTickCount() };
+
+                std::vector<ArrivedFile> files;
+                for (ssize_t offset {0}; offset < length; )
+                {
+                    const inotify_event* event { reinterpret_cast<const inotify_event*>(buffer + offset) };
+                    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                    if (event->mask & IN_Q_OVERFLOW)
+                    {
+                        std::cerr << "\nWarning: Too many files arrived at once in " << m_directory << ", some were missed.\n";
+                    }
+                    else if (event->mask & IN_IGNORED) // the directory was removed or unmounted
+                    {
+                        watching = false;
+                    }
+                    else if (((event->mask & IN_ISDIR) == 0) && (event->len > 0))
+                    {
+                        files.push_back({ (std::filesystem::path{m_directory} / event->name).string(), arrivalTicks });
+                    }
+                }
+
+                if (!files.empty())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock {m_mutex};
+                        m_queue.insert(m_queue.end(), files.begin(), files.end());
+                    }
+                    m_arrived.notify_all();
+                }
+            }
+#endif
+
+            {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                m_finished = true;
+            }
+            m_arrived.notify_all();
+        }
+
+
+        /**
+         * @brief Take the next file from the queue, waiting for one to arrive if the queue is empty
+         * 
+         * @param file receives the file
+         * @param timeoutMilliseconds longest time to wait. Negative waits until a file arrives 
+         *                            or the watcher stops
+         * @return true if a file was taken from the queue
+         * @return false if no file arrived in time, or the watcher stopped
+         */
+        bool DirectoryWatcher::next(ArrivedFile& file, int timeoutMilliseconds)
+        {
+            std::unique_lock<std::mutex> lock {m_mutex};
+
+            auto ready = [this]() { return !m_queue.empty() || m_finished || !isOpen(); };
+            if (timeoutMilliseconds < 0)
+            {
+                m_arrived.wait(lock, ready);
+            }
+            else 
+            {
+                m_arrived.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds), ready);
+            }
+
+            if (m_queue.empty())
+            {
+                return false;
+            }
+
+            file = std::move(m_queue.front());
+            m_queue.pop_front();
+
+            return true;
+        }
+
+
+        /**
+         * @brief Return the no. of files waiting in the queue
+         */
+        std::size_t DirectoryWatcher::pending() const
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+
+            return m_queue.size();
+        }
+
+
+        /**
+         * @brief Add the latency of a file
+         * 
+         * @param arrivalTicks value of cv::getTickCount() when the file arrived
+         * @return double latency in milliseconds, from arrivalTicks until now
+         */
+        double LatencyReport::add(int64 arrivalTicks)
+        {
+            const double milliseconds { static_cast<double>(cv::getTickCount() - arrivalTicks) * 1000.0 / cv::getTickFrequency() };
+            m_milliseconds.push_back(milliseconds);
+
+            return milliseconds;
+        }
+
+
+        void LatencyReport::print(std::ostream& out) const
+        {
+            if (m_milliseconds.empty())
+            {
+                out << "\nNo files were processed.\n";
+
+                return;
+            }
+
+            std::vector<double> sorted { m_milliseconds };
+            std::sort(sorted.begin(), sorted.end());
+
+            const double mean { std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size()) };
+            auto percentile = [&sorted](double p) {
+                return sorted[static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size()))) - 1];
+            };
+
+            out << "\nFile arrival to processed latency (" << sorted.size() << " files):\n"
+                << std::fixed << std::setprecision(2)
+                << "    mean:   " << mean << " ms\n"
+                << "    median: " << percentile(0.5) << " ms\n"
+                << "    95th:   " << percentile(0.95) << " ms\n"
+                << "    max:    " << sorted.back() << " ms\n";
+        }
+
+
+        // Set by stopHandler(). Only a volatile std::sig_atomic_t may be written from a signal handler
+        static volatile std::sig_atomic_t stopSignalled {0};
+
+        /**
+         * @brief Record that the program was asked to stop, and restore the default handler
+         *        so a second Ctrl+C ends the program at once
+         *
+         * @param signalNumber SIGINT or SIGTERM
+         */
+        static void stopHandler(int signalNumber)
+        {
+            stopSignalled = 1;
+            std::signal(signalNumber, SIG_DFL);
+        }
+
+
+        /**
+         * @brief Catch Ctrl+C (SIGINT) and SIGTERM instead of letting them end the program.
+         *        Check stopRequested() to find out if one was received
+         */
+        void installStopHandler()
+        {
+            stopSignalled = 0;
+            std::signal(SIGINT, stopHandler);
+            std::signal(SIGTERM, stopHandler);
+        }
+
+
+        bool stopRequested()
+        {
+            return stopSignalled != 0;
+        }
+    }
+
+    namespace Directories {
+
+        /**
+         * @brief Check if a file passes the filters of a scan, making the cheapest tests first
+         *
+         * @param entry directory entry of a regular file
+         * @param options filters
+         * @param file receives the path and (if a size limit is set) the size of the file
+         * @return true if the file passes every filter
+         * @return false otherwise
+         */
+        static bool passesFilters(const std::filesystem::directory_entry& entry, const ScanOptions& options, ScannedFile& file)
+        {
+            // 1. Extension, from the name alone
+            if (!options.extensions.empty())
+            {
+                std::string extension { entry.path().extension().string() };
+                if (extension.size() < 2)
+                {
+                    return false;
+                }
+                extension.erase(0, 1); // the dot
+                std::transform(extension.begin(), extension.end(), extension.begin(), 
+                               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+                if (std::find(options.extensions.begin(), options.extensions.end(), extension) == options.extensions.end())
+                {
+                    return false;
+                }
+            }
+
+            // 2. Size, which needs a stat() call
+            file.size = 0;
+            if ((options.minSize > 0) || (options.maxSize < UINTMAX_MAX))
+            {
+                std::error_code error;
+                file.size = entry.file_size(error);
+                if (error || (file.size < options.minSize) || (file.size > options.maxSize))
+                {
+                    return false;
+                }
+            }
+
+            file.path = entry.path().string();
+
+            // 3. cv::haveImageReader(), which opens the file and reads its signature
+            if (options.checkImageReader)
+            {
+                try 
+                {
+                    return cv::haveImageReader(file.path);
+                }
+                catch (const cv::Exception&)
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Start scanning a directory
+         * 
+         * @param directory full path to directory
+         * @param options filters, no. of threads and size of the queue of files
+         */
+        DirectoryScanner::DirectoryScanner(const std::string& directory, const ScanOptions& options)
+            : m_options {options}
+        {
+            m_options.queueCapacity = std::max<std::size_t>(m_options.queueCapacity, 1);
+
+            m_directories.push_back(directory);
+            m_busyDirectories = 1;
+
+            const int threads { (options.threads > 0) ? options.threads : std::max(cv::getNumThreads(), 1) };
+            for (int i {0}; i < threads; ++i)
+            {
+                m_threads.emplace_back(&DirectoryScanner::scan, this);
+            }
+        }
+
+
+        DirectoryScanner::~DirectoryScanner()
+        {
+            // Wake up every thread waiting for a directory, or for room in the queue of files
+            m_stop = true;
+            { std::lock_guard<std::mutex> lock {m_directoryMutex}; }
+            m_directoryQueued.notify_all();
+            { std::lock_guard<std::mutex> lock {m_fileMutex}; }
+            m_fileTaken.notify_all();
+
+            for (std::thread& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+
+        /**
+         * @brief Scan directories from the shared queue until every directory has been scanned
+         */
+        void DirectoryScanner::scan()
+        {
+            while (!m_stop)
+            {
+                // 1. Take a directory, waiting while other threads may still find more
+                std::filesystem::path directory;
+                {
+                    std::unique_lock<std::mutex> lock {m_directoryMutex};
+                    m_directoryQueued.wait(lock, [this]() { return m_stop || !m_directories.empty() || (m_busyDirectories == 0); });
+                    if (m_stop || m_directories.empty())
+                    {
+                        break; // every directory has been scanned
+                    }
+
+                    directory = std::move(m_directories.front());
+                    m_directories.pop_front();
+                }
+
+                // 2. Queue its sub-directories straight away, so idle threads can start on them, 
+                //    and pass on the files that pass the filters
+                std::error_code error;
+                std::filesystem::directory_iterator entries { directory, std::filesystem::directory_options::skip_permission_denied, error };
+                const bool opened { !error };
+                if (opened)
+                {
+                    ++m_directoriesScanned;
+                }
+                else 
+                {
+                    ++m_directoryErrors;
+                }
+
+                for (; !error && !m_stop && (entries != std::filesystem::directory_iterator()); entries.increment(error))
+                {
+                    const std::filesystem::directory_entry& entry { *entries };
+
+                    // The type of an entry is usually known from the directory listing, without a stat() call
+                    std::error_code entryError;
+                    if (entry.is_directory(entryError))
+                    {
+                        if (m_options.recursive && !entry.is_symlink(entryError))
+                        {
+                            {
+                                std::lock_guard<std::mutex> lock {m_directoryMutex};
+                                m_directories.push_back(entry.path());
+                                ++m_busyDirectories;
+                            }
+                            m_directoryQueued.notify_one();
+                        }
+                        continue;
+                    }
+
+                    if (!entry.is_regular_file(entryError))
+                    {
+                        continue;
+                    }
+
+                    ++m_filesSeen;
+
+                    ScannedFile file;
+                    if (!passesFilters(entry, m_options, file))
+                    {
+                        continue;
+                    }
+
+                    // Wait while the queue of files is full, so a slow consumer keeps memory use bounded
+                    {
+                        std::unique_lock<std::mutex> lock {m_fileMutex};
+                        m_fileTaken.wait(lock, [this]() { return m_stop || (m_files.size() < m_options.queueCapacity); });
+                        if (m_stop)
+                        {
+                            break;
+                        }
+                        m_files.push_back(std::move(file));
+                    }
+                    m_fileQueued.notify_one();
+                }
+
+                if (opened && error && !m_stop) // the directory could not be read to the end
+                {
+                    ++m_directoryErrors;
+                }
+
+                // 3. This directory is done. If it was the last one, the scan has finished
+                bool finished {false};
+                {
+                    std::lock_guard<std::mutex> lock {m_directoryMutex};
+                    finished = (--m_busyDirectories == 0);
+                }
+
+                if (finished)
+                {
+                    m_directoryQueued.notify_all();
+                    {
+                        std::lock_guard<std::mutex> lock {m_fileMutex};
+                        m_scanning = false;
+                    }
+                    m_fileQueued.notify_all();
+                }
+            }
+        }
+
+
+        /**
+         * @brief Take the next file found, waiting for one if none is waiting
+         * 
+         * @param file receives the file
+         * @return true if a file was taken
+         * @return false if the scan has finished and every file has been taken
+         */
+        bool DirectoryScanner::next(ScannedFile& file)
+        {
+            {
+                std::unique_lock<std::mutex> lock {m_fileMutex};
+                m_fileQueued.wait(lock, [this]() { return !m_files.empty() || !m_scanning; });
+                if (m_files.empty())
+                {
+                    return false;
+                }
+
+                file = std::move(m_files.front());
+                m_files.pop_front();
+            }
+            m_fileTaken.notify_one();
+
+            return true;
+        }
+
+
+        /**
+         * @brief Scan a directory tree with a DirectoryScanner and return all the files found, 
+         *        sorted by path. Use a DirectoryScanner directly to process files as they are found
+         * 
+         * @param directory full path to directory
+         * @param options filters and no. of threads
+         * @return std::vector<std::string> full paths to the files, sorted
+         */
+        std::vector<std::string> listFiles(const std::string& directory, const ScanOptions& options)
+        {
+            DirectoryScanner scanner(directory, options);
+
+            std::vector<std::string> filePaths;
+            ScannedFile file;
+            while (scanner.next(file))
+            {
+                filePaths.push_back(std::move(file.path));
+            }
+
+            std::sort(filePaths.begin(), filePaths.end());
+
+            return filePaths;
+        }
+
+
+        /**
+         * @brief Turn a comma separated list of file extensions into the form ScanOptions::extensions 
+         *        expects, e.g. ".JPG, png,tif" becomes {"jpg", "png", "tif"}
+         * 
+         * @param list comma separated list of extensions, with or without dots
+         * @return std::vector<std::string> lower case extensions without dots. Empty if list is empty
+         */
+        std::vector<std::string> parseExtensionList(const std::string& list)
+        {
+            std::vector<std::string> extensions;
+
+            std::istringstream items {list};
+            std::string item;
+            while (std::getline(items, item, ','))
+            {
+                std::string extension;
+                for (const unsigned char c : item)
+                {
+                    if (!std::isspace(c) && (c != '.'))
+                    {
+                        extension += static_cast<char>(std::tolower(c));
+                    }
+                }
+
+                if (!extension.empty())
+                {
+                    extensions.push_back(extension);
+                }
+            }
+
+            return extensions;
+        }
     }
 }
\ No newline at end of file
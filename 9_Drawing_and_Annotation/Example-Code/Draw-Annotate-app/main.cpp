@@ -1,12 +1,106 @@
 #include "opencv2/core/core.hpp"        // for OpenCV core types e.g. cv::Mat
+#include "opencv2/core/utility.hpp"     // for cv::CommandLineParser
 #include "opencv2/highgui/highgui.hpp"  // for display windows
 #include "opencv2/imgproc/imgproc.hpp"  // for Drawing and Annotation functions
+#include "opencv2/imgcodecs.hpp"        // for cv::imread()
+
+#include "UtilityFunctions/utility_functions.h" // for CPP_CV::Headless functions
 
 #include <iostream>
 #include <array>
-
-int main()
+#include <string>
+#include <filesystem>
+
+/**
+ * @brief Annotate text in different font types onto an image and draw a 
+ *        bounding box around each text string
+ * 
+ * @param image 3-channel image to draw onto
+ */
+void drawAnnotations(cv::Mat& image);
+
+int main(int argc, char* argv[])
 { 
+    /*
+     * Define the command line arguments. All are optional:
+     *  1. list - text file with one image path per line. Each image is annotated 
+     *            instead of a blank canvas and saved without display windows (headless mode)
+     *  2. outDir - directory to save the annotated images to instead of displaying them
+    */
+    const cv::String keys = 
+        "{help h usage ? | | Annotate text and draw bounding boxes }"
+        "{list | | Headless mode: text file with the full path to an image to annotate on each line }"
+        "{outDir | | Directory to save annotated images to instead of displaying them }";
+
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("\nDraw and Annotate v1.0.0\n");
+    parser.printMessage();
+
+    cv::String listPath = parser.get<cv::String>("list");
+    cv::String outputDirectory = parser.get<cv::String>("outDir");
+
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if (!listPath.empty() && outputDirectory.empty())
+    {
+        std::cout << "ERROR! Please provide a directory to save the annotated images to (outDir).\n";
+        return -1;
+    }
+
+    ///////////////////// Headless Mode //////////////////////////
+
+    // Annotate every image in the list and save it to disk, timing each stage of the work
+    if (!listPath.empty())
+    {
+        const auto inputs { CPP_CV::Headless::readInputList(listPath) };
+        if (!inputs || !CPP_CV::Headless::createOutputDirectory(outputDirectory))
+        {
+            return -1;
+        }
+
+        CPP_CV::Headless::StageTimer timer;
+        cv::TickMeter wallTime;
+        wallTime.start();
+
+        int processed {0};
+
+        for (const auto& path : *inputs)
+        {
+            timer.start("decode");
+            cv::Mat image { cv::imread(path, cv::IMREAD_COLOR) };
+            timer.stop();
+
+            if (image.empty())
+            {
+                std::cout << "ERROR! Could not read image: " << path << '\n';
+                continue;
+            }
+
+            timer.start("process");
+            drawAnnotations(image);
+            timer.stop();
+
+            const std::string fileName { std::filesystem::path(path).stem().string() + "_annotated.png" };
+            if (CPP_CV::Headless::writeResult(outputDirectory, fileName, image, timer))
+            {
+                ++processed;
+            }
+        }
+
+        wallTime.stop();
+
+        std::cout << "\nAnnotated " << processed << " images in " << wallTime.getTimeSec() << " s ("
+                  << processed / wallTime.getTimeSec() << " images/s)\n";
+        timer.print();
+
+        std::cout << '\n';
+
+        return 0;
+    }
         
     ///////////////////// Create a Canvas //////////////////////////
 
@@ -25,6 +119,48 @@ int main()
     
     ////////////////////// Annotate Text & Draw a Bounding Box /////////////////////////////////////////
 
+    drawAnnotations(image);
+
+    ///////////////// Display Image Canvas ////////////////////////////////   
+
+    // Save the canvas instead of displaying it if the user provided a directory
+    if (!outputDirectory.empty())
+    {
+        CPP_CV::Headless::StageTimer timer;
+        if (!CPP_CV::Headless::createOutputDirectory(outputDirectory) || 
+            !CPP_CV::Headless::writeResult(outputDirectory, "annotated_canvas.png", image, timer))
+        {
+            std::cout << "ERROR! Could not save canvas.\n";
+            return -1;
+        }
+
+        timer.print();
+        std::cout << '\n';
+
+        return 0;
+    }
+
+    cv::String window_name = "Annotate Text & Draw Bounding Boxes"; 
+    cv::namedWindow(window_name, cv::WINDOW_AUTOSIZE);
+    cv::imshow(window_name, image);
+
+    cv::waitKey(0);
+
+    cv::destroyWindow(window_name);
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+/**
+ * @brief Annotate text in different font types onto an image and draw a 
+ *        bounding box around each text string
+ * 
+ * @param image 3-channel image to draw onto
+ */
+void drawAnnotations(cv::Mat& image)
+{
     // Add the various font types into a std::array
     std::array <int, 9> fontFace {cv::FONT_HERSHEY_SIMPLEX,
                                  cv::FONT_HERSHEY_PLAIN, 
@@ -78,20 +214,4 @@ int main()
         // Annotated Text will be seperated by 50 pixels along the y-axis
         y_coordinate += 50; 
     }
-    
-
-    ///////////////// Display Image Canvas ////////////////////////////////   
-
-
-    cv::String window_name = "Annotate Text & Draw Bounding Boxes"; 
-    cv::namedWindow(window_name, cv::WINDOW_AUTOSIZE);
-    cv::imshow(window_name, image);
-
-    cv::waitKey(0);
-
-    cv::destroyWindow(window_name);
-
-    std::cout << '\n';
-
-    return 0;
 }
\ No newline at end of file
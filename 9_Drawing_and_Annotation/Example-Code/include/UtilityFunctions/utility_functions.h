@@ -12,6 +12,7 @@
 #include <fstream>    // for std::ifstream
 #include <iterator>   // for std::istream_iterator
 #include <algorithm>  // for std::copy
+#include <optional>   // for std::optional
 
 namespace CPP_CV {
 
@@ -389,6 +390,91 @@ namespace CPP_CV {
             }    
         }
     }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Measures the wall time spent in each stage of a batch job (e.g. decode, 
+         *        process, encode, write) over many images. Stages are printed in the 
+         *        order they were first timed.
+         */
+        class StageTimer 
+        {
+        public:
+
+            /**
+             * @brief Start timing a stage. A stage that is still being timed is stopped first.
+             * 
+             * @param stage name of stage e.g. "decode"
+             */
+            void start(const std::string& stage);
+
+
+            /**
+             * @brief Stop timing the current stage and add its time to the stage total
+             */
+            void stop();
+
+
+            /**
+             * @brief Print the no. of runs, total time, mean time and share of the 
+             *        total time of each stage
+             * 
+             * @param out stream to print to e.g. std::cout
+             */
+            void print(std::ostream& out = std::cout) const;
+
+        private:
+
+            struct Stage 
+            {
+                std::string name;
+                int count {0};                  // no. of times the stage was timed
+                double totalMilliseconds {0.0}; // total time spent in the stage
+            };
+
+            std::vector<Stage> m_stages;    // stages in the order they were first timed
+            std::string m_currentStage;     // stage being timed. Empty if no stage is being timed
+            int64 m_startTicks {0};         // value of cv::getTickCount() when the current stage started
+        };
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened (a message is printed to std::cerr)
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath);
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise (a message is printed to std::cerr)
+         */
+        bool createOutputDirectory(const std::string& outputDirectory);
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer);
+    }
 }
 
 
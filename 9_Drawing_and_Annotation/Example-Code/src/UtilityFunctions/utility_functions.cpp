@@ -1,7 +1,12 @@
 #include "UtilityFunctions/utility_functions.h"
 
 
+#include "opencv2/imgcodecs.hpp" // for cv::imencode()
+
 #include <filesystem> // handles files
+#include <fstream>    // for std::ifstream, std::ofstream
+#include <iomanip>    // for std::setw
+#include <algorithm>  // for std::find_if
 
 namespace CPP_CV {
 
@@ -105,4 +110,190 @@ namespace CPP_CV {
             }
         }
     }
+
+
+    namespace Headless {
+
+        /**
+         * @brief Start timing a stage. A stage that is still being timed is stopped first.
+         * 
+         * @param stage name of stage e.g. "decode"
+         */
+        void StageTimer::start(const std::string& stage)
+        {
+            stop();
+
+            m_currentStage = stage;
+            m_startTicks = cv::getTickCount();
+        }
+
+
+        /**
+         * @brief Stop timing the current stage and add its time to the stage total
+         */
+        void StageTimer::stop()
+        {
+            if (m_currentStage.empty())
+            {
+                return; // no stage is being timed
+            }
+
+            const double milliseconds { (cv::getTickCount() - m_startTicks) * 1000.0 / cv::getTickFrequency() };
+
+            auto found { std::find_if(m_stages.begin(), m_stages.end(), 
+                                      [this](const Stage& s) { return s.name == m_currentStage; }) };
+            if (found == m_stages.end())
+            {
+                m_stages.push_back(Stage { m_currentStage, 0, 0.0 });
+                found = m_stages.end() - 1;
+            }
+
+            ++found->count;
+            found->totalMilliseconds += milliseconds;
+
+            m_currentStage.clear();
+        }
+
+
+        /**
+         * @brief Print the no. of runs, total time, mean time and share of the 
+         *        total time of each stage
+         * 
+         * @param out stream to print to e.g. std::cout
+         */
+        void StageTimer::print(std::ostream& out) const
+        {
+            double totalMilliseconds {0.0};
+            for (const auto& stage : m_stages)
+            {
+                totalMilliseconds += stage.totalMilliseconds;
+            }
+
+            out << "\nStage       Runs    Total (ms)    Mean (ms)    Share\n";
+
+            for (const auto& stage : m_stages)
+            {
+                out << std::left << std::setw(10) << stage.name << std::right 
+                    << std::setw(6) << stage.count 
+                    << std::fixed << std::setprecision(2)
+                    << std::setw(14) << stage.totalMilliseconds 
+                    << std::setw(13) << stage.totalMilliseconds / stage.count 
+                    << std::setw(8) << std::setprecision(1) 
+                    << ((totalMilliseconds > 0) ? 100.0 * stage.totalMilliseconds / totalMilliseconds : 0.0) << " %\n";
+            }
+
+            out << std::left << std::setw(10) << "total" << std::right << std::setw(20) 
+                << std::setprecision(2) << totalMilliseconds << '\n';
+        }
+
+
+        /**
+         * @brief Read a list of inputs (e.g. image file paths) from a text file with 
+         *        one input per line. Empty lines and lines starting with '#' are skipped.
+         * 
+         * @param listPath full path to text file
+         * @return std::optional<std::vector<std::string>> inputs in the order they appear in the file, 
+         *         or std::nullopt if the file could not be opened
+         */
+        std::optional<std::vector<std::string>> readInputList(const std::string& listPath)
+        {
+            std::vector<std::string> inputs;
+
+            std::ifstream file(listPath);
+            if (!file)
+            {
+                std::cerr << "\nCould not open list of inputs: " << listPath << '\n';
+
+                return std::nullopt;
+            }
+
+            std::string line;
+            while (std::getline(file, line))
+            {
+                // Remove trailing white space, including '\r' from files saved on Windows
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+
+                if (!line.empty() && (line[0] != '#'))
+                {
+                    inputs.push_back(line);
+                }
+            }
+
+            return inputs;
+        }
+
+
+        /**
+         * @brief Create the directory results are saved to, and any missing parent directories
+         * 
+         * @param outputDirectory full path to directory
+         * @return true if the directory exists or was created
+         * @return false otherwise
+         */
+        bool createOutputDirectory(const std::string& outputDirectory)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(outputDirectory, error);
+
+            if (error || !std::filesystem::is_directory(outputDirectory, error))
+            {
+                std::cerr << "\nCould not create output directory " << outputDirectory 
+                          << (error ? ": " + error.message() : std::string()) << '\n';
+
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /**
+         * @brief Compress an image and save it to a directory instead of displaying it. 
+         *        Compression is timed as the "encode" stage and saving as the "write" stage.
+         * 
+         * @param outputDirectory full path to directory to save the image to
+         * @param fileName name of image file including the extension, which selects the codec e.g. "result.png"
+         * @param image image to save
+         * @param timer stage timer to add the encode and write times to
+         * @return true if the image was saved
+         * @return false if the image could not be compressed or saved
+         */
+        bool writeResult(const std::string& outputDirectory, const std::string& fileName, 
+                         const cv::Mat& image, StageTimer& timer)
+        {
+            std::filesystem::path savePath { outputDirectory };
+            savePath /= fileName;
+
+            // a. Compress the image with the codec that matches the file extension
+            timer.start("encode");
+
+            std::vector<uchar> buffer;
+            bool result {false};
+            try 
+            {
+                result = cv::imencode(savePath.extension().string(), image, buffer);
+            }
+            catch (const cv::Exception& ex)
+            {
+                std::cerr << "\nError compressing " << fileName << ": " << ex.what();
+            }
+
+            timer.stop();
+
+            if (!result)
+            {
+                return false;
+            }
+
+            // b. Save the compressed image
+            timer.start("write");
+
+            std::ofstream file(savePath, std::ios::out | std::ios::binary);
+            file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            result = static_cast<bool>(file);
+            timer.stop();
+
+            return result;
+        }
+    }
 }
\ No newline at end of file